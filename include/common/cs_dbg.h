@@ -36,6 +36,29 @@
 #define CS_LOG_ENABLE_TS_DIFF 0
 #endif
 
+/*
+ * Most verbose level that is compiled in: `LOG()` statements with a level
+ * above it are removed at compile time, regardless of the runtime level.
+ */
+#ifndef CS_LOG_MIN_LEVEL
+#define CS_LOG_MIN_LEVEL LL_VERBOSE_DEBUG
+#endif
+
+/*
+ * Remember at each `LOG()` call site that it was filtered out, so it does not
+ * call `cs_log_print_prefix()` again until `cs_log_level` or
+ * `cs_log_site_cache_gen` changes. Requires `cs_log_site_cache_gen` to be
+ * defined and bumped with `CS_LOG_SITE_CACHE_INVALIDATE()` by whoever calls
+ * `cs_log_set_file_level()`. Costs 2 bytes of RAM per call site.
+ *
+ * Only enable it where a single thread logs: `mgos_debug_write()` sets
+ * `cs_log_level` to `LL_NONE` while it runs, and a site checked from another
+ * thread during that window would be cached as filtered out for good.
+ */
+#ifndef CS_LOG_ENABLE_SITE_CACHE
+#define CS_LOG_ENABLE_SITE_CACHE 0
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -85,6 +108,38 @@ int cs_log_print_prefix(enum cs_log_level level, const char *fname, int line);
 
 extern enum cs_log_level cs_log_level;
 
+#if CS_LOG_ENABLE_SITE_CACHE
+/*
+ * Generation of the per-file levels, 13 bits. Must be bumped with
+ * `CS_LOG_SITE_CACHE_INVALIDATE()` after every `cs_log_set_file_level()` call,
+ * otherwise sites filtered out under the old levels stay silent. In mgos it is
+ * done by `mgos_debug_set_file_level()`.
+ */
+extern uint16_t cs_log_site_cache_gen;
+
+/*
+ * Last generation. A site key from before a wrap would match again, so once
+ * it is reached nothing more is cached, as if the cache was off.
+ */
+#define CS_LOG_SITE_GEN_OFF 0x1fff
+
+#define CS_LOG_SITE_CACHE_INVALIDATE()                 \
+  do {                                                 \
+    if (cs_log_site_cache_gen < CS_LOG_SITE_GEN_OFF) { \
+      cs_log_site_cache_gen++;                         \
+    }                                                  \
+  } while (0)
+
+/*
+ * Call site cache key, never 0: `cs_log_level` is above `_LL_MIN`.
+ */
+#define CS_LOG_SITE_KEY() \
+  ((uint16_t)((cs_log_site_cache_gen << 3) | (cs_log_level - _LL_MIN)))
+
+/* Whether a site may remember the key. */
+#define CS_LOG_SITE_CACHEABLE(key) ((key) < (CS_LOG_SITE_GEN_OFF << 3))
+#endif
+
 #if CS_ENABLE_STDIO
 
 /*
@@ -108,15 +163,42 @@ void cs_log_printf(const char *fmt, ...) PRINTF_LIKE(1, 2);
  * LOG(LL_DEBUG, ("my debug message: %d", 123));
  * ```
  */
-#define LOG(l, x)                                     \
-  do {                                                \
-    if (cs_log_print_prefix(l, __FILE__, __LINE__)) { \
-      cs_log_printf x;                                \
-    }                                                 \
+#if CS_LOG_ENABLE_SITE_CACHE
+
+/*
+ * Only sites with a constant level are cached. The key is read again after
+ * the check so that a level changed meanwhile does not get cached.
+ */
+#define LOG(l, x)                                                    \
+  do {                                                               \
+    if ((l) <= CS_LOG_MIN_LEVEL) {                                   \
+      static uint16_t _cs_log_site;                                  \
+      uint16_t _cs_log_key = CS_LOG_SITE_KEY();                      \
+      if (!__builtin_constant_p(l) || _cs_log_site != _cs_log_key) { \
+        if (cs_log_print_prefix(l, __FILE__, __LINE__)) {            \
+          cs_log_printf x;                                           \
+        } else if (_cs_log_key == CS_LOG_SITE_KEY() &&               \
+                   CS_LOG_SITE_CACHEABLE(_cs_log_key)) {             \
+          _cs_log_site = _cs_log_key;                                \
+        }                                                            \
+      }                                                              \
+    }                                                                \
   } while (0)
 
 #else
 
+#define LOG(l, x)                                       \
+  do {                                                  \
+    if ((l) <= CS_LOG_MIN_LEVEL &&                      \
+        cs_log_print_prefix(l, __FILE__, __LINE__)) {   \
+      cs_log_printf x;                                  \
+    }                                                   \
+  } while (0)
+
+#endif
+
+#else
+
 #define LOG(l, x) ((void) l)
 
 #endif
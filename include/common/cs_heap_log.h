@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compact binary heap log.
+ *
+ * Heap operations are encoded into a RAM ring and drained asynchronously
+ * as text lines, so that logging does not slow down every malloc with
+ * console output. The output looks like this:
+ *
+ *   hlog_param:{"heap_start":1073643520, "heap_end":1073676288, "fmt":"bin1"}
+ *   hlb:<base64 of the record stream>
+ *   hlb:...
+ *
+ * `hlog_param` starts a new stream. Records may span `hlb` lines, so the
+ * payloads must be concatenated in order before decoding.
+ *
+ * Each record starts with a tag byte: bits 0-2 are the type
+ * (CS_HLOG_MALLOC..CS_HLOG_LOST), bit 3 is the "shim" flag and bit 4 is set
+ * if the record carries a call trace. Unsigned LEB128 varints follow:
+ *
+ *   malloc, calloc, zalloc:  size, ptr
+ *   realloc:                 size, old_ptr, ptr
+ *   free:                    ptr
+ *   lost:                    number of records dropped due to ring overflow
+ *
+ * Pointers are 0 for NULL, otherwise zigzag((ptr - heap_start) >> 2) + 1.
+ * The call trace is: number of leading frames that are the same as in the
+ * previous trace, number of new frames, then each new frame as a zigzag
+ * delta from the frame preceding it.
+ */
+
+#ifndef CS_COMMON_CS_HEAP_LOG_H_
+#define CS_COMMON_CS_HEAP_LOG_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Must be a power of 2. */
+#ifndef CS_HLOG_RING_SIZE
+#define CS_HLOG_RING_SIZE 4096
+#endif
+
+enum cs_hlog_type {
+  CS_HLOG_MALLOC = 0,
+  CS_HLOG_CALLOC = 1,
+  CS_HLOG_ZALLOC = 2,
+  CS_HLOG_FREE = 3,
+  CS_HLOG_REALLOC = 4,
+  CS_HLOG_LOST = 7,
+};
+
+typedef void (*cs_hlog_out_t)(const char *data, size_t len);
+
+/* Sets heap range that pointers are encoded relative to. */
+void cs_hlog_init(uintptr_t heap_start, uintptr_t heap_end);
+
+/*
+ * Appends a record to the ring. `old_ptr` is only used for realloc.
+ * If the ring is full, it is flushed synchronously if output is set,
+ * otherwise the record is dropped and counted.
+ */
+void cs_hlog_record(enum cs_hlog_type type, size_t size, const void *ptr,
+                    const void *old_ptr, bool shim);
+
+/*
+ * Sets the output function. The first time it is set, `hlog_param` and
+ * everything accumulated so far are written out.
+ * The function must not allocate memory.
+ */
+void cs_hlog_set_output(cs_hlog_out_t out);
+
+/* Writes out the contents of the ring, if output is set. */
+void cs_hlog_flush(void);
+
+#if MGOS_ENABLE_CALL_TRACE
+/*
+ * Provided by cs_heap_trace.c: current call trace, outermost frame first.
+ * Returns number of frames.
+ */
+unsigned int cs_call_trace_get(void *const **frames);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CS_COMMON_CS_HEAP_LOG_H_ */
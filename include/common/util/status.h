@@ -23,16 +23,32 @@ namespace mgos {
 
 // A Status is a combination of an error code and a string message (for non-OK
 // error codes).
+//
+// An OK status is a single null pointer: creating, copying and destroying it
+// does not touch the heap. Errors keep their code and message in a payload
+// that is allocated once and shared by copies. Reference counting is not
+// atomic, a Status must not be copied concurrently from different threads.
 class Status {
  public:
   // Creates an OK status
-  Status();
+  Status() : rep_(nullptr) {
+  }
 
   // Make a Status from the specified error and message.
   Status(int error, const ::std::string &error_message);
 
-  Status(const Status &other);
+  Status(const Status &other) : rep_(other.rep_) {
+    Ref();
+  }
+  Status(Status &&other) noexcept : rep_(other.rep_) {
+    other.rep_ = nullptr;
+  }
   Status &operator=(const Status &other);
+  Status &operator=(Status &&other) noexcept;
+
+  ~Status() {
+    Unref();
+  }
 
   // Some shortcuts
   static Status OK();  // Identical to 0-arg constructor
@@ -42,14 +58,12 @@ class Status {
 
   // Accessors
   bool ok() const {
-    return code_ == STATUS_OK;
+    return rep_ == nullptr;
   }
   int error_code() const {
-    return code_;
-  }
-  const ::std::string &error_message() const {
-    return message_;
+    return (rep_ == nullptr ? STATUS_OK : rep_->code);
   }
+  const ::std::string &error_message() const;
 
   bool operator==(const Status &x) const;
   bool operator!=(const Status &x) const;
@@ -57,12 +71,46 @@ class Status {
   ::std::string ToString() const;
 
  private:
-  int code_;
-  ::std::string message_;
+  struct Rep {
+    int refs;  // kStaticRefs for the shortcuts, which are never freed.
+    int code;
+    ::std::string message;
+  };
+  static const int kStaticRefs = -1;
+
+  void Ref() const {
+    if (rep_ != nullptr && rep_->refs != kStaticRefs) rep_->refs++;
+  }
+  void Unref() {
+    if (rep_ != nullptr && rep_->refs != kStaticRefs && --rep_->refs == 0) {
+      delete rep_;
+    }
+  }
+  static Status FromStatic(Rep *rep);
+
+  Rep *rep_;
 };
 
+inline Status &Status::operator=(const Status &other) {
+  other.Ref();
+  Unref();
+  rep_ = other.rep_;
+  return *this;
+}
+
+inline Status &Status::operator=(Status &&other) noexcept {
+  if (this != &other) {
+    Unref();
+    rep_ = other.rep_;
+    other.rep_ = nullptr;
+  }
+  return *this;
+}
+
 inline bool Status::operator==(const Status &other) const {
-  return (this->code_ == other.code_) && (this->message_ == other.message_);
+  return (this->rep_ == other.rep_) ||
+         (this->error_code() == other.error_code() &&
+          this->error_message() == other.error_message());
 }
 
 inline bool Status::operator!=(const Status &other) const {
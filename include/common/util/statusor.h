@@ -18,9 +18,14 @@
 
 #include <stdlib.h>
 
+#include <new>
+#include <utility>
+
 namespace mgos {
 
 // A StatusOr holds a Status (in the case of an error), or a value T.
+// The value is constructed in place only when the status is OK, so T does not
+// need to be default-constructible and an error does not construct a T.
 template <typename T>
 class StatusOr {
  public:
@@ -29,13 +34,14 @@ class StatusOr {
 
   // Builds from a non-OK status. Crashes if an OK status is specified.
   inline StatusOr(const Status &status);
+  inline StatusOr(Status &&status);
 
   // Builds from the specified value.
   inline StatusOr(const T &value);
   inline StatusOr(T &&value);
 
   // Copy and move constructors.
-  inline StatusOr(const StatusOr &other) = default;
+  inline StatusOr(const StatusOr &other);
   inline StatusOr(StatusOr &&other);
 
   // Conversion copy constructor, T must be copy constructible from U.
@@ -44,6 +50,8 @@ class StatusOr {
   template <typename U>
   inline StatusOr(StatusOr<U> &&other);
 
+  inline ~StatusOr();
+
   // Assignment operator, copy and move varieties.
   inline const StatusOr &operator=(const StatusOr &other);
   inline StatusOr &operator=(StatusOr &&other);
@@ -74,14 +82,24 @@ class StatusOr {
   friend class StatusOr;
 
  private:
-  Status status_;
-  T value_;
+  // Destroys the value, if any, and sets status to UNKNOWN.
+  inline void Clear();
+
+  template <typename U>
+  inline void Assign(const StatusOr<U> &other);
+  template <typename U>
+  inline void Assign(StatusOr<U> &&other);
+
+  Status status_;  // OK if and only if value_ is constructed.
+  union {
+    T value_;
+  };
 };
 
 // Implementation.
 
 template <typename T>
-inline StatusOr<T>::StatusOr() : status_(STATUS_UNKNOWN, "") {
+inline StatusOr<T>::StatusOr() : status_(Status::UNKNOWN()) {
 }
 
 template <typename T>
@@ -90,61 +108,110 @@ inline StatusOr<T>::StatusOr(const Status &status) : status_(status) {
 }
 
 template <typename T>
-inline StatusOr<T>::StatusOr(const T &value) : value_(value) {
+inline StatusOr<T>::StatusOr(Status &&status) : status_(std::move(status)) {
+  if (status_.ok()) abort();
 }
 
 template <typename T>
-inline StatusOr<T>::StatusOr(T &&value) : value_(std::move(value)) {
+inline StatusOr<T>::StatusOr(const T &value) {
+  new (&value_) T(value);
+}
+
+template <typename T>
+inline StatusOr<T>::StatusOr(T &&value) {
+  new (&value_) T(std::move(value));
+}
+
+template <typename T>
+inline StatusOr<T>::StatusOr(const StatusOr<T> &other)
+    : status_(other.status_) {
+  if (status_.ok()) new (&value_) T(other.value_);
 }
 
 template <typename T>
 inline StatusOr<T>::StatusOr(StatusOr<T> &&other)
-    : status_(other.status_), value_(std::move(other.value_)) {
+    : status_(std::move(other.status_)) {
+  if (status_.ok()) {
+    new (&value_) T(std::move(other.value_));
+    other.value_.~T();
+  }
   other.status_ = Status::UNKNOWN();
 }
 
 template <typename T>
 template <typename U>
 inline StatusOr<T>::StatusOr(const StatusOr<U> &other)
-    : status_(other.status_), value_(other.value_) {
+    : status_(other.status_) {
+  if (status_.ok()) new (&value_) T(other.value_);
 }
 
 template <typename T>
 template <typename U>
 inline StatusOr<T>::StatusOr(StatusOr<U> &&other)
-    : status_(other.status_), value_(std::move(other.value_)) {
-  other.status_ = Status::UNKNOWN();
+    : status_(other.status_) {
+  if (status_.ok()) new (&value_) T(std::move(other.value_));
+  other.Clear();
 }
 
 template <typename T>
-inline const StatusOr<T> &StatusOr<T>::operator=(const StatusOr &other) {
+inline StatusOr<T>::~StatusOr() {
+  if (status_.ok()) value_.~T();
+}
+
+template <typename T>
+inline void StatusOr<T>::Clear() {
+  if (status_.ok()) value_.~T();
+  status_ = Status::UNKNOWN();
+}
+
+template <typename T>
+template <typename U>
+inline void StatusOr<T>::Assign(const StatusOr<U> &other) {
+  if (ok() && other.ok()) {
+    value_ = other.value_;
+    return;
+  }
+  Clear();
+  if (other.ok()) new (&value_) T(other.value_);
   status_ = other.status_;
-  if (status_.ok()) value_ = other.value_;
+}
+
+template <typename T>
+template <typename U>
+inline void StatusOr<T>::Assign(StatusOr<U> &&other) {
+  if (ok() && other.ok()) {
+    value_ = std::move(other.value_);
+  } else {
+    Clear();
+    if (other.ok()) new (&value_) T(std::move(other.value_));
+    status_ = other.status_;
+  }
+  other.Clear();
+}
+
+template <typename T>
+inline const StatusOr<T> &StatusOr<T>::operator=(const StatusOr &other) {
+  if (this != &other) Assign(other);
   return *this;
 }
 
 template <typename T>
 inline StatusOr<T> &StatusOr<T>::operator=(StatusOr &&other) {
-  status_ = std::move(other.status_);
-  if (status_.ok()) value_ = std::move(other.value_);
-  other.status_ = Status::UNKNOWN();
+  if (this != &other) Assign(std::move(other));
   return *this;
 }
 
 template <typename T>
 template <typename U>
 inline const StatusOr<T> &StatusOr<T>::operator=(const StatusOr<U> &other) {
-  status_ = other.status_;
-  if (status_.ok()) value_ = other.value_;
+  Assign(other);
   return *this;
 }
 
 template <typename T>
 template <typename U>
 inline StatusOr<T> &StatusOr<T>::operator=(StatusOr<U> &&other) {
-  status_ = other.status_;
-  if (status_.ok()) value_ = std::move(other.value_);
-  other.status_ = Status::UNKNOWN();
+  Assign(std::move(other));
   return *this;
 }
 
@@ -157,8 +224,9 @@ const T &StatusOr<T>::ValueOrDie() const {
 template <typename T>
 inline T StatusOr<T>::MoveValueOrDie() {
   if (!ok()) abort();
-  status_ = Status::UNKNOWN();
-  return std::move(value_);
+  T value(std::move(value_));
+  Clear();
+  return value;
 }
 
 }  // namespace mgos
@@ -53,6 +53,13 @@ struct mgos_debug_hook_arg {
  */
 void mgos_debug_write(int fd, const void *buf, size_t len);
 
+/*
+ * Set per-file log levels, see `cs_log_set_file_level()`. Use this instead
+ * of calling `cs_log_set_file_level()` directly: it also invalidates the
+ * `LOG()` site cache when `CS_LOG_ENABLE_SITE_CACHE` is on.
+ */
+void mgos_debug_set_file_level(const char *file_level);
+
 /*
  * Flush debug UARTs, both stdout and stderr.
  */
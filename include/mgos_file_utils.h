@@ -29,10 +29,16 @@ extern "C" {
 /* Copy a file */
 bool mgos_file_copy(const char *from, const char *to);
 
-/* Compute file's digest. *digest must have enough space for the digest type. */
+/*
+ * Compute file's digest. *digest must have enough space for the digest type.
+ * Digests of recently hashed files are cached by path, size and mtime.
+ */
 bool mgos_file_digest(const char *fname, mbedtls_md_type_t dt, uint8_t *digest);
 
-/* Copy the file if target does not exist or is different. */
+/*
+ * Copy the file if target does not exist or is different: sizes are compared
+ * first, then contents, stopping at the first difference.
+ */
 bool mgos_file_copy_if_different(const char *from, const char *to);
 
 #ifdef __cplusplus
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Fixed-size object pools.
+ *
+ * A pool hands out objects of a single size from slabs: contiguous chunks of
+ * memory that are carved into `objs_per_slab` objects. Free objects are kept
+ * on a singly-linked list threaded through the objects themselves, so there
+ * is no per-object overhead and alloc/free are O(1).
+ *
+ * Slabs are allocated from the heap when the pool runs out of objects and are
+ * never returned, which keeps small, frequently churned objects (timers,
+ * callback records, events) from fragmenting the general heap. Memory for
+ * slabs can also be provided by the caller with `mgos_pool_add_slab()`, e.g.
+ * a static buffer; combined with `MGOS_POOL_F_NO_GROW` this gives a pool
+ * that never touches the heap.
+ *
+ * Pools are meant to be defined statically:
+ *
+ * ```c
+ * static struct mgos_pool s_foo_pool =
+ *     MGOS_POOL_INIT("foo", sizeof(struct foo), 8, 0);
+ *
+ * struct foo *f = (struct foo *) mgos_pool_zalloc(&s_foo_pool);
+ * ...
+ * mgos_pool_free(&s_foo_pool, f);
+ * ```
+ *
+ * By default pool operations are protected by `mgos_lock()`. Pools created
+ * with `MGOS_POOL_F_ISR_SAFE` disable interrupts instead and can be used from
+ * ISRs, provided they do not need to grow there: pre-fill such pools with
+ * `mgos_pool_add_slab()` or `mgos_pool_reserve()`.
+ */
+
+#ifndef CS_FW_INCLUDE_MGOS_POOL_H_
+#define CS_FW_INCLUDE_MGOS_POOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Alignment of objects handed out by pools. */
+#define MGOS_POOL_ALIGN 8
+
+#define MGOS_POOL_ALIGN_SIZE(s) \
+  (((s) + MGOS_POOL_ALIGN - 1) & ~((size_t) MGOS_POOL_ALIGN - 1))
+
+/* Use interrupt disabling instead of mgos_lock(), pool can be used in ISR. */
+#define MGOS_POOL_F_ISR_SAFE (1 << 0)
+/* Do not allocate slabs from heap, only use mgos_pool_add_slab() memory. */
+#define MGOS_POOL_F_NO_GROW (1 << 1)
+
+struct mgos_pool_slab;
+
+/* Pool state. Treat as opaque, initialize with MGOS_POOL_INIT. */
+struct mgos_pool {
+  const char *name;
+  uint16_t obj_size;
+  uint16_t objs_per_slab;
+  uint16_t flags;
+  uint16_t registered;
+  void *free_list;
+  struct mgos_pool_slab *slabs;
+  struct mgos_pool *next;
+  uint32_t num_total;
+  uint32_t num_used;
+  uint32_t max_used;
+  uint32_t num_allocs;
+  uint32_t num_fails;
+};
+
+/*
+ * Static initializer for a pool of objects of `size` bytes, growing by
+ * `per_slab` objects at a time.
+ */
+#define MGOS_POOL_INIT(name_, size, per_slab, flags_) \
+  { (name_), MGOS_POOL_ALIGN_SIZE(size), (per_slab), (flags_), 0, NULL, NULL, \
+    NULL, 0, 0, 0, 0, 0 }
+
+/* Number of bytes needed for a slab of `n` objects of `size` bytes. */
+#define MGOS_POOL_SLAB_SIZE(size, n) \
+  (MGOS_POOL_ALIGN_SIZE(sizeof(void *) * 2) + MGOS_POOL_ALIGN_SIZE(size) * (n))
+
+/*
+ * Allocate an object from the pool. Returns NULL if the pool is exhausted
+ * and cannot grow.
+ */
+void *mgos_pool_alloc(struct mgos_pool *p);
+
+/* Same as `mgos_pool_alloc()`, but zeroes the object. */
+void *mgos_pool_zalloc(struct mgos_pool *p);
+
+/* Return an object to the pool. NULL is a no-op. */
+void mgos_pool_free(struct mgos_pool *p, void *obj);
+
+/*
+ * Give the pool a chunk of memory to use as a slab. The buffer must be
+ * aligned to MGOS_POOL_ALIGN and stay valid forever.
+ * Returns the number of objects added (0 if the buffer is too small).
+ */
+int mgos_pool_add_slab(struct mgos_pool *p, void *buf, size_t len);
+
+/*
+ * Make sure the pool has at least `n` free objects, allocating slabs
+ * from heap as necessary. Returns false if heap is exhausted.
+ */
+bool mgos_pool_reserve(struct mgos_pool *p, int n);
+
+/* Returns true if `ptr` points into one of the pool's slabs. */
+bool mgos_pool_owns(const struct mgos_pool *p, const void *ptr);
+
+struct mgos_pool_stats {
+  const char *name;
+  size_t obj_size;
+  int num_slabs;
+  int num_total; /* Objects in all slabs. */
+  int num_used;
+  int max_used;  /* High water mark of num_used. */
+  int num_allocs;
+  int num_fails;
+};
+
+/* Get pool statistics. */
+void mgos_pool_get_stats(struct mgos_pool *p, struct mgos_pool_stats *st);
+
+/*
+ * Iterate all pools that have ever had memory. Pass NULL to get the first one.
+ * Returns NULL when there are no more pools.
+ */
+struct mgos_pool *mgos_pool_next(struct mgos_pool *p);
+
+struct json_out;
+
+/*
+ * Print stats of all pools as a JSON array of objects:
+ * `[{"name": "timers", "size": 32, "slabs": 1, "total": 8, "used": 2,
+ * "max_used": 5, "allocs": 123, "fails": 0}, ...]`.
+ * Core has no RPC of its own (Sys.* handlers are registered by the
+ * rpc-common library), a Sys.PoolStats handler there returns this as the
+ * result.
+ */
+int mgos_pool_stats_json(struct json_out *out);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* CS_FW_INCLUDE_MGOS_POOL_H_ */
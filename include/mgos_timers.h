@@ -118,7 +118,8 @@ mgos_timer_id mgos_set_timer(int msecs, int flags, timer_callback cb,
  * This is similar to mgos_set_timer, but can be used for shorter intervals
  * (note that time unit is microseconds).
  *
- * Number of hardware timers is limited (ESP8266: 1, ESP32: 4, CC32xx: 4).
+ * Number of hardware timers is limited (ESP8266: 8, ESP32: 4, CC32xx: 4).
+ * On ESP8266 they are multiplexed onto a single physical timer.
  *
  * Callback is executed in ISR context, with all the implications of that.
  */
@@ -40,6 +40,8 @@
 #include "rs14100_uart.h"
 #elif CS_PLATFORM == CS_P_STM32
 #include "stm32_uart.h"
+#elif defined(MGOS_PLATFORM_UBUNTU)
+#include "ubuntu_uart.h"
 #else
 struct mgos_uart_dev_config {};
 #endif
@@ -36,7 +36,7 @@ MGOS_CONF_SCHEMA += $(MGOS_ESP_SRC_PATH)/esp32_sys_config.yaml
 MGOS_SRCS += mgos_config_util.c mgos_core_dump.c mgos_dlsym.c mgos_event.c \
              mgos_gpio.c mgos_init.c mgos_mmap_esp.c \
              mgos_sys_config.c $(notdir $(MGOS_CONFIG_C)) $(notdir $(MGOS_RO_VARS_C)) \
-             mgos_file_utils.c mgos_hw_timers.c mgos_system.c mgos_time.c mgos_timers.c mgos_uart.c mgos_utils.c \
+             mgos_file_utils.c mgos_hw_timers.c mgos_system.c mgos_pool.c mgos_time.c mgos_timers.c mgos_uart.c mgos_utils.c \
              esp32_crypto.c esp32_debug.c esp32_exc.c esp32_fs_crypt.c \
              esp32_gpio.c esp32_hal.c esp32_hw_timers.c \
              esp32_main.c esp32_uart.c \
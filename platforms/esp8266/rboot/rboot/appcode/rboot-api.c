@@ -82,6 +82,21 @@ bool ICACHE_FLASH_ATTR rboot_set_current_rom(uint8 rom) {
 // create the write status struct, based on supplied start address
 rboot_write_status ICACHE_FLASH_ATTR rboot_write_init(uint32 start_addr) {
 	rboot_write_status status = {0};
+#ifdef BOOT_VERIFIED_CACHE
+	rboot_config conf;
+	uint8 rom;
+
+	// the rom being written must be checked again before it is booted
+	conf = rboot_get_config();
+	for (rom = 0; rom < conf.count && rom < MAX_ROMS; rom++) {
+		if ((conf.verified & (1 << rom)) && start_addr >= conf.roms[rom] &&
+			(conf.roms_sizes[rom] == 0 ||
+			 start_addr < conf.roms[rom] + conf.roms_sizes[rom])) {
+			conf.verified &= ~(1 << rom);
+			rboot_set_config(&conf);
+		}
+	}
+#endif
 	status.start_addr = start_addr;
 	status.start_sector = start_addr / SECTOR_SIZE;
 	//status.max_sector_count = 200;
@@ -31,6 +31,10 @@ typedef unsigned char uint8;
 // buffer size, must be at least 0x10 (size of rom_header_new structure)
 #define BUFFER_SIZE 0x100
 
+// buffer size for reading rom sections when checking the checksum,
+// multiple of 4
+#define CHKSUM_BUFFER_SIZE 0x400
+
 // esp8266 built in rom functions
 extern void ets_printf(const char*, ...);
 extern uint32 SPIRead(uint32 addr, void *outptr, uint32 len);
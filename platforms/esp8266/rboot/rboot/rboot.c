@@ -13,14 +13,34 @@
 #include "rboot-private.h"
 #include <rboot-hex2a.h>
 
-static uint32 check_image(uint32 readpos) {
+// xor all bytes of the block into chksum, a word at a time
+// buffer must be word aligned
+static uint8 calc_chksum_words(uint8 chksum, const uint32 *buffer, uint32 len) {
+	uint32 word = 0;
+	uint32 loop;
+	const uint8 *tail;
+
+	for (loop = 0; loop < len / 4; loop++) {
+		word ^= buffer[loop];
+	}
+	tail = (const uint8*)&buffer[loop];
+	for (loop = 0; loop < len % 4; loop++) {
+		chksum ^= tail[loop];
+	}
+	// fold the word, xor of its bytes
+	word ^= word >> 16;
+	word ^= word >> 8;
+	return chksum ^ (uint8)word;
+}
+
+// returns the address of the rom to boot, 0 if it is bad
+// without verify only the rom header is checked
+static uint32 check_image(uint32 readpos, uint8 verify) {
 
-	uint8 buffer[BUFFER_SIZE];
+	uint32 buffer[CHKSUM_BUFFER_SIZE / 4];
 	uint8 sectcount;
 	uint8 sectcurrent;
-	uint8 *writepos;
 	uint8 chksum = CHKSUM_INIT;
-	uint32 loop;
 	uint32 remaining;
 	uint32 romaddr;
 
@@ -65,6 +85,10 @@ static uint32 check_image(uint32 readpos) {
 		return 0;
 	}
 
+	if (!verify) {
+		return romaddr;
+	}
+
 	// test each section
 	for (sectcurrent = 0; sectcurrent < sectcount; sectcurrent++) {
 
@@ -74,26 +98,22 @@ static uint32 check_image(uint32 readpos) {
 		}
 		readpos += sizeof(section_header);
 
-		// get section address and length
-		writepos = section->address;
+		// get section length
 		remaining = section->length;
 
 		while (remaining > 0) {
-			// work out how much to read, up to BUFFER_SIZE
-			uint32 readlen = (remaining < BUFFER_SIZE) ? remaining : BUFFER_SIZE;
+			// work out how much to read, up to CHKSUM_BUFFER_SIZE
+			uint32 readlen = (remaining < CHKSUM_BUFFER_SIZE) ? remaining : CHKSUM_BUFFER_SIZE;
 			// read the block
 			if (SPIRead(readpos, buffer, readlen) != 0) {
 				return 0;
 			}
-			// increment next read and write positions
+			// increment next read position
 			readpos += readlen;
-			writepos += readlen;
 			// decrement remaining count
 			remaining -= readlen;
 			// add to chksum
-			for (loop = 0; loop < readlen; loop++) {
-				chksum ^= buffer[loop];
-			}
+			chksum = calc_chksum_words(chksum, buffer, readlen);
 		}
 
 #ifdef BOOT_IROM_CHKSUM
@@ -116,7 +136,7 @@ static uint32 check_image(uint32 readpos) {
 	}
 
 	// compare calculated and stored checksums
-	if (buffer[0] != chksum) {
+	if (*(uint8*)buffer != chksum) {
 		return 0;
 	}
 
@@ -273,6 +293,9 @@ uint32 NOINLINE find_image(void) {
 #ifdef BOOT_IROM_CHKSUM
 	ets_printf("rBoot Option: irom chksum\r\n");
 #endif
+#ifdef BOOT_VERIFIED_CACHE
+	ets_printf("rBoot Option: Verified cache\r\n");
+#endif
 
 	ets_printf("\r\n");
 
@@ -353,7 +376,23 @@ uint32 NOINLINE find_image(void) {
 
 	// try to find a good rom
 	do {
-		runAddr = check_image(romconf->roms[romToBoot]);
+#ifdef BOOT_VERIFIED_CACHE
+		// roms are checked until they pass once, and all of them again
+		// while a new rom is on probation
+		uint8 verify = !(romconf->verified & (1 << romToBoot)) ||
+			romconf->is_first_boot;
+#else
+		uint8 verify = TRUE;
+#endif
+		runAddr = check_image(romconf->roms[romToBoot], verify);
+#ifdef BOOT_VERIFIED_CACHE
+		if (runAddr != 0 && !(romconf->verified & (1 << romToBoot))) {
+			romconf->verified |= (1 << romToBoot);
+			updateConfig = TRUE;
+		} else if (runAddr == 0) {
+			romconf->verified &= ~(1 << romToBoot);
+		}
+#endif
 		if (runAddr == 0) {
 			ets_printf("Rom %d is bad.\r\n", romToBoot);
 			if (gpio_boot) {
@@ -26,6 +26,12 @@ extern "C" {
 // roms must be built with esptool2 using -iromchksum option
 //#define BOOT_IROM_CHKSUM
 
+// uncomment to remember which roms passed the checksum and not check them
+// again on every boot. anything that writes to a rom slot must clear its
+// bit in the config first (rboot_write_init does), otherwise a rewritten
+// rom will be booted unchecked
+//#define BOOT_VERIFIED_CACHE
+
 // increase if required
 #define MAX_ROMS 4
 
@@ -64,7 +70,8 @@ typedef struct {
 	uint8 is_first_boot;
 	uint8 boot_attempts;
 	uint8 fw_updated;
-	uint8 padding[2];
+	uint8 verified;		   // bit n set: roms[n] passed the checksum
+	uint8 padding[1];
 	uint32 roms[MAX_ROMS]; // flash addresses of the roms
 	uint32 roms_sizes[MAX_ROMS]; // sizes of the roms
 	uint32 fs_addresses[MAX_ROMS]; // file system addresses
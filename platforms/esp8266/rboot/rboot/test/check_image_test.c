@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * rBoot rom checksum test, runs on the host.
+ *
+ * rboot.c is built against a flash image in memory. Roms are laid out with
+ * the host's sizes of the header structures, which differ from the device
+ * (pointers are 8 bytes), but check_image() only uses sizeof() and fields.
+ * Checks word-wise folding against a byte-wise xor, that good roms of both
+ * header types are accepted and that corrupted ones are not.
+ * With "bench" as the argument also prints check_image() throughput.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rboot-private.h"
+
+void uart_div_modify(int uart, uint32 div);
+void ets_delay_us(uint32 us);
+void ets_memset(void *p, int c, uint32 len);
+void ets_memcpy(void *dst, const void *src, uint32 len);
+
+#include "../rboot.c"
+
+#define FLASH_SIZE 0x400000
+#define ROM_ADDR 0x2000
+
+static uint8 s_flash[FLASH_SIZE];
+static int s_failures;
+
+/* Section data of the last rom made, the bytes covered by the checksum */
+static struct {
+  uint32 pos, len;
+} s_data[16];
+static int s_num_data;
+
+#define CHECK(cond)                                           \
+  do {                                                        \
+    if (!(cond)) {                                            \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+             #cond);                                          \
+      s_failures++;                                           \
+    }                                                         \
+  } while (0)
+
+/* ROM and SDK functions used by rboot.c */
+
+uint32 SPIRead(uint32 addr, void *outptr, uint32 len) {
+  if (addr + len > FLASH_SIZE) return 1;
+  memcpy(outptr, s_flash + addr, len);
+  return 0;
+}
+
+uint32 SPIWrite(uint32 addr, void *inptr, uint32 len) {
+  if (addr + len > FLASH_SIZE) return 1;
+  memcpy(s_flash + addr, inptr, len);
+  return 0;
+}
+
+uint32 SPIEraseSector(int sector) {
+  memset(s_flash + sector * SECTOR_SIZE, 0xff, SECTOR_SIZE);
+  return 0;
+}
+
+void ets_printf(const char *fmt, ...) {
+  (void) fmt;
+}
+
+void uart_div_modify(int uart, uint32 div) {
+  (void) uart;
+  (void) div;
+}
+
+void ets_delay_us(uint32 us) {
+  (void) us;
+}
+
+void ets_memset(void *p, int c, uint32 len) {
+  memset(p, c, len);
+}
+
+void ets_memcpy(void *dst, const void *src, uint32 len) {
+  memcpy(dst, src, len);
+}
+
+/* Rom builder */
+
+static uint8 ref_chksum(uint8 chksum, const uint8 *p, uint32 len) {
+  while (len-- > 0) chksum ^= *p++;
+  return chksum;
+}
+
+/* Appends a section with len random bytes at pos, returns the new pos. */
+static uint32 add_section(uint32 pos, uint32 len, uint8 *chksum) {
+  section_header sh;
+  uint32 i;
+  memset(&sh, 0, sizeof(sh));
+  sh.address = (uint8 *) (uintptr_t) 0x40100000;
+  sh.length = len;
+  memcpy(s_flash + pos, &sh, sizeof(sh));
+  pos += sizeof(sh);
+  for (i = 0; i < len; i++) s_flash[pos + i] = (uint8) rand();
+  *chksum = ref_chksum(*chksum, s_flash + pos, len);
+  s_data[s_num_data].pos = pos;
+  s_data[s_num_data].len = len;
+  s_num_data++;
+  return pos + len;
+}
+
+/* Appends a standard header and sections, then the checksum. */
+static uint32 add_rom(uint32 pos, int count, const uint32 *lens,
+                      uint8 chksum) {
+  rom_header h;
+  int i;
+  memset(&h, 0, sizeof(h));
+  h.magic = ROM_MAGIC;
+  h.count = count;
+  memcpy(s_flash + pos, &h, sizeof(h));
+  pos += sizeof(h);
+  for (i = 0; i < count; i++) pos = add_section(pos, lens[i], &chksum);
+  pos |= 0x0f;
+  s_flash[pos] = chksum;
+  return pos + 1;
+}
+
+/* Old type rom at ROM_ADDR, returns its end. */
+static uint32 make_rom(int count, const uint32 *lens) {
+  memset(s_flash + ROM_ADDR, 0xff, FLASH_SIZE - ROM_ADDR);
+  s_num_data = 0;
+  return add_rom(ROM_ADDR, count, lens, CHKSUM_INIT);
+}
+
+/*
+ * New type rom with irom section first, returns the address to boot.
+ * On the device add and len of rom_header_new are the irom section header.
+ * Here the section header is bigger, so with BOOT_IROM_CHKSUM it follows the
+ * standard header and the returned address (from len) points into the rom
+ * instead of at the standard header after it. It is only compared.
+ */
+static uint32 make_rom_new(uint32 irom_len, int count, const uint32 *lens) {
+  rom_header_new h;
+  uint8 chksum = CHKSUM_INIT;
+  uint32 pos;
+  memset(s_flash + ROM_ADDR, 0xff, FLASH_SIZE - ROM_ADDR);
+  s_num_data = 0;
+  memset(&h, 0, sizeof(h));
+  h.magic = ROM_MAGIC_NEW1;
+  h.count = ROM_MAGIC_NEW2;
+  h.len = irom_len;
+  memcpy(s_flash + ROM_ADDR, &h, sizeof(h));
+#ifdef BOOT_IROM_CHKSUM
+  pos = add_section(ROM_ADDR + sizeof(rom_header), irom_len, &chksum);
+#else
+  pos = ROM_ADDR + sizeof(rom_header_new);
+  s_data[s_num_data].pos = pos;
+  s_data[s_num_data].len = irom_len;
+  s_num_data++;
+  for (; pos < ROM_ADDR + sizeof(rom_header_new) + irom_len; pos++) {
+    s_flash[pos] = (uint8) rand();
+  }
+#endif
+  add_rom(pos, count, lens, chksum);
+  return ROM_ADDR + sizeof(rom_header_new) + irom_len;
+}
+
+/* A random byte covered by the checksum. */
+static uint32 data_byte(void) {
+  int i;
+  do {
+    i = rand() % s_num_data;
+  } while (s_data[i].len == 0);
+  return s_data[i].pos + rand() % s_data[i].len;
+}
+
+static void test_fold(void) {
+  uint32 buf[CHKSUM_BUFFER_SIZE / 4] = {0};
+  uint8 *p = (uint8 *) buf;
+  uint32 len, i;
+  for (len = 0; len <= CHKSUM_BUFFER_SIZE; len++) {
+    uint8 init = (uint8) rand();
+    for (i = 0; i < len; i++) p[i] = (uint8) rand();
+    CHECK(calc_chksum_words(init, buf, len) == ref_chksum(init, p, len));
+  }
+  memset(buf, 0xff, sizeof(buf));
+  CHECK(calc_chksum_words(CHKSUM_INIT, buf, 7) == (uint8) ~CHKSUM_INIT);
+}
+
+static void test_rom(void) {
+  static const uint32 lens[] = {0x5a34, 0x3, 0x400, 0x401, 0x3ff, 0x10};
+  uint32 end = make_rom(6, lens), i;
+
+  CHECK(check_image(ROM_ADDR, TRUE) == ROM_ADDR);
+  CHECK(check_image(0, TRUE) == 0);
+  CHECK(check_image(0xffffffff, TRUE) == 0);
+  CHECK(check_image(ROM_ADDR + 1, TRUE) == 0);
+
+  /* any single corrupted byte is detected */
+  for (i = 0; i < 2000; i++) {
+    uint32 pos = (i == 0 ? end - 1 : data_byte());
+    uint8 bit = 1 << (rand() % 8);
+    s_flash[pos] ^= bit;
+    if (check_image(ROM_ADDR, TRUE) != 0) {
+      printf("corruption at 0x%x not detected\n", pos);
+      s_failures++;
+    }
+    s_flash[pos] ^= bit;
+  }
+  CHECK(check_image(ROM_ADDR, TRUE) == ROM_ADDR);
+
+  /* without verify only the header matters */
+  s_flash[end - 1] ^= 1;
+  CHECK(check_image(ROM_ADDR, TRUE) == 0);
+  CHECK(check_image(ROM_ADDR, FALSE) == ROM_ADDR);
+  s_flash[ROM_ADDR] = 0xff;
+  CHECK(check_image(ROM_ADDR, FALSE) == 0);
+
+  /* no sections */
+  make_rom(0, NULL);
+  CHECK(check_image(ROM_ADDR, TRUE) == ROM_ADDR);
+}
+
+static void test_rom_new(void) {
+  static const uint32 lens[] = {0x2000, 0x7f1, 0x101};
+  uint32 irom_len = 0x31000;
+  uint32 addr = make_rom_new(irom_len, 3, lens);
+  uint32 irom_byte = s_data[0].pos + 0x1234;
+
+  CHECK(check_image(ROM_ADDR, TRUE) == addr);
+  CHECK(check_image(ROM_ADDR, FALSE) == addr);
+  s_flash[irom_byte] ^= 0x10;
+#ifdef BOOT_IROM_CHKSUM
+  CHECK(check_image(ROM_ADDR, TRUE) == 0);
+#else
+  CHECK(check_image(ROM_ADDR, TRUE) == addr);
+#endif
+  s_flash[irom_byte] ^= 0x10;
+  s_flash[s_data[2].pos + 5] ^= 0x10;
+  CHECK(check_image(ROM_ADDR, TRUE) == 0);
+  CHECK(check_image(ROM_ADDR, FALSE) == addr);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(void) {
+  static const uint32 lens[] = {0xfc000};
+  volatile uint8 sink = 0;
+  int i, iters = 200;
+  double t;
+  make_rom(1, lens);
+  t = now();
+  for (i = 0; i < iters; i++) sink += check_image(ROM_ADDR, TRUE) != 0;
+  printf("check_image, 1 MB rom: %.0f MB/s\n",
+         (double) lens[0] * iters / (now() - t) / 1e6);
+}
+
+int main(int argc, char **argv) {
+  srand(1);
+  test_fold();
+  test_rom();
+  test_rom_new();
+  printf("%s: %d failures\n", argv[0], s_failures);
+  if (s_failures == 0 && argc > 1 && strcmp(argv[1], "bench") == 0) bench();
+  return s_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
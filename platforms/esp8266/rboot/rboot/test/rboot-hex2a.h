@@ -0,0 +1,5 @@
+/* Stand-in for the generated stage 2a loader, the test does not boot. */
+const uint32 entry_addr = 0;
+const uint32 _text_addr = 0;
+const uint32 _text_len = 0;
+const uint8 _text_data[] = {0};
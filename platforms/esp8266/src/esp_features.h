@@ -28,6 +28,14 @@
 #define MGOS_ENABLE_HEAP_LOG 0
 #endif
 
+/*
+ * Serve small allocations from size-class pools rather than umm_malloc.
+ * The arena (a bit over 2 KB) is taken out of the umm heap.
+ */
+#ifndef ESP_SMALL_ALLOC_ENABLE
+#define ESP_SMALL_ALLOC_ENABLE 1
+#endif
+
 /* no_extern_c_check */
 
 #endif /* CS_FW_PLATFORMS_ESP8266_SRC_ESP_FEATURES_H_ */
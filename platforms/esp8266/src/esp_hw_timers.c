@@ -40,6 +40,52 @@
 #define TIMER_MIN_LOAD 500
 #define TIMER_MAX_LOAD 8000000
 
+#if MGOS_HW_TIMERS_MUX
+
+/*
+ * FRC1 is used as a one-shot comparator for the multiplexer,
+ * system_get_time() is the free-running counter.
+ * MGOS_ESP8266_HW_TIMER_NMI is not supported in this mode.
+ */
+
+static IRAM void esp_hw_timers_mux_isr(void *arg) {
+  mgos_hw_timers_mux_isr();
+  (void) arg;
+}
+
+IRAM uint32_t mgos_hw_timers_mux_dev_now(void) {
+  return system_get_time();
+}
+
+IRAM void mgos_hw_timers_mux_dev_arm(uint32_t when) {
+  int32_t delta = (int32_t)(when - system_get_time());
+  uint32_t load;
+  if (delta < 0) delta = 0;
+  /* Further deadlines fire early, ISR will re-arm for the remainder. */
+  if (delta > TIMER_MAX_LOAD / (TIMER_FREQ / 1000000)) {
+    delta = TIMER_MAX_LOAD / (TIMER_FREQ / 1000000);
+  }
+  load = delta * (TIMER_FREQ / 1000000);
+  if (load < TIMER_MIN_LOAD) load = TIMER_MIN_LOAD;
+  RTC_REG_WRITE(FRC1_LOAD_ADDRESS, load);
+  RTC_CLR_REG_MASK(FRC1_INT_ADDRESS, FRC1_INT_CLR_MASK);
+  RTC_REG_WRITE(FRC1_CTRL_ADDRESS,
+                TM_ENABLE | TM_INT_EDGE | TIMER_PRESCALER_1);
+}
+
+IRAM void mgos_hw_timers_mux_dev_disarm(void) {
+  RTC_CLR_REG_MASK(FRC1_CTRL_ADDRESS, TM_ENABLE);
+}
+
+bool mgos_hw_timers_mux_dev_init(void) {
+  ETS_FRC_TIMER1_INTR_ATTACH((ets_isr_t) esp_hw_timers_mux_isr, NULL);
+  TM1_EDGE_INT_ENABLE();
+  ETS_FRC1_INTR_ENABLE();
+  return true;
+}
+
+#else /* MGOS_HW_TIMERS_MUX */
+
 static struct mgos_hw_timer_info *s_ti;
 
 IRAM void nmi_isr(void) {
@@ -95,3 +141,5 @@ bool mgos_hw_timers_dev_init(struct mgos_hw_timer_info *ti) {
   (void) ti;
   return true;
 }
+
+#endif /* MGOS_HW_TIMERS_MUX */
@@ -21,6 +21,7 @@
 extern "C" {
 #endif
 
+/* Run the callback as NMI. Requires MGOS_ESP8266_HW_TIMERS_MUX=0. */
 #define MGOS_ESP8266_HW_TIMER_NMI 0x10000
 
 struct mgos_hw_timer_dev_data {};
@@ -30,6 +30,7 @@
 #endif
 
 #include "esp_features.h"
+#include "esp_umm_malloc.h"
 #include "mgos_hal.h"
 #include "mgos_time.h"
 
@@ -48,7 +49,7 @@ int cs_heap_shim = 0;
 void *malloc(size_t size) {
   void *res;
   CS_HEAP_SHIM_FLAG_SET();
-  res = (void *) umm_malloc(size);
+  res = esp_heap_malloc(size);
 #ifdef ESP_ABORT_ON_MALLOC_FAILURE
   if (res == NULL) abort();
 #endif
@@ -57,13 +58,13 @@ void *malloc(size_t size) {
 
 void free(void *ptr) {
   CS_HEAP_SHIM_FLAG_SET();
-  umm_free(ptr);
+  esp_heap_free(ptr);
 }
 
 void *realloc(void *ptr, size_t size) {
   void *res;
   CS_HEAP_SHIM_FLAG_SET();
-  res = (void *) umm_realloc(ptr, size);
+  res = esp_heap_realloc(ptr, size);
 #ifdef ESP_ABORT_ON_MALLOC_FAILURE
   if (res == NULL) {
     printf("failed to alloc %u bytes, %d avail\n", size,
@@ -77,7 +78,7 @@ void *realloc(void *ptr, size_t size) {
 void *calloc(size_t num, size_t size) {
   void *res;
   CS_HEAP_SHIM_FLAG_SET();
-  res = (void *) umm_calloc(num, size);
+  res = esp_heap_calloc(num, size);
 #ifdef ESP_ABORT_ON_MALLOC_FAILURE
   if (res == NULL) abort();
 #endif
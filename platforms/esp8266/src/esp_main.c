@@ -30,6 +30,7 @@
 #endif
 
 #include "common/cs_dbg.h"
+#include "frozen.h"
 #include "mgos_app.h"
 #include "mgos_core_dump.h"
 #include "mgos_debug_internal.h"
@@ -50,6 +51,7 @@
 #include "esp_fs.h"
 #include "esp_hw.h"
 #include "esp_hw_wdt.h"
+#include "esp_main.h"
 #include "esp_periph.h"
 #include "esp_rboot.h"
 #include "esp_umm_malloc.h"
@@ -81,49 +83,103 @@
 #define MGOS_MONGOOSE_MAX_POLL_SLEEP_MS 1000
 #endif
 
+/*
+ * While there is activity, up to this many polls are done per task post
+ * before yielding to the SDK with a re-post, which saves a queue round trip
+ * per poll under load.
+ */
+#ifndef MGOS_MONGOOSE_POLL_BATCH
+#define MGOS_MONGOOSE_POLL_BATCH 4
+#endif
+
+/* A batch is also cut short after this many microseconds. */
+#ifndef MGOS_MONGOOSE_POLL_BATCH_US
+#define MGOS_MONGOOSE_POLL_BATCH_US 5000
+#endif
+
 extern const char *build_version, *build_id;
 extern const char *mg_build_version, *mg_build_id;
 
 bool uart_initialized = false;
 
 static os_timer_t s_mg_poll_tmr;
+/* system_get_time() when the timer is due, valid if s_mg_poll_tmr_armed. */
+static uint32_t s_mg_poll_tmr_due;
+static bool s_mg_poll_tmr_armed = false;
 
 static uint32_t s_mg_polls_in_flight = 0;
 
+static struct esp_mg_poll_stats s_mg_poll_stats;
+
+/* Returns ms until the earliest timer, rounded up, capped at max sleep. */
+static int mgos_mg_poll_timeout_ms(void) {
+  /* Covers both connection timers and mgos timers, which are backed by one. */
+  double min_timer = mg_mgr_min_timer(mgos_get_mgr());
+  double timeout;
+  if (min_timer <= 0) return MGOS_MONGOOSE_MAX_POLL_SLEEP_MS;
+  timeout = (min_timer - mg_time()) * 1000.0;
+  /* Waking up early only results in an empty poll and another sleep. */
+  if (timeout <= 0) return 0;
+  if (timeout >= MGOS_MONGOOSE_MAX_POLL_SLEEP_MS) {
+    return MGOS_MONGOOSE_MAX_POLL_SLEEP_MS;
+  }
+  return ((int) timeout) + 1;
+}
+
 static IRAM void mgos_mg_poll_cb(void *arg) {
+  uint32_t start;
+  int i, timeout_ms = 0;
+  bool busy = false;
   mgos_ints_disable();
   s_mg_polls_in_flight--;
   mgos_ints_enable();
-  int timeout_ms = 0;
-  if (mongoose_poll(0) == 0) {
-    /* Nothing is happening now, see when next timer is due. */
-    double min_timer = mg_mgr_min_timer(mgos_get_mgr());
-    if (min_timer > 0) {
-      /* Note: timeout_ms can get negative if a timer is past due. That's ok. */
-      timeout_ms = (int) ((min_timer - mg_time()) * 1000.0);
-      if (timeout_ms < 0) {
-        timeout_ms = 0; /* Now */
-      } else if (timeout_ms > MGOS_MONGOOSE_MAX_POLL_SLEEP_MS) {
-        timeout_ms = MGOS_MONGOOSE_MAX_POLL_SLEEP_MS;
-      }
-    } else {
-      timeout_ms = MGOS_MONGOOSE_MAX_POLL_SLEEP_MS;
-    }
-  } else {
+#if MGOS_ENABLE_HEAP_LOG
+  esp_heap_log_flush();
+#endif
+  s_mg_poll_stats.posts++;
+  start = system_get_time();
+  for (i = 0; i < MGOS_MONGOOSE_POLL_BATCH; i++) {
+    s_mg_poll_stats.polls++;
+    busy = (mongoose_poll(0) != 0);
+    if (!busy) break;
+    if (system_get_time() - start > MGOS_MONGOOSE_POLL_BATCH_US) break;
+  }
+  if (i == 0) s_mg_poll_stats.idle++;
+  if (busy) {
     /* Things are happening, we need another poll ASAP. */
+    s_mg_poll_stats.reposts++;
+  } else {
+    /* Nothing is happening now, see when next timer is due. */
+    timeout_ms = mgos_mg_poll_timeout_ms();
   }
   if (timeout_ms == 0) {
     mongoose_schedule_poll(false /* from_isr */);
   } else {
-    os_timer_disarm(&s_mg_poll_tmr);
-    /* We set repeat = true in case things get stuck for any reason. */
-    os_timer_arm(&s_mg_poll_tmr, timeout_ms, 1 /* repeat */);
+    uint32_t due = system_get_time() + timeout_ms * 1000;
+    /* Don't re-arm for the same deadline (within the timer's resolution). */
+    if (!s_mg_poll_tmr_armed ||
+        (uint32_t)(due - s_mg_poll_tmr_due + 1000) > 2000) {
+      os_timer_disarm(&s_mg_poll_tmr);
+      /* We set repeat = true in case things get stuck for any reason. */
+      os_timer_arm(&s_mg_poll_tmr, timeout_ms, 1 /* repeat */);
+      s_mg_poll_tmr_due = due;
+      s_mg_poll_tmr_armed = true;
+    }
   }
   (void) arg;
 }
 
+static IRAM void mgos_mg_poll_tmr_cb(void *arg) {
+  s_mg_poll_stats.timer++;
+  s_mg_poll_tmr_armed = false;
+  /* RTOS callbacks are executed in ISR context; for non-OS it doesn't matter. */
+  mongoose_schedule_poll(true /* from_isr */);
+  (void) arg;
+}
+
 IRAM void mongoose_schedule_poll(bool from_isr) {
   mgos_ints_disable();
+  s_mg_poll_stats.requests++;
   if (s_mg_polls_in_flight < 2) {
     s_mg_polls_in_flight++;
     mgos_ints_enable();
@@ -133,6 +189,7 @@ IRAM void mongoose_schedule_poll(bool from_isr) {
       /* Ok, that didn't work, roll back our counter change. */
       mgos_ints_disable();
       s_mg_polls_in_flight--;
+      s_mg_poll_stats.dropped++;
       /*
        * Not much else we can do here, the queue is full.
        * Background poll timer will eventually restart polling.
@@ -140,10 +197,29 @@ IRAM void mongoose_schedule_poll(bool from_isr) {
     }
   } else {
     /* There are at least two pending callbacks, don't bother. */
+    s_mg_poll_stats.coalesced++;
   }
   mgos_ints_enable();
 }
 
+void esp_mg_poll_get_stats(struct esp_mg_poll_stats *st) {
+  mgos_ints_disable();
+  *st = s_mg_poll_stats;
+  mgos_ints_enable();
+}
+
+int esp_mg_poll_stats_json(struct json_out *out) {
+  struct esp_mg_poll_stats st;
+  esp_mg_poll_get_stats(&st);
+  return json_printf(out,
+                     "{requests: %u, coalesced: %u, dropped: %u, timer: %u, "
+                     "posts: %u, polls: %u, idle: %u, reposts: %u}",
+                     (unsigned) st.requests, (unsigned) st.coalesced,
+                     (unsigned) st.dropped, (unsigned) st.timer,
+                     (unsigned) st.posts, (unsigned) st.polls,
+                     (unsigned) st.idle, (unsigned) st.reposts);
+}
+
 void mg_lwip_mgr_schedule_poll(struct mg_mgr *mgr) {
   (void) mgr;
   mongoose_schedule_poll(false /* from_isr */);
@@ -294,10 +370,7 @@ void user_init(void) {
   mgos_debug_init();
   srand(system_get_time() ^ system_get_rtc_time());
   os_timer_disarm(&s_mg_poll_tmr);
-  os_timer_setfn(&s_mg_poll_tmr, (void (*)(void *)) mongoose_schedule_poll,
-                 /* RTOS callbacks are executed in ISR context; for non-OS it
-                    doesn't matter. */
-                 (void *) true);
+  os_timer_setfn(&s_mg_poll_tmr, mgos_mg_poll_tmr_cb, NULL);
   esp_hw_wdt_setup(ESP_HW_WDT_26_8_SEC, ESP_HW_WDT_26_8_SEC);
   /* Soft WDT feeds HW WDT, we don't want this. */
   system_soft_wdt_stop();
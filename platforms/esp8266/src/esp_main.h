@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CS_FW_PLATFORMS_ESP8266_SRC_ESP_MAIN_H_
+#define CS_FW_PLATFORMS_ESP8266_SRC_ESP_MAIN_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Counters of mongoose polls and what caused them, since boot. */
+struct esp_mg_poll_stats {
+  uint32_t requests;  /* mongoose_schedule_poll() calls: I/O, callbacks. */
+  uint32_t coalesced; /* Requests that found two polls already queued. */
+  uint32_t dropped;   /* Requests that could not be queued. */
+  uint32_t timer;     /* Wakeups by the poll timer (timer deadlines). */
+  uint32_t posts;     /* Poll callbacks run. */
+  uint32_t polls;     /* mongoose_poll() calls, > posts due to batching. */
+  uint32_t idle;      /* Posts where nothing happened. */
+  uint32_t reposts;   /* Posts that ran out of batch and queued another. */
+};
+
+void esp_mg_poll_get_stats(struct esp_mg_poll_stats *st);
+
+struct json_out;
+
+/*
+ * Print poll stats as a JSON object:
+ * `{"requests": 123, "coalesced": 4, "dropped": 0, "timer": 56, ...}`.
+ */
+int esp_mg_poll_stats_json(struct json_out *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CS_FW_PLATFORMS_ESP8266_SRC_ESP_MAIN_H_ */
@@ -20,6 +20,10 @@
 
 #include "umm_malloc.h"
 
+#include "mgos_pool.h"
+#include "mgos_system.h"
+
+#include "esp_features.h"
 #include "esp_umm_malloc.h"
 
 #if ESP_UMM_ENABLE
@@ -63,43 +67,194 @@
  * will use heap implementation from SDK.
  */
 
+#if ESP_SMALL_ALLOC_ENABLE
+
+/*
+ * Small allocations (SDK and lwIP have lots of them) are served from three
+ * size classes - 8, 16 and 32 bytes - carved out of a static arena.
+ * They don't fragment the umm heap and don't pay the 8 byte block overhead.
+ * When a class is exhausted, the next larger one is tried, then umm_malloc.
+ * Since the arena is a single static array, ownership is a range check.
+ */
+#define ESP_SMALL_ALLOC_MAX 32
+#define ESP_SA_NUM_CLASSES 3
+#define ESP_SA_SLAB_8 MGOS_POOL_SLAB_SIZE(8, 64)
+#define ESP_SA_SLAB_16 MGOS_POOL_SLAB_SIZE(16, 48)
+#define ESP_SA_SLAB_32 MGOS_POOL_SLAB_SIZE(32, 24)
+#define ESP_SMALL_ALLOC_ARENA_SIZE \
+  (ESP_SA_SLAB_8 + ESP_SA_SLAB_16 + ESP_SA_SLAB_32)
+#define ESP_SA_POOL_FLAGS (MGOS_POOL_F_ISR_SAFE | MGOS_POOL_F_NO_GROW)
+
+static struct mgos_pool s_sa_pools[ESP_SA_NUM_CLASSES] = {
+    MGOS_POOL_INIT("heap8", 8, 0, ESP_SA_POOL_FLAGS),
+    MGOS_POOL_INIT("heap16", 16, 0, ESP_SA_POOL_FLAGS),
+    MGOS_POOL_INIT("heap32", 32, 0, ESP_SA_POOL_FLAGS),
+};
+static uint64_t s_sa_arena[ESP_SMALL_ALLOC_ARENA_SIZE / sizeof(uint64_t)];
+/*
+ * umm_* calls are recorded by the heap log wrappers (esp_heap_trace.c),
+ * pool hits have to be recorded here.
+ */
+#if MGOS_ENABLE_HEAP_LOG
+#define ESP_SA_LOG(type, size, ptr, old_ptr) \
+  esp_heap_log_record(type, size, ptr, old_ptr)
+#else
+#define ESP_SA_LOG(type, size, ptr, old_ptr)
+#endif
+
+static bool s_sa_init_started = false, s_sa_inited = false;
+
+/*
+ * mgos_ints_disable() does not nest on esp8266 and mgos_pool_add_slab() takes
+ * the pool's own lock, so slabs are added with interrupts enabled. Only the
+ * claim is done with interrupts off: whoever comes in meanwhile (e.g. an ISR)
+ * sees the pools empty or partially filled and falls back to umm_malloc.
+ */
+static void esp_sa_init(void) {
+  char *p = (char *) s_sa_arena;
+  bool claimed;
+  mgos_ints_disable();
+  claimed = !s_sa_init_started;
+  s_sa_init_started = true;
+  mgos_ints_enable();
+  if (!claimed) return;
+  mgos_pool_add_slab(&s_sa_pools[0], p, ESP_SA_SLAB_8);
+  p += ESP_SA_SLAB_8;
+  mgos_pool_add_slab(&s_sa_pools[1], p, ESP_SA_SLAB_16);
+  p += ESP_SA_SLAB_16;
+  mgos_pool_add_slab(&s_sa_pools[2], p, ESP_SA_SLAB_32);
+  s_sa_inited = true;
+}
+
+static void *esp_sa_alloc(size_t size) {
+  int i = (size <= 8 ? 0 : size <= 16 ? 1 : 2);
+  if (!s_sa_inited) esp_sa_init();
+  for (; i < ESP_SA_NUM_CLASSES; i++) {
+    void *ptr = mgos_pool_alloc(&s_sa_pools[i]);
+    if (ptr != NULL) return ptr;
+  }
+  return NULL;
+}
+
+static struct mgos_pool *esp_sa_pool(const void *ptr) {
+  uintptr_t off = (uintptr_t) ptr - (uintptr_t) s_sa_arena;
+  if (off >= sizeof(s_sa_arena)) return NULL;
+  if (off < ESP_SA_SLAB_8) return &s_sa_pools[0];
+  if (off < ESP_SA_SLAB_8 + ESP_SA_SLAB_16) return &s_sa_pools[1];
+  return &s_sa_pools[2];
+}
+
+void *esp_heap_malloc(size_t size) {
+  if (size > 0 && size <= ESP_SMALL_ALLOC_MAX) {
+    void *ptr = esp_sa_alloc(size);
+    if (ptr != NULL) {
+      ESP_SA_LOG(CS_HLOG_MALLOC, size, ptr, NULL);
+      return ptr;
+    }
+  }
+  return umm_malloc(size);
+}
+
+void *esp_heap_calloc(size_t num, size_t size) {
+  size_t total = num * size;
+  if (total > 0 && total <= ESP_SMALL_ALLOC_MAX && total / num == size) {
+    void *ptr = esp_sa_alloc(total);
+    if (ptr != NULL) {
+      memset(ptr, 0, total);
+      ESP_SA_LOG(CS_HLOG_CALLOC, total, ptr, NULL);
+      return ptr;
+    }
+  }
+  return umm_calloc(num, size);
+}
+
+void *esp_heap_realloc(void *ptr, size_t size) {
+  struct mgos_pool *p;
+  void *new_ptr;
+  if (ptr == NULL) return esp_heap_malloc(size);
+  p = esp_sa_pool(ptr);
+  if (p == NULL) return umm_realloc(ptr, size);
+  if (size == 0) {
+    ESP_SA_LOG(CS_HLOG_FREE, 0, ptr, NULL);
+    mgos_pool_free(p, ptr);
+    return NULL;
+  }
+  if (size <= p->obj_size) {
+    ESP_SA_LOG(CS_HLOG_REALLOC, size, ptr, ptr);
+    return ptr;
+  }
+  /* Recorded as malloc of the new block and free of the old one. */
+  new_ptr = esp_heap_malloc(size);
+  if (new_ptr == NULL) return NULL;
+  memcpy(new_ptr, ptr, p->obj_size);
+  ESP_SA_LOG(CS_HLOG_FREE, 0, ptr, NULL);
+  mgos_pool_free(p, ptr);
+  return new_ptr;
+}
+
+void esp_heap_free(void *ptr) {
+  struct mgos_pool *p = esp_sa_pool(ptr);
+  if (p != NULL) {
+    ESP_SA_LOG(CS_HLOG_FREE, 0, ptr, NULL);
+    mgos_pool_free(p, ptr);
+  } else {
+    umm_free(ptr);
+  }
+}
+
+#else /* ESP_SMALL_ALLOC_ENABLE */
+
+void *esp_heap_malloc(size_t size) {
+  return umm_malloc(size);
+}
+
+void *esp_heap_calloc(size_t num, size_t size) {
+  return umm_calloc(num, size);
+}
+
+void *esp_heap_realloc(void *ptr, size_t size) {
+  return umm_realloc(ptr, size);
+}
+
+void esp_heap_free(void *ptr) {
+  umm_free(ptr);
+}
+
+#endif /* ESP_SMALL_ALLOC_ENABLE */
+
 void *pvPortMalloc(size_t size, const char *file, unsigned line) {
   (void) file;
   (void) line;
 
-  return umm_malloc(size);
+  return esp_heap_malloc(size);
 }
 
 void *pvPortCalloc(size_t num, size_t size, const char *file, unsigned line) {
   (void) file;
   (void) line;
 
-  return umm_calloc(num, size);
+  return esp_heap_calloc(num, size);
 }
 
 void *pvPortZalloc(size_t size, const char *file, unsigned line) {
-  void *ret;
-
   (void) file;
   (void) line;
 
-  ret = umm_malloc(size);
-  if (ret != NULL) memset(ret, 0, size);
-  return ret;
+  return esp_heap_calloc(1, size);
 }
 
 void *pvPortRealloc(void *ptr, size_t size, const char *file, unsigned line) {
   (void) file;
   (void) line;
 
-  return umm_realloc(ptr, size);
+  return esp_heap_realloc(ptr, size);
 }
 
 void vPortFree(void *ptr, const char *file, unsigned line) {
   (void) file;
   (void) line;
 
-  umm_free(ptr);
+  esp_heap_free(ptr);
 }
 
 size_t xPortGetFreeHeapSize(void) {
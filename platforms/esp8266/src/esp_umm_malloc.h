@@ -32,4 +32,28 @@ void esp_umm_init(void);
  */
 void esp_umm_oom_cb(size_t size, size_t blocks_cnt);
 
+/*
+ * Heap entry points used by both libc and SDK shims. Requests of up to
+ * ESP_SMALL_ALLOC_MAX bytes are served from fixed-size pools in a static
+ * arena (if ESP_SMALL_ALLOC_ENABLE), the rest go to umm_malloc.
+ */
+void *esp_heap_malloc(size_t size);
+void *esp_heap_calloc(size_t num, size_t size);
+void *esp_heap_realloc(void *ptr, size_t size);
+void esp_heap_free(void *ptr);
+
+#if MGOS_ENABLE_HEAP_LOG
+#include "common/cs_heap_log.h"
+
+/* Drain heap log ring to the debug UART. Called from the main loop. */
+void esp_heap_log_flush(void);
+
+/*
+ * Record a heap operation that does not go through umm_malloc (small
+ * allocation pools), the same way the umm_* wrappers do.
+ */
+void esp_heap_log_record(enum cs_hlog_type type, size_t size, const void *ptr,
+                         const void *old_ptr);
+#endif
+
 #endif /* CS_COMMON_PLATFORMS_ESP8266_ESP_UMM_MALLOC_H_ */
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "common/cs_dbg.h"
@@ -31,6 +32,9 @@ struct ubuntu_flags {
   gid_t gid;
   char *chroot;
   int secure;
+  char *core_dump_file;
+  char *uart_dev[MGOS_MAX_NUM_UARTS];
+  char *gpio_chip;
 };
 
 // Logging for the main process (using different colors)
@@ -73,6 +77,33 @@ bool ubuntu_wdt_enable(void);
 bool ubuntu_wdt_disable(void);
 void ubuntu_wdt_set_timeout(int secs);
 
+// Core dump: install fatal signal handlers and, if file_name is not NULL,
+// persist dumps to it. Must be called before chroot.
+bool ubuntu_cd_init(const char *file_name, uintptr_t stack_top);
+
+#if MGOS_ENABLE_HEAP_LOG
+// Heap log: drain the record ring to stderr. Called from the main loop.
+void ubuntu_heap_log_flush(void);
+#endif
+
+// Simulated interrupts, see ubuntu_irq.c.
+typedef void (*ubuntu_irq_handler_t)(int fd, uint32_t events, void *arg);
+bool ubuntu_irq_init(void);
+// Registers fd as an interrupt source. It is disabled until armed.
+bool ubuntu_irq_add(int fd, ubuntu_irq_handler_t handler, void *arg);
+// Enables a one-shot interrupt for the given EPOLL* events, 0 disables.
+bool ubuntu_irq_arm(int fd, uint32_t events);
+void ubuntu_irq_del(int fd);
+
+// GPIO, see ubuntu_hal_gpio.c.
+// Reads several pins with one ioctl.
+bool ubuntu_gpio_read_many(int n, const int *pins, bool *values);
+// Kernel timestamp (CLOCK_MONOTONIC, ns) of the last edge interrupt on pin.
+uint64_t ubuntu_gpio_last_edge_ns(int pin);
+
+// Logs HW timer dispatch lateness, see mgos_hw_timers_mux_get_stats().
+void ubuntu_hw_timers_log_stats(void);
+
 // Capabilities (drop privs, chroot, et al)
 bool ubuntu_cap_init(void);
 
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2019 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This is D. Vyukov's bounded MPMC queue, with the consumer side simplified
+// for a single consumer. Every cell carries a sequence number: a cell at
+// position `pos` is free for the producer when seq == pos and holds data for
+// the consumer when seq == pos + 1. Positions grow without bound, the cell
+// index is pos & mask.
+
+#include "ubuntu_cb_queue.h"
+
+#include <stdlib.h>
+
+bool ubuntu_cb_queue_init(struct ubuntu_cb_queue *q, unsigned int len) {
+  uintptr_t i;
+  if (len == 0 || (len & (len - 1)) != 0) return false;
+  q->cells = (struct ubuntu_cb_queue_cell *) calloc(len, sizeof(*q->cells));
+  if (q->cells == NULL) return false;
+  for (i = 0; i < len; i++) q->cells[i].seq = i;
+  q->mask = len - 1;
+  q->enq_pos = 0;
+  q->deq_pos = 0;
+  return true;
+}
+
+bool ubuntu_cb_queue_put(struct ubuntu_cb_queue *q, mgos_cb_t cb, void *arg) {
+  struct ubuntu_cb_queue_cell *c;
+  uintptr_t pos = __atomic_load_n(&q->enq_pos, __ATOMIC_RELAXED);
+  for (;;) {
+    intptr_t dif;
+    c = &q->cells[pos & q->mask];
+    dif = (intptr_t)(__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) - pos);
+    if (dif == 0) {
+      if (__atomic_compare_exchange_n(&q->enq_pos, &pos, pos + 1,
+                                      true /* weak */, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED)) {
+        break;
+      }
+      // pos has been reloaded by the failed CAS.
+    } else if (dif < 0) {
+      // The cell still holds an entry from the previous lap: full.
+      return false;
+    } else {
+      pos = __atomic_load_n(&q->enq_pos, __ATOMIC_RELAXED);
+    }
+  }
+  c->cb = cb;
+  c->arg = arg;
+  __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+int ubuntu_cb_queue_run(struct ubuntu_cb_queue *q, int max) {
+  int n;
+  for (n = 0; n < max; n++) {
+    const uintptr_t pos = q->deq_pos;
+    struct ubuntu_cb_queue_cell *c = &q->cells[pos & q->mask];
+    mgos_cb_t cb;
+    void *arg;
+    // Also false for a cell that is claimed but not yet published,
+    // the producer will wake us up when it is.
+    if (__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) != pos + 1) break;
+    cb = c->cb;
+    arg = c->arg;
+    // Hand the cell back before running the callback, so it can post.
+    __atomic_store_n(&c->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+    q->deq_pos = pos + 1;
+    cb(arg);
+  }
+  return n;
+}
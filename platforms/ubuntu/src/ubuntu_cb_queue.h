@@ -0,0 +1,63 @@
+/*
+ * Copyright 2019 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Bounded lock-free multi-producer, single-consumer queue of callbacks.
+//
+// Cells are preallocated, posting never allocates or takes a lock: producers
+// claim a position with a CAS on the enqueue counter and publish the cell by
+// bumping its sequence number. The consumer is the main loop, it runs
+// callbacks in batches and does not need atomic RMW operations at all.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mgos_system.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define UBUNTU_CB_QUEUE_CACHE_LINE 64
+
+struct ubuntu_cb_queue_cell {
+  uintptr_t seq;
+  mgos_cb_t cb;
+  void *arg;
+};
+
+struct ubuntu_cb_queue {
+  struct ubuntu_cb_queue_cell *cells;
+  uintptr_t mask;
+  // Producers and the consumer each get their own cache line.
+  uintptr_t enq_pos __attribute__((aligned(UBUNTU_CB_QUEUE_CACHE_LINE)));
+  uintptr_t deq_pos __attribute__((aligned(UBUNTU_CB_QUEUE_CACHE_LINE)));
+};
+
+// Allocates `len` cells, `len` must be a power of 2.
+bool ubuntu_cb_queue_init(struct ubuntu_cb_queue *q, unsigned int len);
+
+// Can be called from any thread. Returns false if the queue is full.
+bool ubuntu_cb_queue_put(struct ubuntu_cb_queue *q, mgos_cb_t cb, void *arg);
+
+// Consumer side: runs up to `max` queued callbacks, returns how many were run.
+// Callbacks may post to the queue.
+int ubuntu_cb_queue_run(struct ubuntu_cb_queue *q, int max);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
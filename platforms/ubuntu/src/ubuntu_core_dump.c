@@ -0,0 +1,260 @@
+/*
+ * Copyright 2019 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  // For REG_* in ucontext.h
+#endif
+
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "mgos_core_dump.h"
+#include "ubuntu.h"
+
+// Max amount of stack to include in the dump.
+#define UBUNTU_CD_MAX_STACK_SIZE (64 * 1024)
+
+// Fatal signals are handled on a stack of their own, so that a stack overflow
+// gets dumped too.
+#define UBUNTU_CD_ALT_STACK_SIZE (64 * 1024)
+
+static int s_cd_fd = -1;
+static int s_cd_dir_fd = -1;
+static char s_cd_name[NAME_MAX + 1];
+static char s_cd_old_name[NAME_MAX + 1];
+static const ucontext_t *s_uc = NULL;
+static uintptr_t s_stack_top = 0;
+static char s_alt_stack[UBUNTU_CD_ALT_STACK_SIZE] __attribute__((aligned(16)));
+
+/*
+ * File sink. The file and its directory are opened in advance (before
+ * chroot), at crash time only write(2) and friends are used, all of which are
+ * async-signal-safe. Console output goes to stderr with write(2) too (see
+ * ubuntu_hal.c), and the dump itself does no formatting with stdio.
+ */
+static bool ubuntu_cd_file_begin(void *arg) {
+  struct stat st;
+  int fd;
+  if (s_cd_fd < 0) return false;
+  // A dump that was not collected yet is moved to <file>.1, replacing the one
+  // that was there. If that fails, it's kept and this one goes to the console.
+  if (fstat(s_cd_fd, &st) != 0) return false;
+  if (st.st_size > 0) {
+    if (renameat(s_cd_dir_fd, s_cd_name, s_cd_dir_fd, s_cd_old_name) != 0) {
+      return false;
+    }
+    fd = openat(s_cd_dir_fd, s_cd_name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0600);
+    if (fd < 0) return false;
+    close(s_cd_fd);
+    s_cd_fd = fd;
+  }
+  return (lseek(s_cd_fd, 0, SEEK_SET) == 0);
+  (void) arg;
+}
+
+static void ubuntu_cd_file_write(const char *data, size_t len, void *arg) {
+  while (len > 0) {
+    ssize_t n = write(s_cd_fd, data, len);
+    if (n <= 0) break;
+    data += n;
+    len -= n;
+  }
+  (void) arg;
+}
+
+static void ubuntu_cd_file_end(void *arg) {
+  fsync(s_cd_fd);
+  (void) arg;
+}
+
+static size_t ubuntu_cd_file_stored_size(void *arg) {
+  struct stat st;
+  if (s_cd_fd < 0 || fstat(s_cd_fd, &st) != 0) return 0;
+  return st.st_size;
+  (void) arg;
+}
+
+static int ubuntu_cd_file_read(size_t offset, void *buf, size_t len,
+                               void *arg) {
+  return pread(s_cd_fd, buf, len, offset);
+  (void) arg;
+}
+
+static void ubuntu_cd_file_erase(void *arg) {
+  if (s_cd_fd < 0) return;
+  if (ftruncate(s_cd_fd, 0) != 0) {
+    LOG(LL_ERROR, ("Failed to erase core dump"));
+  }
+  (void) arg;
+}
+
+static const struct mgos_cd_sink s_cd_file_sink = {
+    .begin = ubuntu_cd_file_begin,
+    .write = ubuntu_cd_file_write,
+    .end = ubuntu_cd_file_end,
+    .stored_size = ubuntu_cd_file_stored_size,
+    .read = ubuntu_cd_file_read,
+    .erase = ubuntu_cd_file_erase,
+    .arg = NULL,
+};
+
+#if defined(__x86_64__)
+// Register layout of the GDB amd64 target.
+struct ubuntu_cd_regs {
+  uint64_t rax, rbx, rcx, rdx, rsi, rdi, rbp, rsp;
+  uint64_t r8, r9, r10, r11, r12, r13, r14, r15;
+  uint64_t rip;
+  uint32_t eflags, cs, ss, ds, es, fs, gs;
+} __attribute__((packed));
+
+static void ubuntu_cd_dump_regs(void) {
+  struct ubuntu_cd_regs regs;
+  const greg_t *gr;
+  if (s_uc == NULL) return;
+  gr = s_uc->uc_mcontext.gregs;
+  memset(&regs, 0, sizeof(regs));
+  regs.rax = gr[REG_RAX];
+  regs.rbx = gr[REG_RBX];
+  regs.rcx = gr[REG_RCX];
+  regs.rdx = gr[REG_RDX];
+  regs.rsi = gr[REG_RSI];
+  regs.rdi = gr[REG_RDI];
+  regs.rbp = gr[REG_RBP];
+  regs.rsp = gr[REG_RSP];
+  regs.r8 = gr[REG_R8];
+  regs.r9 = gr[REG_R9];
+  regs.r10 = gr[REG_R10];
+  regs.r11 = gr[REG_R11];
+  regs.r12 = gr[REG_R12];
+  regs.r13 = gr[REG_R13];
+  regs.r14 = gr[REG_R14];
+  regs.r15 = gr[REG_R15];
+  regs.rip = gr[REG_RIP];
+  regs.eflags = gr[REG_EFL];
+  regs.cs = (gr[REG_CSGSFS] & 0xffff);
+  regs.gs = ((gr[REG_CSGSFS] >> 16) & 0xffff);
+  regs.fs = ((gr[REG_CSGSFS] >> 32) & 0xffff);
+  mgos_cd_write_section(MGOS_CORE_DUMP_SECTION_REGS, &regs, sizeof(regs));
+}
+
+static void ubuntu_cd_dump_stack(void) {
+  uintptr_t sp;
+  if (s_uc == NULL) return;
+  sp = (s_uc->uc_mcontext.gregs[REG_RSP] & ~((uintptr_t) 3));
+  // Only dump the main thread's stack, we don't know other threads' bounds.
+  if (sp >= s_stack_top || s_stack_top - sp > UBUNTU_CD_MAX_STACK_SIZE) return;
+  mgos_cd_write_section("STACK", (const void *) sp, s_stack_top - sp);
+}
+#endif
+
+// The watchdog lives in the broker, feeding it takes the IPC lock and does a
+// request on the broker socket. Neither is safe in a signal handler: the crash
+// may have happened with the lock held, or between a request and its reply.
+void mgos_cd_wdt_feed(void) {
+}
+
+static void ubuntu_cd_fatal_signal_handler(int sig, siginfo_t *info,
+                                           void *ctx) {
+  s_uc = (const ucontext_t *) ctx;
+  mgos_cd_write();
+  // Handler has been reset by SA_RESETHAND, let the default action happen.
+  raise(sig);
+  (void) info;
+}
+
+static bool ubuntu_cd_open_file(const char *file_name) {
+  const char *base = strrchr(file_name, '/');
+  char dir[PATH_MAX];
+  if (base == NULL) {
+    base = file_name;
+    strcpy(dir, ".");
+  } else if (base == file_name) {
+    base++;
+    strcpy(dir, "/");
+  } else if (base - file_name < (int) sizeof(dir)) {
+    memcpy(dir, file_name, base - file_name);
+    dir[base - file_name] = '\0';
+    base++;
+  } else {
+    return false;
+  }
+  if (*base == '\0' ||
+      snprintf(s_cd_old_name, sizeof(s_cd_old_name), "%s.1", base) >=
+          (int) sizeof(s_cd_old_name)) {
+    return false;
+  }
+  strcpy(s_cd_name, base);
+  s_cd_dir_fd = open(dir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+  if (s_cd_dir_fd < 0) return false;
+  s_cd_fd = openat(s_cd_dir_fd, s_cd_name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  return (s_cd_fd >= 0);
+}
+
+bool ubuntu_cd_init(const char *file_name, uintptr_t stack_top) {
+  static const int sigs[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+  struct sigaction sa;
+  stack_t ss;
+  size_t stored_size;
+
+  s_stack_top = stack_top;
+#if defined(__x86_64__)
+  mgos_cd_register_section_writer(ubuntu_cd_dump_regs);
+  mgos_cd_register_section_writer(ubuntu_cd_dump_stack);
+#endif
+
+  // Only the calling (Mongoose) thread gets the alternate stack.
+  memset(&ss, 0, sizeof(ss));
+  ss.ss_sp = s_alt_stack;
+  ss.ss_size = sizeof(s_alt_stack);
+  if (sigaltstack(&ss, NULL) != 0) {
+    LOG(LL_WARN, ("Failed to set up the signal stack"));
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = ubuntu_cd_fatal_signal_handler;
+  sa.sa_flags = SA_SIGINFO | SA_RESETHAND | SA_ONSTACK;
+  sigemptyset(&sa.sa_mask);
+  for (size_t i = 0; i < sizeof(sigs) / sizeof(sigs[0]); i++) {
+    sigaction(sigs[i], &sa, NULL);
+  }
+
+  if (file_name == NULL) return true;
+  if (!ubuntu_cd_open_file(file_name)) {
+    LOG(LL_ERROR, ("Failed to open core dump file %s", file_name));
+    return false;
+  }
+  mgos_cd_add_sink(&s_cd_file_sink);
+  // No need to have a copy on the console, it's all in the file.
+  mgos_cd_set_console_enabled(false);
+  // A dump from the previous run is printed to stderr and erased.
+  stored_size = mgos_cd_stored_size();
+  if (stored_size > 0) {
+    LOG(LL_WARN, ("Found a stored core dump (%lu bytes) in %s",
+                  (unsigned long) stored_size, file_name));
+    if (!mgos_cd_stored_print()) {
+      LOG(LL_ERROR, ("Failed to read the stored core dump, kept it"));
+    }
+  }
+  return true;
+}
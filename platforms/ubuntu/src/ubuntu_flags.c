@@ -18,6 +18,7 @@
 #include <grp.h>
 #include <libgen.h>
 #include <pwd.h>
+#include <string.h>
 
 #include "ubuntu.h"
 
@@ -31,6 +32,8 @@ static void ubuntu_flags_default(void) {
   Flags.gid = getgid();
   Flags.chroot = realpath("./build/fs/", NULL);
 
+  Flags.gpio_chip = strdup("/dev/gpiochip0");
+
   Flags.secure = true;
   return;
 }
@@ -39,7 +42,8 @@ static void ubuntu_flags_usage(char *progname) {
   printf("Usage:\n");
   printf(
       "  %s [--secure|--insecure] [-u|--user <user>] [-g|--group <group>] "
-      "[-c|--chroot <dir>] [-h|--help]\n",
+      "[-c|--chroot <dir>] [-d|--core-dump-file <file>] "
+      "[-U|--uart <n>:<device>] [-G|--gpio-chip <device>] [-h|--help]\n",
       basename(progname));
   printf("\n");
   printf(
@@ -51,6 +55,17 @@ static void ubuntu_flags_usage(char *progname) {
   printf(
       "  --chroot <dir> If running as root (or awarded cap_sys_chroot), this "
       "changes the root directory to <dir> before starting Mongoose.\n");
+  printf(
+      "  --core-dump-file <file> Store core dumps in <file> instead of "
+      "printing them to stderr. A stored dump is printed to stderr and erased "
+      "on next start.\n");
+  printf(
+      "  --uart <n>:<device> Attach UART <n> to a tty <device> (opened by the "
+      "main process), or to a new pseudo-terminal if <device> is 'pty'. "
+      "May be repeated.\n");
+  printf(
+      "  --gpio-chip <device> GPIO character device to use, pin numbers are "
+      "line offsets on it. Default: /dev/gpiochip0.\n");
   printf("  --secure will fail if chroot is not possible (the default)\n");
   printf(
       "  --insecure will allow to run without changing user, group, chroot, "
@@ -128,6 +143,9 @@ bool ubuntu_flags_init(int argc, char **argv) {
         {"user", required_argument, 0, 'u'},
         {"group", required_argument, 0, 'g'},
         {"chroot", required_argument, 0, 'c'},
+        {"core-dump-file", required_argument, 0, 'd'},
+        {"uart", required_argument, 0, 'U'},
+        {"gpio-chip", required_argument, 0, 'G'},
         {"secure", no_argument, &Flags.secure, 1},
         {"insecure", no_argument, &Flags.secure, 0},
         {"help", no_argument, 0, 'h'},
@@ -135,7 +153,7 @@ bool ubuntu_flags_init(int argc, char **argv) {
         {0, 0, 0, 0}};
     int option_index = 0;
 
-    c = getopt_long(argc, argv, "u:g:c:h", long_options, &option_index);
+    c = getopt_long(argc, argv, "u:g:c:d:U:G:h", long_options, &option_index);
 
     /* Detect the end of the options. */
     if (c == -1) {
@@ -189,6 +207,32 @@ bool ubuntu_flags_init(int argc, char **argv) {
         }
         break;
 
+      case 'd':
+        if (Flags.core_dump_file) {
+          free(Flags.core_dump_file);
+        }
+        Flags.core_dump_file = strdup(optarg);
+        break;
+
+      case 'U': {
+        char *dev = strchr(optarg, ':');
+        int uart_no = atoi(optarg);
+        if (dev == NULL || dev[1] == '\0' || uart_no < 0 ||
+            uart_no >= MGOS_MAX_NUM_UARTS) {
+          printf("Invalid UART spec '%s'\n", optarg);
+          ok = false;
+          goto exit;
+        }
+        free(Flags.uart_dev[uart_no]);
+        Flags.uart_dev[uart_no] = strdup(dev + 1);
+        break;
+      }
+
+      case 'G':
+        free(Flags.gpio_chip);
+        Flags.gpio_chip = strdup(optarg);
+        break;
+
       case 'h':
       case '?':
       default:
@@ -15,6 +15,7 @@
  */
 
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "mgos_hal.h"
 #include "mgos_mongoose.h"
@@ -44,6 +45,17 @@ int mg_ssl_if_mbed_random(void *ctx, unsigned char *buf, size_t len) {
   return 0;
 }
 
+// Core dump output goes straight to the fd, stdio is not async-signal-safe.
 void mgos_cd_putc(int c) {
-  fputc(c, stderr);
+  char ch = c;
+  mgos_cd_putsn(&ch, 1);
+}
+
+void mgos_cd_putsn(const char *s, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(STDERR_FILENO, s, len);
+    if (n <= 0) break;
+    s += n;
+    len -= n;
+  }
 }
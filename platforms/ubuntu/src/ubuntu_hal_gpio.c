@@ -14,96 +14,480 @@
  * limitations under the License.
  */
 
-#include <malloc.h>
+// GPIO on the Linux GPIO character device (uAPI v2, Linux 5.10+).
+//
+// Pin numbers are line offsets on the chip given with --gpio-chip
+// (/dev/gpiochip0 by default). All the lines in use are held in a single line
+// request, so reads and writes of several lines are one ioctl each, and edge
+// events for all lines come in on one fd. That fd is an interrupt source for
+// ubuntu_irq, its handler feeds events to mgos_gpio_hal_int_cb() so button
+// debouncing and ISR / deferred handlers work as they do on MCUs.
+//
+// Using a new line requires re-requesting the whole set, which briefly
+// releases the lines already in use; output values are preserved. It's best to
+// set up all the pins at init time.
+//
+// Level-triggered interrupts are not supported by the kernel interface.
+
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/gpio.h>
 
 #include "mgos_gpio_hal.h"
 #include "ubuntu.h"
+#include "ubuntu_ipc.h"
 
-bool mgos_gpio_set_mode(int pin, enum mgos_gpio_mode mode) {
-  LOG(LL_INFO, ("Not implemented yet"));
+extern struct ubuntu_flags Flags;
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+
+#define UBUNTU_GPIO_MAX_LINES GPIO_V2_LINES_MAX
+// Events read from the kernel at once.
+#define UBUNTU_GPIO_EVENT_BATCH 16
+
+#define UBUNTU_GPIO_DIR_FLAGS \
+  (GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_OUTPUT | \
+   GPIO_V2_LINE_FLAG_OPEN_DRAIN)
+#define UBUNTU_GPIO_BIAS_FLAGS                                 \
+  (GPIO_V2_LINE_FLAG_BIAS_PULL_UP | GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN | \
+   GPIO_V2_LINE_FLAG_BIAS_DISABLED)
+#define UBUNTU_GPIO_EDGE_FLAGS \
+  (GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING)
+
+struct ubuntu_gpio_line {
+  int pin;
+  uint64_t flags;  // GPIO_V2_LINE_FLAG_*
+  bool out_value;
+  bool int_enabled;
+  // Events older than this have been cleared.
+  uint64_t clear_ns;
+  uint64_t last_edge_ns;
+};
+
+static int s_chip_fd = -1;
+static int s_req_fd = -1;
+// Index in this array is the index of the line in the request.
+static struct ubuntu_gpio_line s_lines[UBUNTU_GPIO_MAX_LINES];
+static int s_num_lines = 0;
+// Timestamp of the event being dispatched, see mgos_gpio_hal_clear_int().
+static uint64_t s_cur_event_ns = 0;
+
+static uint64_t ubuntu_gpio_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int ubuntu_gpio_find(int pin) {
+  int i;
+  for (i = 0; i < s_num_lines; i++) {
+    if (s_lines[i].pin == pin) return i;
+  }
+  return -1;
+}
+
+// Lines with the same flags share an attribute, the most common case goes into
+// the default flags. Output values of all outputs are set too.
+static bool ubuntu_gpio_fill_config(struct gpio_v2_line_config *cfg) {
+  uint64_t out_mask = 0, out_values = 0;
+  int i, j;
+  memset(cfg, 0, sizeof(*cfg));
+  if (s_num_lines > 0) cfg->flags = s_lines[0].flags;
+  for (i = 0; i < s_num_lines; i++) {
+    const struct ubuntu_gpio_line *l = &s_lines[i];
+    if (l->flags & GPIO_V2_LINE_FLAG_OUTPUT) {
+      out_mask |= (1ULL << i);
+      if (l->out_value) out_values |= (1ULL << i);
+    }
+    if (l->flags == cfg->flags) continue;
+    for (j = 0; j < (int) cfg->num_attrs; j++) {
+      if (cfg->attrs[j].attr.flags == l->flags) break;
+    }
+    if (j == (int) cfg->num_attrs) {
+      // Last slot is reserved for output values.
+      if (j == GPIO_V2_LINE_NUM_ATTRS_MAX - 1) {
+        LOG(LL_ERROR, ("Too many different GPIO configurations"));
+        return false;
+      }
+      cfg->attrs[j].attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+      cfg->attrs[j].attr.flags = l->flags;
+      cfg->num_attrs++;
+    }
+    cfg->attrs[j].mask |= (1ULL << i);
+  }
+  if (out_mask != 0) {
+    j = cfg->num_attrs++;
+    cfg->attrs[j].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    cfg->attrs[j].attr.values = out_values;
+    cfg->attrs[j].mask = out_mask;
+  }
   return true;
+}
+
+static void ubuntu_gpio_irq(int fd, uint32_t events, void *arg);
+
+// (Re-)request all the lines. Must be called with ints disabled.
+static bool ubuntu_gpio_request(void) {
+  struct gpio_v2_line_request req;
+  int i;
+  memset(&req, 0, sizeof(req));
+  for (i = 0; i < s_num_lines; i++) req.offsets[i] = s_lines[i].pin;
+  req.num_lines = s_num_lines;
+  snprintf(req.consumer, sizeof(req.consumer), "%s", MGOS_APP);
+  if (!ubuntu_gpio_fill_config(&req.config)) return false;
+  if (s_req_fd >= 0) {
+    ubuntu_irq_del(s_req_fd);
+    close(s_req_fd);
+    s_req_fd = -1;
+  }
+  if (ioctl(s_chip_fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+    LOG(LL_ERROR, ("Failed to request GPIO lines: %d", errno));
+    return false;
+  }
+  s_req_fd = req.fd;
+  fcntl(s_req_fd, F_SETFL, fcntl(s_req_fd, F_GETFL) | O_NONBLOCK);
+  return (ubuntu_irq_add(s_req_fd, ubuntu_gpio_irq, NULL) &&
+          ubuntu_irq_arm(s_req_fd, EPOLLIN));
+}
+
+static bool ubuntu_gpio_reconfigure(void) {
+  struct gpio_v2_line_config cfg;
+  if (!ubuntu_gpio_fill_config(&cfg)) return false;
+  if (ioctl(s_req_fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &cfg) < 0) {
+    LOG(LL_ERROR, ("Failed to configure GPIO lines: %d", errno));
+    return false;
+  }
+  return true;
+}
+
+// Returns the line, adding it to the request as an input if it's not in use.
+// Must be called with ints disabled.
+static struct ubuntu_gpio_line *ubuntu_gpio_get_line(int pin) {
+  struct ubuntu_gpio_line *l;
+  int i = ubuntu_gpio_find(pin);
+  if (i >= 0) return &s_lines[i];
+  if (s_chip_fd < 0 || pin < 0 || s_num_lines == UBUNTU_GPIO_MAX_LINES) {
+    return NULL;
+  }
+  l = &s_lines[s_num_lines++];
+  memset(l, 0, sizeof(*l));
+  l->pin = pin;
+  l->flags = GPIO_V2_LINE_FLAG_INPUT;
+  if (!ubuntu_gpio_request()) {
+    s_num_lines--;
+    // Get the rest of the lines back.
+    ubuntu_gpio_request();
+    return NULL;
+  }
+  return l;
+}
+
+// Sets flags in `mask` to `flags` and applies the change.
+static bool ubuntu_gpio_update_flags(int pin, uint64_t mask, uint64_t flags) {
+  struct ubuntu_gpio_line *l;
+  uint64_t old_flags;
+  bool res = false;
+  mgos_ints_disable();
+  l = ubuntu_gpio_get_line(pin);
+  if (l == NULL) goto out;
+  old_flags = l->flags;
+  l->flags = (l->flags & ~mask) | flags;
+  // Edge detection is only available on inputs.
+  if (l->flags & GPIO_V2_LINE_FLAG_OUTPUT) l->flags &= ~UBUNTU_GPIO_EDGE_FLAGS;
+  res = (l->flags == old_flags || ubuntu_gpio_reconfigure());
+  if (!res) l->flags = old_flags;
+out:
+  mgos_ints_enable();
+  return res;
+}
+
+static void ubuntu_gpio_irq(int fd, uint32_t events, void *arg) {
+  struct gpio_v2_line_event evs[UBUNTU_GPIO_EVENT_BATCH];
+  ssize_t n = read(fd, evs, sizeof(evs));
+  int i, j;
+  for (i = 0; i < n / (ssize_t) sizeof(evs[0]); i++) {
+    struct ubuntu_gpio_line *l;
+    j = ubuntu_gpio_find(evs[i].offset);
+    if (j < 0) continue;
+    l = &s_lines[j];
+    if (!l->int_enabled || evs[i].timestamp_ns < l->clear_ns) continue;
+    l->last_edge_ns = evs[i].timestamp_ns;
+    s_cur_event_ns = evs[i].timestamp_ns;
+    mgos_gpio_hal_int_cb(l->pin);
+    s_cur_event_ns = 0;
+  }
+  // Handlers may have re-requested the lines, the fd is gone then.
+  if (fd == s_req_fd) ubuntu_irq_arm(fd, EPOLLIN);
+  (void) events;
+  (void) arg;
+}
+
+bool mgos_gpio_set_mode(int pin, enum mgos_gpio_mode mode) {
+  uint64_t flags;
+  switch (mode) {
+    case MGOS_GPIO_MODE_INPUT:
+      flags = GPIO_V2_LINE_FLAG_INPUT;
+      break;
+    case MGOS_GPIO_MODE_OUTPUT:
+      flags = GPIO_V2_LINE_FLAG_OUTPUT;
+      break;
+    case MGOS_GPIO_MODE_OUTPUT_OD:
+      flags = GPIO_V2_LINE_FLAG_OUTPUT | GPIO_V2_LINE_FLAG_OPEN_DRAIN;
+      break;
+    default:
+      return false;
+  }
+  return ubuntu_gpio_update_flags(pin, UBUNTU_GPIO_DIR_FLAGS, flags);
+}
+
+bool mgos_gpio_set_pull(int pin, enum mgos_gpio_pull_type pull) {
+  uint64_t flags;
+  switch (pull) {
+    case MGOS_GPIO_PULL_NONE:
+      flags = GPIO_V2_LINE_FLAG_BIAS_DISABLED;
+      break;
+    case MGOS_GPIO_PULL_UP:
+      flags = GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+      break;
+    case MGOS_GPIO_PULL_DOWN:
+      flags = GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN;
+      break;
+    default:
+      return false;
+  }
+  return ubuntu_gpio_update_flags(pin, UBUNTU_GPIO_BIAS_FLAGS, flags);
+}
+
+bool ubuntu_gpio_read_many(int n, const int *pins, bool *values) {
+  struct gpio_v2_line_values lv = {0};
+  int i, j;
+  bool res = false;
+  mgos_ints_disable();
+  for (i = 0; i < n; i++) {
+    j = ubuntu_gpio_find(pins[i]);
+    if (j < 0) goto out;
+    lv.mask |= (1ULL << j);
+  }
+  if (ioctl(s_req_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &lv) < 0) goto out;
+  for (i = 0; i < n; i++) {
+    values[i] = !!(lv.bits & (1ULL << ubuntu_gpio_find(pins[i])));
+  }
+  res = true;
+out:
+  mgos_ints_enable();
+  return res;
+}
+
+bool mgos_gpio_read(int pin) {
+  bool v = false;
+  ubuntu_gpio_read_many(1, &pin, &v);
+  return v;
+}
+
+bool mgos_gpio_read_out(int pin) {
+  bool v = false;
+  int i;
+  mgos_ints_disable();
+  i = ubuntu_gpio_find(pin);
+  if (i >= 0) v = s_lines[i].out_value;
+  mgos_ints_enable();
+  return v;
+}
+
+void mgos_gpio_write(int pin, bool level) {
+  struct gpio_v2_line_values lv = {0};
+  int i;
+  mgos_ints_disable();
+  i = ubuntu_gpio_find(pin);
+  if (i >= 0) {
+    s_lines[i].out_value = level;
+    lv.mask = (1ULL << i);
+    lv.bits = (level ? lv.mask : 0);
+    ioctl(s_req_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &lv);
+  }
+  mgos_ints_enable();
+}
+
+bool mgos_gpio_setup_output(int pin, bool level) {
+  struct ubuntu_gpio_line *l;
+  mgos_ints_disable();
+  // Set the value first so that the line is driven to it right away.
+  l = ubuntu_gpio_get_line(pin);
+  if (l != NULL) l->out_value = level;
+  mgos_ints_enable();
+  return (l != NULL && mgos_gpio_set_mode(pin, MGOS_GPIO_MODE_OUTPUT));
+}
+
+bool mgos_gpio_hal_set_int_mode(int pin, enum mgos_gpio_int_mode mode) {
+  uint64_t flags;
+  switch (mode) {
+    case MGOS_GPIO_INT_NONE:
+      flags = 0;
+      break;
+    case MGOS_GPIO_INT_EDGE_POS:
+      flags = GPIO_V2_LINE_FLAG_EDGE_RISING;
+      break;
+    case MGOS_GPIO_INT_EDGE_NEG:
+      flags = GPIO_V2_LINE_FLAG_EDGE_FALLING;
+      break;
+    case MGOS_GPIO_INT_EDGE_ANY:
+      flags = UBUNTU_GPIO_EDGE_FLAGS;
+      break;
+    default:
+      return false;
+  }
+  if (flags != 0) {
+    // Edge detection is only available on inputs.
+    struct ubuntu_gpio_line *l;
+    bool is_output;
+    mgos_ints_disable();
+    l = ubuntu_gpio_get_line(pin);
+    is_output = (l != NULL && (l->flags & GPIO_V2_LINE_FLAG_OUTPUT));
+    mgos_ints_enable();
+    if (l == NULL || is_output) return false;
+  }
+  return ubuntu_gpio_update_flags(pin, UBUNTU_GPIO_EDGE_FLAGS, flags);
+}
 
+bool mgos_gpio_hal_enable_int(int pin) {
+  bool res = false;
+  int i;
+  mgos_ints_disable();
+  i = ubuntu_gpio_find(pin);
+  if (i >= 0 && (s_lines[i].flags & UBUNTU_GPIO_EDGE_FLAGS)) {
+    s_lines[i].int_enabled = true;
+    res = true;
+  }
+  mgos_ints_enable();
+  return res;
+}
+
+bool mgos_gpio_hal_disable_int(int pin) {
+  int i;
+  mgos_ints_disable();
+  i = ubuntu_gpio_find(pin);
+  if (i >= 0) s_lines[i].int_enabled = false;
+  mgos_ints_enable();
+  return (i >= 0);
+}
+
+void mgos_gpio_hal_clear_int(int pin) {
+  int i;
+  mgos_ints_disable();
+  i = ubuntu_gpio_find(pin);
+  if (i >= 0) {
+    // In the handler, only clear up to the event being handled, the ones that
+    // came after it are still pending.
+    s_lines[i].clear_ns =
+        (s_cur_event_ns != 0 ? s_cur_event_ns + 1 : ubuntu_gpio_now_ns());
+  }
+  mgos_ints_enable();
+}
+
+uint64_t ubuntu_gpio_last_edge_ns(int pin) {
+  uint64_t res = 0;
+  int i;
+  mgos_ints_disable();
+  i = ubuntu_gpio_find(pin);
+  if (i >= 0) res = s_lines[i].last_edge_ns;
+  mgos_ints_enable();
+  return res;
+}
+
+enum mgos_init_result mgos_gpio_hal_init(void) {
+  s_chip_fd = ubuntu_ipc_open(Flags.gpio_chip, O_RDWR | O_CLOEXEC);
+  if (s_chip_fd < 0) {
+    // Not an error, there may be no GPIOs on this machine.
+    LOG(LL_INFO, ("%s is not available, GPIO disabled", Flags.gpio_chip));
+  }
+  return MGOS_INIT_OK;
+}
+
+#else /* GPIO_V2_GET_LINE_IOCTL */
+
+// Built against kernel headers without GPIO uAPI v2, no GPIO support.
+
+bool mgos_gpio_set_mode(int pin, enum mgos_gpio_mode mode) {
+  return false;
   (void) pin;
   (void) mode;
 }
 
 bool mgos_gpio_set_pull(int pin, enum mgos_gpio_pull_type pull) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return true;
-
+  return false;
   (void) pin;
   (void) pull;
 }
 
-bool mgos_gpio_read(int pin) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return true;
+bool ubuntu_gpio_read_many(int n, const int *pins, bool *values) {
+  return false;
+  (void) n;
+  (void) pins;
+  (void) values;
+}
 
+bool mgos_gpio_read(int pin) {
+  return false;
   (void) pin;
 }
 
 bool mgos_gpio_read_out(int pin) {
-  LOG(LL_INFO, ("Not implemented yet"));
   return false;
   (void) pin;
 }
 
 void mgos_gpio_write(int pin, bool level) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return;
-
   (void) pin;
   (void) level;
 }
 
-bool mgos_gpio_toggle(int pin) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return true;
-
+bool mgos_gpio_setup_output(int pin, bool level) {
+  return false;
   (void) pin;
+  (void) level;
 }
 
-bool mgos_gpio_enable_int(int pin) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return true;
-
+bool mgos_gpio_hal_set_int_mode(int pin, enum mgos_gpio_int_mode mode) {
+  return (mode == MGOS_GPIO_INT_NONE);
   (void) pin;
 }
 
-bool mgos_gpio_disable_int(int pin) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return true;
-
+bool mgos_gpio_hal_enable_int(int pin) {
+  return false;
   (void) pin;
 }
 
-bool mgos_gpio_hal_set_int_mode(int pin, enum mgos_gpio_int_mode mode) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return true;
-
+bool mgos_gpio_hal_disable_int(int pin) {
+  return false;
   (void) pin;
-  (void) mode;
 }
 
-void mgos_gpio_hal_int_cb(int pin) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return;
-
+void mgos_gpio_hal_clear_int(int pin) {
   (void) pin;
 }
 
-bool mgos_gpio_setup_output(int pin, bool level) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return false;
+uint64_t ubuntu_gpio_last_edge_ns(int pin) {
+  return 0;
   (void) pin;
-  (void) level;
 }
 
 enum mgos_init_result mgos_gpio_hal_init(void) {
-  LOG(LL_INFO, ("Not implemented yet"));
+  LOG(LL_INFO, ("Built without GPIO support"));
   return MGOS_INIT_OK;
 }
+
+#endif /* GPIO_V2_GET_LINE_IOCTL */
+
+const char *mgos_gpio_str(int pin_def, char buf[8]) {
+  snprintf(buf, 8, "%d", pin_def);
+  buf[7] = '\0';
+  return buf;
+}
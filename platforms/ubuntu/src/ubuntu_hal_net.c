@@ -25,21 +25,21 @@
 
 static bool mgos_eth_dev_get_default_gateway(char *dev, size_t devlen,
                                              struct sockaddr_in *gw) {
-  int fd;
   FILE *f = NULL;
-  char line[100], *p, *c, *g, *saveptr;
+  char buf[4096], line[100], *p, *c, *g, *saveptr;
+  ssize_t len;
   bool ret = false;
 
   if (!dev || !gw) {
     return false;
   }
 
-  fd = ubuntu_ipc_open("/proc/net/route", O_RDONLY);
-  if (fd < 0) {
+  len = ubuntu_ipc_read_file("/proc/net/route", buf, sizeof(buf));
+  if (len < 0) {
     LOG(LL_ERROR, ("Could not open /proc/net/route"));
     return false;
   }
-  f = fdopen(fd, "r");
+  f = fmemopen(buf, len, "r");
   if (!f) {
     return false;
   }
@@ -67,7 +67,6 @@ static bool mgos_eth_dev_get_default_gateway(char *dev, size_t devlen,
   }
 
   fclose(f);
-  close(fd);
   return ret;
 }
 
@@ -137,19 +136,15 @@ void device_get_mac_address(uint8_t mac[6]) {
   int i;
 
   if (mgos_eth_dev_get_default_gateway(gw_dev, sizeof(gw_dev), &gw)) {
-    char buf[100];
+    char path[100], buf[100];
     int hex[6];
-    int fd;
     int len;
-    snprintf(buf, sizeof(buf), "/sys/class/net/%s/address", gw_dev);
-    if (!(fd = ubuntu_ipc_open(buf, O_RDONLY))) {
-      goto fallback;
-    }
-    len = read(fd, buf, sizeof(buf));
-    close(fd);
+    snprintf(path, sizeof(path), "/sys/class/net/%s/address", gw_dev);
+    len = ubuntu_ipc_read_file(path, buf, sizeof(buf) - 1);
     if (len < 17) {
       goto fallback;
     }
+    buf[len] = '\0';
 
     len = sscanf(buf, "%x:%x:%x:%x:%x:%x", &hex[0], &hex[1], &hex[2], &hex[3],
                  &hex[4], &hex[5]);
@@ -172,48 +172,26 @@ bool ubuntu_set_nsleep100(void) {
   return true;
 }
 
-void mgos_ints_disable(void) {
-  // LOG(LL_INFO, ("Not implemented"));
-  return;
-}
-
-void mgos_ints_enable(void) {
-  // LOG(LL_INFO, ("Not implemented"));
-  return;
-}
-
 uint32_t mgos_get_cpu_freq(void) {
-  int fd = ubuntu_ipc_open("/proc/cpuinfo", O_RDONLY);
   char *p;
-  char buf[2048];
+  char buf[4096];
   ssize_t len;
-  uint32_t freq = 0;
+  long mhz;
 
-  if (!fd) {
+  // The first processor's entry is enough.
+  len = ubuntu_ipc_read_file("/proc/cpuinfo", buf, sizeof(buf) - 1);
+  if (len < 0) {
     LOG(LL_ERROR, ("Cannot open /proc/cpuinfo"));
-    goto exit;
+    return 0;
   }
-  len = read(fd, buf, 2048);
-  p = NULL;
-  while (len > 0 && !p) {
-    long mhz;
-
-    p = strstr(buf, "cpu MHz");
-    p += 7;
-    while (*p && (isspace(*p) || *p == ':')) {
-      p++;
-    }
-    mhz = atol(p);
-    if (mhz > 0) {
-      freq = mhz * 1e6;
-      goto exit;
-    }
-    len = read(fd, buf, 2048);
+  buf[len] = '\0';
+  if ((p = strstr(buf, "cpu MHz")) == NULL) {
+    return 0;
   }
-
-exit:
-  if (fd > 0) {
-    close(fd);
+  p += 7;
+  while (*p && (isspace(*p) || *p == ':')) {
+    p++;
   }
-  return freq;
+  mhz = atol(p);
+  return (mhz > 0 ? mhz * 1e6 : 0);
 }
@@ -14,66 +14,70 @@
  * limitations under the License.
  */
 
-#include <malloc.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <sys/time.h>
+// HW timers: the mux comparator (see mgos_hw_timers_mux.c) is a
+// CLOCK_MONOTONIC timerfd, delivered as a simulated interrupt by ubuntu_irq.
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "mgos_hw_timers_hal.h"
 #include "ubuntu.h"
 
-bool mgos_hw_timers_dev_set(struct mgos_hw_timer_info *ti, int usecs,
-                            int flags) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return true;
-
-  (void) ti;
-  (void) usecs;
-  (void) flags;
-}
-
-void mgos_hw_timers_isr(struct mgos_hw_timer_info *ti) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return;
-
-  (void) ti;
-}
-
-void mgos_hw_timers_dev_isr_bottom(struct mgos_hw_timer_info *ti) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return;
+static int s_tfd = -1;
 
-  (void) ti;
+uint32_t mgos_hw_timers_mux_dev_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
 }
 
-void mgos_hw_timers_dev_clear(struct mgos_hw_timer_info *ti) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return;
-
-  (void) ti;
+void mgos_hw_timers_mux_dev_arm(uint32_t when) {
+  struct itimerspec its = {0};
+  int32_t delta = (int32_t)(when - mgos_hw_timers_mux_dev_now());
+  // Zero would disarm the timer.
+  if (delta < 1) delta = 1;
+  its.it_value.tv_sec = delta / 1000000;
+  its.it_value.tv_nsec = (delta % 1000000) * 1000;
+  timerfd_settime(s_tfd, 0, &its, NULL);
+  ubuntu_irq_arm(s_tfd, EPOLLIN);
 }
 
-bool mgos_hw_timers_dev_init(struct mgos_hw_timer_info *ti) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return true;
-
-  (void) ti;
+void mgos_hw_timers_mux_dev_disarm(void) {
+  struct itimerspec its = {0};
+  timerfd_settime(s_tfd, 0, &its, NULL);
+  ubuntu_irq_arm(s_tfd, 0);
 }
 
-enum mgos_init_result mgos_hw_timers_init(void) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return MGOS_INIT_OK;
+static void ubuntu_hw_timers_irq(int fd, uint32_t events, void *arg) {
+  uint64_t n;
+  // Acknowledge the expiration. May have been re-armed since it fired,
+  // in which case there's nothing to read, but the ISR is harmless.
+  if (read(fd, &n, sizeof(n)) < 0 && errno != EAGAIN) return;
+  mgos_hw_timers_mux_isr();
+  (void) events;
+  (void) arg;
 }
 
-void mgos_hw_timers_deinit(void) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return;
+bool mgos_hw_timers_mux_dev_init(void) {
+  s_tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (s_tfd < 0) {
+    LOG(LL_ERROR, ("timerfd_create failed: %d", errno));
+    return false;
+  }
+  return ubuntu_irq_add(s_tfd, ubuntu_hw_timers_irq, NULL);
 }
 
-void mgos_clear_hw_timer(mgos_timer_id id) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return;
-
-  (void) id;
+void ubuntu_hw_timers_log_stats(void) {
+  struct mgos_hw_timers_mux_stats st;
+  mgos_hw_timers_mux_get_stats(&st);
+  if (st.num_calls == 0) return;
+  LOG(LL_INFO, ("HW timers: %u calls in %u ISRs, lateness avg %u max %u us, "
+                "ISR latency %u us",
+                (unsigned) st.num_calls, (unsigned) st.num_isrs,
+                (unsigned) (st.sum_late / st.num_calls),
+                (unsigned) st.max_late, (unsigned) st.latency));
 }
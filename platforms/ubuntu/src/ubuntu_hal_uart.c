@@ -14,72 +14,297 @@
  * limitations under the License.
  */
 
-#include <malloc.h>
+// UART on top of a tty device or a pseudo-terminal.
+//
+// The fd is non-blocking and is registered as a simulated interrupt source
+// (see ubuntu_irq.c): readability / writability schedules the dispatcher,
+// which moves data between the fd and rx/tx buffers in bulk.
+// A device that goes away (USB adapter unplugged, pty peer closed) is closed;
+// from then on the UART behaves as one with no device until reconfigured.
+
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
 
 #include "mgos_uart_hal.h"
 #include "ubuntu.h"
+#include "ubuntu_ipc.h"
 
-bool mgos_uart_hal_init(struct mgos_uart_state *us) {
-  LOG(LL_INFO, ("Not implemented yet"));
+extern struct ubuntu_flags Flags;
+
+struct ubuntu_uart_state {
+  int fd;
+  // Slave side of our pty, kept open so that reads on the master do not
+  // fail with EIO while nobody is attached.
+  int pty_slave_fd;
+  char *dev;
+  // Hangup or error reported by the device, set by the interrupt handler or
+  // by a failed read or write.
+  bool gone;
+};
+
+static const struct {
+  int baud_rate;
+  speed_t speed;
+} s_speeds[] = {
+    {1200, B1200},       {2400, B2400},       {4800, B4800},
+    {9600, B9600},       {19200, B19200},     {38400, B38400},
+    {57600, B57600},     {115200, B115200},   {230400, B230400},
+    {460800, B460800},   {500000, B500000},   {576000, B576000},
+    {921600, B921600},   {1000000, B1000000}, {1152000, B1152000},
+    {1500000, B1500000}, {2000000, B2000000}, {2500000, B2500000},
+    {3000000, B3000000}, {3500000, B3500000}, {4000000, B4000000},
+};
+
+static void ubuntu_uart_irq(int fd, uint32_t events, void *arg) {
+  struct mgos_uart_state *us = (struct mgos_uart_state *) arg;
+  struct ubuntu_uart_state *uds = (struct ubuntu_uart_state *) us->dev_data;
+  us->stats.ints++;
+  if (events & (EPOLLHUP | EPOLLERR)) uds->gone = true;
+  if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) us->stats.rx_ints++;
+  if (events & EPOLLOUT) us->stats.tx_ints++;
+  mgos_uart_schedule_dispatcher(us->uart_no, true /* from_isr */);
+  (void) fd;
+}
+
+static int ubuntu_uart_open_pty(struct mgos_uart_state *us) {
+  struct ubuntu_uart_state *uds = (struct ubuntu_uart_state *) us->dev_data;
+  int unlock = 0;
+  unsigned int pty_no;
+  // Opened by the main process, /dev/ptmx is likely not in our chroot.
+  int fd = ubuntu_ipc_open("/dev/ptmx", O_RDWR | O_NOCTTY);
+  if (fd < 0) return -1;
+  // Not grantpt() / ptsname(): they stat() the slave path.
+  if (ioctl(fd, TIOCSPTLCK, &unlock) != 0 || ioctl(fd, TIOCGPTN, &pty_no) != 0) {
+    LOG(LL_ERROR, ("UART%d: failed to set up pty: %d", us->uart_no, errno));
+    close(fd);
+    return -1;
+  }
+#ifdef TIOCGPTPEER
+  uds->pty_slave_fd = ioctl(fd, TIOCGPTPEER, O_RDWR | O_NOCTTY);
+#endif
+  LOG(LL_INFO, ("UART%d: /dev/pts/%u", us->uart_no, pty_no));
+  return fd;
+}
+
+static void ubuntu_uart_close(struct ubuntu_uart_state *uds) {
+  if (uds->fd >= 0) {
+    ubuntu_irq_del(uds->fd);
+    close(uds->fd);
+    uds->fd = -1;
+  }
+  if (uds->pty_slave_fd >= 0) {
+    close(uds->pty_slave_fd);
+    uds->pty_slave_fd = -1;
+  }
+  free(uds->dev);
+  uds->dev = NULL;
+  uds->gone = false;
+}
+
+static bool ubuntu_uart_io_error(int err) {
+  return (err != EAGAIN && err != EWOULDBLOCK && err != EINTR);
+}
+
+static bool ubuntu_uart_open(struct mgos_uart_state *us, const char *dev) {
+  struct ubuntu_uart_state *uds = (struct ubuntu_uart_state *) us->dev_data;
+  int fd;
+  if (strcmp(dev, "pty") == 0) {
+    fd = ubuntu_uart_open_pty(us);
+  } else {
+    fd = ubuntu_ipc_open(dev, O_RDWR | O_NOCTTY);
+  }
+  if (fd < 0) {
+    LOG(LL_ERROR, ("UART%d: failed to open %s", us->uart_no, dev));
+    return false;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  if (!ubuntu_irq_add(fd, ubuntu_uart_irq, us)) {
+    close(fd);
+    return false;
+  }
+  uds->fd = fd;
+  uds->dev = strdup(dev);
+  return true;
+}
+
+static bool ubuntu_uart_set_termios(struct mgos_uart_state *us,
+                                    const struct mgos_uart_config *cfg) {
+  struct ubuntu_uart_state *uds = (struct ubuntu_uart_state *) us->dev_data;
+  struct termios t;
+  size_t i;
+  if (tcgetattr(uds->fd, &t) != 0) {
+    LOG(LL_ERROR, ("UART%d: tcgetattr failed: %d", us->uart_no, errno));
+    return false;
+  }
+  cfmakeraw(&t);
+  for (i = 0; i < sizeof(s_speeds) / sizeof(s_speeds[0]); i++) {
+    if (s_speeds[i].baud_rate == cfg->baud_rate) break;
+  }
+  if (i == sizeof(s_speeds) / sizeof(s_speeds[0])) {
+    LOG(LL_ERROR, ("UART%d: unsupported baud rate %d", us->uart_no,
+                   cfg->baud_rate));
+    return false;
+  }
+  cfsetispeed(&t, s_speeds[i].speed);
+  cfsetospeed(&t, s_speeds[i].speed);
+  t.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS);
+  t.c_cflag |= CLOCAL | CREAD;
+  switch (cfg->num_data_bits) {
+    case 5:
+      t.c_cflag |= CS5;
+      break;
+    case 6:
+      t.c_cflag |= CS6;
+      break;
+    case 7:
+      t.c_cflag |= CS7;
+      break;
+    case 8:
+      t.c_cflag |= CS8;
+      break;
+    default:
+      return false;
+  }
+  switch (cfg->parity) {
+    case MGOS_UART_PARITY_NONE:
+      break;
+    case MGOS_UART_PARITY_EVEN:
+      t.c_cflag |= PARENB;
+      break;
+    case MGOS_UART_PARITY_ODD:
+      t.c_cflag |= PARENB | PARODD;
+      break;
+  }
+  switch (cfg->stop_bits) {
+    case MGOS_UART_STOP_BITS_1:
+      break;
+    case MGOS_UART_STOP_BITS_2:
+      t.c_cflag |= CSTOPB;
+      break;
+    case MGOS_UART_STOP_BITS_1_5:
+      // Not supported by termios.
+      return false;
+  }
+  // Software flow control is done by the common code.
+  if (cfg->rx_fc_type == MGOS_UART_FC_HW || cfg->tx_fc_type == MGOS_UART_FC_HW) {
+    t.c_cflag |= CRTSCTS;
+  }
+  // With VMIN 0 read() returns 0 when there is no data, even on a
+  // non-blocking fd. With 1 it fails with EAGAIN, and 0 means hangup.
+  t.c_cc[VMIN] = 1;
+  t.c_cc[VTIME] = 0;
+  if (tcsetattr(uds->fd, TCSANOW, &t) != 0) {
+    LOG(LL_ERROR, ("UART%d: tcsetattr failed: %d", us->uart_no, errno));
+    return false;
+  }
   return true;
+}
 
-  (void) us;
+static void ubuntu_uart_arm(struct mgos_uart_state *us) {
+  struct ubuntu_uart_state *uds = (struct ubuntu_uart_state *) us->dev_data;
+  uint32_t events = 0;
+  if (uds->fd < 0) return;
+  if (uds->gone) {
+    // Re-arming would report the hangup again, over and over.
+    LOG(LL_ERROR, ("UART%d: %s is gone", us->uart_no, uds->dev));
+    ubuntu_uart_close(uds);
+    return;
+  }
+  if (us->rx_enabled && mgos_uart_rxb_free(us) > 0) events |= EPOLLIN;
+  if (us->tx_buf.len > 0) events |= EPOLLOUT;
+  ubuntu_irq_arm(uds->fd, events);
+}
+
+bool mgos_uart_hal_init(struct mgos_uart_state *us) {
+  struct ubuntu_uart_state *uds =
+      (struct ubuntu_uart_state *) calloc(1, sizeof(*uds));
+  if (uds == NULL) return false;
+  uds->fd = -1;
+  uds->pty_slave_fd = -1;
+  us->dev_data = uds;
+  return true;
 }
 
 bool mgos_uart_hal_configure(struct mgos_uart_state *us,
                              const struct mgos_uart_config *cfg) {
-  LOG(LL_INFO, ("Not implemented yet"));
+  struct ubuntu_uart_state *uds = (struct ubuntu_uart_state *) us->dev_data;
+  const char *dev = cfg->dev.dev;
+  if (dev == NULL || uds->dev == NULL || strcmp(dev, uds->dev) != 0) {
+    ubuntu_uart_close(uds);
+    if (dev != NULL && !ubuntu_uart_open(us, dev)) return false;
+  }
+  if (uds->fd >= 0 && !ubuntu_uart_set_termios(us, cfg)) return false;
   return true;
-
-  (void) us;
-  (void) cfg;
 }
 
 void mgos_uart_hal_config_set_defaults(int uart_no,
                                        struct mgos_uart_config *cfg) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return;
-
-  (void) uart_no;
-  (void) cfg;
+  cfg->dev.dev = Flags.uart_dev[uart_no];
 }
 
 void mgos_uart_hal_dispatch_rx_top(struct mgos_uart_state *us) {
-  //  LOG(LL_INFO, ("rx: Not implemented yet"));
-  return;
-
-  (void) us;
+  struct ubuntu_uart_state *uds = (struct ubuntu_uart_state *) us->dev_data;
+  struct mbuf *rxb = &us->rx_buf;
+  size_t rx_free;
+  if (uds->fd < 0) return;
+  while ((rx_free = mgos_uart_rxb_free(us)) > 0) {
+    ssize_t n;
+    if (rxb->size < rxb->len + rx_free) mbuf_resize(rxb, rxb->len + rx_free);
+    n = read(uds->fd, rxb->buf + rxb->len, rx_free);
+    // The fd is non-blocking: 0 is a hangup, not "no data".
+    if (n == 0 || (n < 0 && ubuntu_uart_io_error(errno))) uds->gone = true;
+    if (n <= 0) break;
+    rxb->len += n;
+    us->stats.rx_bytes += n;
+    if ((size_t) n < rx_free) break;
+  }
 }
 
 void mgos_uart_hal_dispatch_tx_top(struct mgos_uart_state *us) {
-  //  LOG(LL_INFO, ("tx: Not implemented yet"));
-  return;
-
-  (void) us;
+  struct ubuntu_uart_state *uds = (struct ubuntu_uart_state *) us->dev_data;
+  struct mbuf *txb = &us->tx_buf;
+  ssize_t n;
+  if (txb->len == 0) return;
+  if (uds->fd < 0) {
+    // Not connected, the bits go nowhere.
+    us->stats.tx_bytes += txb->len;
+    mbuf_remove(txb, txb->len);
+    return;
+  }
+  n = write(uds->fd, txb->buf, txb->len);
+  if (n > 0) {
+    mbuf_remove(txb, n);
+    us->stats.tx_bytes += n;
+  } else if (n < 0 && ubuntu_uart_io_error(errno)) {
+    uds->gone = true;
+    us->stats.tx_bytes += txb->len;
+    mbuf_remove(txb, txb->len);
+  } else if (n < 0 && errno == EAGAIN && uds->pty_slave_fd >= 0 &&
+             us->cfg.tx_fc_type != MGOS_UART_FC_HW) {
+    // Nobody is reading the pty. A real wire does not wait for the receiver,
+    // and neither should mgos_uart_flush().
+    mbuf_remove(txb, txb->len);
+  }
 }
 
 void mgos_uart_hal_dispatch_bottom(struct mgos_uart_state *us) {
-  //  LOG(LL_INFO, ("bottom: Not implemented yet"));
-  return;
-
-  (void) us;
+  ubuntu_uart_arm(us);
 }
 
 void mgos_uart_hal_flush_fifo(struct mgos_uart_state *us) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return;
-
-  (void) us;
+  struct ubuntu_uart_state *uds = (struct ubuntu_uart_state *) us->dev_data;
+  if (uds->fd >= 0 && uds->pty_slave_fd < 0) tcdrain(uds->fd);
 }
 
 void mgos_uart_hal_set_rx_enabled(struct mgos_uart_state *us, bool enabled) {
-  LOG(LL_INFO, ("Not implemented yet"));
-  return;
-
-  (void) us;
+  ubuntu_uart_arm(us);
   (void) enabled;
 }
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2019 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  // For PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+#endif
+
+#include "ubuntu.h"
+
+#if MGOS_ENABLE_HEAP_LOG
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "common/cs_heap_log.h"
+
+// Heap log malloc shim. The linker is told to --wrap malloc and friends
+// (see Makefile.build), so this sees all allocations made by mgos, mongoose
+// and the app, but not the ones libc makes internally. The record stream is
+// the same as on esp8266 and can be fed to tools/heaplog_viewer.
+
+// Only used to size the viewer's heap map, mmap()ed chunks will be outside.
+#define UBUNTU_HEAP_LOG_SPAN (64 * 1024 * 1024)
+
+extern void *__real_malloc(size_t size);
+extern void *__real_calloc(size_t num, size_t size);
+extern void *__real_realloc(void *ptr, size_t size);
+extern void __real_free(void *ptr);
+
+static pthread_mutex_t s_hlog_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static bool s_hlog_inited = false;
+
+static void hlog_record(enum cs_hlog_type type, size_t size, void *ptr,
+                        void *old_ptr) {
+  pthread_mutex_lock(&s_hlog_lock);
+  if (!s_hlog_inited) {
+    uintptr_t start = (uintptr_t) sbrk(0);
+    cs_hlog_init(start, start + UBUNTU_HEAP_LOG_SPAN);
+    s_hlog_inited = true;
+  }
+  cs_hlog_record(type, size, ptr, old_ptr, true /* shim */);
+  pthread_mutex_unlock(&s_hlog_lock);
+}
+
+static void hlog_out(const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(STDERR_FILENO, data, len);
+    if (n <= 0) break;
+    data += n;
+    len -= n;
+  }
+}
+
+void ubuntu_heap_log_flush(void) {
+  pthread_mutex_lock(&s_hlog_lock);
+  cs_hlog_set_output(hlog_out);
+  cs_hlog_flush();
+  pthread_mutex_unlock(&s_hlog_lock);
+}
+
+void *__wrap_malloc(size_t size) {
+  void *ret = __real_malloc(size);
+  hlog_record(CS_HLOG_MALLOC, size, ret, NULL);
+  return ret;
+}
+
+void *__wrap_calloc(size_t num, size_t size) {
+  void *ret = __real_calloc(num, size);
+  hlog_record(CS_HLOG_CALLOC, num * size, ret, NULL);
+  return ret;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  void *ret = __real_realloc(ptr, size);
+  hlog_record(CS_HLOG_REALLOC, size, ret, ptr);
+  return ret;
+}
+
+void __wrap_free(void *ptr) {
+  if (ptr == NULL) return;
+  hlog_record(CS_HLOG_FREE, 0, ptr, NULL);
+  __real_free(ptr);
+}
+
+#endif /* MGOS_ENABLE_HEAP_LOG */
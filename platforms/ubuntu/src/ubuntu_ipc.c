@@ -22,10 +22,18 @@
 
 struct ubuntu_pipe s_pipe;
 
+extern struct ubuntu_flags Flags;
+
 static int ubuntu_ipc_handle_open(const char *pathname, int flags) {
-  const char *patterns[] = {"/dev/i2c-*", "/dev/spidev*.*", "/proc/cpuinfo",
-                            "/sys/class/net/*/address", "/proc/net/route",
-                            NULL};
+  // Only serial port families: /dev/tty and the virtual consoles accept input
+  // injection (TIOCSTI) and must not be handed to the child.
+  const char *patterns[] = {"/dev/i2c-*",      "/dev/spidev*.*",
+                            "/dev/ttyS*",      "/dev/ttyUSB*",
+                            "/dev/ttyACM*",    "/dev/ttyAMA*",
+                            "/dev/serial/by-id/*", "/dev/ptmx",
+                            "/dev/gpiochip*",  "/proc/cpuinfo",
+                            "/sys/class/net/*/address",
+                            "/proc/net/route", NULL};
   int i;
   bool ok = false;
 
@@ -35,6 +43,13 @@ static int ubuntu_ipc_handle_open(const char *pathname, int flags) {
       break;
     }
   }
+  // Devices given with --uart are allowed as is.
+  for (i = 0; !ok && i < MGOS_MAX_NUM_UARTS; i++) {
+    if (Flags.uart_dev[i] != NULL && strcmp(Flags.uart_dev[i], "pty") != 0 &&
+        strcmp(Flags.uart_dev[i], pathname) == 0) {
+      ok = true;
+    }
+  }
   if (!ok) {
     LOG(LL_ERROR, ("Refusing to open '%s'", pathname));
     return -1;
@@ -42,11 +57,10 @@ static int ubuntu_ipc_handle_open(const char *pathname, int flags) {
   return open(pathname, flags);
 }
 
-bool ubuntu_ipc_handle(uint16_t timeout_ms) {
-  fd_set rfds;
-  struct timeval tv;
-  int retval;
-  size_t _len;
+// Handles one request. Returns 1 if handled, 0 if there was nothing to read
+// and -1 if the pipe is broken.
+static int ubuntu_ipc_handle_msg(void) {
+  ssize_t _len;
   struct msghdr msg;
   struct iovec iov[1];
   struct ubuntu_pipe_message iovec_payload;
@@ -56,22 +70,6 @@ bool ubuntu_ipc_handle(uint16_t timeout_ms) {
   } control_un;
   int fd = -1;
 
-  FD_ZERO(&rfds);
-  FD_SET(s_pipe.main_fd, &rfds);
-
-  tv.tv_sec = 0;
-  tv.tv_usec = timeout_ms * 1000;
-
-  //  LOG(LL_INFO, ("Selecting for %u ms", timeout_ms));
-  retval = select(FD_SETSIZE, &rfds, NULL, NULL, &tv);
-  if (retval < 0) {
-    LOGM(LL_ERROR, ("Cannot not select"));
-    return false;
-  } else if (retval == 0) {
-    //    LOG(LL_INFO, ("No data within %u ms", timeout_ms));
-    return true;
-  }
-
   memset(&msg, 0, sizeof(struct msghdr));
   memset(&iovec_payload, 0, sizeof(struct ubuntu_pipe_message));
   iov[0].iov_base = (void *) &iovec_payload;
@@ -79,9 +77,12 @@ bool ubuntu_ipc_handle(uint16_t timeout_ms) {
   msg.msg_iov = iov;
   msg.msg_iovlen = 1;
 
-  _len = recvmsg(s_pipe.main_fd, &msg, 0);
+  _len = recvmsg(s_pipe.main_fd, &msg, MSG_DONTWAIT);
+  if (_len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return 0;
+  }
   if (_len <= 0) {
-    return false;
+    return -1;
   }
   // LOG(LL_INFO, ("Received: cmd=%d len=%u msg='%.*s'", iovec_payload.cmd,
   // iovec_payload.len, (int)iovec_payload.len, (char *)iovec_payload.data));
@@ -145,15 +146,49 @@ bool ubuntu_ipc_handle(uint16_t timeout_ms) {
   msg.msg_iov = iov;
   msg.msg_iovlen = 1;
   _len = sendmsg(s_pipe.main_fd, &msg, 0);
-  if (_len <= 0) {
-    return false;
-  }
   if (fd > 0) {
     close(fd);  // Close the UBUNTU_CMD_OPEN fd in parent
   }
+  if (_len <= 0) {
+    return -1;
+  }
   //  LOG(LL_INFO, ("Sent: cmd=%d len=%u msg='%.*s' fd=%d", iovec_payload.cmd,
   //  iovec_payload.len, (int)iovec_payload.len, (char *)iovec_payload.data,
   //  fd));
+  return 1;
+}
+
+bool ubuntu_ipc_handle(uint16_t timeout_ms) {
+  fd_set rfds;
+  struct timeval tv;
+  int retval, i;
+
+  FD_ZERO(&rfds);
+  FD_SET(s_pipe.main_fd, &rfds);
+
+  tv.tv_sec = 0;
+  tv.tv_usec = timeout_ms * 1000;
+
+  //  LOG(LL_INFO, ("Selecting for %u ms", timeout_ms));
+  retval = select(FD_SETSIZE, &rfds, NULL, NULL, &tv);
+  if (retval < 0) {
+    LOGM(LL_ERROR, ("Cannot not select"));
+    return false;
+  } else if (retval == 0) {
+    //    LOG(LL_INFO, ("No data within %u ms", timeout_ms));
+    return true;
+  }
+
+  // Requests may be pipelined, handle everything that's queued up (within
+  // reason, the caller needs to check on the watchdog and the child too).
+  for (i = 0; i < UBUNTU_IPC_MAX_BATCH; i++) {
+    retval = ubuntu_ipc_handle_msg();
+    if (retval < 0) {
+      return false;
+    } else if (retval == 0) {
+      break;
+    }
+  }
   return true;
 }
 
@@ -164,7 +199,7 @@ bool ubuntu_ipc_init(void) {
     mgos_rlock_destroy(s_pipe.lock);
   }
   s_pipe.lock = mgos_rlock_create();
-  if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, fd)) {
+  if (0 != socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fd)) {
     LOG(LL_ERROR, ("Can't create socketpair(): %s", strerror(errno)));
     return false;
   }
@@ -23,6 +23,8 @@
 //
 // The main thread creates a socket pair (with ubuntu_ipc_init()) and
 // passes the client file descriptor on to the Mongoose thread.
+// It is a SOCK_SEQPACKET pair, so requests can be pipelined: replies come
+// back in order, one per request.
 //
 // Usage:
 // #include "ubuntu_ipc.h"
@@ -40,6 +42,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/types.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -67,9 +70,32 @@ struct ubuntu_pipe_message {
   uint8_t data[256];
 };
 
+// Max number of requests handled per wakeup of the Main process, and in
+// flight at a time from ubuntu_ipc_open_many().
+#define UBUNTU_IPC_MAX_BATCH 32
+
+// ubuntu_ipc_read_file() of /proc and /sys files is served from a cache of
+// fds that were opened once, without a round trip to the Main process. The
+// fds never leave the cache: each read is a pread() from offset 0, so callers
+// do not share a file offset.
+#ifndef UBUNTU_IPC_FD_CACHE
+#define UBUNTU_IPC_FD_CACHE 1
+#endif
+#define UBUNTU_IPC_FD_CACHE_SIZE 8
+
 // Helper -- perform open() on the Main process, and return the filedescriptor.
 int ubuntu_ipc_open(const char *pathname, int flags);
 
+// Reads up to len bytes from the start of pathname, opened read-only on the
+// Main process. Returns the number of bytes read, or -1 on error.
+ssize_t ubuntu_ipc_read_file(const char *pathname, void *buf, size_t len);
+
+// Same as ubuntu_ipc_open() for n files, with requests pipelined.
+// fds[i] is set to -1 for files that failed to open.
+// Returns the number of files opened.
+int ubuntu_ipc_open_many(int n, const char *const *pathnames,
+                         const int *flags, int *fds);
+
 // Send a ping message from Mongoose to Main and back.
 void ubuntu_ipc_ping(void);
 
@@ -14,7 +14,10 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <fnmatch.h>
+#include <unistd.h>
 
 #include "mgos_system.h"
 #include "ubuntu.h"
@@ -61,46 +64,46 @@ exit:
   return ret;
 }
 
-int ubuntu_ipc_open(const char *pathname, int flags) {
+static bool ubuntu_ipc_send_open(const char *pathname, int flags) {
   ssize_t len;
   struct msghdr msg;
   struct iovec iov[1];
   struct ubuntu_pipe_message iovec_payload;
-
-  static union {
-    struct cmsghdr cm;
-    char control[CMSG_SPACE(sizeof(int))];
-  } control_un;
-  struct cmsghdr *cmptr;
-
-  int fd = -1;
-
-  if (!pathname) {
-    goto exit;
-  }
-  if (strlen(pathname) > 250) {
-    goto exit;
-  }
+  size_t pathlen = strlen(pathname);
 
   memset(&iovec_payload, 0, sizeof(struct ubuntu_pipe_message));
   iovec_payload.cmd = UBUNTU_CMD_OPEN;
-  iovec_payload.len = strlen(pathname) + 1 + sizeof(int);
-  memcpy(&iovec_payload.data, pathname, strlen(pathname));
-  memcpy(&iovec_payload.data[strlen(pathname) + 1], &flags, sizeof(int));
+  iovec_payload.len = pathlen + 1 + sizeof(int);
+  memcpy(&iovec_payload.data, pathname, pathlen);
+  memcpy(&iovec_payload.data[pathlen + 1], &flags, sizeof(int));
   memset(&msg, 0, sizeof(struct msghdr));
   iov[0].iov_base = (void *) &iovec_payload;
   iov[0].iov_len = iovec_payload.len + 2;
   msg.msg_iov = iov;
   msg.msg_iovlen = 1;
 
-  mgos_rlock(s_pipe.lock);
   len = sendmsg(s_pipe.mongoose_fd, &msg, 0);
   if (len < 2) {
     LOG(LL_ERROR, ("Cannot write message %d", (int) len));
-    goto exit;
+    return false;
   }
+  return true;
+}
 
-  memset(&iovec_payload, 0, sizeof(struct ubuntu_pipe_message));
+// Returns received fd, -1 if the file could not be opened and -2 if the
+// pipe is broken.
+static int ubuntu_ipc_recv_open(void) {
+  ssize_t len;
+  struct msghdr msg;
+  struct iovec iov[1];
+  struct ubuntu_pipe_message iovec_payload;
+  union {
+    struct cmsghdr cm;
+    char control[CMSG_SPACE(sizeof(int))];
+  } control_un;
+  struct cmsghdr *cmptr;
+
+  memset(&msg, 0, sizeof(struct msghdr));
   iov[0].iov_base = (void *) &iovec_payload;
   iov[0].iov_len = sizeof(struct ubuntu_pipe_message);
   msg.msg_iov = iov;
@@ -111,22 +114,155 @@ int ubuntu_ipc_open(const char *pathname, int flags) {
   len = recvmsg(s_pipe.mongoose_fd, &msg, 0);
   if (len < 2) {
     LOG(LL_ERROR, ("Cannot read message"));
-    goto exit;
+    return -2;
   }
 
   if ((cmptr = CMSG_FIRSTHDR(&msg)) != NULL &&
       cmptr->cmsg_len == CMSG_LEN(sizeof(int)) &&
       cmptr->cmsg_level == SOL_SOCKET && cmptr->cmsg_type == SCM_RIGHTS) {
-    fd = *((int *) CMSG_DATA(cmptr));
+    return *((int *) CMSG_DATA(cmptr));
   }
+  return -1;
+}
+
+int ubuntu_ipc_open_many(int n, const char *const *pathnames,
+                         const int *flags, int *fds) {
+  int i, j, num_sent, num_open = 0;
+
+  mgos_rlock(s_pipe.lock);
+  for (i = 0; i < n; i += num_sent) {
+    // Keep the number in flight bounded so that neither side blocks on a
+    // full socket buffer while the other one is not reading.
+    for (num_sent = 0; num_sent < UBUNTU_IPC_MAX_BATCH && i + num_sent < n;
+         num_sent++) {
+      const char *pathname = pathnames[i + num_sent];
+      fds[i + num_sent] = -1;
+      if (pathname == NULL || strlen(pathname) > 250) continue;
+      if (!ubuntu_ipc_send_open(pathname, flags[i + num_sent])) break;
+      fds[i + num_sent] = -2;  // Reply pending.
+    }
+    for (j = i; j < i + num_sent; j++) {
+      if (fds[j] != -2) continue;
+      fds[j] = ubuntu_ipc_recv_open();
+      if (fds[j] >= 0) {
+        num_open++;
+      } else if (fds[j] == -2) {
+        // Out of sync, there is no way to tell which reply is which.
+        while (j < n) fds[j++] = -1;
+        goto exit;
+      }
+    }
+    if (num_sent == 0) break;
+  }
+  for (; i < n; i++) fds[i] = -1;
 
-// LOG(LL_INFO, ("Received: cmd=%u len=%u msg='%.*s', fd=%d", iovec_payload.cmd,
-// iovec_payload.len, (int)iovec_payload.len, (char *)iovec_payload.data, fd));
 exit:
   mgos_runlock(s_pipe.lock);
+  return num_open;
+}
+
+#if UBUNTU_IPC_FD_CACHE
+struct ubuntu_ipc_cached_fd {
+  char *pathname;
+  int fd;
+};
+
+static struct ubuntu_ipc_cached_fd s_fd_cache[UBUNTU_IPC_FD_CACHE_SIZE];
+
+static bool ubuntu_ipc_cacheable(const char *pathname) {
+  return (0 == fnmatch("/proc/*", pathname, 0) ||
+          0 == fnmatch("/sys/*", pathname, 0));
+}
+
+// Returns the cached fd, or NULL if there isn't one.
+// Must be called with the pipe lock held, like the other cache functions.
+static struct ubuntu_ipc_cached_fd *ubuntu_ipc_cache_get(const char *pathname) {
+  struct ubuntu_ipc_cached_fd *c;
+  for (c = s_fd_cache; c < s_fd_cache + UBUNTU_IPC_FD_CACHE_SIZE; c++) {
+    if (c->pathname != NULL && strcmp(c->pathname, pathname) == 0) return c;
+  }
+  return NULL;
+}
+
+// Takes ownership of fd if there is room in the cache.
+static bool ubuntu_ipc_cache_put(const char *pathname, int fd) {
+  struct ubuntu_ipc_cached_fd *c;
+  for (c = s_fd_cache; c < s_fd_cache + UBUNTU_IPC_FD_CACHE_SIZE; c++) {
+    if (c->pathname != NULL) continue;
+    if ((c->pathname = strdup(pathname)) == NULL) return false;
+    c->fd = fd;
+    return true;
+  }
+  return false;
+}
+
+static void ubuntu_ipc_cache_drop(struct ubuntu_ipc_cached_fd *c) {
+  close(c->fd);
+  free(c->pathname);
+  c->pathname = NULL;
+}
+#endif
+
+// Reads from offset 0, so that the fd can be shared: procfs and sysfs
+// regenerate the contents when read from the start.
+static ssize_t ubuntu_ipc_pread(int fd, void *buf, size_t len) {
+  size_t n = 0;
+  while (n < len) {
+    ssize_t r = pread(fd, (char *) buf + n, len - n, n);
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0) return -1;
+    if (r == 0) break;
+    n += r;
+  }
+  return n;
+}
+
+int ubuntu_ipc_open(const char *pathname, int flags) {
+  int fd = -1;
+
+  if (!pathname) {
+    return -1;
+  }
+
+  ubuntu_ipc_open_many(1, &pathname, &flags, &fd);
   return fd;
+}
+
+ssize_t ubuntu_ipc_read_file(const char *pathname, void *buf, size_t len) {
+  int fd, flags = O_RDONLY | O_CLOEXEC;
+  ssize_t n;
+
+  if (!pathname) {
+    return -1;
+  }
+
+#if UBUNTU_IPC_FD_CACHE
+  if (ubuntu_ipc_cacheable(pathname)) {
+    struct ubuntu_ipc_cached_fd *c;
+    mgos_rlock(s_pipe.lock);
+    if ((c = ubuntu_ipc_cache_get(pathname)) != NULL) {
+      n = ubuntu_ipc_pread(c->fd, buf, len);
+      if (n >= 0) {
+        mgos_runlock(s_pipe.lock);
+        return n;
+      }
+      // E.g. the network interface is gone, try opening it afresh.
+      ubuntu_ipc_cache_drop(c);
+    }
+    fd = ubuntu_ipc_open(pathname, flags);
+    n = (fd >= 0 ? ubuntu_ipc_pread(fd, buf, len) : -1);
+    if (fd >= 0 && (n < 0 || !ubuntu_ipc_cache_put(pathname, fd))) close(fd);
+    mgos_runlock(s_pipe.lock);
+    return n;
+  }
+#endif
 
-  (void) flags;
+  if ((fd = ubuntu_ipc_open(pathname, flags)) < 0) {
+    return -1;
+  }
+  n = ubuntu_ipc_pread(fd, buf, len);
+  close(fd);
+  return n;
 }
 
 void mgos_wdt_set_timeout(int secs) {
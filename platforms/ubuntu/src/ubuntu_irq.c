@@ -0,0 +1,187 @@
+/*
+ * Copyright 2019 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Simulated interrupts.
+//
+// Device fds (tty, timerfd, GPIO line events, ...) are watched by a dedicated
+// thread with epoll. When one becomes ready, its handler is invoked on that
+// thread with "interrupts disabled", i.e. holding the lock that
+// mgos_ints_disable() takes, which gives handlers the same exclusion
+// guarantees as a real ISR has. Sources are one-shot: after firing, a source
+// stays disabled until ubuntu_irq_arm() is called again, much like an
+// interrupt that is masked until the driver is done with it.
+// Disabled sources keep EPOLLONESHOT too: epoll reports EPOLLHUP and EPOLLERR
+// even with no events requested, and this way they are reported only once
+// instead of on every epoll_wait().
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  // For PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "mgos_system.h"
+#include "ubuntu.h"
+
+struct ubuntu_irq {
+  int fd;
+  ubuntu_irq_handler_t handler;
+  void *arg;
+  struct ubuntu_irq *next;
+};
+
+static int s_epfd = -1;
+static pthread_mutex_t s_ints_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static struct ubuntu_irq *s_irqs = NULL;
+// Removed entries, freed by the IRQ thread when it's sure not to use them.
+static struct ubuntu_irq *s_dead_irqs = NULL;
+
+void mgos_ints_disable(void) {
+  pthread_mutex_lock(&s_ints_lock);
+}
+
+void mgos_ints_enable(void) {
+  pthread_mutex_unlock(&s_ints_lock);
+}
+
+static struct ubuntu_irq *ubuntu_irq_find(int fd) {
+  struct ubuntu_irq *irq;
+  for (irq = s_irqs; irq != NULL; irq = irq->next) {
+    if (irq->fd == fd) break;
+  }
+  return irq;
+}
+
+static void *ubuntu_irq_thread(void *arg) {
+  for (;;) {
+    struct epoll_event ev;
+    struct ubuntu_irq *irq;
+    int n;
+    mgos_ints_disable();
+    while (s_dead_irqs != NULL) {
+      irq = s_dead_irqs;
+      s_dead_irqs = irq->next;
+      free(irq);
+    }
+    mgos_ints_enable();
+    // One at a time, so that an entry removed while we are handling another
+    // one is never looked at.
+    n = epoll_wait(s_epfd, &ev, 1, -1);
+    if (n < 0 && errno != EINTR) {
+      LOG(LL_ERROR, ("epoll_wait failed: %d", errno));
+      break;
+    }
+    if (n <= 0) continue;
+    irq = (struct ubuntu_irq *) ev.data.ptr;
+    mgos_ints_disable();
+    // Handler is reset when the entry is removed.
+    if (irq->handler != NULL) irq->handler(irq->fd, ev.events, irq->arg);
+    mgos_ints_enable();
+  }
+  return NULL;
+  (void) arg;
+}
+
+bool ubuntu_irq_init(void) {
+  pthread_t t;
+  pthread_attr_t attr;
+  sigset_t all, old;
+  int res;
+  s_epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (s_epfd < 0) {
+    LOG(LL_ERROR, ("epoll_create1 failed: %d", errno));
+    return false;
+  }
+  // Signals (SIGINT in particular) should go to the main thread.
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  res = pthread_create(&t, &attr, ubuntu_irq_thread, NULL);
+  pthread_attr_destroy(&attr);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (res != 0) {
+    LOG(LL_ERROR, ("Failed to create IRQ thread: %d", res));
+    return false;
+  }
+  // Interrupts preempt everything else, if we're allowed to (CAP_SYS_NICE or
+  // RLIMIT_RTPRIO). Without it, timer latency is at the mercy of the
+  // scheduler.
+  {
+    struct sched_param sp = {.sched_priority = 1};
+    res = pthread_setschedparam(t, SCHED_FIFO, &sp);
+    if (res != 0) {
+      LOG(LL_DEBUG, ("IRQ thread is not real-time: %d", res));
+    }
+  }
+  return true;
+}
+
+bool ubuntu_irq_add(int fd, ubuntu_irq_handler_t handler, void *arg) {
+  struct epoll_event ev = {.events = EPOLLONESHOT};
+  struct ubuntu_irq *irq = (struct ubuntu_irq *) calloc(1, sizeof(*irq));
+  if (irq == NULL) return false;
+  irq->fd = fd;
+  irq->handler = handler;
+  irq->arg = arg;
+  ev.data.ptr = irq;
+  // Registered disabled, see ubuntu_irq_arm().
+  if (epoll_ctl(s_epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    LOG(LL_ERROR, ("Failed to add fd %d: %d", fd, errno));
+    free(irq);
+    return false;
+  }
+  mgos_ints_disable();
+  irq->next = s_irqs;
+  s_irqs = irq;
+  mgos_ints_enable();
+  return true;
+}
+
+bool ubuntu_irq_arm(int fd, uint32_t events) {
+  struct epoll_event ev = {.events = events | EPOLLONESHOT};
+  bool res = false;
+  mgos_ints_disable();
+  ev.data.ptr = ubuntu_irq_find(fd);
+  if (ev.data.ptr != NULL) {
+    res = (epoll_ctl(s_epfd, EPOLL_CTL_MOD, fd, &ev) == 0);
+  }
+  mgos_ints_enable();
+  return res;
+}
+
+void ubuntu_irq_del(int fd) {
+  struct ubuntu_irq **pp, *irq;
+  mgos_ints_disable();
+  for (pp = &s_irqs; *pp != NULL; pp = &(*pp)->next) {
+    if ((*pp)->fd == fd) break;
+  }
+  irq = *pp;
+  if (irq != NULL) {
+    epoll_ctl(s_epfd, EPOLL_CTL_DEL, fd, NULL);
+    *pp = irq->next;
+    irq->handler = NULL;
+    irq->next = s_dead_irqs;
+    s_dead_irqs = irq;
+  }
+  mgos_ints_enable();
+}
@@ -14,10 +14,12 @@
  * limitations under the License.
  */
 
+#include <errno.h>
 #include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
-
-#include "common/queue.h"
+#include <unistd.h>
 
 #include "mgos_debug_internal.h"
 #include "mgos_init_internal.h"
@@ -28,6 +30,7 @@
 #include "mgos_sys_config.h"
 #include "mgos_uart_internal.h"
 #include "ubuntu.h"
+#include "ubuntu_cb_queue.h"
 
 extern const char *build_version, *build_id;
 extern const char *mg_build_version, *mg_build_id;
@@ -37,16 +40,63 @@ struct ubuntu_flags Flags;
 static bool mongoose_running = false;
 static pid_t s_parent, s_child;
 
-struct cb_info {
-  void (*cb)(void *arg);
-  void *cb_arg;
-  STAILQ_ENTRY(cb_info) next;
-};
+// Must be a power of 2. mgos_invoke_cb() fails when the queue is full.
+#ifndef UBUNTU_CB_QUEUE_LEN
+#define UBUNTU_CB_QUEUE_LEN 1024
+#endif
+// Callbacks run per loop iteration, so that a flood of them does not starve
+// network connections and timers.
+#define UBUNTU_CB_BATCH 64
 
-STAILQ_HEAD(s_cbs, cb_info) s_cbs = STAILQ_HEAD_INITIALIZER(s_cbs);
-struct mgos_rlock_type *s_cbs_lock = NULL;
+static struct ubuntu_cb_queue s_cbs;
 struct mgos_rlock_type *s_mgos_lock = NULL;
 
+/*
+ * Main loop blocks in mongoose_poll() until there is something to do:
+ * socket activity, the next software timer (mongoose limits its wait by
+ * ev_timer_time of the timers connection) or a wakeup. Wakeups are requested
+ * by other threads via mgos_invoke_cb() and mongoose_schedule_poll() and are
+ * delivered as a byte written to a socket pair, the read end of which is a
+ * mongoose connection. At most one byte is in flight at any time.
+ */
+#define UBUNTU_MAX_POLL_MS 1000
+
+static int s_wakeup_fds[2] = {-1, -1};
+static volatile int s_wakeup_pending = 0;
+
+static void ubuntu_wakeup(void) {
+  ssize_t n;
+  if (__atomic_exchange_n(&s_wakeup_pending, 1, __ATOMIC_ACQ_REL)) return;
+  n = write(s_wakeup_fds[1], "", 1);
+  /* Can only fail with EAGAIN, which means a wakeup is pending anyway. */
+  (void) n;
+}
+
+static void ubuntu_wakeup_handler(struct mg_connection *nc, int ev,
+                                  void *ev_data, void *user_data) {
+  if (ev == MG_EV_RECV) {
+    mbuf_remove(&nc->recv_mbuf, nc->recv_mbuf.len);
+  }
+  (void) ev_data;
+  (void) user_data;
+}
+
+static bool ubuntu_wakeup_init(void) {
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+                 s_wakeup_fds) != 0) {
+    LOG(LL_ERROR, ("socketpair failed: %d", errno));
+    return false;
+  }
+  return true;
+}
+
+static bool ubuntu_wakeup_start(void) {
+  struct mg_add_sock_opts opts;
+  memset(&opts, 0, sizeof(opts));
+  return (mg_add_sock_opt(mgos_get_mgr(), s_wakeup_fds[0],
+                          ubuntu_wakeup_handler, NULL, opts) != NULL);
+}
+
 static void ubuntu_sigint_handler(int sig) {
   mongoose_running = false;
   (void) sig;
@@ -55,14 +105,26 @@ static void ubuntu_sigint_handler(int sig) {
 static int ubuntu_mongoose(void) {
   enum mgos_init_result r;
 
-  s_cbs_lock = mgos_rlock_create();
   s_mgos_lock = mgos_rlock_create();
+  if (!ubuntu_cb_queue_init(&s_cbs, UBUNTU_CB_QUEUE_LEN)) {
+    return -2;
+  }
 
   ubuntu_set_boottime();
   ubuntu_set_nsleep100();
+  if (!ubuntu_wakeup_init()) {
+    return -2;
+  }
+  if (!ubuntu_cd_init(Flags.core_dump_file,
+                      (uintptr_t) __builtin_frame_address(0))) {
+    return -2;
+  }
   if (!ubuntu_cap_init()) {
     return -2;
   }
+  if (!ubuntu_irq_init()) {
+    return -2;
+  }
 
   r = mongoose_init();
   if (r != MGOS_INIT_OK) {
@@ -70,35 +132,34 @@ static int ubuntu_mongoose(void) {
         ("mongoose_init=%d (expecting %d), exiting", r, MGOS_INIT_OK));
     return -3;
   }
+  if (!ubuntu_wakeup_start()) {
+    LOG(LL_ERROR, ("Failed to set up main loop wakeups"));
+    return -3;
+  }
   mongoose_running = true;
   struct sigaction sa = {
       .sa_handler = ubuntu_sigint_handler,
   };
   sigaction(SIGINT, &sa, NULL);
   while (mongoose_running) {
-    mgos_rlock(s_cbs_lock);
-    while (!STAILQ_EMPTY(&s_cbs)) {
-      struct cb_info *cbi = STAILQ_FIRST(&s_cbs);
-      STAILQ_REMOVE_HEAD(&s_cbs, next);
-      mgos_runlock(s_cbs_lock);
-      cbi->cb(cbi->cb_arg);
-      free(cbi);
-      mgos_rlock(s_cbs_lock);
+    /* Posts that come after this are guaranteed to interrupt the poll. */
+    __atomic_store_n(&s_wakeup_pending, 0, __ATOMIC_SEQ_CST);
+    if (ubuntu_cb_queue_run(&s_cbs, UBUNTU_CB_BATCH) == UBUNTU_CB_BATCH) {
+      /* There may be more, do not block in poll. */
+      ubuntu_wakeup();
     }
-    mgos_runlock(s_cbs_lock);
-    mongoose_poll(1);
+#if MGOS_ENABLE_HEAP_LOG
+    ubuntu_heap_log_flush();
+#endif
+    mongoose_poll(UBUNTU_MAX_POLL_MS);
   }
+  ubuntu_hw_timers_log_stats();
   return 0;
 }
 
 bool mgos_invoke_cb(mgos_cb_t cb, void *arg, bool from_isr) {
-  struct cb_info *cbi = (struct cb_info *) calloc(1, sizeof(*cbi));
-  if (cbi == NULL) return false;
-  cbi->cb = cb;
-  cbi->cb_arg = arg;
-  mgos_rlock(s_cbs_lock);
-  STAILQ_INSERT_TAIL(&s_cbs, cbi, next);
-  mgos_runlock(s_cbs_lock);
+  if (!ubuntu_cb_queue_put(&s_cbs, cb, arg)) return false;
+  ubuntu_wakeup();
   (void) from_isr;
   return true;
 }
@@ -160,16 +221,8 @@ int main(int argc, char *argv[]) {
   (void) argv;
 }
 
-static void dummy_handler(struct mg_connection *nc, int ev, void *ev_data,
-                          void *user_data) {
-  (void) nc;
-  (void) ev;
-  (void) ev_data;
-  (void) user_data;
-}
-
 void mongoose_schedule_poll(bool from_isr) {
-  mg_broadcast(mgos_get_mgr(), dummy_handler, NULL, 0);
+  ubuntu_wakeup();
   (void) from_isr;
 }
 
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2019 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct mgos_uart_dev_config {
+  // tty device the UART is attached to, e.g. "/dev/ttyUSB0", or "pty" to
+  // create a pseudo-terminal (its name is logged). If NULL, the UART is not
+  // connected to anything: output is discarded and there is no input.
+  // Default can be set with the --uart command line flag.
+  const char *dev;
+};
+
+#ifdef __cplusplus
+}
+#endif
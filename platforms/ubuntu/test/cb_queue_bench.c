@@ -0,0 +1,171 @@
+/*
+ * Copyright 2019 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Throughput of mgos_invoke_cb()-style posting from multiple threads to the
+// main loop: the lock-free queue vs. the previous implementation, which
+// allocated a record per call and kept them on a list under a mutex.
+//
+// Usage: cb_queue_bench [num_producers] [posts_per_producer]
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "common/queue.h"
+
+#include "ubuntu_cb_queue.h"
+
+struct bench_impl {
+  const char *name;
+  bool (*put)(mgos_cb_t cb, void *arg);
+  int (*run)(int max);
+};
+
+// Previous implementation.
+struct cb_info {
+  void (*cb)(void *arg);
+  void *cb_arg;
+  STAILQ_ENTRY(cb_info) next;
+};
+
+static STAILQ_HEAD(s_cbs, cb_info) s_cbs = STAILQ_HEAD_INITIALIZER(s_cbs);
+static pthread_mutex_t s_cbs_lock;
+
+static bool list_put(mgos_cb_t cb, void *arg) {
+  struct cb_info *cbi = (struct cb_info *) calloc(1, sizeof(*cbi));
+  if (cbi == NULL) return false;
+  cbi->cb = cb;
+  cbi->cb_arg = arg;
+  pthread_mutex_lock(&s_cbs_lock);
+  STAILQ_INSERT_TAIL(&s_cbs, cbi, next);
+  pthread_mutex_unlock(&s_cbs_lock);
+  return true;
+}
+
+static int list_run(int max) {
+  int n = 0;
+  pthread_mutex_lock(&s_cbs_lock);
+  while (!STAILQ_EMPTY(&s_cbs) && n < max) {
+    struct cb_info *cbi = STAILQ_FIRST(&s_cbs);
+    STAILQ_REMOVE_HEAD(&s_cbs, next);
+    pthread_mutex_unlock(&s_cbs_lock);
+    cbi->cb(cbi->cb_arg);
+    free(cbi);
+    n++;
+    pthread_mutex_lock(&s_cbs_lock);
+  }
+  pthread_mutex_unlock(&s_cbs_lock);
+  return n;
+}
+
+static struct ubuntu_cb_queue s_q;
+
+static bool queue_put(mgos_cb_t cb, void *arg) {
+  return ubuntu_cb_queue_put(&s_q, cb, arg);
+}
+
+static int queue_run(int max) {
+  return ubuntu_cb_queue_run(&s_q, max);
+}
+
+static const struct bench_impl s_impls[] = {
+    {"mutex + list", list_put, list_run},
+    {"lock-free queue", queue_put, queue_run},
+};
+
+#define MAX_PRODUCERS 64
+
+static const struct bench_impl *s_impl;
+static int s_num_posts;
+static unsigned long s_last[MAX_PRODUCERS];
+static unsigned long s_num_run;
+static unsigned long s_num_errors;
+static unsigned long s_num_full;
+
+// Arg encodes producer number in the low bits, sequence number above that.
+static void bench_cb(void *arg) {
+  const uintptr_t v = (uintptr_t) arg;
+  const int p = v % MAX_PRODUCERS;
+  const unsigned long seq = v / MAX_PRODUCERS;
+  // Posts from each producer must come out in order.
+  if (seq != s_last[p] + 1) s_num_errors++;
+  s_last[p] = seq;
+  s_num_run++;
+}
+
+static void *producer(void *arg) {
+  const uintptr_t p = (uintptr_t) arg;
+  unsigned long full = 0;
+  for (uintptr_t i = 1; i <= (uintptr_t) s_num_posts; i++) {
+    while (!s_impl->put(bench_cb, (void *) (i * MAX_PRODUCERS + p))) {
+      full++;
+      sched_yield();
+    }
+  }
+  __atomic_fetch_add(&s_num_full, full, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  int num_producers = (argc > 1 ? atoi(argv[1]) : 4);
+  unsigned long total;
+  pthread_mutexattr_t ma;
+  pthread_t threads[MAX_PRODUCERS];
+  size_t i;
+  int ret = 0;
+
+  s_num_posts = (argc > 2 ? atoi(argv[2]) : 1000000);
+  if (num_producers < 1 || num_producers > MAX_PRODUCERS) return 1;
+  total = (unsigned long) num_producers * s_num_posts;
+
+  // Same as mgos_rlock.
+  pthread_mutexattr_init(&ma);
+  pthread_mutexattr_settype(&ma, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&s_cbs_lock, &ma);
+  ubuntu_cb_queue_init(&s_q, 1024);
+
+  for (i = 0; i < sizeof(s_impls) / sizeof(s_impls[0]); i++) {
+    double start, elapsed;
+    int j;
+    s_impl = &s_impls[i];
+    s_num_run = s_num_errors = s_num_full = 0;
+    for (j = 0; j < MAX_PRODUCERS; j++) s_last[j] = 0;
+    start = now();
+    for (j = 0; j < num_producers; j++) {
+      pthread_create(&threads[j], NULL, producer, (void *) (uintptr_t) j);
+    }
+    // Main loop: run what's there, yield when there is nothing.
+    while (s_num_run < total) {
+      if (s_impl->run(64) == 0) sched_yield();
+    }
+    for (j = 0; j < num_producers; j++) pthread_join(threads[j], NULL);
+    elapsed = now() - start;
+    printf("%-16s %d x %d posts: %.3f s, %.2f M posts/s, %lu full retries%s\n",
+           s_impl->name, num_producers, s_num_posts, elapsed,
+           total / elapsed / 1e6, s_num_full,
+           (s_num_errors == 0 ? "" : ", ORDER ERRORS"));
+    if (s_num_errors != 0) ret = 1;
+  }
+  return ret;
+}
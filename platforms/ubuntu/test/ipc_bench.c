@@ -0,0 +1,172 @@
+/*
+ * Copyright 2019 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Latency of privileged opens through the IPC broker: one request at a time
+// (or from the fd cache, when it's enabled) vs. pipelined with
+// ubuntu_ipc_open_many().
+//
+// Usage: ipc_bench [num_opens]
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ubuntu.h"
+#include "ubuntu_ipc.h"
+
+// Stubs for what the broker needs from the rest of the platform.
+struct ubuntu_flags Flags;
+
+struct mgos_rlock_type {
+  pthread_mutex_t m;
+};
+
+struct mgos_rlock_type *mgos_rlock_create(void) {
+  pthread_mutexattr_t attr;
+  struct mgos_rlock_type *l = calloc(1, sizeof(*l));
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&l->m, &attr);
+  return l;
+}
+
+void mgos_rlock(struct mgos_rlock_type *l) {
+  pthread_mutex_lock(&l->m);
+}
+
+void mgos_runlock(struct mgos_rlock_type *l) {
+  pthread_mutex_unlock(&l->m);
+}
+
+void mgos_rlock_destroy(struct mgos_rlock_type *l) {
+  free(l);
+}
+
+bool ubuntu_wdt_feed(void) {
+  return true;
+}
+bool ubuntu_wdt_enable(void) {
+  return true;
+}
+bool ubuntu_wdt_disable(void) {
+  return true;
+}
+void ubuntu_wdt_set_timeout(int secs) {
+  (void) secs;
+}
+
+int cs_log_print_prefix(enum cs_log_level l, const char *file, int ln) {
+  (void) l;
+  (void) file;
+  (void) ln;
+  return 0;
+}
+
+int logm_print_prefix(enum cs_log_level l, const char *func,
+                      const char *file) {
+  (void) l;
+  (void) func;
+  (void) file;
+  return 0;
+}
+
+void cs_log_printf(const char *fmt, ...) {
+  (void) fmt;
+}
+
+static double now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void bench_one(const char *name, const char *path, int n) {
+  double start = now_us();
+  int i;
+  for (i = 0; i < n; i++) {
+    int fd = ubuntu_ipc_open(path, O_RDONLY);
+    if (fd < 0) {
+      fprintf(stderr, "%s: open failed\n", path);
+      exit(1);
+    }
+    close(fd);
+  }
+  printf("  %-10s %8.2f us/open\n", name, (now_us() - start) / n);
+}
+
+static void bench_read(const char *path, int n) {
+  char buf[64];
+  double start = now_us();
+  int i;
+  for (i = 0; i < n; i++) {
+    if (ubuntu_ipc_read_file(path, buf, sizeof(buf)) != sizeof(buf)) {
+      fprintf(stderr, "%s: read failed\n", path);
+      exit(1);
+    }
+  }
+  printf("  %-10s %8.2f us/read\n", "read_file", (now_us() - start) / n);
+}
+
+static void bench_many(const char *path, int n) {
+  const char *paths[UBUNTU_IPC_MAX_BATCH];
+  int flags[UBUNTU_IPC_MAX_BATCH], fds[UBUNTU_IPC_MAX_BATCH];
+  double start;
+  int i, j;
+  for (i = 0; i < UBUNTU_IPC_MAX_BATCH; i++) {
+    paths[i] = path;
+    flags[i] = O_RDONLY;
+  }
+  start = now_us();
+  // In batches, not to run out of fds.
+  for (i = 0; i < n; i += UBUNTU_IPC_MAX_BATCH) {
+    if (ubuntu_ipc_open_many(UBUNTU_IPC_MAX_BATCH, paths, flags, fds) !=
+        UBUNTU_IPC_MAX_BATCH) {
+      fprintf(stderr, "%s: open failed\n", path);
+      exit(1);
+    }
+    for (j = 0; j < UBUNTU_IPC_MAX_BATCH; j++) close(fds[j]);
+  }
+  printf("  %-10s %8.2f us/open\n", "pipelined",
+         (now_us() - start) / (i > 0 ? i : 1));
+}
+
+int main(int argc, char **argv) {
+  int n = (argc > 1 ? atoi(argv[1]) : 10000), wstatus;
+  pid_t child;
+  if (!ubuntu_ipc_init()) return 1;
+  child = fork();
+  if (child < 0) return 1;
+  if (child > 0) {
+    ubuntu_ipc_init_main();
+    while (waitpid(child, &wstatus, WNOHANG) == 0) {
+      ubuntu_ipc_handle(100);
+    }
+    return WEXITSTATUS(wstatus);
+  }
+  ubuntu_ipc_init_mongoose();
+  printf("%d opens, fd cache %s:\n", n,
+         UBUNTU_IPC_FD_CACHE ? "enabled" : "disabled");
+  bench_one("single", "/proc/cpuinfo", n);
+  bench_many("/proc/cpuinfo", n);
+  // Served from the cache, if enabled.
+  bench_read("/proc/cpuinfo", n);
+  return 0;
+}
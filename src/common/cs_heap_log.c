@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common/cs_heap_log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common/cs_base64.h"
+#include "common/platform.h"
+
+#ifndef CALL_TRACE_SIZE
+#define CALL_TRACE_SIZE 32
+#endif
+
+/* Raw bytes per output line, must be a multiple of 3. */
+#define HLOG_LINE_BYTES 48
+
+/* Tag + 3 pointer-sized varints, then trace header and frames. */
+#define HLOG_VARINT_MAX (sizeof(uintptr_t) * 8 / 7 + 1)
+#define HLOG_MAX_RECORD (1 + HLOG_VARINT_MAX * (3 + 2 + CALL_TRACE_SIZE))
+
+#define HLOG_F_SHIM 0x08
+#define HLOG_F_TRACE 0x10
+
+static uint8_t s_ring[CS_HLOG_RING_SIZE];
+/* Free-running counters, head - tail is the number of bytes in the ring. */
+static size_t s_head, s_tail;
+static uintptr_t s_heap_start, s_heap_end;
+static unsigned int s_lost;
+static cs_hlog_out_t s_out;
+static bool s_flushing;
+
+#if MGOS_ENABLE_CALL_TRACE
+static void *s_prev_trace[CALL_TRACE_SIZE];
+static unsigned int s_prev_trace_len;
+#endif
+
+NOINSTR static uint8_t *put_varint(uint8_t *p, uintptr_t v) {
+  while (v >= 0x80) {
+    *p++ = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (uint8_t) v;
+  return p;
+}
+
+NOINSTR static uintptr_t zigzag(intptr_t v) {
+  return ((uintptr_t) v << 1) ^ (uintptr_t)(v >> (sizeof(v) * 8 - 1));
+}
+
+NOINSTR static uintptr_t deflate_ptr(const void *ptr) {
+  if (ptr == NULL) return 0;
+  return zigzag(((intptr_t)((uintptr_t) ptr - s_heap_start)) >> 2) + 1;
+}
+
+#if MGOS_ENABLE_CALL_TRACE
+NOINSTR static uint8_t *put_trace(uint8_t *p) {
+  void *const *frames;
+  unsigned int i, n = cs_call_trace_get(&frames);
+  uintptr_t prev = 0;
+  if (n > CALL_TRACE_SIZE) n = CALL_TRACE_SIZE;
+  for (i = 0; i < n && i < s_prev_trace_len; i++) {
+    if (frames[i] != s_prev_trace[i]) break;
+    prev = (uintptr_t) frames[i];
+  }
+  p = put_varint(p, i);
+  p = put_varint(p, n - i);
+  for (; i < n; i++) {
+    const uintptr_t a = (uintptr_t) frames[i];
+    p = put_varint(p, zigzag((intptr_t)(a - prev)));
+    s_prev_trace[i] = frames[i];
+    prev = a;
+  }
+  s_prev_trace_len = n;
+  return p;
+}
+#endif
+
+NOINSTR static void write_ring(const uint8_t *data, size_t len) {
+  size_t off = s_head % sizeof(s_ring);
+  size_t n = sizeof(s_ring) - off;
+  if (n > len) n = len;
+  memcpy(s_ring + off, data, n);
+  memcpy(s_ring, data + n, len - n);
+  s_head += len;
+}
+
+/* Makes room for `len` bytes, returns false if the record has to be dropped. */
+NOINSTR static bool ring_reserve(size_t len) {
+  if (s_head - s_tail + len <= sizeof(s_ring)) return true;
+  if (s_out == NULL || s_flushing) return false;
+  cs_hlog_flush();
+  return true;
+}
+
+void cs_hlog_init(uintptr_t heap_start, uintptr_t heap_end) {
+  s_heap_start = heap_start;
+  s_heap_end = heap_end;
+}
+
+NOINSTR void cs_hlog_record(enum cs_hlog_type type, size_t size,
+                            const void *ptr, const void *old_ptr, bool shim) {
+  uint8_t buf[HLOG_MAX_RECORD], *p = buf + 1;
+  buf[0] = type | (shim ? HLOG_F_SHIM : 0);
+  switch (type) {
+    case CS_HLOG_REALLOC:
+      p = put_varint(p, size);
+      p = put_varint(p, deflate_ptr(old_ptr));
+      p = put_varint(p, deflate_ptr(ptr));
+      break;
+    case CS_HLOG_FREE:
+      p = put_varint(p, deflate_ptr(ptr));
+      break;
+    default:
+      p = put_varint(p, size);
+      p = put_varint(p, deflate_ptr(ptr));
+      break;
+  }
+#if MGOS_ENABLE_CALL_TRACE
+  buf[0] |= HLOG_F_TRACE;
+  p = put_trace(p);
+#endif
+  if (s_lost > 0) {
+    /* Dropped records are reported before the next one that makes it. */
+    uint8_t lbuf[1 + HLOG_VARINT_MAX];
+    size_t llen;
+    lbuf[0] = CS_HLOG_LOST;
+    llen = put_varint(lbuf + 1, s_lost) - lbuf;
+    if (!ring_reserve(llen + (p - buf))) goto drop;
+    write_ring(lbuf, llen);
+    s_lost = 0;
+  } else if (!ring_reserve(p - buf)) {
+    goto drop;
+  }
+  write_ring(buf, p - buf);
+  return;
+
+drop:
+  s_lost++;
+#if MGOS_ENABLE_CALL_TRACE
+  /* Trace is delta-encoded, the next one has to be complete. */
+  s_prev_trace_len = 0;
+#endif
+}
+
+NOINSTR void cs_hlog_flush(void) {
+  uint8_t raw[HLOG_LINE_BYTES];
+  char line[4 + HLOG_LINE_BYTES * 4 / 3 + 2];
+  if (s_out == NULL || s_flushing) return;
+  s_flushing = true;
+  while (s_head != s_tail) {
+    size_t i, n = s_head - s_tail, b64_len;
+    if (n > sizeof(raw)) n = sizeof(raw);
+    for (i = 0; i < n; i++) raw[i] = s_ring[(s_tail + i) % sizeof(s_ring)];
+    memcpy(line, "hlb:", 4);
+    cs_base64_encode(raw, n, line + 4);
+    b64_len = strlen(line + 4);
+    line[4 + b64_len] = '\n';
+    s_out(line, 4 + b64_len + 1);
+    s_tail += n;
+  }
+  s_flushing = false;
+}
+
+void cs_hlog_set_output(cs_hlog_out_t out) {
+  char buf[100];
+  if (s_out != NULL || out == NULL) {
+    s_out = out;
+    return;
+  }
+  /*
+   * snprintf may allocate, format before setting output so that resulting
+   * records stay in the ring and are not flushed ahead of the header.
+   */
+  snprintf(buf, sizeof(buf),
+           "\nhlog_param:{\"heap_start\":%lu, \"heap_end\":%lu, "
+           "\"fmt\":\"bin1\"}\n",
+           (unsigned long) s_heap_start, (unsigned long) s_heap_end);
+  s_out = out;
+  out(buf, strlen(buf));
+  cs_hlog_flush();
+}
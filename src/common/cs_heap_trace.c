@@ -50,6 +50,12 @@ void esp_exc_printf(const char *fmt, ...);
 #define call_trace_printf printf
 #endif
 
+NOINSTR unsigned int cs_call_trace_get(void *const **frames) {
+  *frames = call_trace.addresses;
+  return (call_trace.size < CALL_TRACE_SIZE ? call_trace.size
+                                            : CALL_TRACE_SIZE);
+}
+
 NOINSTR void print_call_trace() {
   static void *prev_trace[CALL_TRACE_SIZE];
   unsigned int size = call_trace.size;
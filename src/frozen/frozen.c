@@ -72,6 +72,35 @@ typedef unsigned _int64 uint64_t;
 #define JSON_ENABLE_ARRAY 1
 #endif
 
+/*
+ * Skip over whitespace and plain string contents in bulk: 16 bytes at a time
+ * with SSE2 or NEON if available, a machine word at a time otherwise.
+ */
+#ifndef JSON_FAST_SCAN
+#define JSON_FAST_SCAN 1
+#endif
+
+/*
+ * json_vprintf() collects literal text, quoted keys and formatted numbers in
+ * a buffer of this size on the stack and hands them to the printer in one
+ * call, instead of calling the printer for every character.
+ */
+#ifndef JSON_PRINTF_BUF_SIZE
+#define JSON_PRINTF_BUF_SIZE 64
+#endif
+
+#if JSON_FAST_SCAN
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define JSON_SCAN_SSE2 1
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(__GNUC__) && \
+    defined(__ORDER_LITTLE_ENDIAN__) &&                                       \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#define JSON_SCAN_NEON 1
+#endif
+#endif /* JSON_FAST_SCAN */
+
 struct frozen {
   const char *end;
   const char *cur;
@@ -114,6 +143,8 @@ struct fstate {
 static int json_append_to_path(struct frozen *f, const char *str, int size) {
   int n = f->path_len;
   int left = sizeof(f->path) - n - 1;
+  /* Path is only used by the callback. */
+  if (f->callback == NULL) return n;
   if (size > left) size = left;
   memcpy(f->path + n, str, size);
   f->path[n + size] = '\0';
@@ -150,8 +181,138 @@ static int json_isspace(int ch) {
   return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
 }
 
+/*
+ * Bytes that end a run of plain string contents: quote, backslash, control
+ * characters and the first byte of a UTF-8 sequence (which is skipped over
+ * as a whole without looking at the rest, so must not be scanned in bulk).
+ */
+static int json_is_str_special(unsigned char ch) {
+  return ch == '"' || ch == '\\' || ch < 0x20 || ch >= 0x80;
+}
+
+#if JSON_FAST_SCAN && !defined(JSON_SCAN_SSE2) && !defined(JSON_SCAN_NEON)
+#ifdef __GNUC__
+typedef size_t __attribute__((__may_alias__)) json_word_t;
+#else
+typedef size_t json_word_t;
+#endif
+
+#define JSON_WORD_ONES (((size_t) -1) / 0xff)
+#define JSON_WORD_HIGHS (JSON_WORD_ONES * 0x80)
+
+/* 0x80 in every byte of x that is zero, 0 in others. Exact, no carries. */
+static size_t json_word_zero_bytes(size_t x) {
+  size_t t = (x & ~JSON_WORD_HIGHS) + ~JSON_WORD_HIGHS;
+  return ~(t | x | ~JSON_WORD_HIGHS);
+}
+
+static size_t json_word_eq_bytes(size_t x, unsigned char ch) {
+  return json_word_zero_bytes(x ^ (JSON_WORD_ONES * ch));
+}
+
+#define JSON_WORD_ALIGNED(p) (((size_t)(p) & (sizeof(size_t) - 1)) == 0)
+#endif
+
+/* Returns the first json_is_str_special() byte in [p, end), or end. */
+static const char *json_scan_str(const char *p, const char *end) {
+#if defined(JSON_SCAN_SSE2)
+  const __m128i quote = _mm_set1_epi8('"'), bslash = _mm_set1_epi8('\\');
+  const __m128i ctl = _mm_set1_epi8(0x20);
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    /* Signed compare, so bytes >= 0x80 are "less than" too. */
+    int mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                  _mm_cmpeq_epi8(v, bslash)),
+                     _mm_cmplt_epi8(v, ctl)));
+    if (mask != 0) return p + __builtin_ctz(mask);
+    p += 16;
+  }
+#elif defined(JSON_SCAN_NEON)
+  const uint8x16_t quote = vdupq_n_u8('"'), bslash = vdupq_n_u8('\\');
+  const int8x16_t ctl = vdupq_n_s8(0x20);
+  while (end - p >= 16) {
+    uint8x16_t v = vld1q_u8((const uint8_t *) p);
+    uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, bslash)),
+                            vcltq_s8(vreinterpretq_s8_u8(v), ctl));
+    /* 4 bits per byte. */
+    uint64_t bits = vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+    if (bits != 0) return p + (__builtin_ctzll(bits) >> 2);
+    p += 16;
+  }
+#elif JSON_FAST_SCAN
+  while (p < end && !JSON_WORD_ALIGNED(p)) {
+    if (json_is_str_special(*(const unsigned char *) p)) return p;
+    p++;
+  }
+  while (end - p >= (long) sizeof(size_t)) {
+    size_t x = *(const json_word_t *) p;
+    if ((json_word_eq_bytes(x, '"') | json_word_eq_bytes(x, '\\') |
+         json_word_zero_bytes(x & (JSON_WORD_ONES * 0xe0)) |
+         (x & JSON_WORD_HIGHS)) != 0) {
+      break;
+    }
+    p += sizeof(size_t);
+  }
+#else
+  /* Scalar parser looks at every byte. */
+  return p;
+#endif
+  while (p < end && !json_is_str_special(*(const unsigned char *) p)) p++;
+  return p;
+}
+
+/* Returns the first non-whitespace byte in [p, end), or end. */
+static const char *json_scan_ws(const char *p, const char *end) {
+#if defined(JSON_SCAN_SSE2)
+  const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+  const __m128i cr = _mm_set1_epi8('\r'), nl = _mm_set1_epi8('\n');
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    int mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+                     _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, nl))));
+    mask ^= 0xffff;
+    if (mask != 0) return p + __builtin_ctz(mask);
+    p += 16;
+  }
+#elif defined(JSON_SCAN_NEON)
+  const uint8x16_t sp = vdupq_n_u8(' '), tab = vdupq_n_u8('\t');
+  const uint8x16_t cr = vdupq_n_u8('\r'), nl = vdupq_n_u8('\n');
+  while (end - p >= 16) {
+    uint8x16_t v = vld1q_u8((const uint8_t *) p);
+    uint8x16_t m = vmvnq_u8(vorrq_u8(vorrq_u8(vceqq_u8(v, sp), vceqq_u8(v, tab)),
+                                     vorrq_u8(vceqq_u8(v, cr), vceqq_u8(v, nl))));
+    uint64_t bits = vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+    if (bits != 0) return p + (__builtin_ctzll(bits) >> 2);
+    p += 16;
+  }
+#elif JSON_FAST_SCAN
+  while (p < end && !JSON_WORD_ALIGNED(p)) {
+    if (!json_isspace(*p)) return p;
+    p++;
+  }
+  while (end - p >= (long) sizeof(size_t)) {
+    size_t x = *(const json_word_t *) p;
+    if ((json_word_eq_bytes(x, ' ') | json_word_eq_bytes(x, '\t') |
+         json_word_eq_bytes(x, '\r') | json_word_eq_bytes(x, '\n')) !=
+        JSON_WORD_HIGHS) {
+      break;
+    }
+    p += sizeof(size_t);
+  }
+#endif
+  while (p < end && json_isspace(*p)) p++;
+  return p;
+}
+
 static void json_skip_whitespaces(struct frozen *f) {
-  while (f->cur < f->end && json_isspace(*f->cur)) f->cur++;
+  /* Most of the time there is none or just one. */
+  if (f->cur < f->end && json_isspace(*f->cur)) {
+    f->cur = json_scan_ws(f->cur + 1, f->end);
+  }
 }
 
 static int json_cur(struct frozen *f) {
@@ -237,6 +398,8 @@ static int json_parse_string(struct frozen *f) {
   {
     SET_STATE(f, f->cur, "", 0);
     for (; f->cur < f->end; f->cur += len) {
+      f->cur = json_scan_str(f->cur, f->end);
+      if (f->cur == f->end) break;
       ch = *(unsigned char *) f->cur;
       len = json_get_utf8_char_len((unsigned char) ch);
       EXPECT(ch >= 32 && len > 0, JSON_STRING_INVALID); /* No control chars */
@@ -300,12 +463,16 @@ static int json_parse_array(struct frozen *f) {
     {
       SET_STATE(f, f->cur - 1, "", 0);
       while (json_cur(f) != ']') {
-        snprintf(buf, sizeof(buf), "[%d]", i);
+        if (f->callback != NULL) {
+          snprintf(buf, sizeof(buf), "[%d]", i);
+          current_path_len = json_append_to_path(f, buf, strlen(buf));
+          f->cur_name =
+              f->path + strlen(f->path) - strlen(buf) + 1 /*opening brace*/;
+          f->cur_name_len = strlen(buf) - 2 /*braces*/;
+        } else {
+          current_path_len = f->path_len;
+        }
         i++;
-        current_path_len = json_append_to_path(f, buf, strlen(buf));
-        f->cur_name =
-            f->path + strlen(f->path) - strlen(buf) + 1 /*opening brace*/;
-        f->cur_name_len = strlen(buf) - 2 /*braces*/;
         TRY(json_parse_value(f));
         json_truncate_path(f, current_path_len);
         if (json_cur(f) == ',') f->cur++;
@@ -434,26 +601,44 @@ static int json_doit(struct frozen *f) {
   return json_parse_value(f);
 }
 
+/* Length of the run at p that json_escape() can output as is. */
+static size_t json_escape_run(const char *p, const char *end) {
+  const char *q = json_scan_str(p, end), *del;
+  while (q < end && !json_is_str_special(*(const unsigned char *) q)) q++;
+  del = (const char *) memchr(p, 0x7f, q - p);
+  return (del != NULL ? del : q) - p;
+}
+
 int json_escape(struct json_out *out, const char *p, size_t len) WEAK;
 int json_escape(struct json_out *out, const char *p, size_t len) {
-  size_t i, cl, n = 0;
+  size_t i, cl, run, n = 0;
   const char *hex_digits = "0123456789abcdef";
   const char *specials = "btnvfr";
+  char esc[6];
 
   for (i = 0; i < len; i++) {
-    unsigned char ch = ((unsigned char *) p)[i];
+    unsigned char ch;
+    run = json_escape_run(p + i, p + len);
+    if (run > 0) {
+      n += out->printer(out, p + i, run);
+      i += run;
+      if (i == len) break;
+    }
+    ch = ((unsigned char *) p)[i];
+    esc[0] = '\\';
     if (ch == '"' || ch == '\\') {
-      n += out->printer(out, "\\", 1);
-      n += out->printer(out, p + i, 1);
+      esc[1] = ch;
+      n += out->printer(out, esc, 2);
     } else if (ch >= '\b' && ch <= '\r') {
-      n += out->printer(out, "\\", 1);
-      n += out->printer(out, &specials[ch - '\b'], 1);
+      esc[1] = specials[ch - '\b'];
+      n += out->printer(out, esc, 2);
     } else if (isprint(ch)) {
       n += out->printer(out, p + i, 1);
     } else if ((cl = json_get_utf8_char_len(ch)) == 1) {
-      n += out->printer(out, "\\u00", 4);
-      n += out->printer(out, &hex_digits[(ch >> 4) % 0xf], 1);
-      n += out->printer(out, &hex_digits[ch % 0xf], 1);
+      memcpy(esc + 1, "u00", 3);
+      esc[4] = hex_digits[(ch >> 4) & 0xf];
+      esc[5] = hex_digits[ch & 0xf];
+      n += out->printer(out, esc, 6);
     } else {
       n += out->printer(out, p + i, cl);
       i += cl - 1;
@@ -553,58 +738,126 @@ static unsigned char hexdec(const char *s) {
   return (HEXTOI(a) << 4) | HEXTOI(b);
 }
 
+/* Output staged by json_vprintf(), see JSON_PRINTF_BUF_SIZE. */
+struct json_printf_buf {
+  struct json_out *out;
+  int len; /* sum of what the printer returned */
+  size_t n;
+  char buf[JSON_PRINTF_BUF_SIZE];
+};
+
+static void json_pbuf_flush(struct json_printf_buf *b) {
+  if (b->n > 0) {
+    b->len += b->out->printer(b->out, b->buf, b->n);
+    b->n = 0;
+  }
+}
+
+static void json_pbuf_add(struct json_printf_buf *b, const char *s, size_t n) {
+  if (b->n + n > sizeof(b->buf)) {
+    json_pbuf_flush(b);
+    if (n > sizeof(b->buf)) {
+      b->len += b->out->printer(b->out, s, n);
+      return;
+    }
+  }
+  memcpy(b->buf + b->n, s, n);
+  b->n += n;
+}
+
+/*
+ * Decimal digits of v, without snprintf(). 64-bit division is a library
+ * call on 32-bit targets, so only the high part of big values takes it.
+ */
+static void json_pbuf_add_int(struct json_printf_buf *b, uint64_t v,
+                              int neg) {
+  char tmp[21], *end = tmp + sizeof(tmp), *p = end;
+  uint32_t v32;
+  while (v > 0xffffffffUL) {
+    *--p = '0' + (char) (v % 10);
+    v /= 10;
+  }
+  v32 = (uint32_t) v;
+  do {
+    *--p = '0' + (char) (v32 % 10);
+    v32 /= 10;
+  } while (v32 != 0);
+  if (neg) *--p = '-';
+  json_pbuf_add(b, p, end - p);
+}
+
+static void json_pbuf_add_signed(struct json_printf_buf *b, int64_t v) {
+  json_pbuf_add_int(b, v < 0 ? 0 - (uint64_t) v : (uint64_t) v, v < 0);
+}
+
 int json_vprintf(struct json_out *out, const char *fmt, va_list xap) WEAK;
 int json_vprintf(struct json_out *out, const char *fmt, va_list xap) {
   int len = 0;
   const char *quote = "\"", *null = "null";
+  struct json_printf_buf b;
   va_list ap;
   va_copy(ap, xap);
+  b.out = out;
+  b.len = 0;
+  b.n = 0;
 
   while (*fmt != '\0') {
-    if (strchr(":, \r\n\t[]{}\"", *fmt) != NULL) {
-      len += out->printer(out, fmt, 1);
-      fmt++;
-    } else if (fmt[0] == '%') {
+    if (fmt[0] == '%') {
       char buf[21];
       size_t skip = 2;
 
       if (fmt[1] == 'l' && fmt[2] == 'l' && (fmt[3] == 'd' || fmt[3] == 'u')) {
         int64_t val = va_arg(ap, int64_t);
-        const char *fmt2 = fmt[3] == 'u' ? "%" UINT64_FMT : "%" INT64_FMT;
-        snprintf(buf, sizeof(buf), fmt2, val);
-        len += out->printer(out, buf, strlen(buf));
+        if (fmt[3] == 'u') {
+          json_pbuf_add_int(&b, (uint64_t) val, 0);
+        } else {
+          json_pbuf_add_signed(&b, val);
+        }
         skip += 2;
+      } else if (fmt[1] == 'l' && (fmt[2] == 'd' || fmt[2] == 'u')) {
+        if (fmt[2] == 'u') {
+          json_pbuf_add_int(&b, va_arg(ap, unsigned long), 0);
+        } else {
+          json_pbuf_add_signed(&b, va_arg(ap, long));
+        }
+        skip += 1;
+      } else if (fmt[1] == 'd') {
+        json_pbuf_add_signed(&b, va_arg(ap, int));
+      } else if (fmt[1] == 'u') {
+        json_pbuf_add_int(&b, va_arg(ap, unsigned int), 0);
       } else if (fmt[1] == 'z' && fmt[2] == 'u') {
-        size_t val = va_arg(ap, size_t);
-        snprintf(buf, sizeof(buf), "%lu", (unsigned long) val);
-        len += out->printer(out, buf, strlen(buf));
+        json_pbuf_add_int(&b, va_arg(ap, size_t), 0);
         skip += 1;
       } else if (fmt[1] == 'M') {
         json_printf_callback_t f = va_arg(ap, json_printf_callback_t);
+        json_pbuf_flush(&b);
         len += f(out, &ap);
       } else if (fmt[1] == 'B') {
         int val = va_arg(ap, int);
         const char *str = val ? "true" : "false";
-        len += out->printer(out, str, strlen(str));
+        json_pbuf_add(&b, str, strlen(str));
       } else if (fmt[1] == 'H') {
 #if JSON_ENABLE_HEX
         const char *hex = "0123456789abcdef";
         int i, n = va_arg(ap, int);
         const unsigned char *p = va_arg(ap, const unsigned char *);
-        len += out->printer(out, quote, 1);
+        json_pbuf_add(&b, quote, 1);
         for (i = 0; i < n; i++) {
-          len += out->printer(out, &hex[(p[i] >> 4) & 0xf], 1);
-          len += out->printer(out, &hex[p[i] & 0xf], 1);
+          char pair[2];
+          pair[0] = hex[(p[i] >> 4) & 0xf];
+          pair[1] = hex[p[i] & 0xf];
+          json_pbuf_add(&b, pair, 2);
         }
-        len += out->printer(out, quote, 1);
+        json_pbuf_add(&b, quote, 1);
 #endif /* JSON_ENABLE_HEX */
       } else if (fmt[1] == 'V') {
 #if JSON_ENABLE_BASE64
         const unsigned char *p = va_arg(ap, const unsigned char *);
         int n = va_arg(ap, int);
-        len += out->printer(out, quote, 1);
+        json_pbuf_add(&b, quote, 1);
+        json_pbuf_flush(&b);
         len += b64enc(out, p, n);
-        len += out->printer(out, quote, 1);
+        json_pbuf_add(&b, quote, 1);
 #endif /* JSON_ENABLE_BASE64 */
       } else if (fmt[1] == 'Q' ||
                  (fmt[1] == '.' && fmt[2] == '*' && fmt[3] == 'Q')) {
@@ -618,14 +871,15 @@ int json_vprintf(struct json_out *out, const char *fmt, va_list xap) {
         p = va_arg(ap, char *);
 
         if (p == NULL) {
-          len += out->printer(out, null, 4);
+          json_pbuf_add(&b, null, 4);
         } else {
           if (fmt[1] == 'Q') {
             l = strlen(p);
           }
-          len += out->printer(out, quote, 1);
+          json_pbuf_add(&b, quote, 1);
+          json_pbuf_flush(&b);
           len += json_escape(out, p, l);
-          len += out->printer(out, quote, 1);
+          json_pbuf_add(&b, quote, 1);
         }
       } else {
         /*
@@ -716,7 +970,7 @@ int json_vprintf(struct json_out *out, const char *fmt, va_list xap) {
           }
         }
 
-        len += out->printer(out, pbuf, strlen(pbuf));
+        json_pbuf_add(&b, pbuf, strlen(pbuf));
         skip = n + 1;
 
         /* If buffer was allocated from heap, free it */
@@ -727,20 +981,25 @@ int json_vprintf(struct json_out *out, const char *fmt, va_list xap) {
       }
       fmt += skip;
     } else if (*fmt == '_' || json_isalpha(*fmt)) {
-      len += out->printer(out, quote, 1);
-      while (*fmt == '_' || json_isalpha(*fmt) || json_isdigit(*fmt)) {
-        len += out->printer(out, fmt, 1);
+      const char *start = fmt;
+      while (*fmt == '_' || json_isalpha(*fmt) || json_isdigit(*fmt)) fmt++;
+      json_pbuf_add(&b, quote, 1);
+      json_pbuf_add(&b, start, fmt - start);
+      json_pbuf_add(&b, quote, 1);
+    } else {
+      /* Punctuation, whitespace and anything else up to the next key or
+       * conversion is copied as is. */
+      const char *start = fmt;
+      while (*fmt != '\0' && *fmt != '%' && *fmt != '_' && !json_isalpha(*fmt)) {
         fmt++;
       }
-      len += out->printer(out, quote, 1);
-    } else {
-      len += out->printer(out, fmt, 1);
-      fmt++;
+      json_pbuf_add(&b, start, fmt - start);
     }
   }
+  json_pbuf_flush(&b);
   va_end(ap);
 
-  return len;
+  return len + b.len;
 }
 
 int json_printf(struct json_out *out, const char *fmt, ...) WEAK;
@@ -852,15 +1111,35 @@ int json_scanf_array_elem(const char *s, int len, const char *path, int idx,
   return info.found ? token->len : -1;
 }
 
+/*
+ * Up to this many conversions are matched in one pass over the document,
+ * longer formats take more passes.
+ */
+#ifndef JSON_SCANF_MAX_KEYS
+#define JSON_SCANF_MAX_KEYS 16
+#endif
+
+#define JSON_SCANF_MAX_CONV_LEN 20
+
 struct json_scanf_info {
   int num_conversions;
-  char *path;
+  const char *path;
+  unsigned int path_hash;
   const char *fmt;
   void *target;
   void *user_data;
   int type;
 };
 
+struct json_scanf_batch {
+  struct json_scanf_info infos[JSON_SCANF_MAX_KEYS];
+  int num_infos;
+  /* Paths and conversion specs of the infos. */
+  char buf[JSON_MAX_PATH_LEN + JSON_SCANF_MAX_CONV_LEN];
+  int buf_len;
+  int num_conversions;
+};
+
 int json_unescape(const char *src, int slen, char *dst, int dlen) WEAK;
 int json_unescape(const char *src, int slen, char *dst, int dlen) {
   char *send = (char *) src + slen, *dend = dst + dlen, *orig_dst = dst, *p;
@@ -904,18 +1183,7 @@ static void json_scanf_cb(void *callback_data, const char *name,
   (void) name;
   (void) name_len;
 
-  if (token->ptr == NULL) {
-    /*
-     * We're not interested here in the events for which we have no value;
-     * namely, JSON_TYPE_OBJECT_START and JSON_TYPE_ARRAY_START
-     */
-    return;
-  }
-
-  if (strcmp(path, info->path) != 0) {
-    /* It's not the path we're looking for, so, just ignore this callback */
-    return;
-  }
+  (void) path;
 
   switch (info->type) {
     case 'B':
@@ -1032,12 +1300,57 @@ static void json_scanf_cb(void *callback_data, const char *name,
   }
 }
 
+/* FNV-1a, to quickly rule out the paths that are not being scanned for. */
+static unsigned int json_path_hash(const char *p) {
+  unsigned int h = 2166136261U;
+  while (*p != '\0') h = (h ^ (unsigned char) *p++) * 16777619U;
+  return h;
+}
+
+static void json_scanf_batch_cb(void *callback_data, const char *name,
+                                size_t name_len, const char *path,
+                                const struct json_token *token) {
+  struct json_scanf_batch *b = (struct json_scanf_batch *) callback_data;
+  unsigned int h;
+  int i;
+
+  if (token->ptr == NULL) {
+    /*
+     * We're not interested here in the events for which we have no value;
+     * namely, JSON_TYPE_OBJECT_START and JSON_TYPE_ARRAY_START
+     */
+    return;
+  }
+
+  h = json_path_hash(path);
+  for (i = 0; i < b->num_infos; i++) {
+    struct json_scanf_info *info = &b->infos[i];
+    if (info->path_hash == h && strcmp(path, info->path) == 0) {
+      json_scanf_cb(info, name, name_len, path, token);
+    }
+  }
+}
+
+/* Performs all the pending conversions in one walk over the document. */
+static void json_scanf_flush(const char *s, int len,
+                             struct json_scanf_batch *b) {
+  int i;
+  if (b->num_infos == 0) return;
+  json_walk(s, len, json_scanf_batch_cb, b);
+  for (i = 0; i < b->num_infos; i++) {
+    b->num_conversions += b->infos[i].num_conversions;
+  }
+  b->num_infos = b->buf_len = 0;
+}
+
 int json_vscanf(const char *s, int len, const char *fmt, va_list ap) WEAK;
 int json_vscanf(const char *s, int len, const char *fmt, va_list ap) {
-  char path[JSON_MAX_PATH_LEN] = "", fmtbuf[20];
+  char path[JSON_MAX_PATH_LEN] = "";
   int i = 0;
   char *p = NULL;
-  struct json_scanf_info info = {0, path, fmtbuf, NULL, NULL, 0};
+  struct json_scanf_batch b;
+
+  b.num_infos = b.buf_len = b.num_conversions = 0;
 
   while (fmt[i] != '\0') {
     if (fmt[i] == '{') {
@@ -1047,13 +1360,36 @@ int json_vscanf(const char *s, int len, const char *fmt, va_list ap) {
       if ((p = strrchr(path, '.')) != NULL) *p = '\0';
       i++;
     } else if (fmt[i] == '%') {
-      info.target = va_arg(ap, void *);
-      info.type = fmt[i + 1];
+      struct json_scanf_info *info;
+      int path_len = strlen(path);
+      /*
+       * A %M scanner may look at the targets of the preceding conversions,
+       * so it gets a walk of its own, after theirs and before the following
+       * ones, as if every conversion walked the document in format order.
+       */
+      if (fmt[i + 1] == 'M' || b.num_infos == JSON_SCANF_MAX_KEYS ||
+          b.buf_len + path_len + 1 + JSON_SCANF_MAX_CONV_LEN >
+              (int) sizeof(b.buf)) {
+        json_scanf_flush(s, len, &b);
+      }
+      info = &b.infos[b.num_infos++];
+      memset(info, 0, sizeof(*info));
+      memcpy(b.buf + b.buf_len, path, path_len + 1);
+      info->path = b.buf + b.buf_len;
+      info->path_hash = json_path_hash(path);
+      b.buf_len += path_len + 1;
+      info->fmt = "";
+      info->target = va_arg(ap, void *);
+      info->type = fmt[i + 1];
       switch (fmt[i + 1]) {
         case 'M':
+          info->user_data = va_arg(ap, void *);
+          json_scanf_flush(s, len, &b);
+          i += 2;
+          break;
         case 'V':
         case 'H':
-          info.user_data = va_arg(ap, void *);
+          info->user_data = va_arg(ap, void *);
         /* FALLTHROUGH */
         case 'B':
         case 'Q':
@@ -1063,14 +1399,19 @@ int json_vscanf(const char *s, int len, const char *fmt, va_list ap) {
         default: {
           const char *delims = ", \t\r\n]}";
           int conv_len = strcspn(fmt + i + 1, delims) + 1;
-          memcpy(fmtbuf, fmt + i, conv_len);
-          fmtbuf[conv_len] = '\0';
+          int n = conv_len < JSON_SCANF_MAX_CONV_LEN
+                      ? conv_len
+                      : JSON_SCANF_MAX_CONV_LEN - 1;
+          char *fmtbuf = b.buf + b.buf_len;
+          memcpy(fmtbuf, fmt + i, n);
+          fmtbuf[n] = '\0';
+          info->fmt = fmtbuf;
+          b.buf_len += n + 1;
           i += conv_len;
           i += strspn(fmt + i, delims);
           break;
         }
       }
-      json_walk(s, len, json_scanf_cb, &info);
     } else if (json_isalpha(fmt[i]) || json_get_utf8_char_len(fmt[i]) > 1) {
       char *pe;
       const char *delims = ": \r\n\t";
@@ -1084,7 +1425,8 @@ int json_vscanf(const char *s, int len, const char *fmt, va_list ap) {
       i++;
     }
   }
-  return info.num_conversions;
+  json_scanf_flush(s, len, &b);
+  return b.num_conversions;
 }
 
 int json_scanf(const char *str, int len, const char *fmt, ...) WEAK;
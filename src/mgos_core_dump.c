@@ -37,9 +37,37 @@ extern const char *build_version, *build_id;
 
 static mgos_cd_section_writer_f s_section_writers[8];
 
-#ifndef MGOS_BOOT_BUILD
+#ifdef MGOS_BOOT_BUILD
+static NOINSTR void cd_out(const char *s, size_t len) {
+  while (len-- > 0) mgos_cd_putc(*s++);
+}
+
+#define mgos_cd_wdt_feed mgos_wdt_feed
+#else
+static const struct mgos_cd_sink *s_sinks[2];
+static unsigned int s_active_sinks = 0;
+static bool s_console_enabled = true;
+
+void mgos_cd_putsn(const char *s, size_t len) __attribute__((weak));
+NOINSTR void mgos_cd_putsn(const char *s, size_t len) {
+  while (len-- > 0) mgos_cd_putc(*s++);
+}
+
+void mgos_cd_wdt_feed(void) __attribute__((weak));
+NOINSTR void mgos_cd_wdt_feed(void) {
+  mgos_wdt_feed();
+}
+
+static NOINSTR void cd_out(const char *s, size_t len) {
+  if (s_console_enabled || s_active_sinks == 0) mgos_cd_putsn(s, len);
+  for (int i = 0; i < (int) ARRAY_SIZE(s_sinks); i++) {
+    if (!(s_active_sinks & (1 << i))) continue;
+    s_sinks[i]->write(s, len, s_sinks[i]->arg);
+  }
+}
+
 void mgos_cd_puts(const char *s) {
-  while (*s != '\0') mgos_cd_putc(*s++);
+  cd_out(s, strlen(s));
 }
 
 void mgos_cd_printf(const char *fmt, ...) {
@@ -50,58 +78,222 @@ void mgos_cd_printf(const char *fmt, ...) {
   va_end(ap);
   mgos_cd_puts(buf);
 }
+
+bool mgos_cd_add_sink(const struct mgos_cd_sink *sink) {
+  for (int i = 0; i < (int) ARRAY_SIZE(s_sinks); i++) {
+    if (s_sinks[i] == NULL) {
+      s_sinks[i] = sink;
+      return true;
+    }
+  }
+  return false;
+}
+
+void mgos_cd_set_console_enabled(bool enabled) {
+  s_console_enabled = enabled;
+}
+
+static const struct mgos_cd_sink *get_stored_sink(void) {
+  for (int i = 0; i < (int) ARRAY_SIZE(s_sinks); i++) {
+    const struct mgos_cd_sink *sink = s_sinks[i];
+    if (sink == NULL) break;
+    if (sink->stored_size != NULL && sink->stored_size(sink->arg) > 0) {
+      return sink;
+    }
+  }
+  return NULL;
+}
+
+size_t mgos_cd_stored_size(void) {
+  const struct mgos_cd_sink *sink = get_stored_sink();
+  return (sink != NULL ? sink->stored_size(sink->arg) : 0);
+}
+
+int mgos_cd_stored_read(size_t offset, void *buf, size_t len) {
+  const struct mgos_cd_sink *sink = get_stored_sink();
+  if (sink == NULL || sink->read == NULL) return -1;
+  return sink->read(offset, buf, len, sink->arg);
+}
+
+void mgos_cd_stored_erase(void) {
+  for (int i = 0; i < (int) ARRAY_SIZE(s_sinks); i++) {
+    const struct mgos_cd_sink *sink = s_sinks[i];
+    if (sink == NULL) break;
+    if (sink->erase != NULL) sink->erase(sink->arg);
+  }
+}
+
+bool mgos_cd_stored_print(void) {
+  char buf[256];
+  size_t size = mgos_cd_stored_size(), offset = 0;
+  if (size == 0) return false;
+  while (offset < size) {
+    int n = mgos_cd_stored_read(offset, buf, sizeof(buf));
+    if (n <= 0) break;
+    mgos_cd_putsn(buf, n);
+    offset += n;
+  }
+  /* Keep it if it could not be read in full, it can be fetched by hand. */
+  if (offset < size) return false;
+  mgos_cd_stored_erase();
+  return true;
+}
 #endif  // MGOS_BOOT_BUILD
 
+#define MGOS_CD_LINE_LEN 160
+/* Words copied out of the section at a time, also max literal run length. */
+#define MGOS_CD_CHUNK_WORDS 16
+
 struct section_ctx {
   struct cs_base64_ctx b64_ctx;
   int col_counter;
   uint32_t crc32;
+  char line[MGOS_CD_LINE_LEN];
 };
 
+static NOINSTR void flush_line(struct section_ctx *ctx) {
+  if (ctx->col_counter == 0) return;
+  cd_out(ctx->line, ctx->col_counter);
+  ctx->col_counter = 0;
+}
+
 static NOINSTR void write_char(char c, void *user_data) {
   struct section_ctx *ctx = (struct section_ctx *) user_data;
-  mgos_cd_putc(c);
-  ctx->col_counter++;
-  if (ctx->col_counter >= 160) {
-    mgos_cd_puts("\r\n");
-    ctx->col_counter = 0;
-    mgos_wdt_feed();
+  ctx->line[ctx->col_counter++] = c;
+  if (ctx->col_counter >= MGOS_CD_LINE_LEN) {
+    flush_line(ctx);
+    cd_out("\r\n", 2);
+    mgos_cd_wdt_feed();
+  }
+}
+
+/* No printf at crash time: it is not async-signal-safe on hosted platforms. */
+static NOINSTR void cd_put_ulong(unsigned long v) {
+  char buf[24], *p = buf + sizeof(buf);
+  *--p = '\0';
+  do {
+    *--p = '0' + (v % 10);
+    v /= 10;
+  } while (v != 0);
+  mgos_cd_puts(p);
+}
+
+static NOINSTR void write_data(struct section_ctx *ctx, const void *data,
+                               size_t len) {
+  ctx->crc32 = cs_crc32(ctx->crc32, data, len);
+  cs_base64_update(&ctx->b64_ctx, (const char *) data, len);
+}
+
+#if MGOS_CD_COMPRESS
+/*
+ * "rle32" encoding: a sequence of records, each starting with a varint
+ * (LEB128) header of (n << 1 | rep). For rep = 1 a single word follows which
+ * is to be repeated n times, for rep = 0 n literal words follow.
+ * CRC is computed over the encoded stream, so repeated words are not hashed
+ * one by one.
+ */
+static NOINSTR void write_rle32_hdr(struct section_ctx *ctx, uint32_t n,
+                                    int rep) {
+  uint8_t buf[5];
+  size_t len = 0;
+  uint32_t v = (n << 1) | (rep ? 1 : 0);
+  do {
+    buf[len] = (v & 0x7f);
+    v >>= 7;
+    if (v != 0) buf[len] |= 0x80;
+    len++;
+  } while (v != 0);
+  write_data(ctx, buf, len);
+}
+
+static NOINSTR void write_rle32(struct section_ctx *ctx, const uint32_t *dp,
+                                const uint32_t *end) {
+  /* Words are read once and copied, the section may include our own stack. */
+  uint32_t buf[MGOS_CD_CHUNK_WORDS];
+  while (dp < end) {
+    uint32_t w = *dp;
+    uint32_t n = 1;
+    while (dp + n < end && dp[n] == w) n++;
+    if (n > 1) {
+      write_rle32_hdr(ctx, n, 1 /* rep */);
+      write_data(ctx, &w, sizeof(w));
+      dp += n;
+      continue;
+    }
+    /* Literal run, up to the start of the next repeat. */
+    buf[n - 1] = w;
+    while (n < MGOS_CD_CHUNK_WORDS && dp + n < end) {
+      uint32_t v = dp[n];
+      if (v == buf[n - 1]) {
+        n--;
+        break;
+      }
+      buf[n++] = v;
+    }
+    write_rle32_hdr(ctx, n, 0 /* rep */);
+    write_data(ctx, buf, n * sizeof(uint32_t));
+    dp += n;
   }
 }
+#endif
 
 NOINSTR void mgos_cd_write_section(const char *name, const void *p,
                                    size_t len) {
   struct section_ctx ctx = {.col_counter = 0, .crc32 = 0};
   cs_base64_init(&ctx.b64_ctx, write_char, &ctx);
-  mgos_cd_printf(",\r\n\"%s\": {\"addr\": %lu, \"data\": \"\r\n", name,
-                 (unsigned long) p);
-
   const uint32_t *dp = (const uint32_t *) p;
   const uint32_t *end = dp + (len / sizeof(uint32_t));
+  mgos_cd_puts(",\r\n\"");
+  mgos_cd_puts(name);
+  mgos_cd_puts("\": {\"addr\": ");
+  cd_put_ulong((unsigned long) p);
+#if MGOS_CD_COMPRESS
+  mgos_cd_puts(", \"enc\": \"rle32\", \"data\": \"\r\n");
+  write_rle32(&ctx, dp, end);
+#else
+  mgos_cd_puts(", \"data\": \"\r\n");
   while (dp < end) {
-    uint32_t tmp = *dp++;
-    ctx.crc32 = cs_crc32(ctx.crc32, &tmp, sizeof(tmp));
-    cs_base64_update(&ctx.b64_ctx, (char *) &tmp, sizeof(tmp));
+    uint32_t buf[MGOS_CD_CHUNK_WORDS];
+    size_t n = 0;
+    while (n < MGOS_CD_CHUNK_WORDS && dp < end) buf[n++] = *dp++;
+    write_data(&ctx, buf, n * sizeof(uint32_t));
   }
+#endif
   cs_base64_finish(&ctx.b64_ctx);
-  mgos_cd_printf("\", \"crc32\": %u}", (unsigned int) ctx.crc32);
+  flush_line(&ctx);
+  mgos_cd_puts("\", \"crc32\": ");
+  cd_put_ulong(ctx.crc32);
+  mgos_cd_puts("}");
 }
 
 NOINSTR void mgos_cd_write(void) {
+#ifndef MGOS_BOOT_BUILD
+  s_active_sinks = 0;
+  for (int i = 0; i < (int) ARRAY_SIZE(s_sinks); i++) {
+    const struct mgos_cd_sink *sink = s_sinks[i];
+    if (sink == NULL) break;
+    if (sink->begin == NULL || sink->begin(sink->arg)) {
+      s_active_sinks |= (1 << i);
+    }
+  }
+#endif
   mgos_cd_puts(MGOS_CORE_DUMP_START "{");
   mgos_cd_puts("\"app\": \"" MGOS_APP "\", ");
   mgos_cd_puts("\"arch\": \"" CS_STRINGIFY_MACRO(FW_ARCHITECTURE) "\", ");
-  mgos_cd_printf("\"version\": \"%s\", ", build_version);
-  mgos_cd_printf("\"build_id\": \"%s\"", build_id);
+  mgos_cd_puts("\"version\": \"");
+  mgos_cd_puts(build_version);
+  mgos_cd_puts("\", \"build_id\": \"");
+  mgos_cd_puts(build_id);
+  mgos_cd_puts("\"");
 #ifdef MGOS_SDK_BUILD_IMAGE
-  mgos_cd_printf(", \"build_image\": \"" MGOS_SDK_BUILD_IMAGE "\"");
+  mgos_cd_puts(", \"build_image\": \"" MGOS_SDK_BUILD_IMAGE "\"");
 #endif
 // For ARM targets, add profile information.
 #if defined(__FPU_PRESENT)
 #if __FPU_PRESENT
-  mgos_cd_printf(", \"target_features\": \"arm-with-m-vfp-d16.xml\"");
+  mgos_cd_puts(", \"target_features\": \"arm-with-m-vfp-d16.xml\"");
 #else
-  mgos_cd_printf(", \"target_features\": \"arm-with-m.xml\"");
+  mgos_cd_puts(", \"target_features\": \"arm-with-m.xml\"");
 #endif
 #endif
 
@@ -111,6 +303,14 @@ NOINSTR void mgos_cd_write(void) {
   }
 
   mgos_cd_puts("}" MGOS_CORE_DUMP_END);
+
+#ifndef MGOS_BOOT_BUILD
+  for (int i = 0; i < (int) ARRAY_SIZE(s_sinks); i++) {
+    if (!(s_active_sinks & (1 << i))) continue;
+    if (s_sinks[i]->end != NULL) s_sinks[i]->end(s_sinks[i]->arg);
+  }
+  s_active_sinks = 0;
+#endif
 }
 
 void mgos_cd_register_section_writer(mgos_cd_section_writer_f writer) {
@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdlib.h>
 
 #ifdef __cplusplus
@@ -25,6 +26,14 @@ extern "C" {
 
 #define MGOS_CORE_DUMP_SECTION_REGS "REGS"
 
+/*
+ * If enabled, sections are written in the compact "rle32" encoding
+ * (runs of identical words are collapsed). Requires a recent serve_core.
+ */
+#ifndef MGOS_CD_COMPRESS
+#define MGOS_CD_COMPRESS 0
+#endif
+
 typedef void (*mgos_cd_section_writer_f)(void);
 void mgos_cd_register_section_writer(mgos_cd_section_writer_f writer);
 
@@ -32,7 +41,64 @@ void mgos_cd_write(void);
 void mgos_cd_write_section(const char *name, const void *p, size_t len);
 
 #ifndef MGOS_BOOT_BUILD
+/*
+ * Core dump sink: receives the dump (including the delimiters) in addition to
+ * or instead of the console. All the write-side callbacks are invoked at crash
+ * time and must not use the heap.
+ * Persistent sinks (flash partition, file) also provide `stored_size`, `read`
+ * and `erase` so that the dump can be retrieved after reboot.
+ */
+struct mgos_cd_sink {
+  /* Prepare for writing. Return false to skip this sink. Optional. */
+  bool (*begin)(void *arg);
+  void (*write)(const char *data, size_t len, void *arg);
+  /* Finish writing, flush. Optional. */
+  void (*end)(void *arg);
+  /* Size of the stored dump, 0 if there isn't one. Optional. */
+  size_t (*stored_size)(void *arg);
+  /* Read stored dump data, returns number of bytes read or -1 on error. */
+  int (*read)(size_t offset, void *buf, size_t len, void *arg);
+  void (*erase)(void *arg);
+  void *arg;
+};
+
+/* Adds a sink. `sink` must remain valid. */
+bool mgos_cd_add_sink(const struct mgos_cd_sink *sink);
+
+/*
+ * Enable or disable console output of the dump (enabled by default).
+ * Console is still used if none of the sinks is ready to accept the dump.
+ */
+void mgos_cd_set_console_enabled(bool enabled);
+
+/* Size of the core dump stored by a persistent sink, 0 if none. */
+size_t mgos_cd_stored_size(void);
+
+/* Read a chunk of the stored core dump. Returns number of bytes or -1. */
+int mgos_cd_stored_read(size_t offset, void *buf, size_t len);
+
+/* Erase the stored core dump (e.g. after it has been uploaded). */
+void mgos_cd_stored_erase(void);
+
+/*
+ * Print the stored core dump to the console and erase it.
+ * Returns false if there was none or it could not be read in full.
+ */
+bool mgos_cd_stored_print(void);
+
+/*
+ * Called periodically while the dump is being written. Default implementation
+ * feeds the watchdog, platforms where that is not safe from a signal handler
+ * override it.
+ */
+void mgos_cd_wdt_feed(void);
+
 void mgos_cd_puts(const char *s);
+/*
+ * Outputs a chunk of data. Default implementation calls mgos_cd_putc for each
+ * char, platforms with a faster path may override it. Must be ISR-safe.
+ */
+void mgos_cd_putsn(const char *s, size_t len);
 void mgos_cd_printf(const char *fmt, ...)
 #ifdef __GNUC__
     __attribute__((format(printf, 1, 2)))
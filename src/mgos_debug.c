@@ -55,6 +55,10 @@ static inline void debug_unlock(void) {
 extern enum cs_log_level cs_log_cur_msg_level;
 #endif
 
+#if CS_LOG_ENABLE_SITE_CACHE
+uint16_t cs_log_site_cache_gen = 0;
+#endif
+
 void mgos_debug_write(int fd, const void *data, size_t len) {
   char buf[MGOS_DEBUG_TMP_BUF_SIZE];
   enum cs_log_level old_level;
@@ -121,6 +125,13 @@ out_unlock:
   debug_unlock();
 }
 
+void mgos_debug_set_file_level(const char *file_level) {
+  cs_log_set_file_level(file_level);
+#if CS_LOG_ENABLE_SITE_CACHE
+  CS_LOG_SITE_CACHE_INVALIDATE();
+#endif
+}
+
 void mgos_debug_flush(void) {
   if (s_stdout_uart >= 0) mgos_uart_flush(s_stdout_uart);
   if (s_stderr_uart >= 0) mgos_uart_flush(s_stderr_uart);
@@ -15,23 +15,242 @@
  * limitations under the License.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* sendfile(), st_mtim */
+#endif
+
 #include "mgos_file_utils.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 
 #include "common/cs_dbg.h"
 #include "common/mg_str.h"
 #include "common/platform.h"
 
+#include "mgos_hal.h"
+
 #if defined(SL_MAJOR_VERSION_NUM)
 #include "common/platforms/simplelink/sl_fs_slfs.h"
 #endif
 
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Size of the buffer used to copy, compare and hash files. Defaults to a
+ * flash sector; if that much heap is not available, smaller buffers are tried.
+ */
+#ifndef MGOS_FILE_BUF_SIZE
+#define MGOS_FILE_BUF_SIZE 4096
+#endif
+
+#define MGOS_FILE_MIN_BUF_SIZE 128
+
+/* Number of file digests remembered by mgos_file_digest(), 0 to disable. */
+#ifndef MGOS_FILE_DIGEST_CACHE_SIZE
+#define MGOS_FILE_DIGEST_CACHE_SIZE 4
+#endif
+
+static void *file_buf_alloc(size_t *size) {
+  size_t n;
+  for (n = MGOS_FILE_BUF_SIZE; n >= MGOS_FILE_MIN_BUF_SIZE; n /= 2) {
+    void *buf = malloc(n);
+    if (buf != NULL) {
+      *size = n;
+      return buf;
+    }
+  }
+  return NULL;
+}
+
+/* Reads up to len bytes, returns fewer only at the end of file or on error. */
+static size_t file_read_full(FILE *fp, void *buf, size_t len) {
+  size_t total = 0;
+  while (total < len) {
+    size_t n = fread((char *) buf + total, 1, len - total, fp);
+    if (n == 0) break;
+    total += n;
+  }
+  return total;
+}
+
+#if MGOS_FILE_DIGEST_CACHE_SIZE > 0
+/*
+ * The cache is shared by all callers, entries are looked up and updated under
+ * mgos_lock(). Files are hashed outside of it.
+ */
+struct file_digest_cache_entry {
+  char *fname;
+  mbedtls_md_type_t dt;
+  off_t size;
+  time_t mtime;
+  long mtime_ns;
+  uint8_t digest[MBEDTLS_MD_MAX_SIZE];
+};
+
+static struct file_digest_cache_entry
+    s_digest_cache[MGOS_FILE_DIGEST_CACHE_SIZE];
+static unsigned int s_digest_cache_next;
+
+static long file_mtime_ns(const struct stat *st) {
+#if defined(__linux__)
+  return st->st_mtim.tv_nsec;
+#else
+  (void) st;
+  return 0;
+#endif
+}
+
+/*
+ * Whether the file may still be modified without a change of mtime. File
+ * times come from a coarse clock: 1s on most embedded filesystems and a
+ * scheduler tick (CLOCK_REALTIME_COARSE) on Linux before 6.13, so two writes
+ * within the same tick leave the same mtime, and possibly the same size.
+ */
+static bool file_mtime_is_recent(const struct stat *st) {
+#if defined(__linux__)
+  struct timespec now, res;
+  long long mt, nt;
+  if (clock_gettime(CLOCK_REALTIME_COARSE, &now) != 0 ||
+      clock_getres(CLOCK_REALTIME_COARSE, &res) != 0) {
+    return true;
+  }
+  mt = (long long) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+  nt = (long long) now.tv_sec * 1000000000 + now.tv_nsec;
+  return mt + res.tv_nsec + (long long) res.tv_sec * 1000000000 > nt;
+#else
+  return st->st_mtime >= time(NULL);
+#endif
+}
+
+static struct file_digest_cache_entry *file_digest_cache_find(
+    const char *fname, mbedtls_md_type_t dt) {
+  int i;
+  for (i = 0; i < MGOS_FILE_DIGEST_CACHE_SIZE; i++) {
+    struct file_digest_cache_entry *e = &s_digest_cache[i];
+    if (e->fname != NULL && e->dt == dt && strcmp(e->fname, fname) == 0) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Returns the cached digest of the file if it has not been modified since.
+ * Files without mtime (SPIFFS) are never cached.
+ */
+static bool file_digest_cache_get(const char *fname, mbedtls_md_type_t dt,
+                                  const struct stat *st, uint8_t *digest) {
+  struct file_digest_cache_entry *e;
+  bool res = false;
+  if (st->st_mtime == 0) return false;
+  mgos_lock();
+  e = file_digest_cache_find(fname, dt);
+  if (e != NULL && e->size == st->st_size && e->mtime == st->st_mtime &&
+      e->mtime_ns == file_mtime_ns(st)) {
+    memcpy(digest, e->digest,
+           mbedtls_md_get_size(mbedtls_md_info_from_type(dt)));
+    res = true;
+  }
+  mgos_unlock();
+  return res;
+}
+
+static void file_digest_cache_put(const char *fname, mbedtls_md_type_t dt,
+                                  const struct stat *st,
+                                  const uint8_t *digest) {
+  struct file_digest_cache_entry *e;
+  if (st->st_mtime == 0 || file_mtime_is_recent(st)) return;
+  mgos_lock();
+  e = file_digest_cache_find(fname, dt);
+  if (e == NULL) {
+    e = &s_digest_cache[s_digest_cache_next++ % MGOS_FILE_DIGEST_CACHE_SIZE];
+    free(e->fname);
+    e->fname = strdup(fname);
+    if (e->fname == NULL) goto out;
+    e->dt = dt;
+  }
+  e->size = st->st_size;
+  e->mtime = st->st_mtime;
+  e->mtime_ns = file_mtime_ns(st);
+  memcpy(e->digest, digest, mbedtls_md_get_size(mbedtls_md_info_from_type(dt)));
+out:
+  mgos_unlock();
+}
+
+/* Forgets digests of a file that is about to be written. */
+static void file_digest_cache_drop(const char *fname) {
+  int i;
+  mgos_lock();
+  for (i = 0; i < MGOS_FILE_DIGEST_CACHE_SIZE; i++) {
+    struct file_digest_cache_entry *e = &s_digest_cache[i];
+    if (e->fname != NULL && strcmp(e->fname, fname) == 0) {
+      free(e->fname);
+      e->fname = NULL;
+    }
+  }
+  mgos_unlock();
+}
+#else
+#define file_digest_cache_get(fname, dt, st, digest) false
+#define file_digest_cache_put(fname, dt, st, digest)
+#define file_digest_cache_drop(fname)
+#endif /* MGOS_FILE_DIGEST_CACHE_SIZE > 0 */
+
+#if defined(__linux__)
+/*
+ * Copies the file in the kernel: copy_file_range() (which can share extents
+ * on filesystems that support it), or sendfile() if that is not available.
+ * Returns -1 if neither can be used for these files, before anything is
+ * written.
+ */
+static int file_copy_kernel(int from_fd, int to_fd, size_t size) {
+  size_t total = 0;
+  bool use_sendfile = false;
+  while (total < size) {
+    ssize_t n = -1;
+#ifdef SYS_copy_file_range
+    if (!use_sendfile) {
+      n = syscall(SYS_copy_file_range, from_fd, NULL, to_fd, NULL,
+                  size - total, 0);
+      if (n < 0 && total == 0 &&
+          (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+           errno == EOPNOTSUPP)) {
+        use_sendfile = true;
+      }
+    }
+#else
+    use_sendfile = true;
+#endif
+    if (use_sendfile) {
+      n = sendfile(to_fd, from_fd, NULL, size - total);
+      if (n < 0 && total == 0 && (errno == EINVAL || errno == ENOSYS)) {
+        return -1;
+      }
+    }
+    if (n < 0) return 0;
+    if (n == 0) break; /* File shrunk. */
+    total += n;
+  }
+  return 1;
+}
+#endif
+
 bool mgos_file_copy(const char *from, const char *to) {
   bool ret = false;
   FILE *from_fp = NULL, *to_fp = NULL;
-  int total = 0;
+  struct stat st;
+  size_t total = 0, buf_size = 0;
+  char *buf = NULL;
 
   LOG(LL_INFO, ("Copying %s -> %s", from, to));
 
@@ -52,35 +271,55 @@ bool mgos_file_copy(const char *from, const char *to) {
   }
 #endif
 
+  file_digest_cache_drop(to);
   to_fp = fopen(to, "w");
   if (to_fp == NULL) {
     LOG(LL_ERROR, ("Failed to open %s", to));
     goto out;
   }
 
-  char buf[128];
+#if defined(__linux__)
+  if (fstat(fileno(from_fp), &st) == 0 && S_ISREG(st.st_mode)) {
+    int r = file_copy_kernel(fileno(from_fp), fileno(to_fp), st.st_size);
+    if (r == 0) {
+      LOG(LL_ERROR, ("Failed to copy %s to %s: %d", from, to, errno));
+      goto out;
+    }
+    if (r > 0) {
+      LOG(LL_DEBUG, ("Wrote %ld to %s", (long) st.st_size, to));
+      ret = true;
+      goto out;
+    }
+  }
+#else
+  (void) st;
+#endif
+
+  buf = (char *) file_buf_alloc(&buf_size);
+  if (buf == NULL) goto out;
   while (true) {
-    int n = fread(buf, 1, sizeof(buf), from_fp);
-    if (n < 0) {
+    size_t n = file_read_full(from_fp, buf, buf_size);
+    if (ferror(from_fp)) {
       LOG(LL_ERROR, ("Failed to read from %s", from));
       goto out;
     }
-    if (fwrite(buf, 1, n, to_fp) != (size_t) n) {
-      LOG(LL_ERROR, ("Failed to write %d bytes to %s", n, to));
+    if (fwrite(buf, 1, n, to_fp) != n) {
+      LOG(LL_ERROR, ("Failed to write %d bytes to %s", (int) n, to));
       goto out;
     }
     total += n;
-    if (n < (int) sizeof(buf)) break;
+    if (n < buf_size) break;
   }
 
-  LOG(LL_DEBUG, ("Wrote %d to %s", total, to));
+  LOG(LL_DEBUG, ("Wrote %d to %s", (int) total, to));
 
   ret = true;
 
 out:
+  free(buf);
   if (from_fp != NULL) fclose(from_fp);
   if (to_fp != NULL) {
-    fclose(to_fp);
+    if (fclose(to_fp) != 0) ret = false;
     if (!ret) remove(to);
   }
 #if defined(MG_FS_SLFS)
@@ -97,6 +336,9 @@ bool mgos_file_digest(const char *fname, mbedtls_md_type_t dt,
   FILE *fp = NULL;
   mbedtls_md_context_t ctx;
   const mbedtls_md_info_t *di;
+  struct stat st;
+  size_t buf_size = 0;
+  unsigned char *buf = NULL;
 
   mbedtls_md_init(&ctx);
   di = mbedtls_md_info_from_type(dt);
@@ -105,30 +347,76 @@ bool mgos_file_digest(const char *fname, mbedtls_md_type_t dt,
   fp = fopen(fname, "r");
   if (fp == NULL) goto out;
 
-  unsigned char buf[128];
+  if (stat(fname, &st) != 0) st.st_mtime = 0;
+  if (file_digest_cache_get(fname, dt, &st, digest)) {
+    res = true;
+    goto out;
+  }
+
+  buf = (unsigned char *) file_buf_alloc(&buf_size);
+  if (buf == NULL) goto out;
   if (mbedtls_md_setup(&ctx, di, false /* hmac */) != 0) goto out;
   if (mbedtls_md_starts(&ctx) != 0) goto out;
   while (true) {
-    int n = fread(buf, 1, sizeof(buf), fp);
-    if (n < 0) goto out;
+    size_t n = file_read_full(fp, buf, buf_size);
+    if (ferror(fp)) goto out;
     if (mbedtls_md_update(&ctx, buf, n) != 0) goto out;
-    if (n < (int) sizeof(buf)) break;
+    if (n < buf_size) break;
   }
   if (mbedtls_md_finish(&ctx, digest) != 0) goto out;
+  file_digest_cache_put(fname, dt, &st, digest);
   res = true;
 
 out:
+  free(buf);
   if (fp != NULL) fclose(fp);
   mbedtls_md_free(&ctx);
   return res;
 }
 
+/*
+ * Compares contents of two files of the same size chunk by chunk, stops at
+ * the first difference. Returns -1 if the files could not be compared.
+ */
+static int file_cmp(const char *a, const char *b) {
+  int res = -1;
+  FILE *fpa = fopen(a, "r"), *fpb = fopen(b, "r");
+  size_t buf_size = 0, half;
+  char *buf = (char *) file_buf_alloc(&buf_size);
+  if (fpa == NULL || fpb == NULL || buf == NULL) goto out;
+  half = buf_size / 2;
+  while (true) {
+    size_t na = file_read_full(fpa, buf, half);
+    size_t nb = file_read_full(fpb, buf + half, half);
+    if (ferror(fpa) || ferror(fpb)) goto out;
+    if (na != nb || memcmp(buf, buf + half, na) != 0) {
+      res = 1;
+      break;
+    }
+    if (na < half) {
+      res = 0;
+      break;
+    }
+  }
+out:
+  free(buf);
+  if (fpa != NULL) fclose(fpa);
+  if (fpb != NULL) fclose(fpb);
+  return res;
+}
+
 bool mgos_file_copy_if_different(const char *from, const char *to) {
   bool res = false;
+  struct stat sf, st;
   uint8_t df[32], dt[32];
-  if (!mgos_file_digest(from, MBEDTLS_MD_SHA256, df)) goto out;
-  if (!mgos_file_digest(to, MBEDTLS_MD_SHA256, dt)) goto out;
-  res = (memcmp(df, dt, sizeof(df)) == 0);
+  if (stat(from, &sf) != 0 || stat(to, &st) != 0) goto out;
+  if (sf.st_size != st.st_size) goto out;
+  if (file_digest_cache_get(from, MBEDTLS_MD_SHA256, &sf, df) &&
+      file_digest_cache_get(to, MBEDTLS_MD_SHA256, &st, dt)) {
+    res = (memcmp(df, dt, sizeof(df)) == 0);
+  } else {
+    res = (file_cmp(from, to) == 0);
+  }
   if (res) {
     LOG(LL_DEBUG, ("%s and %s are the same", from, to));
   }
@@ -17,6 +17,8 @@
 
 #include "mgos_hw_timers_hal.h"
 
+#if !MGOS_HW_TIMERS_MUX
+
 #include "common/cs_dbg.h"
 
 #include "mgos_hal.h"
@@ -94,3 +96,5 @@ void mgos_hw_timers_deinit(void) {
     mgos_clear_hw_timer(s_timers[i].id);
   }
 }
+
+#endif /* !MGOS_HW_TIMERS_MUX */
@@ -7,6 +7,7 @@
 #define CS_FW_SRC_MGOS_HW_TIMERS_HAL_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "common/platform.h"
 
@@ -29,15 +30,66 @@ struct mgos_hw_timer_dev_data {};
 extern "C" {
 #endif
 
+/*
+ * If set, MGOS_NUM_HW_TIMERS virtual timers are multiplexed onto a single
+ * physical one, see mgos_hw_timers_mux.c.
+ */
+#ifndef MGOS_HW_TIMERS_MUX
+#define MGOS_HW_TIMERS_MUX 0
+#endif
+
 struct mgos_hw_timer_info {
   mgos_timer_id id;
   timer_callback cb;
   void *cb_arg;
   int flags;
+#if MGOS_HW_TIMERS_MUX
+  uint32_t deadline; /* Microseconds, mgos_hw_timers_mux_dev_now() time. */
+  uint32_t period;
+  struct mgos_hw_timer_info *next;
+#endif
   /* Device-specific data. */
   struct mgos_hw_timer_dev_data dev;
 };
 
+#if MGOS_HW_TIMERS_MUX
+
+/*
+ * Multiplexer HAL. Platform provides a free-running microsecond counter and
+ * a single comparator, instead of the per-timer mgos_hw_timers_dev_* API.
+ */
+
+/* Current value of the free-running microsecond counter. */
+uint32_t mgos_hw_timers_mux_dev_now(void);
+
+/*
+ * Arrange for mgos_hw_timers_mux_isr() to be invoked once, at `when`.
+ * If `when` is too close or in the past, it should fire as soon as possible.
+ * Deadlines further away than the hardware can handle may fire early.
+ * Replaces previously armed deadline.
+ */
+void mgos_hw_timers_mux_dev_arm(uint32_t when);
+
+void mgos_hw_timers_mux_dev_disarm(void);
+
+bool mgos_hw_timers_mux_dev_init(void);
+
+/* Invoke this as the ISR. */
+void mgos_hw_timers_mux_isr(void);
+
+struct mgos_hw_timers_mux_stats {
+  uint32_t num_isrs;
+  uint32_t num_calls;  /* Callbacks invoked. */
+  uint32_t max_late;   /* Worst callback lateness, us. */
+  uint64_t sum_late;   /* Sum of lateness of all the calls, us. */
+  uint32_t latency;    /* Current ISR latency estimate, us. */
+};
+
+/* Get dispatch statistics since init. */
+void mgos_hw_timers_mux_get_stats(struct mgos_hw_timers_mux_stats *st);
+
+#else
+
 bool mgos_hw_timers_dev_set(struct mgos_hw_timer_info *ti, int usecs,
                             int flags);
 
@@ -51,6 +103,11 @@ void mgos_hw_timers_dev_clear(struct mgos_hw_timer_info *ti);
 
 bool mgos_hw_timers_dev_init(struct mgos_hw_timer_info *ti);
 
+#endif /* MGOS_HW_TIMERS_MUX */
+
+/* Used by mgos_clear_timer() for ids returned by mgos_set_hw_timer(). */
+void mgos_clear_hw_timer(mgos_timer_id id);
+
 enum mgos_init_result mgos_hw_timers_init(void);
 void mgos_hw_timers_deinit(void);
 
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Virtual HW timers on top of a single comparator.
+ *
+ * Active timers are kept on a list sorted by deadline, and the comparator
+ * is always programmed for the earliest one. The ISR dispatches everything
+ * that is due (or nearly so), re-queues repeating timers and re-arms for the
+ * new head of the list.
+ *
+ * The time it takes from the comparator firing to the ISR running is
+ * measured on every interrupt and the comparator is armed that much early,
+ * so callbacks are invoked on time on average. What remains is absorbed by
+ * busy-waiting for deadlines that are closer than MGOS_HW_TIMERS_MUX_SPIN_US,
+ * which is cheaper than taking another interrupt.
+ */
+
+#include "mgos_hw_timers_hal.h"
+
+#if MGOS_HW_TIMERS_MUX
+
+#include "common/cs_dbg.h"
+
+#include "mgos_hal.h"
+
+#ifndef IRAM
+#define IRAM
+#endif
+
+/* Deadlines this close are waited for in the ISR instead of re-arming. */
+#ifndef MGOS_HW_TIMERS_MUX_SPIN_US
+#define MGOS_HW_TIMERS_MUX_SPIN_US 10
+#endif
+
+/* Minimum period of a repeating timer. */
+#ifndef MGOS_HW_TIMERS_MUX_MIN_PERIOD_US
+#define MGOS_HW_TIMERS_MUX_MIN_PERIOD_US 50
+#endif
+
+/* Initial estimate of the ISR entry latency. */
+#ifndef MGOS_HW_TIMERS_MUX_LATENCY_US
+#define MGOS_HW_TIMERS_MUX_LATENCY_US 0
+#endif
+
+/* Latency estimate is not allowed to exceed this. */
+#ifndef MGOS_HW_TIMERS_MUX_MAX_LATENCY_US
+#define MGOS_HW_TIMERS_MUX_MAX_LATENCY_US 100
+#endif
+
+/* Estimate is kept in 1/16 us and moves by 1/8 of the error each time. */
+#define LAT_SHIFT 4
+#define LAT_GAIN_SHIFT 3
+
+#define TIME_BEFORE(a, b) ((int32_t)((a) - (b)) < 0)
+
+static struct mgos_hw_timer_info s_timers[MGOS_NUM_HW_TIMERS];
+/* Active timers, earliest deadline first. */
+static struct mgos_hw_timer_info *s_queue = NULL;
+/* Deadline the comparator is currently armed for, if it has not fired yet. */
+static uint32_t s_armed_deadline;
+static bool s_armed = false;
+/* Comparator is enabled. It stays so after firing, until disarmed. */
+static bool s_dev_armed = false;
+/* Whether the comparator had enough lead time to measure latency with. */
+static bool s_armed_calibrate = false;
+static int32_t s_latency = (MGOS_HW_TIMERS_MUX_LATENCY_US << LAT_SHIFT);
+static bool s_in_isr = false;
+static struct mgos_hw_timers_mux_stats s_stats;
+
+static IRAM void queue_insert(struct mgos_hw_timer_info *ti) {
+  struct mgos_hw_timer_info **p = &s_queue;
+  /* Equal deadlines fire in the order they were queued. */
+  while (*p != NULL && !TIME_BEFORE(ti->deadline, (*p)->deadline)) {
+    p = &(*p)->next;
+  }
+  ti->next = *p;
+  *p = ti;
+}
+
+static IRAM void queue_remove(struct mgos_hw_timer_info *ti) {
+  struct mgos_hw_timer_info **p;
+  for (p = &s_queue; *p != NULL; p = &(*p)->next) {
+    if (*p == ti) {
+      *p = ti->next;
+      break;
+    }
+  }
+  ti->next = NULL;
+}
+
+/* Program the comparator for the head of the queue. Interrupts must be off. */
+static IRAM void rearm(void) {
+  uint32_t lat, when;
+  /* ISR will re-arm when it's done. */
+  if (s_in_isr) return;
+  if (s_queue == NULL) {
+    if (s_dev_armed) {
+      mgos_hw_timers_mux_dev_disarm();
+      s_dev_armed = false;
+    }
+    s_armed = false;
+    return;
+  }
+  if (s_armed && s_armed_deadline == s_queue->deadline) return;
+  lat = (uint32_t)(s_latency >> LAT_SHIFT);
+  when = s_queue->deadline - lat;
+  s_armed_deadline = s_queue->deadline;
+  s_armed_calibrate = TIME_BEFORE(mgos_hw_timers_mux_dev_now() +
+                                      MGOS_HW_TIMERS_MUX_SPIN_US,
+                                  when);
+  s_armed = s_dev_armed = true;
+  mgos_hw_timers_mux_dev_arm(when);
+}
+
+static IRAM void update_latency(uint32_t now) {
+  int32_t err = (int32_t)(now - s_armed_deadline);
+  /* Early wakeups (deadline beyond hardware range) are not latency. */
+  if (err < -MGOS_HW_TIMERS_MUX_MAX_LATENCY_US ||
+      err > MGOS_HW_TIMERS_MUX_MAX_LATENCY_US) {
+    return;
+  }
+  s_latency += err * (1 << LAT_SHIFT) / (1 << LAT_GAIN_SHIFT);
+  if (s_latency < 0) s_latency = 0;
+  if (s_latency > (MGOS_HW_TIMERS_MUX_MAX_LATENCY_US << LAT_SHIFT)) {
+    s_latency = (MGOS_HW_TIMERS_MUX_MAX_LATENCY_US << LAT_SHIFT);
+  }
+}
+
+IRAM void mgos_hw_timers_mux_isr(void) {
+  uint32_t now = mgos_hw_timers_mux_dev_now();
+  if (s_armed && s_armed_calibrate) update_latency(now);
+  s_armed = false;
+  s_stats.num_isrs++;
+  s_in_isr = true;
+  while (s_queue != NULL) {
+    struct mgos_hw_timer_info *ti = s_queue;
+    timer_callback cb = ti->cb;
+    void *cb_arg = ti->cb_arg;
+    int32_t left = (int32_t)(ti->deadline - now);
+    if (left > MGOS_HW_TIMERS_MUX_SPIN_US) break;
+    while (left > 0) {
+      now = mgos_hw_timers_mux_dev_now();
+      left = (int32_t)(ti->deadline - now);
+    }
+    s_stats.num_calls++;
+    s_stats.sum_late += (uint32_t) -left;
+    if ((uint32_t) -left > s_stats.max_late) s_stats.max_late = -left;
+    s_queue = ti->next;
+    if (ti->flags & MGOS_TIMER_REPEAT) {
+      ti->deadline += ti->period;
+      /* If we fell behind by more than a period, skip the missed ticks. */
+      if (TIME_BEFORE(ti->deadline, now)) ti->deadline = now + ti->period;
+      queue_insert(ti);
+    } else {
+      /* Release a one-shot timer before invoking the callback so it can be
+       * rescheduled from within it. */
+      ti->next = NULL;
+      ti->cb_arg = NULL;
+      ti->cb = NULL;
+    }
+    cb(cb_arg);
+    now = mgos_hw_timers_mux_dev_now();
+  }
+  s_in_isr = false;
+  rearm();
+}
+
+IRAM mgos_timer_id mgos_set_hw_timer(int usecs, int flags, timer_callback cb,
+                                     void *cb_arg) {
+  mgos_timer_id id;
+  struct mgos_hw_timer_info *ti = NULL;
+  if (usecs < 0 || ((flags & MGOS_TIMER_REPEAT) &&
+                    usecs < MGOS_HW_TIMERS_MUX_MIN_PERIOD_US)) {
+    LOG(LL_ERROR, ("Invalid HW timer value %d", usecs));
+    return MGOS_INVALID_TIMER_ID;
+  }
+  mgos_ints_disable();
+  for (id = 0; (int) id < MGOS_NUM_HW_TIMERS; id++) {
+    if (s_timers[id].cb == NULL) {
+      ti = &s_timers[id];
+      break;
+    }
+  }
+  if (ti == NULL) {
+    mgos_ints_enable();
+    LOG(LL_ERROR, ("No HW timers available."));
+    return MGOS_INVALID_TIMER_ID;
+  }
+  ti->cb = cb;
+  ti->cb_arg = cb_arg;
+  ti->flags = flags;
+  ti->period = usecs;
+  ti->deadline = mgos_hw_timers_mux_dev_now() + usecs;
+  queue_insert(ti);
+  rearm();
+  mgos_ints_enable();
+  return id + 1;
+}
+
+IRAM void mgos_clear_hw_timer(mgos_timer_id id) {
+  if (id < 1 || id > MGOS_NUM_HW_TIMERS) return;
+  struct mgos_hw_timer_info *ti = &s_timers[id - 1];
+  mgos_ints_disable();
+  if (ti->cb != NULL) {
+    queue_remove(ti);
+    ti->cb_arg = NULL;
+    ti->cb = NULL;
+    rearm();
+  }
+  mgos_ints_enable();
+}
+
+void mgos_hw_timers_mux_get_stats(struct mgos_hw_timers_mux_stats *st) {
+  mgos_ints_disable();
+  *st = s_stats;
+  st->latency = (uint32_t)(s_latency >> LAT_SHIFT);
+  mgos_ints_enable();
+}
+
+enum mgos_init_result mgos_hw_timers_init(void) {
+  for (int i = 0; i < MGOS_NUM_HW_TIMERS; i++) {
+    s_timers[i].id = i + 1;
+  }
+  if (!mgos_hw_timers_mux_dev_init()) {
+    return MGOS_INIT_TIMERS_INIT_FAILED;
+  }
+  return MGOS_INIT_OK;
+}
+
+void mgos_hw_timers_deinit(void) {
+  for (int i = 0; i < MGOS_NUM_HW_TIMERS; i++) {
+    mgos_clear_hw_timer(s_timers[i].id);
+  }
+}
+
+#endif /* MGOS_HW_TIMERS_MUX */
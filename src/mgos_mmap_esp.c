@@ -18,6 +18,7 @@
 #ifdef CS_MMAP
 
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
@@ -35,52 +36,78 @@
 #endif
 
 /*
- * Reads unaligned byte, handles mmapped addresses properly.
+ * Returns the aligned word at addr, with at least the bytes in mask valid.
+ * Handles mmapped addresses properly: the descriptor is looked up once per
+ * word, and only the bytes in mask are read, since reading the rest of the
+ * word could go past the last mapped page of the file.
+ */
+IRAM NOINSTR static uint32_t read_word(uint32_t addr, uint8_t mask) {
+  struct mgos_vfs_mmap_desc *desc;
+  uint32_t off, word = 0;
+  int i;
+
+  if (addr >= (uint32_t) MMAP_END) return *(uint32_t *) addr;
+
+  desc = MMAP_DESC_FROM_ADDR(addr);
+  off = MMAP_ADDR_FROM_ADDR(addr);
+  for (i = 0; i < 4; i++) {
+    if (!(mask & (1 << i))) continue;
+    word |= (uint32_t) desc->fs->ops->read_mmapped_byte(desc, off + i) << 8 * i;
+  }
+  return word;
+}
+
+/* Loads size (1, 2 or 4) bytes at addr, little-endian, zero-extended. */
+IRAM NOINSTR static uint32_t read_data(uint32_t addr, int size) {
+  uint32_t base = addr & ~0x3, val;
+  int shift = addr & 0x3;
+
+  if (shift + size <= 4) {
+    /* All 32-bit loads (they are aligned) and most 8- and 16-bit ones. */
+    val = read_word(base, ((1 << size) - 1) << shift) >> 8 * shift;
+  } else {
+    val = read_word(base, 0xf & (0xf << shift)) >> 8 * shift |
+          read_word(base + 4, 0xf >> (8 - shift - size)) << 8 * (4 - shift);
+  }
+  return (size == 4 ? val : val & ((1U << 8 * size) - 1));
+}
+
+/*
+ * Reads the 16-bit instruction prefix at pc.
  *
  * TODO(dfrank):
  * On esp32, just dereferencing the `uint8_t *` which points to the instruction
  * memory results in a load-store-error, like on esp8266. On esp8266 we have a
- * generic exception handler which emulates that, on esp32 it's TODO.
- *
- * So when esp32 also handles it generically, we need to rename
- * read_unaligned_byte to read_mmapped_byte, and don't use it to read the
- * instruction in esp_mmap_exception_handler
+ * generic exception handler which emulates that, on esp32 it's TODO. Until
+ * then, instruction memory is read by words.
  */
-IRAM NOINSTR static uint8_t read_unaligned_byte(uint8_t *addr) {
-  uint32_t *base = (uint32_t *) ((uintptr_t) addr & ~0x3);
-  uint32_t word;
-
-  if (addr >= (uint8_t *) MMAP_BASE && addr < (uint8_t *) MMAP_END) {
-    /* The byte is mmapped */
-    struct mgos_vfs_mmap_desc *desc = MMAP_DESC_FROM_ADDR(addr);
-    return desc->fs->ops->read_mmapped_byte(desc, MMAP_ADDR_FROM_ADDR(addr));
-  }
-
-  word = *base;
-  return (uint8_t)(word >> 8 * ((uintptr_t) addr & 0x3));
+IRAM NOINSTR static uint32_t read_instr(uint8_t *pc) {
+  uint32_t *base = (uint32_t *) ((uintptr_t) pc & ~0x3);
+  int shift = (uintptr_t) pc & 0x3;
+  uint32_t instr = base[0] >> 8 * shift;
+  if (shift == 3) instr |= base[1] << 8;
+  return instr & 0xffff;
 }
 
 IRAM NOINSTR int esp_mmap_exception_handler(uint32_t vaddr, uint8_t *pc,
                                             long *pa2) {
   int pc_inc = 0;
 
-  uint32_t instr = (uint32_t) read_unaligned_byte(pc) |
-                   ((uint32_t) read_unaligned_byte(pc + 1) << 8);
+  uint32_t instr = read_instr(pc);
   uint8_t at = (instr >> 4) & 0xf;
 
   uint32_t val = 0;
 
   if ((instr & 0xf00f) == 0x2) {
     /* l8ui at, as, imm       r = 0 */
-    val = read_unaligned_byte((uint8_t *) vaddr);
+    val = read_data(vaddr, 1);
     pc_inc = 3;
   } else if ((instr & 0x700f) == 0x1002) {
     /*
      * l16ui at, as, imm      r = 1
      * l16si at, as, imm      r = 9
      */
-    val = read_unaligned_byte((uint8_t *) vaddr) |
-          read_unaligned_byte((uint8_t *) vaddr + 1) << 8;
+    val = read_data(vaddr, 2);
     if (instr & 0x8000) val = (int16_t) val;
     pc_inc = 3;
   } else if ((instr & 0xf00f) == 0x2002 || (instr & 0xf) == 0x8) {
@@ -88,14 +115,7 @@ IRAM NOINSTR int esp_mmap_exception_handler(uint32_t vaddr, uint8_t *pc,
      * l32i   at, as, imm      r = 2
      * l32i.n at, as, imm
      */
-    /*
-     * TODO(dfrank): provide fast code path for aligned access since
-     * all mmap 32-bit loads will be aligned.
-     */
-    val = read_unaligned_byte((uint8_t *) vaddr) |
-          read_unaligned_byte((uint8_t *) vaddr + 1) << 8 |
-          read_unaligned_byte((uint8_t *) vaddr + 2) << 16 |
-          read_unaligned_byte((uint8_t *) vaddr + 3) << 24;
+    val = read_data(vaddr, 4);
     pc_inc = ((instr & 0xf) == 0x8) ? 2 : 3;
   } else {
     fprintf(stderr, "cannot emulate flash mem instr at pc = %p\n", (void *) pc);
@@ -24,6 +24,7 @@
 #include "mgos_event.h"
 #include "mgos_hal.h"
 #include "mgos_mongoose.h"
+#include "mgos_pool.h"
 #include "mgos_system.h"
 #ifdef MGOS_HAVE_PPPOS
 #include "mgos_pppos.h"
@@ -38,6 +39,9 @@ struct net_ev_info {
   enum mgos_net_event ev;
 };
 
+static struct mgos_pool s_net_ev_pool =
+    MGOS_POOL_INIT("net_ev", sizeof(struct net_ev_info), 4, 0);
+
 static const char *get_if_name(enum mgos_net_if_type if_type, int if_instance) {
   const char *name = "";
   switch (if_type) {
@@ -109,18 +113,21 @@ static void mgos_net_on_change_cb(void *arg) {
 
   mgos_event_trigger(ei->ev, &evd);
 
-  free(ei);
+  mgos_pool_free(&s_net_ev_pool, ei);
   (void) if_name;
 }
 
 void mgos_net_dev_event_cb(enum mgos_net_if_type if_type, int if_instance,
                            enum mgos_net_event ev) {
-  struct net_ev_info *ei = (struct net_ev_info *) calloc(1, sizeof(*ei));
+  struct net_ev_info *ei =
+      (struct net_ev_info *) mgos_pool_zalloc(&s_net_ev_pool);
   if (ei == NULL) return;
   ei->if_type = if_type;
   ei->if_instance = if_instance;
   ei->ev = ev;
-  mgos_invoke_cb(mgos_net_on_change_cb, ei, false /* from_isr */);
+  if (!mgos_invoke_cb(mgos_net_on_change_cb, ei, false /* from_isr */)) {
+    mgos_pool_free(&s_net_ev_pool, ei);
+  }
 }
 
 bool mgos_net_get_ip_info(enum mgos_net_if_type if_type, int if_instance,
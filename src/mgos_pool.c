@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mgos_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "frozen.h"
+
+#include "mgos_hal.h"
+#include "mgos_system.h"
+
+struct mgos_pool_slab {
+  struct mgos_pool_slab *next;
+  char *end;
+};
+
+#define SLAB_HDR_SIZE MGOS_POOL_ALIGN_SIZE(sizeof(struct mgos_pool_slab))
+
+/*
+ * All pools that have at least one slab. Only ever grows. Protected by
+ * interrupt disabling, which works for pools of either kind, but never while
+ * holding a pool lock: mgos_ints_disable() does not nest on all platforms.
+ */
+static struct mgos_pool *s_pools = NULL;
+
+static inline void pool_lock(const struct mgos_pool *p) {
+  if (p->flags & MGOS_POOL_F_ISR_SAFE) {
+    mgos_ints_disable();
+  } else {
+    mgos_lock();
+  }
+}
+
+static inline void pool_unlock(const struct mgos_pool *p) {
+  if (p->flags & MGOS_POOL_F_ISR_SAFE) {
+    mgos_ints_enable();
+  } else {
+    mgos_unlock();
+  }
+}
+
+/* Must be called with the pool locked. */
+static int pool_add_slab_locked(struct mgos_pool *p, void *buf, size_t len) {
+  struct mgos_pool_slab *s = (struct mgos_pool_slab *) buf;
+  char *obj;
+  int i, n;
+  if (len < SLAB_HDR_SIZE + p->obj_size) return 0;
+  n = (len - SLAB_HDR_SIZE) / p->obj_size;
+  s->end = ((char *) buf) + SLAB_HDR_SIZE + n * p->obj_size;
+  s->next = p->slabs;
+  p->slabs = s;
+  /* Thread the objects so that they are handed out in address order. */
+  for (i = 0, obj = s->end - p->obj_size; i < n; i++, obj -= p->obj_size) {
+    *((void **) obj) = p->free_list;
+    p->free_list = obj;
+  }
+  p->num_total += n;
+  return n;
+}
+
+/* Must be called with no locks held. */
+static void pool_register(struct mgos_pool *p) {
+  mgos_ints_disable();
+  if (!p->registered) {
+    p->registered = 1;
+    p->next = s_pools;
+    s_pools = p;
+  }
+  mgos_ints_enable();
+}
+
+int mgos_pool_add_slab(struct mgos_pool *p, void *buf, size_t len) {
+  int n;
+  pool_lock(p);
+  n = pool_add_slab_locked(p, buf, len);
+  pool_unlock(p);
+  if (n > 0) pool_register(p);
+  return n;
+}
+
+static bool pool_grow(struct mgos_pool *p) {
+  size_t len;
+  void *buf;
+  if (p->flags & MGOS_POOL_F_NO_GROW) return false;
+  len = SLAB_HDR_SIZE + (size_t) p->obj_size * p->objs_per_slab;
+  buf = malloc(len);
+  if (buf == NULL) return false;
+  mgos_pool_add_slab(p, buf, len);
+  return true;
+}
+
+bool mgos_pool_reserve(struct mgos_pool *p, int n) {
+  int num_free;
+  while (true) {
+    pool_lock(p);
+    num_free = p->num_total - p->num_used;
+    pool_unlock(p);
+    if (num_free >= n) break;
+    /* Do not hold the lock while in malloc. */
+    if (!pool_grow(p)) return false;
+  }
+  return true;
+}
+
+void *mgos_pool_alloc(struct mgos_pool *p) {
+  void *obj;
+  pool_lock(p);
+  if (p->free_list == NULL) {
+    /* Do not hold the lock while in malloc. */
+    pool_unlock(p);
+    pool_grow(p);
+    pool_lock(p);
+  }
+  obj = p->free_list;
+  if (obj != NULL) {
+    p->free_list = *((void **) obj);
+    p->num_used++;
+    if (p->num_used > p->max_used) p->max_used = p->num_used;
+    p->num_allocs++;
+  } else {
+    p->num_fails++;
+  }
+  pool_unlock(p);
+  return obj;
+}
+
+void *mgos_pool_zalloc(struct mgos_pool *p) {
+  void *obj = mgos_pool_alloc(p);
+  if (obj != NULL) memset(obj, 0, p->obj_size);
+  return obj;
+}
+
+void mgos_pool_free(struct mgos_pool *p, void *obj) {
+  if (obj == NULL) return;
+  pool_lock(p);
+  *((void **) obj) = p->free_list;
+  p->free_list = obj;
+  p->num_used--;
+  pool_unlock(p);
+}
+
+bool mgos_pool_owns(const struct mgos_pool *p, const void *ptr) {
+  const struct mgos_pool_slab *s;
+  bool res = false;
+  pool_lock(p);
+  for (s = p->slabs; s != NULL; s = s->next) {
+    if ((const char *) ptr >= ((const char *) s) + SLAB_HDR_SIZE &&
+        (const char *) ptr < s->end) {
+      res = true;
+      break;
+    }
+  }
+  pool_unlock(p);
+  return res;
+}
+
+void mgos_pool_get_stats(struct mgos_pool *p, struct mgos_pool_stats *st) {
+  const struct mgos_pool_slab *s;
+  memset(st, 0, sizeof(*st));
+  pool_lock(p);
+  st->name = p->name;
+  st->obj_size = p->obj_size;
+  for (s = p->slabs; s != NULL; s = s->next) st->num_slabs++;
+  st->num_total = p->num_total;
+  st->num_used = p->num_used;
+  st->max_used = p->max_used;
+  st->num_allocs = p->num_allocs;
+  st->num_fails = p->num_fails;
+  pool_unlock(p);
+}
+
+struct mgos_pool *mgos_pool_next(struct mgos_pool *p) {
+  struct mgos_pool *res;
+  mgos_ints_disable();
+  res = (p == NULL ? s_pools : p->next);
+  mgos_ints_enable();
+  return res;
+}
+
+int mgos_pool_stats_json(struct json_out *out) {
+  int len = json_printf(out, "[");
+  struct mgos_pool *p, *first = mgos_pool_next(NULL);
+  for (p = first; p != NULL; p = mgos_pool_next(p)) {
+    struct mgos_pool_stats st;
+    mgos_pool_get_stats(p, &st);
+    len += json_printf(out,
+                       "%s{name: %Q, size: %d, slabs: %d, total: %d, "
+                       "used: %d, max_used: %d, allocs: %d, fails: %d}",
+                       (p == first ? "" : ", "), st.name, (int) st.obj_size,
+                       st.num_slabs, st.num_total, st.num_used, st.max_used,
+                       st.num_allocs, st.num_fails);
+  }
+  len += json_printf(out, "]");
+  return len;
+}
@@ -23,18 +23,20 @@
 #include "mgos_features.h"
 #include "mgos_mongoose.h"
 #include "mgos_mongoose_internal.h"
+#include "mgos_pool.h"
 #include "mgos_system.h"
 #include "mgos_time.h"
 
+/*
+ * HW timer ids are small integers, 1 to MGOS_NUM_HW_TIMERS, SW timer ids are
+ * pointers. Pointers can have the upper bits clear (e.g. x86-64 user space),
+ * so compare against the range rather than masking.
+ */
 #if MGOS_NUM_HW_TIMERS > 0
-#ifdef __LP64__
-#define MGOS_SW_TIMER_MASK 0xffff000000000000
-#else
-#define MGOS_SW_TIMER_MASK 0xffff0000
-#endif
+#define MGOS_IS_HW_TIMER_ID(id) ((id) <= MGOS_NUM_HW_TIMERS)
 #else
 /* All timers are soft timers. */
-#define MGOS_SW_TIMER_MASK ((uintptr_t) -1)
+#define MGOS_IS_HW_TIMER_ID(id) false
 #endif
 
 #ifndef IRAM
@@ -56,6 +58,8 @@ struct timer_data {
 };
 
 static struct timer_data *s_timer_data = NULL;
+static struct mgos_pool s_timer_pool =
+    MGOS_POOL_INIT("timers", sizeof(struct timer_info), 8, 0);
 static struct mgos_rlock_type *s_timer_data_lock = NULL;
 
 static void schedule_next_timer(struct timer_data *td) {
@@ -96,7 +100,7 @@ static void mgos_timer_ev(struct mg_connection *nc, int ev, void *ev_data,
     }
     schedule_next_timer(td);
     mgos_runlock(s_timer_data_lock);
-    if (ti != NULL) free(ti);
+    if (ti != NULL) mgos_pool_free(&s_timer_pool, ti);
   }
   if (cb != NULL) cb(cb_arg);
   (void) ev_data;
@@ -105,7 +109,8 @@ static void mgos_timer_ev(struct mg_connection *nc, int ev, void *ev_data,
 
 mgos_timer_id mgos_set_timer(int msecs, int flags, timer_callback cb,
                              void *arg) {
-  struct timer_info *ti = (struct timer_info *) calloc(1, sizeof(*ti));
+  struct timer_info *ti =
+      (struct timer_info *) mgos_pool_zalloc(&s_timer_pool);
   if (ti == NULL) return MGOS_INVALID_TIMER_ID;
   if (flags & MGOS_TIMER_REPEAT) {
     ti->interval_ms = msecs;
@@ -146,7 +151,7 @@ static void mgos_clear_sw_timer(mgos_timer_id id) {
     /* Removing a timer can only push back invocation, no need to do a poll. */
   }
   mgos_runlock(s_timer_data_lock);
-  free(ti);
+  mgos_pool_free(&s_timer_pool, ti);
 }
 
 void mgos_clear_hw_timer(mgos_timer_id id);
@@ -154,10 +159,10 @@ void mgos_clear_hw_timer(mgos_timer_id id);
 IRAM void mgos_clear_timer(mgos_timer_id id) {
   if (id == MGOS_INVALID_TIMER_ID) {
     return;
-  } else if (id & MGOS_SW_TIMER_MASK) {
-    mgos_clear_sw_timer(id);
-  } else {
+  } else if (MGOS_IS_HW_TIMER_ID(id)) {
     mgos_clear_hw_timer(id);
+  } else {
+    mgos_clear_sw_timer(id);
   }
 }
 
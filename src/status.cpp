@@ -25,44 +25,45 @@ Status Status::OK() {
   return Status();
 }
 
+// static
+Status Status::FromStatic(Rep *rep) {
+  Status res;
+  res.rep_ = rep;
+  return res;
+}
+
 // static
 Status Status::CANCELLED() {
-  return Status(STATUS_CANCELLED, "Cancelled");
+  static Rep rep = {kStaticRefs, STATUS_CANCELLED, "Cancelled"};
+  return FromStatic(&rep);
 }
 
 // static
 Status Status::UNIMPLEMENTED() {
-  return Status(STATUS_UNIMPLEMENTED, "Unimplemented");
+  static Rep rep = {kStaticRefs, STATUS_UNIMPLEMENTED, "Unimplemented"};
+  return FromStatic(&rep);
 }
 
 // static
 Status Status::UNKNOWN() {
-  return Status(STATUS_UNKNOWN, "Unknown");
+  static Rep rep = {kStaticRefs, STATUS_UNKNOWN, "Unknown"};
+  return FromStatic(&rep);
 }
 
-Status::Status() : code_(STATUS_OK), message_("") {
-}
-
-Status::Status(int error, const std::string &error_message)
-    : code_(error), message_(error_message) {
-  if (code_ == STATUS_OK) {
-    message_.clear();
+Status::Status(int error, const std::string &error_message) : rep_(nullptr) {
+  if (error != STATUS_OK) {
+    rep_ = new Rep{1, error, error_message};
   }
 }
 
-Status::Status(const Status &other)
-    : code_(other.code_), message_(other.message_) {
-}
-
-Status &Status::operator=(const Status &other) {
-  code_ = other.code_;
-  message_ = other.message_;
-  return *this;
+const std::string &Status::error_message() const {
+  static const std::string empty;
+  return (rep_ == nullptr ? empty : rep_->message);
 }
 
 std::string Status::ToString() const {
-  if (message_.empty()) return StatusToString(code_);
-  return StatusToString(code_) + ": " + message_;
+  if (error_message().empty()) return StatusToString(error_code());
+  return StatusToString(error_code()) + ": " + error_message();
 }
 
 Status Errorf(int code, const char *msg_fmt, ...) {
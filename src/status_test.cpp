@@ -1,96 +1,203 @@
 #include <common/util/status.h>
 
-#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <new>
 #include <string>
 
 #include <gtest/gtest.h>
 
-#include <common/util/logging.h>
+// Counts heap allocations made by the tests.
+static int s_num_allocs = 0;
+
+void *operator new(size_t size) {
+  s_num_allocs++;
+  void *p = malloc(size);
+  if (p == nullptr) abort();
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
 
-namespace util {
+void operator delete(void *p, size_t size) noexcept {
+  (void) size;
+  free(p);
+}
 
-using util::Status;
+namespace mgos {
 
-void VerifyOk(const Status *s) {
-  EXPECT_TRUE(s->ok());
-  EXPECT_EQ(error::OK, s->error_code());
-  EXPECT_EQ("", s->error_message());
-  EXPECT_EQ("OK", s->ToString());
+void VerifyOk(const Status &s) {
+  EXPECT_TRUE(s.ok());
+  EXPECT_EQ(STATUS_OK, s.error_code());
+  EXPECT_EQ("", s.error_message());
+  EXPECT_EQ("OK", s.ToString());
 }
 
 TEST(StatusTest, DefaultConstructedOK) {
   Status s;
-  VerifyOk(&s);
+  VerifyOk(s);
 }
 
 TEST(StatusTest, ConstantOK) {
-  VerifyOk(&Status::OK);
+  VerifyOk(Status::OK());
 }
 
 TEST(StatusTest, ConstantCancelled) {
-  EXPECT_FALSE(Status::CANCELLED.ok());
-  EXPECT_EQ(error::CANCELLED, Status::CANCELLED.error_code());
-  EXPECT_EQ("", Status::CANCELLED.error_message());
-  EXPECT_EQ("CANCELLED", Status::CANCELLED.ToString());
+  EXPECT_FALSE(Status::CANCELLED().ok());
+  EXPECT_EQ(STATUS_CANCELLED, Status::CANCELLED().error_code());
+  EXPECT_EQ("Cancelled", Status::CANCELLED().error_message());
+  EXPECT_EQ("CANCELLED: Cancelled", Status::CANCELLED().ToString());
 }
 
 TEST(StatusTest, ConstantUnknown) {
-  EXPECT_FALSE(Status::UNKNOWN.ok());
-  EXPECT_EQ(error::UNKNOWN, Status::UNKNOWN.error_code());
-  EXPECT_EQ("", Status::UNKNOWN.error_message());
-  EXPECT_EQ("UNKNOWN", Status::UNKNOWN.ToString());
+  EXPECT_FALSE(Status::UNKNOWN().ok());
+  EXPECT_EQ(STATUS_UNKNOWN, Status::UNKNOWN().error_code());
+  EXPECT_EQ("Unknown", Status::UNKNOWN().error_message());
+  EXPECT_EQ("UNKNOWN: Unknown", Status::UNKNOWN().ToString());
 }
 
 TEST(StatusTest, CustomCodeAndEmptyMessage) {
-  Status s(error::NOT_FOUND, "");
-  EXPECT_EQ(error::NOT_FOUND, s.error_code());
+  Status s(STATUS_NOT_FOUND, "");
+  EXPECT_EQ(STATUS_NOT_FOUND, s.error_code());
   EXPECT_EQ("", s.error_message());
   EXPECT_EQ("NOT_FOUND", s.ToString());
 }
 
 TEST(StatusTest, CustomCodeAndMessage) {
-  Status s(error::NOT_FOUND, "Nothing here");
-  EXPECT_EQ(error::NOT_FOUND, s.error_code());
+  Status s(STATUS_NOT_FOUND, "Nothing here");
+  EXPECT_EQ(STATUS_NOT_FOUND, s.error_code());
   EXPECT_EQ("Nothing here", s.error_message());
   EXPECT_EQ("NOT_FOUND: Nothing here", s.ToString());
 }
 
+TEST(StatusTest, OKCodeDropsMessage) {
+  Status s(STATUS_OK, "Nothing here");
+  VerifyOk(s);
+}
+
 TEST(StatusTest, Equality) {
-  Status s1(error::NOT_FOUND, "Nothing here");
-  Status s2(error::NOT_FOUND, "Nothing here");
+  Status s1(STATUS_NOT_FOUND, "Nothing here");
+  Status s2(STATUS_NOT_FOUND, "Nothing here");
   EXPECT_EQ(s1, s2);
-  Status s3(error::NOT_FOUND, "Nothing here.");
+  Status s3(STATUS_NOT_FOUND, "Nothing here.");
   EXPECT_NE(s1, s3);
   EXPECT_EQ(s1.error_code(), s3.error_code());
-  Status s4(error::INTERNAL, "Nothing here");
+  Status s4(STATUS_INTERNAL, "Nothing here");
   EXPECT_EQ(s1.error_message(), s2.error_message());
   EXPECT_NE(s1, s4);
+  EXPECT_NE(s1, Status::OK());
+  EXPECT_EQ(Status(), Status::OK());
 }
 
 TEST(StatusTest, CopyConstruction) {
-  Status s1(error::NOT_FOUND, "Nothing here");
-  Status s2(error::NOT_FOUND, "Nothing here");
+  Status s1(STATUS_NOT_FOUND, "Nothing here");
+  Status s2(STATUS_NOT_FOUND, "Nothing here");
   Status s3(s2);
   EXPECT_EQ(s2, s3);
   EXPECT_EQ(s1, s3);
 }
 
 TEST(StatusTest, Assignment) {
-  Status s1(error::NOT_FOUND, "Nothing here");
+  Status s1(STATUS_NOT_FOUND, "Nothing here");
   Status s2;
   {
-    Status s3(error::NOT_FOUND, "Nothing here");
+    Status s3(STATUS_NOT_FOUND, "Nothing here");
     s2 = s3;
   }
   EXPECT_EQ(s1, s2);
+  s2 = s2;
+  EXPECT_EQ(s1, s2);
+  s2 = Status::OK();
+  VerifyOk(s2);
+}
+
+TEST(StatusTest, MoveConstruction) {
+  Status s1(STATUS_NOT_FOUND, "Nothing here");
+  Status s2(std::move(s1));
+  EXPECT_EQ(Status(STATUS_NOT_FOUND, "Nothing here"), s2);
+  VerifyOk(s1);
+}
+
+TEST(StatusTest, MoveAssignment) {
+  Status s1(STATUS_NOT_FOUND, "Nothing here");
+  Status s2(STATUS_INTERNAL, "Oops");
+  s2 = std::move(s1);
+  EXPECT_EQ(Status(STATUS_NOT_FOUND, "Nothing here"), s2);
+  VerifyOk(s1);
+}
+
+TEST(StatusTest, Annotatef) {
+  Status s = Annotatef(Errorf(STATUS_NOT_FOUND, "no %s", "file"), "open %d", 1);
+  EXPECT_EQ(STATUS_NOT_FOUND, s.error_code());
+  EXPECT_EQ("open 1 : no file", s.error_message());
+}
+
+TEST(StatusTest, NoAllocations) {
+  int n = s_num_allocs;
+  {
+    Status s1;
+    Status s2(s1);
+    Status s3 = Status::OK();
+    s3 = s2;
+    s2 = std::move(s3);
+    Status s4 = Status::UNKNOWN();
+    Status s5(s4);
+    s4 = Status::CANCELLED();
+    s5 = Status::UNIMPLEMENTED();
+    EXPECT_FALSE(s5.ok());
+  }
+  EXPECT_EQ(n, s_num_allocs);
+  // Copies of an error share the message.
+  Status s6(STATUS_INTERNAL, "Something went wrong here");
+  n = s_num_allocs;
+  Status s7(s6), s8;
+  s8 = s7;
+  EXPECT_EQ(n, s_num_allocs);
+  EXPECT_EQ(s6, s8);
+}
+
+static uint64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+__attribute__((noinline)) Status ReturnStatus(int i) {
+  if (i < 0) return Status(STATUS_INVALID_ARGUMENT, "negative");
+  return Status::OK();
+}
+
+__attribute__((noinline)) Status ReturnUnknown(int i) {
+  if (i < 0) return Status(STATUS_INVALID_ARGUMENT, "negative");
+  return Status::UNKNOWN();
+}
+
+__attribute__((noinline)) Status ReturnError(int i) {
+  return Errorf(STATUS_INVALID_ARGUMENT, "bad value %d", i);
+}
+
+static void Bench(const char *name, Status (*fn)(int), int iters) {
+  int n = s_num_allocs, num_ok = 0;
+  uint64_t t = NowNs();
+  for (int i = 0; i < iters; i++) {
+    Status s = fn(i);
+    Status s2(s);
+    if (s2.ok()) num_ok++;
+  }
+  double ns = (double) (NowNs() - t) / iters;
+  printf("%-24s %8.1f ns/op %6.2f allocs/op\n", name, ns,
+         (double) (s_num_allocs - n) / iters);
+  EXPECT_GE(num_ok, 0);
 }
 
-TEST(StatusTest, Streamification) {
-  Status s(error::NOT_FOUND, "Nothing here");
-  std::stringstream ss;
-  ss << s;
-  const std::string stream_output = ss.rdbuf()->str();
-  EXPECT_EQ(s.ToString(), stream_output);
+TEST(StatusTest, Benchmark) {
+  Bench("return OK + copy", ReturnStatus, 10000000);
+  Bench("return UNKNOWN + copy", ReturnUnknown, 10000000);
+  Bench("Errorf + copy", ReturnError, 1000000);
 }
 
-}  // namespace util
+}  // namespace mgos
@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * json_walk() throughput on a synthetic corpus: the vectorized tokenizer
+ * against the scalar one (frozen.c built with JSON_FAST_SCAN=0).
+ * json_scanf() of 1, 5 and 20 keys from a 4K message: one call for all keys
+ * against one call per key.
+ * json_printf() of an RPC-like reply: output rate and printer calls per
+ * message, which is what a socket or UART printer pays for.
+ * Usage: json_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "frozen.h"
+
+int json_walk_scalar(const char *json_string, int json_string_length,
+                     json_walk_callback_t callback, void *callback_data);
+
+typedef int (*walk_fn_t)(const char *, int, json_walk_callback_t, void *);
+
+struct corpus {
+  const char *name;
+  char *data;
+  int len;
+};
+
+static void count_cb(void *callback_data, const char *name, size_t name_len,
+                     const char *path, const struct json_token *token) {
+  (*(int *) callback_data)++;
+  (void) name;
+  (void) name_len;
+  (void) path;
+  (void) token;
+}
+
+static int append(char *buf, int len, const char *s) {
+  int n = strlen(s);
+  memcpy(buf + len, s, n);
+  return len + n;
+}
+
+/* Config-like object: short keys, short values, pretty-printed. */
+static void make_config(struct corpus *c) {
+  int i, len = 0;
+  char *buf = malloc(256 * 1024), tmp[200];
+  len = append(buf, len, "{\n");
+  for (i = 0; i < 2000; i++) {
+    snprintf(tmp, sizeof(tmp),
+             "  \"section%d\": {\n    \"enable\": %s,\n    \"port\": %d,\n"
+             "    \"host\": \"host%d.example.com\",\n    \"ids\": [%d, %d, %d]"
+             "\n  }%s\n",
+             i, (i & 1 ? "true" : "false"), 1000 + i, i, i, i * 2, i * 3,
+             (i == 1999 ? "" : ","));
+    len = append(buf, len, tmp);
+  }
+  len = append(buf, len, "}\n");
+  c->name = "config";
+  c->data = buf;
+  c->len = len;
+}
+
+/* Array of long strings, with occasional escapes and UTF-8. */
+static void make_strings(struct corpus *c) {
+  int i, j, len = 0;
+  char *buf = malloc(1024 * 1024);
+  len = append(buf, len, "[");
+  for (i = 0; i < 2000; i++) {
+    len = append(buf, len, (i == 0 ? "\"" : ", \""));
+    for (j = 0; j < 400; j++) buf[len++] = 'a' + (i + j) % 26;
+    if (i % 4 == 0) len = append(buf, len, "\\\"quoted\\\"");
+    if (i % 8 == 0) len = append(buf, len, " \xd0\xbf\xd1\x80\xd0\xb8");
+    for (j = 0; j < 100; j++) buf[len++] = '0' + j % 10;
+    len = append(buf, len, "\"");
+  }
+  len = append(buf, len, "]");
+  c->name = "strings";
+  c->data = buf;
+  c->len = len;
+}
+
+/* Minified records, as returned by RPC. */
+static void make_records(struct corpus *c) {
+  int i, len = 0;
+  char *buf = malloc(512 * 1024), tmp[300];
+  len = append(buf, len, "{\"result\":[");
+  for (i = 0; i < 2000; i++) {
+    snprintf(tmp, sizeof(tmp),
+             "%s{\"id\":%d,\"name\":\"device-%08x\",\"fw\":\"2.19.1\","
+             "\"desc\":\"A reasonably long description of the device %d\","
+             "\"ok\":true,\"rssi\":-%d}",
+             (i == 0 ? "" : ","), i, i * 2654435761u, i, i % 90);
+    len = append(buf, len, tmp);
+  }
+  len = append(buf, len, "]}");
+  c->name = "records";
+  c->data = buf;
+  c->len = len;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run(walk_fn_t fn, const struct corpus *c, int iters,
+                  json_walk_callback_t cb, int *ntok) {
+  int i;
+  double start = now();
+  for (i = 0; i < iters; i++) {
+    *ntok = 0;
+    if (fn(c->data, c->len, cb, ntok) <= 0) {
+      fprintf(stderr, "%s: parse error\n", c->name);
+      exit(1);
+    }
+  }
+  return (double) c->len * iters / (now() - start) / 1e6;
+}
+
+/* 4K message with 20 fields to be extracted, interleaved with others. */
+static void make_message(struct corpus *c) {
+  int i, len = 0;
+  char *buf = malloc(8192), tmp[300];
+  len = append(buf, len, "{");
+  for (i = 0; i < 20; i++) {
+    snprintf(tmp, sizeof(tmp),
+             "%s\"f%d\":%d,\"pad%d\":{\"name\":\"padding padding %d\","
+             "\"list\":[1,2,3,4,5,6,7,8],\"flag\":false,\"desc\":\"some "
+             "longer text to make the message bigger, about 4K in total %d\"}",
+             (i == 0 ? "" : ","), i, i, i, i, i);
+    len = append(buf, len, tmp);
+  }
+  len = append(buf, len, "}");
+  c->name = "message";
+  c->data = buf;
+  c->len = len;
+}
+
+static int scan_keys(const struct corpus *c, int nkeys, int per_key,
+                     int *v) {
+  const char *s = c->data;
+  int n = 0, len = c->len;
+  if (nkeys == 1) return json_scanf(s, len, "{f0:%d}", &v[0]);
+  if (nkeys == 5 && !per_key) {
+    return json_scanf(s, len, "{f0:%d f4:%d f9:%d f14:%d f19:%d}", &v[0],
+                      &v[4], &v[9], &v[14], &v[19]);
+  }
+  if (nkeys == 20 && !per_key) {
+    return json_scanf(s, len,
+                      "{f0:%d f1:%d f2:%d f3:%d f4:%d f5:%d f6:%d f7:%d f8:%d "
+                      "f9:%d f10:%d f11:%d f12:%d f13:%d f14:%d f15:%d f16:%d "
+                      "f17:%d f18:%d f19:%d}",
+                      &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7],
+                      &v[8], &v[9], &v[10], &v[11], &v[12], &v[13], &v[14],
+                      &v[15], &v[16], &v[17], &v[18], &v[19]);
+  }
+  {
+    /* One json_scanf() call per key, same as it used to be done internally. */
+    int i, step = 20 / nkeys;
+    char fmt[20];
+    for (i = 0; i < 20; i += step) {
+      snprintf(fmt, sizeof(fmt), "{f%d:%%d}", i);
+      n += json_scanf(s, len, fmt, &v[i]);
+    }
+  }
+  return n;
+}
+
+static void bench_scanf(const struct corpus *c, int iters) {
+  static const int nkeys[] = {1, 5, 20};
+  int i, j, k, v[20];
+  printf("\n%-8s %8s  %10s %10s\n", "keys", "bytes", "one call", "per key");
+  for (i = 0; i < 3; i++) {
+    double t[2];
+    for (k = 0; k < 2; k++) {
+      double start = now();
+      for (j = 0; j < iters; j++) {
+        if (scan_keys(c, nkeys[i], k, v) != nkeys[i]) {
+          fprintf(stderr, "%d keys: scanf error\n", nkeys[i]);
+          exit(1);
+        }
+      }
+      t[k] = (now() - start) / iters * 1e6;
+    }
+    printf("%-8d %8d  %8.1fus %8.1fus\n", nkeys[i], c->len, t[0], t[1]);
+  }
+}
+
+struct counting_out {
+  struct json_out out; /* must be first */
+  int calls;
+};
+
+static int counting_printer(struct json_out *out, const char *buf,
+                            size_t len) {
+  ((struct counting_out *) out)->calls++;
+  return json_printer_buf(out, buf, len);
+}
+
+static int print_record(struct json_out *out, int i) {
+  return json_printf(out,
+                     "{id: %d, name: \"device-%08x\", fw: %Q, desc: %Q, "
+                     "uptime: %lu, heap: %u, ok: %B, rssi: %d}",
+                     i, i * 2654435761u, "2.19.1",
+                     "A reasonably long description of the device", 12345678UL,
+                     41234u, i & 1, -(i % 90));
+}
+
+static void bench_printf(int iters) {
+  char buf[4096];
+  struct counting_out c;
+  int i, j, len = 0;
+  double start = now();
+  for (i = 0; i < iters; i++) {
+    struct json_out o = JSON_OUT_BUF(buf, sizeof(buf));
+    c.out = o;
+    c.out.printer = counting_printer;
+    c.calls = 0;
+    len = json_printf(&c.out, "{id: %d, result: [", i);
+    for (j = 0; j < 10; j++) {
+      if (j > 0) len += json_printf(&c.out, ", ");
+      len += print_record(&c.out, j);
+    }
+    len += json_printf(&c.out, "]}");
+  }
+  printf("\n%-8s %8s  %10s %10s\n", "printf", "bytes", "MB/s", "calls/msg");
+  printf("%-8s %8d  %10.1f %10d\n", "records", len,
+         (double) len * iters / (now() - start) / 1e6, c.calls);
+}
+
+int main(int argc, char *argv[]) {
+  struct corpus corpora[3];
+  int i, n1, n2, iters = (argc > 1 ? atoi(argv[1]) : 200);
+  make_config(&corpora[0]);
+  make_strings(&corpora[1]);
+  make_records(&corpora[2]);
+  printf("%-8s %8s  %10s %10s  %10s %10s\n", "corpus", "bytes", "fast MB/s",
+         "scalar", "no cb fast", "scalar");
+  for (i = 0; i < 3; i++) {
+    const struct corpus *c = &corpora[i];
+    double f = run(json_walk, c, iters, count_cb, &n1);
+    double s = run(json_walk_scalar, c, iters, count_cb, &n2);
+    double fn, sn;
+    if (n1 != n2) {
+      fprintf(stderr, "%s: %d vs %d tokens\n", c->name, n1, n2);
+      return 1;
+    }
+    fn = run(json_walk, c, iters, NULL, &n1);
+    sn = run(json_walk_scalar, c, iters, NULL, &n2);
+    printf("%-8s %8d  %10.1f %10.1f  %10.1f %10.1f\n", c->name, c->len, f, s,
+           fn, sn);
+    free(c->data);
+  }
+  make_message(&corpora[0]);
+  bench_scanf(&corpora[0], iters * 50);
+  free(corpora[0].data);
+  bench_printf(iters * 50);
+  return 0;
+}
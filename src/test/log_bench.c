@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Cost of a LOG() statement that is filtered out: by the global level and by
+ * a debug.file_level pattern, with and without CS_LOG_ENABLE_SITE_CACHE, and
+ * compiled out by CS_LOG_MIN_LEVEL.
+ * cs_log_print_prefix() here follows the filter of cs_dbg.c: it builds the
+ * "file:line" prefix and matches it against the comma-separated patterns.
+ * Usage: log_bench [iterations]
+ */
+
+#define CS_LOG_ENABLE_SITE_CACHE 1
+#define CS_LOG_MIN_LEVEL LL_DEBUG
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common/cs_dbg.h"
+
+/* The LOG() macro without the site cache */
+#define LOG_NO_CACHE(l, x)                              \
+  do {                                                  \
+    if (cs_log_print_prefix(l, __FILE__, __LINE__)) {   \
+      cs_log_printf x;                                  \
+    }                                                   \
+  } while (0)
+
+enum cs_log_level cs_log_level = LL_INFO;
+uint16_t cs_log_site_cache_gen = 0;
+static char *s_file_level = NULL;
+static int s_num_printed = 0;
+
+void cs_log_set_level(enum cs_log_level level) {
+  cs_log_level = level;
+}
+
+void cs_log_set_file_level(const char *file_level) {
+  free(s_file_level);
+  s_file_level = (file_level != NULL ? strdup(file_level) : NULL);
+}
+
+int cs_log_print_prefix(enum cs_log_level level, const char *file, int ln) {
+  char prefix[CS_LOG_PREFIX_LEN];
+  const char *p, *q;
+  int pl;
+
+  if (level > cs_log_level && s_file_level == NULL) return 0;
+
+  p = strrchr(file, '/');
+  p = (p != NULL ? p + 1 : file);
+  pl = snprintf(prefix, sizeof(prefix), "%s:%d", p, ln);
+  if (pl >= (int) sizeof(prefix)) pl = sizeof(prefix) - 1;
+
+  if (s_file_level != NULL) {
+    enum cs_log_level pll = cs_log_level;
+    for (p = s_file_level; *p != '\0'; p = (*q == ',' ? q + 1 : q)) {
+      const char *eq = p;
+      while (*eq != '=' && *eq != ',' && *eq != '\0') eq++;
+      q = eq;
+      while (*q != ',' && *q != '\0') q++;
+      if (*eq != '=' || eq + 1 == q) continue;
+      if (eq - p > pl || strncmp(prefix, p, eq - p) != 0) continue;
+      pll = (enum cs_log_level)(eq[1] - '0');
+      break;
+    }
+    if (level > pll) return 0;
+  }
+  s_num_printed++;
+  return 1;
+}
+
+void cs_log_printf(const char *fmt, ...) {
+  (void) fmt;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Each runs a suppressed debug statement in a loop, kept out of line */
+static __attribute__((noinline)) void loop_no_cache(int n) {
+  int i;
+  for (i = 0; i < n; i++) LOG_NO_CACHE(LL_DEBUG, ("i = %d", i));
+}
+
+static __attribute__((noinline)) void loop_cache(int n) {
+  int i;
+  for (i = 0; i < n; i++) LOG(LL_DEBUG, ("i = %d", i));
+}
+
+static __attribute__((noinline)) void loop_compiled_out(int n) {
+  int i;
+  for (i = 0; i < n; i++) LOG(LL_VERBOSE_DEBUG, ("i = %d", i));
+}
+
+static double bench(void (*fn)(int), int n) {
+  double t = now();
+  fn(n);
+  return (now() - t) * 1e9 / n;
+}
+
+static void run(const char *name, int n) {
+  double nc = bench(loop_no_cache, n), c = bench(loop_cache, n);
+  double co = bench(loop_compiled_out, n);
+  printf("%-32s %8.2f %8.2f %8.2f\n", name, nc, c, co);
+}
+
+int main(int argc, char **argv) {
+  int n = (argc > 1 ? atoi(argv[1]) : 10000000), printed, i;
+
+  printf("suppressed LOG(), ns/op           no cache    cache  min lvl\n");
+  cs_log_set_level(LL_INFO);
+  run("global level", n);
+
+  cs_log_set_file_level("mgos_wifi.c=4,mgos_net.c=3,mongoose.c=1,log_bench=2");
+  CS_LOG_SITE_CACHE_INVALIDATE();
+  cs_log_set_level(LL_VERBOSE_DEBUG);
+  run("file level", n);
+
+  /* Sites come back once the filter allows them */
+  cs_log_set_file_level("log_bench=3");
+  CS_LOG_SITE_CACHE_INVALIDATE();
+  printed = s_num_printed;
+  loop_cache(10);
+  if (s_num_printed != printed + 10) {
+    printf("cached site was not re-checked\n");
+    return EXIT_FAILURE;
+  }
+
+  /* A site filtered out long ago is not matched again after the wrap */
+  cs_log_set_file_level("log_bench=2");
+  CS_LOG_SITE_CACHE_INVALIDATE();
+  loop_cache(1);
+  cs_log_set_file_level("log_bench=3");
+  for (i = 0; i <= CS_LOG_SITE_GEN_OFF; i++) CS_LOG_SITE_CACHE_INVALIDATE();
+  printed = s_num_printed;
+  loop_cache(10);
+  if (s_num_printed != printed + 10) {
+    printf("stale site after %d file level changes\n", i);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
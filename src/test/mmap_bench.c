@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Cost of an emulated load from an mmapped file in esp_mmap_exception_handler()
+ * (mgos_mmap_esp.c, built for esp8266 against the stand-in headers in
+ * mmap_stubs/): read_mmapped_byte() calls and ns per load, against the
+ * byte-at-a-time emulator it replaced. On the device each call is a flash
+ * read, so the call count is what matters; host ns only show the overhead.
+ * A conformance pass runs first: random l8ui/l16ui/l16si/l32i/l32i.n loads,
+ * many of them at the end of the file, are checked against the file contents
+ * and no byte past the end may be read.
+ * Usage: mmap_bench [iterations]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../mgos_mmap_esp.c"
+
+#define FILE_LEN (64 * 1024 + 3)
+#define FILE_ADDR 0x10100000 /* Area 1 */
+
+static uint8_t s_file[FILE_LEN];
+static long s_num_reads, s_num_oob_reads;
+
+static uint8_t read_mmapped_byte(struct mgos_vfs_mmap_desc *desc,
+                                 uint32_t addr) {
+  s_num_reads++;
+  if (addr >= desc->len) {
+    s_num_oob_reads++;
+    return 0xee;
+  }
+  return desc->data[addr];
+}
+
+static const struct mgos_vfs_fs_ops s_ops = {read_mmapped_byte};
+static struct mgos_vfs_fs s_fs = {&s_ops};
+struct mgos_vfs_mmap_desc mgos_vfs_mmap_descs[1 << MMAP_NUM_BITS];
+
+/* Load instructions with at = a3, as in the exception frame. */
+static const struct {
+  const char *name;
+  uint16_t instr;
+  int size, pc_inc;
+} s_insns[] = {
+    {"l8ui", 0x0032, 1, 3},  {"l16ui", 0x1032, 2, 3}, {"l16si", 0x9032, 2, 3},
+    {"l32i", 0x2032, 4, 3},  {"l32i.n", 0x0038, 4, 2},
+};
+
+static uint8_t s_code[8] __attribute__((aligned(4)));
+static long s_regs[14]; /* a2 - a15 */
+
+static uint32_t expected(int k, uint32_t off) {
+  const uint8_t *p = s_file + off;
+  switch (s_insns[k].size) {
+    case 1:
+      return p[0];
+    case 2:
+      return (s_insns[k].instr & 0x8000 ? (uint32_t)(int16_t)(p[0] | p[1] << 8)
+                                        : (uint32_t)(p[0] | p[1] << 8));
+    default:
+      return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+  }
+}
+
+/*
+ * The emulator that esp_mmap_exception_handler() replaced: the instruction
+ * and the data are read a byte at a time, each byte with a range check, a
+ * descriptor lookup and, for mmapped bytes, an FS call.
+ */
+static uint8_t read_unaligned_byte(uintptr_t addr) {
+  if (addr >= (uintptr_t) MMAP_BASE && addr < (uintptr_t) MMAP_END) {
+    struct mgos_vfs_mmap_desc *desc = MMAP_DESC_FROM_ADDR(addr);
+    return desc->fs->ops->read_mmapped_byte(desc, MMAP_ADDR_FROM_ADDR(addr));
+  }
+  return *(uint8_t *) addr;
+}
+
+static __attribute__((noinline)) int bytewise_handler(uint32_t vaddr,
+                                                      uint8_t *pc, long *pa2) {
+  uint32_t instr = read_unaligned_byte((uintptr_t) pc) |
+                   read_unaligned_byte((uintptr_t) pc + 1) << 8;
+  uint32_t val = 0;
+  int i, size = 0, pc_inc = 3;
+  if ((instr & 0xf00f) == 0x2) {
+    size = 1;
+  } else if ((instr & 0x700f) == 0x1002) {
+    size = 2;
+  } else if ((instr & 0xf00f) == 0x2002 || (instr & 0xf) == 0x8) {
+    size = 4;
+    if ((instr & 0xf) == 0x8) pc_inc = 2;
+  }
+  for (i = 0; i < size; i++) {
+    val |= (uint32_t) read_unaligned_byte(vaddr + i) << 8 * i;
+  }
+  if (size == 2 && (instr & 0x8000)) val = (uint32_t)(int16_t) val;
+  *(pa2 + ((instr >> 4) & 0xf) - 2) = val;
+  return pc_inc;
+}
+
+typedef int (*handler_fn_t)(uint32_t vaddr, uint8_t *pc, long *pa2);
+
+static uint32_t load(handler_fn_t fn, int k, uint32_t off, int pcoff) {
+  s_code[pcoff] = s_insns[k].instr & 0xff;
+  s_code[pcoff + 1] = s_insns[k].instr >> 8;
+  if (fn(FILE_ADDR + off, s_code + pcoff, s_regs) != s_insns[k].pc_inc) {
+    printf("%s: wrong pc increment\n", s_insns[k].name);
+    exit(EXIT_FAILURE);
+  }
+  return (uint32_t) s_regs[1];
+}
+
+static uint32_t random_off(int k) {
+  uint32_t off = (uint32_t) rand() % (FILE_LEN - s_insns[k].size + 1);
+  /* Every third load is at the very end of the file */
+  if (rand() % 3 == 0) off = FILE_LEN - s_insns[k].size - rand() % 4;
+  /* 32-bit loads are always aligned */
+  if (s_insns[k].size == 4) off &= ~3;
+  return off;
+}
+
+static int conformance(int n) {
+  int i, k, failures = 0;
+  for (i = 0; i < n; i++) {
+    uint32_t off, v;
+    k = rand() % (int) (sizeof(s_insns) / sizeof(s_insns[0]));
+    off = random_off(k);
+    v = load(esp_mmap_exception_handler, k, off, rand() % 4);
+    if (v != expected(k, off)) {
+      if (failures++ < 5) {
+        printf("%s at %u: %#x, expected %#x\n", s_insns[k].name,
+               (unsigned) off, (unsigned) v, (unsigned) expected(k, off));
+      }
+    }
+  }
+  return failures;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Sequential loads of size bytes each, over the whole file */
+static void run(int k, int n) {
+  volatile uint32_t sink = 0;
+  uint32_t span = (FILE_LEN - 4) & ~3, off = 0;
+  long reads_bw, reads;
+  double t_bw, t;
+  int i;
+
+  reads_bw = s_num_reads;
+  t_bw = now();
+  for (i = 0; i < n; i++, off = (off + s_insns[k].size) % span) {
+    sink += load(bytewise_handler, k, off, 0);
+  }
+  t_bw = (now() - t_bw) * 1e9 / n;
+  reads_bw = s_num_reads - reads_bw;
+
+  reads = s_num_reads;
+  t = now();
+  for (i = 0, off = 0; i < n; i++, off = (off + s_insns[k].size) % span) {
+    sink += load(esp_mmap_exception_handler, k, off, 0);
+  }
+  t = (now() - t) * 1e9 / n;
+  reads = s_num_reads - reads;
+
+  printf("%-8s %10.2f %10.2f %10.1f %10.1f\n", s_insns[k].name,
+         (double) reads_bw / n, (double) reads / n, t_bw, t);
+  (void) sink;
+}
+
+int main(int argc, char **argv) {
+  int n = (argc > 1 ? atoi(argv[1]) : 5000000), failures;
+  size_t i;
+
+  srand(1);
+  for (i = 0; i < sizeof(s_file); i++) s_file[i] = (uint8_t) rand();
+  mgos_vfs_mmap_descs[1].fs = &s_fs;
+  mgos_vfs_mmap_descs[1].data = s_file;
+  mgos_vfs_mmap_descs[1].len = sizeof(s_file);
+
+  failures = conformance(n / 2);
+  printf("conformance: %d loads, %d failures, %ld reads past the end\n",
+         n / 2, failures, s_num_oob_reads);
+  if (failures != 0 || s_num_oob_reads != 0) return EXIT_FAILURE;
+
+  printf("load     FS calls: bytewise    emulator  ns: bytewise   emulator\n");
+  for (i = 0; i < sizeof(s_insns) / sizeof(s_insns[0]); i++) run(i, n);
+  return EXIT_SUCCESS;
+}
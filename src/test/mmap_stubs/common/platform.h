@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stand-in for common/platform.h, used by mmap_bench to build
+ * mgos_mmap_esp.c as if for esp8266.
+ */
+
+#ifndef CS_COMMON_PLATFORM_H_
+#define CS_COMMON_PLATFORM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define CS_P_ESP32 15
+#define CS_P_ESP8266 3
+#define CS_PLATFORM CS_P_ESP8266
+
+#define IRAM
+#define NOINSTR
+
+#endif /* CS_COMMON_PLATFORM_H_ */
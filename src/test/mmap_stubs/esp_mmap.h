@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stand-in for the esp8266 mmap layout: 256 areas of 1M each at
+ * 0x10000000, as on the device.
+ */
+
+#ifndef CS_FW_SRC_TEST_MMAP_STUBS_ESP_MMAP_H_
+#define CS_FW_SRC_TEST_MMAP_STUBS_ESP_MMAP_H_
+
+#include "mgos_vfs.h"
+
+#define MMAP_BASE ((void *) 0x10000000)
+#define MMAP_END ((void *) 0x20000000)
+
+#define MMAP_ADDR_BITS 20
+#define MMAP_NUM_BITS 8
+
+#define MMAP_DESC_FROM_ADDR(addr) \
+  (&mgos_vfs_mmap_descs[(((uintptr_t)(addr)) >> MMAP_ADDR_BITS) & \
+                        ((1 << MMAP_NUM_BITS) - 1)])
+#define MMAP_ADDR_FROM_ADDR(addr) \
+  ((uintptr_t)(addr) & ((1 << MMAP_ADDR_BITS) - 1))
+
+#endif /* CS_FW_SRC_TEST_MMAP_STUBS_ESP_MMAP_H_ */
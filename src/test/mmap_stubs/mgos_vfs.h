@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stand-in for the parts of mgos_vfs.h used by mgos_mmap_esp.c. The
+ * descriptor points straight at the file contents, so that mmap_bench can
+ * count reads and catch reads past the end.
+ */
+
+#ifndef CS_FW_SRC_TEST_MMAP_STUBS_MGOS_VFS_H_
+#define CS_FW_SRC_TEST_MMAP_STUBS_MGOS_VFS_H_
+
+#include <stdint.h>
+
+struct mgos_vfs_mmap_desc;
+
+struct mgos_vfs_fs_ops {
+  uint8_t (*read_mmapped_byte)(struct mgos_vfs_mmap_desc *desc, uint32_t addr);
+};
+
+struct mgos_vfs_fs {
+  const struct mgos_vfs_fs_ops *ops;
+};
+
+struct mgos_vfs_mmap_desc {
+  struct mgos_vfs_fs *fs;
+  const uint8_t *data;
+  uint32_t len;
+};
+
+extern struct mgos_vfs_mmap_desc mgos_vfs_mmap_descs[];
+
+#endif /* CS_FW_SRC_TEST_MMAP_STUBS_MGOS_VFS_H_ */
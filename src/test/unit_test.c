@@ -11,6 +11,9 @@
 
 #include "mgos_config_util.h"
 #include "mgos_event.h"
+#include "mgos_hal.h"
+#include "mgos_hw_timers_hal.h"
+#include "mgos_pool.h"
 
 #include "mgos_config.h"
 #include "test_main.h"
@@ -77,6 +80,14 @@ static const char *test_config(void) {
 #error MGOS_CONFIG_HAVE_xxx must be defined
 #endif
 
+/* %M scanner that records the value of "type" seen at the time of the call */
+static void scan_data(const char *str, int len, void *user_data) {
+  char **type = (char **) user_data;
+  (void) str;
+  (void) len;
+  type[1] = (type[0] != NULL ? strdup(type[0]) : NULL);
+}
+
 static const char *test_json_scanf(void) {
   int a = 0;
   bool b = false;
@@ -90,6 +101,235 @@ static const char *test_json_scanf(void) {
   else
     ASSERT(c == false);
 
+  /* More keys than fit in one pass, nested objects, repeated paths. */
+  {
+    int v[12], x = 0, y = 0, z = 0;
+    char *q = NULL;
+    struct json_token t = {NULL, 0, JSON_TYPE_INVALID}, ty = t;
+    const char *doc =
+        "{\"k0\":0,\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4,\"k5\":5,"
+        "\"k6\":6,\"k7\":7,\"k8\":8,\"k9\":9,\"k10\":10,\"k11\":11,"
+        "\"o\":{\"x\":-1,\"p\":{\"y\":\"0x10\"},\"s\":\"a\\tb\"},"
+        "\"arr\":[1,2],\"x\":42}";
+    memset(v, 0xff, sizeof(v));
+    ASSERT_EQ(json_scanf(doc, strlen(doc),
+                         "{k0:%d k1:%d k2:%d k3:%d k4:%d k5:%d k6:%d k7:%d "
+                         "k8:%d k9:%d k10:%d k11:%d o:{x:%d s:%Q p:{y:%T}} "
+                         "arr:%T x:%d nope:%d}",
+                         &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6],
+                         &v[7], &v[8], &v[9], &v[10], &v[11], &x, &q, &ty, &t,
+                         &z, &a),
+              17);
+    for (a = 0; a < 12; a++) ASSERT_EQ(v[a], a);
+    ASSERT_EQ(x, -1);
+    ASSERT_EQ(ty.type, JSON_TYPE_STRING);
+    ASSERT_EQ(ty.len, 4);
+    ASSERT_EQ(z, 42);
+    ASSERT_STREQ(q, "a\tb");
+    ASSERT_EQ(t.type, JSON_TYPE_ARRAY_END);
+    ASSERT_EQ(t.len, 5);
+    free(q);
+    /* Same path twice. */
+    x = y = 0;
+    ASSERT_EQ(json_scanf(doc, strlen(doc), "{k5:%d, k5:%u}", &x, &y), 2);
+    ASSERT_EQ(x, 5);
+    ASSERT_EQ(y, 5);
+  }
+
+  /* %M sees the conversions that precede it in the format. */
+  {
+    char *type[2] = {NULL, NULL};
+    const char *doc = "{\"data\":{\"v\":1},\"type\":\"foo\"}";
+    ASSERT_EQ(json_scanf(doc, strlen(doc), "{type: %Q, data: %M}", &type[0],
+                         scan_data, type),
+              2);
+    ASSERT_STREQ(type[0], "foo");
+    ASSERT_STREQ(type[1], "foo");
+    free(type[0]);
+    free(type[1]);
+  }
+
+  return NULL;
+}
+
+/* Scalar frozen, built with JSON_FAST_SCAN=0 and json_walk renamed. */
+int json_walk_scalar(const char *json_string, int json_string_length,
+                     json_walk_callback_t callback, void *callback_data);
+
+struct walk_trace {
+  char buf[4096];
+  size_t len;
+};
+
+static void walk_trace_cb(void *callback_data, const char *name,
+                          size_t name_len, const char *path,
+                          const struct json_token *token) {
+  struct walk_trace *t = (struct walk_trace *) callback_data;
+  size_t left = sizeof(t->buf) - t->len;
+  int n = snprintf(t->buf + t->len, left, "%d %s [%.*s] [%.*s]\n", token->type,
+                   path, (int) name_len, (name ? name : ""), token->len,
+                   (token->ptr ? token->ptr : ""));
+  if (n > 0) t->len += ((size_t) n < left ? (size_t) n : left - 1);
+}
+
+/*
+ * Walks the string at every alignment with both the vectorized and the
+ * scalar tokenizer and checks that they agree on everything.
+ */
+static const char *check_walk(const char *s, int len) {
+  static char buf[512 + 16];
+  static struct walk_trace t1, t2;
+  int i, r1, r2;
+  for (i = 0; i < 16; i++) {
+    memcpy(buf + i, s, len);
+    t1.len = t2.len = 0;
+    r1 = json_walk(buf + i, len, walk_trace_cb, &t1);
+    r2 = json_walk_scalar(buf + i, len, walk_trace_cb, &t2);
+    if (r1 != r2 || t1.len != t2.len || memcmp(t1.buf, t2.buf, t1.len) != 0) {
+      printf("Mismatch at %d: [%.*s] %d %d\n", i, len, s, r1, r2);
+      return "json_walk mismatch";
+    }
+    /* Path is not tracked without a callback, result must be the same. */
+    if (json_walk(buf + i, len, NULL, NULL) != r1) return "no-cb mismatch";
+  }
+  return NULL;
+}
+
+static const char *test_json_walk_fast_scan(void) {
+  static const char *docs[] = {
+      "{\"a\":\"hello, world\",\"b\":[1,2,\"three\"],\"c\":{\"d\":true}}",
+      "  \t\r\n {  \"key with spaces\"  :  \"value\\\"quoted\\\\\"  }  \n",
+      "{\"u\":\"\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 \xe2\x82\xac "
+      "\xf0\x9f\x98\x80 tail of the string\"}",
+      "{\"esc\":\"\\u0041\\n\\t\\/\\b\\f\\r 0123456789abcdef0123456789\"}",
+      "[\"\", \"x\", \"0123456789abcde\", \"0123456789abcdef\", "
+      "\"0123456789abcdefg\", \"0123456789abcdef0123456789abcdef0\"]",
+      "{\"ctl\":\"abcdefghijklmnopqrstuvwxyz\x01\"}",
+      "{\"bad\":\"abcdefghijklmnop\xff\"}",
+      "{\"a\":[[[[{\"b\":[null,false,-1.5e3,0x1f]}]]]]}",
+      "{a:1,b:'not a string',c:\"ok\"}",
+  };
+  const char *err;
+  char s[128];
+  int i, j, k, len;
+  for (i = 0; i < (int) (sizeof(docs) / sizeof(docs[0])); i++) {
+    len = strlen(docs[i]);
+    /* Every prefix, to cover truncation inside strings and whitespace. */
+    for (j = 0; j <= len; j++) {
+      if ((err = check_walk(docs[i], j)) != NULL) return err;
+    }
+  }
+  /* A special byte at every position of strings of various lengths. */
+  {
+    static const char specials[] = {'"', '\\', '\n', 0x1f, ' ', 0x7f, '\x80',
+                                    '\xc3', '\xe2', '\xf0', '\xff', 'a'};
+    for (len = 0; len < 40; len++) {
+      for (j = 0; j < len; j++) {
+        for (k = 0; k < (int) sizeof(specials); k++) {
+          int n = 0;
+          s[n++] = '[';
+          s[n++] = '"';
+          memset(s + n, 'x', len);
+          s[n + j] = specials[k];
+          n += len;
+          s[n++] = '"';
+          memset(s + n, ' ', j);
+          n += j;
+          s[n++] = ']';
+          if ((err = check_walk(s, n)) != NULL) return err;
+        }
+      }
+    }
+  }
+  return NULL;
+}
+
+struct counting_out {
+  struct json_out out; /* must be first */
+  int calls;
+};
+
+static int counting_printer(struct json_out *out, const char *buf,
+                            size_t len) {
+  ((struct counting_out *) out)->calls++;
+  return json_printer_buf(out, buf, len);
+}
+
+static int print_nested(struct json_out *out, va_list *ap) {
+  int n = va_arg(*ap, int);
+  return json_printf(out, "{n: %d}", n);
+}
+
+static const char *test_json_printf(void) {
+  char buf[512];
+  struct counting_out c;
+  unsigned char bin[] = {0x00, 0x7f, 0xab};
+  int i;
+
+#define RESET_OUT()                                   \
+  do {                                                \
+    struct json_out o = JSON_OUT_BUF(buf, sizeof(buf)); \
+    c.out = o;                                        \
+    c.out.printer = counting_printer;                 \
+    c.calls = 0;                                      \
+  } while (0)
+
+  /* Keys, punctuation and numbers go out in one printer call. */
+  RESET_OUT();
+  ASSERT_EQ(json_printf(&c.out, "{a: %d, b_2: [%u, %ld, %lu], c: %B}", -5,
+                        4000000000u, -7L, 8UL, 1),
+            48);
+  ASSERT_STREQ(buf, "{\"a\": -5, \"b_2\": [4000000000, -7, 8], \"c\": true}");
+  ASSERT_EQ(c.calls, 1);
+
+  RESET_OUT();
+  json_printf(&c.out, "[%d, %d, %lld, %llu, %zu, %d]", INT32_MIN, INT32_MAX,
+              (int64_t) INT64_MIN, (uint64_t) UINT64_MAX, (size_t) 0, 0);
+  ASSERT_STREQ(buf,
+               "[-2147483648, 2147483647, -9223372036854775808, "
+               "18446744073709551615, 0, 0]");
+
+  /* Conversions left to snprintf. */
+  RESET_OUT();
+  json_printf(&c.out, "{f: %.2f, w: %5d, x: %x, s: %.*s}", 1.5, 42, 255, 3,
+              "abcdef");
+  ASSERT_STREQ(buf, "{\"f\": 1.50, \"w\":    42, \"x\": ff, \"s\": abc}");
+
+  /* Strings: runs of plain characters are not split. */
+  RESET_OUT();
+  json_printf(&c.out, "%Q", "plain text, no escapes at all");
+  ASSERT_STREQ(buf, "\"plain text, no escapes at all\"");
+  ASSERT_EQ(c.calls, 3);
+  RESET_OUT();
+  json_printf(&c.out, "[%Q, %.*Q, %Q]",
+              "q\"b\\n\n\t\x01\x0f\x1f\x7f \xd0\xbf end", 3, "abcdef", NULL);
+  ASSERT_STREQ(buf,
+               "[\"q\\\"b\\\\n\\n\\t\\u0001\\u000f\\u001f\\u007f "
+               "\xd0\xbf end\", \"abc\", null]");
+
+  /* Literal text longer than the staging buffer. */
+  RESET_OUT();
+  json_printf(&c.out,
+              "[%d,                                                          "
+              "                                                     %d]",
+              1, 2);
+  ASSERT_EQ(strlen(buf), 116);
+  ASSERT_EQ(buf[114], '2');
+
+  /* Hex, base64 and callbacks, in order with the text around them. */
+  RESET_OUT();
+  json_printf(&c.out, "{h: %H, v: %V, m: %M, t: %d}", (int) sizeof(bin), bin,
+              bin, (int) sizeof(bin), print_nested, 7, 8);
+  ASSERT_STREQ(buf, "{\"h\": \"007fab\", \"v\": \"AH+r\", \"m\": {\"n\": 7}, "
+                    "\"t\": 8}");
+
+  /* Return value is the total length also when going through the buffer. */
+  for (i = 0; i < 2; i++) {
+    struct json_out o = JSON_OUT_BUF(buf, i == 0 ? sizeof(buf) : 4);
+    ASSERT_EQ(json_printf(&o, "{key: %Q, n: %d}", "value", 12345), 28);
+  }
+#undef RESET_OUT
+
   return NULL;
 }
 
@@ -259,14 +499,277 @@ static const char *test_cs_hex(void) {
   return NULL;
 }
 
+static int s_lock_depth = 0, s_ints_depth = 0, s_ints_nested = 0;
+
+void mgos_lock(void) {
+  s_lock_depth++;
+}
+
+void mgos_unlock(void) {
+  s_lock_depth--;
+}
+
+/* Like on esp8266, interrupt disabling must not nest. */
+void mgos_ints_disable(void) {
+  if (s_ints_depth > 0) s_ints_nested++;
+  s_ints_depth++;
+  s_lock_depth++;
+}
+
+void mgos_ints_enable(void) {
+  s_ints_depth--;
+  s_lock_depth--;
+}
+
+static const char *test_pool(void) {
+  static struct mgos_pool p1 = MGOS_POOL_INIT("p1", 12, 3, 0);
+  static struct mgos_pool p2 =
+      MGOS_POOL_INIT("p2", 4, 0, MGOS_POOL_F_ISR_SAFE | MGOS_POOL_F_NO_GROW);
+  static uint64_t buf[MGOS_POOL_SLAB_SIZE(4, 2) / sizeof(uint64_t)];
+  struct mgos_pool_stats st;
+  void *o[4];
+
+  s_ints_nested = 0;
+  ASSERT_EQ(p1.obj_size, 16);
+  o[0] = mgos_pool_zalloc(&p1);
+  o[1] = mgos_pool_alloc(&p1);
+  o[2] = mgos_pool_alloc(&p1);
+  o[3] = mgos_pool_alloc(&p1);
+  ASSERT(o[0] != NULL && o[3] != NULL);
+  ASSERT_EQ(((uintptr_t) o[0]) % MGOS_POOL_ALIGN, 0);
+  ASSERT_EQ((char *) o[1] - (char *) o[0], 16);
+  ASSERT(mgos_pool_owns(&p1, o[3]));
+  ASSERT(!mgos_pool_owns(&p1, &st));
+  mgos_pool_get_stats(&p1, &st);
+  ASSERT_EQ(st.num_slabs, 2);
+  ASSERT_EQ(st.num_total, 6);
+  ASSERT_EQ(st.num_used, 4);
+  mgos_pool_free(&p1, o[1]);
+  mgos_pool_free(&p1, NULL);
+  ASSERT(mgos_pool_alloc(&p1) == o[1]);
+  mgos_pool_free(&p1, o[0]);
+  mgos_pool_free(&p1, o[1]);
+  mgos_pool_free(&p1, o[2]);
+  mgos_pool_free(&p1, o[3]);
+  mgos_pool_get_stats(&p1, &st);
+  ASSERT_EQ(st.num_used, 0);
+  ASSERT_EQ(st.max_used, 4);
+  ASSERT_EQ(st.num_allocs, 5);
+  ASSERT(mgos_pool_reserve(&p1, 6));
+  ASSERT_EQ(p1.num_total, 6);
+
+  ASSERT(mgos_pool_alloc(&p2) == NULL);
+  ASSERT_EQ(mgos_pool_add_slab(&p2, buf, sizeof(buf)), 2);
+  o[0] = mgos_pool_alloc(&p2);
+  o[1] = mgos_pool_alloc(&p2);
+  ASSERT(o[0] == ((char *) buf) + sizeof(buf) - 2 * MGOS_POOL_ALIGN);
+  ASSERT(mgos_pool_alloc(&p2) == NULL);
+  ASSERT(!mgos_pool_reserve(&p2, 1));
+  mgos_pool_get_stats(&p2, &st);
+  ASSERT_EQ(st.num_fails, 2);
+  ASSERT_EQ(s_lock_depth, 0);
+  ASSERT_EQ(s_ints_nested, 0);
+
+  {
+    char buf[256];
+    struct json_out out = JSON_OUT_BUF(buf, sizeof(buf));
+    mgos_pool_stats_json(&out);
+    ASSERT_STREQ(buf,
+                 "[{\"name\": \"p2\", \"size\": 8, \"slabs\": 1, "
+                 "\"total\": 2, \"used\": 2, \"max_used\": 2, "
+                 "\"allocs\": 2, \"fails\": 2}, "
+                 "{\"name\": \"p1\", \"size\": 16, \"slabs\": 2, "
+                 "\"total\": 6, \"used\": 0, \"max_used\": 4, "
+                 "\"allocs\": 5, \"fails\": 0}]");
+  }
+
+  return NULL;
+}
+
+/*
+ * Simulated free-running counter and comparator for the HW timer mux.
+ * Every read of the counter takes 1 us, the ISR is entered s_sim_lat us
+ * after the comparator fires. Like FRC1, the comparator stays enabled after
+ * firing and fires again SIM_REFIRE_US later unless re-armed or disarmed.
+ */
+#define SIM_REFIRE_US 5000
+static uint32_t s_sim_now;
+static uint32_t s_sim_when;
+static bool s_sim_armed;
+static uint32_t s_sim_lat;
+
+uint32_t mgos_hw_timers_mux_dev_now(void) {
+  return s_sim_now++;
+}
+
+void mgos_hw_timers_mux_dev_arm(uint32_t when) {
+  s_sim_when = when;
+  s_sim_armed = true;
+}
+
+void mgos_hw_timers_mux_dev_disarm(void) {
+  s_sim_armed = false;
+}
+
+bool mgos_hw_timers_mux_dev_init(void) {
+  return true;
+}
+
+static void sim_run(uint32_t usecs) {
+  const uint32_t end = s_sim_now + usecs;
+  while (s_sim_armed) {
+    uint32_t fire = s_sim_when;
+    if ((int32_t)(fire - s_sim_now) < 0) fire = s_sim_now;
+    if ((int32_t)(fire + s_sim_lat - end) > 0) break;
+    s_sim_now = fire + s_sim_lat;
+    s_sim_when = fire + SIM_REFIRE_US;
+    mgos_hw_timers_mux_isr();
+  }
+  if ((int32_t)(end - s_sim_now) > 0) s_sim_now = end;
+}
+
+#define SIM_MAX_CALLS 100
+static uint32_t s_sim_calls[SIM_MAX_CALLS];
+static int s_sim_num_calls;
+
+static void sim_cb(void *arg) {
+  if (s_sim_num_calls < SIM_MAX_CALLS) {
+    s_sim_calls[s_sim_num_calls] = (uint32_t)(uintptr_t) arg;
+  }
+  s_sim_num_calls++;
+}
+
+static uint32_t s_sim_times[SIM_MAX_CALLS];
+
+static void sim_time_cb(void *arg) {
+  if (s_sim_num_calls < SIM_MAX_CALLS) {
+    s_sim_times[s_sim_num_calls] = s_sim_now;
+  }
+  s_sim_num_calls++;
+  (void) arg;
+}
+
+static void sim_resched_cb(void *arg) {
+  sim_cb(arg);
+  if (s_sim_num_calls < 3) mgos_set_hw_timer(100, 0, sim_resched_cb, arg);
+}
+
+static const char *test_hw_timers_mux(void) {
+  mgos_timer_id ids[MGOS_NUM_HW_TIMERS];
+  int i;
+
+  s_sim_now = 0xfffff000; /* Make sure wraparound is handled. */
+  ASSERT_EQ(mgos_hw_timers_init(), MGOS_INIT_OK);
+
+  /* One-shot timers fire in deadline order, regardless of set order. */
+  s_sim_num_calls = 0;
+  mgos_set_hw_timer(1000, 0, sim_cb, (void *) 1);
+  mgos_set_hw_timer(500, 0, sim_cb, (void *) 2);
+  mgos_set_hw_timer(1500, 0, sim_cb, (void *) 3);
+  ids[0] = mgos_set_hw_timer(1200, 0, sim_cb, (void *) 4);
+  ASSERT(s_sim_armed);
+  sim_run(1100);
+  ASSERT_EQ(s_sim_num_calls, 2);
+  mgos_clear_hw_timer(ids[0]);
+  sim_run(1000);
+  ASSERT_EQ(s_sim_num_calls, 3);
+  ASSERT_EQ(s_sim_calls[0], 2);
+  ASSERT_EQ(s_sim_calls[1], 1);
+  ASSERT_EQ(s_sim_calls[2], 3);
+  ASSERT(!s_sim_armed);
+
+  /* All the slots are released, and there are only so many of them. */
+  for (i = 0; i < MGOS_NUM_HW_TIMERS; i++) {
+    ids[i] = mgos_set_hw_timer(10000, 0, sim_cb, NULL);
+    ASSERT_NE(ids[i], MGOS_INVALID_TIMER_ID);
+  }
+  ASSERT_EQ(mgos_set_hw_timer(10000, 0, sim_cb, NULL), MGOS_INVALID_TIMER_ID);
+  for (i = 0; i < MGOS_NUM_HW_TIMERS; i++) mgos_clear_hw_timer(ids[i]);
+  ASSERT(!s_sim_armed);
+
+  /* Comparator is disarmed once the last one-shot has fired. */
+  {
+    struct mgos_hw_timers_mux_stats st0, st;
+    mgos_hw_timers_mux_get_stats(&st0);
+    mgos_set_hw_timer(100, 0, sim_cb, NULL);
+    mgos_set_hw_timer(200, 0, sim_cb, NULL);
+    sim_run(SIM_REFIRE_US * 4);
+    ASSERT(!s_sim_armed);
+    mgos_hw_timers_mux_get_stats(&st);
+    ASSERT_EQ(st.num_isrs - st0.num_isrs, 2);
+  }
+
+  /* Too short for a repeating timer. */
+  ASSERT_EQ(mgos_set_hw_timer(1, MGOS_TIMER_REPEAT, sim_cb, NULL),
+            MGOS_INVALID_TIMER_ID);
+
+  /* One-shot timer can be re-set from its own callback. */
+  s_sim_num_calls = 0;
+  mgos_set_hw_timer(100, 0, sim_resched_cb, (void *) 5);
+  sim_run(1000);
+  ASSERT_EQ(s_sim_num_calls, 3);
+  ASSERT(!s_sim_armed);
+
+  /* Repeating timers interleave with each other and don't drift. */
+  s_sim_num_calls = 0;
+  ids[0] = mgos_set_hw_timer(100, MGOS_TIMER_REPEAT, sim_cb, (void *) 6);
+  ids[1] = mgos_set_hw_timer(250, MGOS_TIMER_REPEAT, sim_cb, (void *) 7);
+  sim_run(1020);
+  ASSERT_EQ(s_sim_num_calls, 14);
+  ASSERT_EQ(s_sim_calls[0], 6);
+  ASSERT_EQ(s_sim_calls[1], 6);
+  ASSERT_EQ(s_sim_calls[2], 7);
+  mgos_clear_hw_timer(ids[0]);
+  mgos_clear_hw_timer(ids[1]);
+  ASSERT(!s_sim_armed);
+
+  /*
+   * With ISR latency, the comparator is armed early by the measured amount
+   * and callbacks end up being invoked on time.
+   */
+  s_sim_lat = 30;
+  s_sim_num_calls = 0;
+  {
+    const uint32_t start = s_sim_now;
+    struct mgos_hw_timers_mux_stats st0, st;
+    mgos_hw_timers_mux_get_stats(&st0);
+    ids[0] = mgos_set_hw_timer(200, MGOS_TIMER_REPEAT, sim_time_cb, NULL);
+    sim_run(200 * SIM_MAX_CALLS + 100);
+    mgos_clear_hw_timer(ids[0]);
+    ASSERT_EQ(s_sim_num_calls, SIM_MAX_CALLS);
+    /* The first one is late by the full latency. */
+    ASSERT_GT((int32_t)(s_sim_times[0] - (start + 200)), 25);
+    for (i = SIM_MAX_CALLS - 10; i < SIM_MAX_CALLS; i++) {
+      int32_t err = (int32_t)(s_sim_times[i] - (start + 1 + 200 * (i + 1)));
+      ASSERT_LT(err, 3);
+      ASSERT_GT(err, -3);
+    }
+    mgos_hw_timers_mux_get_stats(&st);
+    ASSERT_EQ(st.num_calls - st0.num_calls, SIM_MAX_CALLS);
+    ASSERT_GT(st.max_late, 25);
+    ASSERT_LT(st.latency, 35);
+    ASSERT_GT(st.latency, 25);
+  }
+  s_sim_lat = 0;
+
+  mgos_hw_timers_deinit();
+  ASSERT_EQ(s_lock_depth, 0);
+
+  return NULL;
+}
+
 void tests_setup(void) {
 }
 
 const char *tests_run(const char *filter) {
   RUN_TEST(test_config);
   RUN_TEST(test_json_scanf);
+  RUN_TEST(test_json_walk_fast_scan);
+  RUN_TEST(test_json_printf);
   RUN_TEST(test_events);
   RUN_TEST(test_cs_hex);
+  RUN_TEST(test_pool);
+  RUN_TEST(test_hw_timers_mux);
   return NULL;
 }
 
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Long-running fragmentation and latency benchmark.
+ *
+ * Simulates days of uptime: a mix of long-lived allocations (freed rarely)
+ * and short-lived ones (buffers, timers, connection state) of varying size.
+ * After each phase prints allocation and free latency, length of the free
+ * list and fragmentation of the free space.
+ *
+ * With -DBENCH_SMALL_POOLS, requests of up to 32 bytes are first served from
+ * mgos_pool size classes carved out of the heap at startup, the same way the
+ * esp8266 malloc shim does it.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "umm_malloc.h"
+#include "umm_malloc_internal.h"
+
+#ifdef BENCH_SMALL_POOLS
+#include "mgos_pool.h"
+#endif
+
+#define NUM_SLOTS 400
+#define NUM_PHASES 10
+#define OPS_PER_PHASE 500000
+/* Every this many slots is long-lived */
+#define LONG_LIVED_EVERY 8
+
+char test_umm_heap[UMM_MALLOC_CFG__HEAP_SIZE];
+
+void umm_corruption(void) {
+  fprintf(stderr, "heap corruption!\n");
+  abort();
+}
+
+struct lat_stats {
+  uint64_t total_ns;
+  uint64_t max_ns;
+  uint64_t cnt;
+};
+
+#ifdef BENCH_SMALL_POOLS
+#define NUM_CLASSES 3
+#define SMALL_MAX 32
+static const int s_class_cnt[NUM_CLASSES] = {64, 48, 24};
+static struct mgos_pool s_pools[NUM_CLASSES] = {
+    MGOS_POOL_INIT("heap8", 8, 0, MGOS_POOL_F_NO_GROW),
+    MGOS_POOL_INIT("heap16", 16, 0, MGOS_POOL_F_NO_GROW),
+    MGOS_POOL_INIT("heap32", 32, 0, MGOS_POOL_F_NO_GROW),
+};
+
+void mgos_lock(void) {
+}
+
+void mgos_unlock(void) {
+}
+
+void mgos_ints_disable(void) {
+}
+
+void mgos_ints_enable(void) {
+}
+
+static void pools_init(void) {
+  int i;
+  for (i = 0; i < NUM_CLASSES; i++) {
+    size_t len = MGOS_POOL_SLAB_SIZE(8 << i, s_class_cnt[i]);
+    mgos_pool_add_slab(&s_pools[i], umm_malloc(len), len);
+  }
+}
+
+static void *bench_malloc(size_t size) {
+  int i;
+  if (size <= SMALL_MAX) {
+    for (i = (size <= 8 ? 0 : size <= 16 ? 1 : 2); i < NUM_CLASSES; i++) {
+      void *ptr = mgos_pool_alloc(&s_pools[i]);
+      if (ptr != NULL) return ptr;
+    }
+  }
+  return umm_malloc(size);
+}
+
+static void bench_free(void *ptr) {
+  int i;
+  for (i = 0; i < NUM_CLASSES; i++) {
+    if (mgos_pool_owns(&s_pools[i], ptr)) {
+      mgos_pool_free(&s_pools[i], ptr);
+      return;
+    }
+  }
+  umm_free(ptr);
+}
+#else
+#define bench_malloc umm_malloc
+#define bench_free umm_free
+#endif
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void lat_add(struct lat_stats *s, uint64_t ns) {
+  s->total_ns += ns;
+  if (ns > s->max_ns) s->max_ns = ns;
+  s->cnt++;
+}
+
+/* Mostly small objects, sometimes large buffers. */
+static size_t rand_size(void) {
+  int r = rand() % 100;
+  if (r < 50) return 4 + rand() % 28;
+  if (r < 80) return 32 + rand() % 96;
+  if (r < 95) return 128 + rand() % 384;
+  return 512 + rand() % 1024;
+}
+
+int main(void) {
+  static void *slots[NUM_SLOTS];
+  struct lat_stats ms, fs;
+  unsigned long ooms = 0;
+  int phase, i;
+
+#if defined(UMM_SEGREGATED_FIT)
+  printf("Segregated fit\n");
+#elif defined(UMM_FIRST_FIT)
+  printf("First fit\n");
+#else
+  printf("Best fit\n");
+#endif
+#ifdef BENCH_SMALL_POOLS
+  printf("Small allocations from pools\n");
+#endif
+  printf("%5s %9s %9s %9s %9s %7s %7s %7s %6s\n", "phase", "malloc_ns",
+         "max_ns", "free_ns", "max_ns", "nfree", "free", "maxfree", "ooms");
+
+  srand(1);
+  umm_init();
+#ifdef BENCH_SMALL_POOLS
+  pools_init();
+#endif
+  memset(slots, 0, sizeof(slots));
+
+  for (phase = 0; phase < NUM_PHASES; phase++) {
+    memset(&ms, 0, sizeof(ms));
+    memset(&fs, 0, sizeof(fs));
+    for (i = 0; i < OPS_PER_PHASE; i++) {
+      int idx = rand() % NUM_SLOTS;
+      uint64_t t;
+      if (slots[idx] != NULL) {
+        /* Long-lived objects are freed 100 times less often. */
+        if (idx % LONG_LIVED_EVERY == 0 && rand() % 100 != 0) continue;
+        t = now_ns();
+        bench_free(slots[idx]);
+        lat_add(&fs, now_ns() - t);
+        slots[idx] = NULL;
+      } else {
+        size_t size = rand_size();
+        t = now_ns();
+        slots[idx] = bench_malloc(size);
+        lat_add(&ms, now_ns() - t);
+        if (slots[idx] == NULL) {
+          ooms++;
+        } else {
+          memset(slots[idx], 0xfe, size);
+        }
+      }
+    }
+    umm_info(NULL, 0);
+    printf("%5d %9.1f %9lu %9.1f %9lu %7d %7u %7u %6lu\n", phase,
+           (double) ms.total_ns / ms.cnt, (unsigned long) ms.max_ns,
+           (double) fs.total_ns / fs.cnt, (unsigned long) fs.max_ns,
+           umm_free_entries_cnt(),
+           (unsigned int) ummHeapInfo.freeBlocks * ummHeapInfo.blockSize,
+           (unsigned int) ummHeapInfo.maxFreeContiguousBlocks *
+               ummHeapInfo.blockSize,
+           ooms);
+  }
+
+#ifdef BENCH_SMALL_POOLS
+  for (i = 0; i < NUM_CLASSES; i++) {
+    struct mgos_pool_stats st;
+    mgos_pool_get_stats(&s_pools[i], &st);
+    printf("%s: %d/%d used, max %d, %d allocs, %d misses\n", st.name,
+           st.num_used, st.num_total, st.max_used, st.num_allocs,
+           st.num_fails);
+  }
+#endif
+
+  return 0;
+}
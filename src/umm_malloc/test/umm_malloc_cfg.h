@@ -54,6 +54,13 @@
  * Set this if you want to use a first-fit algorithm for allocating new
  * blocks
  *
+ * -D UMM_SEGREGATED_FIT
+ *
+ * Set this to keep free blocks in size-segregated lists, which makes malloc
+ * time (almost) independent of the number of free blocks. Costs
+ * UMM_NUM_BINS blocks of heap for list heads (55 blocks with the default
+ * UMM_SEGREGATED_SL_BITS=2, 29 with 1).
+ *
  * -D UMM_DBG_LOG_LEVEL=n
  *
  * Set n to a value from 0 to 6 depending on how verbose you want the debug
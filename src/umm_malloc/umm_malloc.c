@@ -485,6 +485,39 @@
  * block (s) which adds it to the free list.
  *
  * ----------------------------------------------------------------------------
+ *
+ * Segregated free lists (UMM_SEGREGATED_FIT)
+ *
+ * With a single free list, malloc() has to walk all the free blocks, which
+ * gets slow (with interrupts disabled!) as the heap fragments. With
+ * UMM_SEGREGATED_FIT, free blocks are kept in a number of lists (bins) by
+ * size, TLSF-style: small sizes have a bin each, larger ones are split into
+ * power of two ranges, each divided into 2^UMM_SEGREGATED_SL_BITS bins.
+ *
+ * Bin heads are the first UMM_NUM_BINS blocks of the heap: block b is the
+ * head of bin b, with only its nf field used. Block 0 is still the head of
+ * the whole block list, and it points at the first real block, UMM_NUM_BINS.
+ *
+ *    +----+----+----+----+
+ *  0 | B  |  0 | f0 | ?? |   bin 0 head, block list head
+ *    +----+----+----+----+
+ *  1 | ?? | ?? | f1 | ?? |   bin 1 head
+ *    +----+----+----+----+
+ *             ...
+ *    +----+----+----+----+
+ *  B |  n |  0 |   ...   |   first real block
+ *    +----+----+----+----+
+ *
+ * The pf of the first block in a bin points to the bin head, so unlinking
+ * a block from its list works exactly as before. A bitmap of non-empty bins
+ * lets malloc() find a suitable bin without walking the empty ones.
+ *
+ * malloc() looks at up to UMM_SEGREGATED_SEARCH_MAX blocks of the bin for
+ * the requested size (they may be a bit too small), then takes the first
+ * block of the next non-empty bin, which is guaranteed to fit. Whenever a
+ * free block changes size (split, assimilation) it is moved to its new bin.
+ *
+ * ----------------------------------------------------------------------------
  */
 
 #include <stdio.h>
@@ -496,8 +529,19 @@
 #include "umm_malloc_cfg.h"   /* user-dependent */
 
 #ifndef UMM_FIRST_FIT
-#  ifndef UMM_BEST_FIT
-#    define UMM_BEST_FIT
+#  ifndef UMM_SEGREGATED_FIT
+#    ifndef UMM_BEST_FIT
+#      define UMM_BEST_FIT
+#    endif
+#  endif
+#endif
+
+#if defined(UMM_SEGREGATED_FIT)
+#  ifndef UMM_SEGREGATED_SL_BITS
+#    define UMM_SEGREGATED_SL_BITS 2
+#  endif
+#  ifndef UMM_SEGREGATED_SEARCH_MAX
+#    define UMM_SEGREGATED_SEARCH_MAX 4
 #  endif
 #endif
 
@@ -609,6 +653,21 @@ UMM_H_ATTPACKPRE typedef struct umm_block_t {
 #define UMM_FREELIST_MASK (0x8000)
 #define UMM_BLOCKNO_MASK  (0x7FFF)
 
+#if defined(UMM_SEGREGATED_FIT)
+/*
+ * Sizes below UMM_SMALL_SIZES get a bin each, then every power of two range
+ * up to the max block number (15 bits) is divided into UMM_SL_CNT bins.
+ */
+#define UMM_SL_CNT       (1 << UMM_SEGREGATED_SL_BITS)
+#define UMM_SMALL_SIZES  (2 * UMM_SL_CNT)
+#define UMM_NUM_BINS     (UMM_SMALL_SIZES - 1 + \
+                          (15 - 1 - UMM_SEGREGATED_SL_BITS) * UMM_SL_CNT)
+#define UMM_BINS_MAP_LEN ((UMM_NUM_BINS + 31) / 32)
+#define UMM_FIRST_BLOCK  (UMM_NUM_BINS)
+#else
+#define UMM_FIRST_BLOCK  (1)
+#endif
+
 /* ------------------------------------------------------------------------- */
 
 #ifdef UMM_REDEFINE_MEM_FUNCTIONS
@@ -625,6 +684,11 @@ unsigned short int umm_numblocks = 0;
 /* Heap statistics which is updated incrementally at each heap operation */
 UMM_STAT umm_stat;
 
+#if defined(UMM_SEGREGATED_FIT)
+/* Bitmap of non-empty bins */
+static unsigned int umm_bins_map[UMM_BINS_MAP_LEN];
+#endif
+
 #define UMM_NUMBLOCKS (umm_numblocks)
 
 /* ------------------------------------------------------------------------ */
@@ -637,6 +701,63 @@ UMM_STAT umm_stat;
 #define UMM_PFREE(b)  (UMM_BLOCK(b).body.free.prev)
 #define UMM_DATA(b)   (UMM_BLOCK(b).body.data)
 
+#define UMM_BLOCK_SIZE(b) ((UMM_NBLOCK(b) & UMM_BLOCKNO_MASK) - (b))
+
+/* segregated free lists (UMM_SEGREGATED_FIT) {{{ */
+#if defined(UMM_SEGREGATED_FIT)
+/*
+ * Returns the bin for free blocks of the given size (in blocks).
+ */
+static unsigned short int umm_bin( unsigned short int size ) {
+  int fl;
+
+  if( size < UMM_SMALL_SIZES ) {
+    return( size - 1 );
+  }
+
+  fl = 31 - __builtin_clz( size );
+
+  return( UMM_SMALL_SIZES - 1
+          + (fl - UMM_SEGREGATED_SL_BITS - 1) * UMM_SL_CNT
+          + ((size >> (fl - UMM_SEGREGATED_SL_BITS)) - UMM_SL_CNT) );
+}
+
+static void umm_bin_set( unsigned short int bin ) {
+  umm_bins_map[bin / 32] |= (1U << (bin % 32));
+}
+
+static void umm_bin_clear( unsigned short int bin ) {
+  umm_bins_map[bin / 32] &= ~(1U << (bin % 32));
+}
+
+/*
+ * Returns the first non-empty bin starting from `bin`, or -1 if there is none.
+ */
+static int umm_bin_find( unsigned short int bin ) {
+  int i = bin / 32;
+  unsigned int m;
+
+  if( bin >= UMM_NUM_BINS ) {
+    return( -1 );
+  }
+
+  m = umm_bins_map[i] & (~0U << (bin % 32));
+  while( m == 0 ) {
+    if( ++i >= UMM_BINS_MAP_LEN ) {
+      return( -1 );
+    }
+    m = umm_bins_map[i];
+  }
+
+  return( i * 32 + __builtin_ctz( m ) );
+}
+
+#define UMM_FREE_LIST_HEAD(c) umm_bin( UMM_BLOCK_SIZE(c) )
+#else
+#define UMM_FREE_LIST_HEAD(c) 0
+#endif
+/* }}} */
+
 /* integrity check (UMM_INTEGRITY_CHECK) {{{ */
 #if defined(UMM_INTEGRITY_CHECK)
 /*
@@ -663,6 +784,7 @@ UMM_STAT umm_stat;
  */
 static int integrity_check(void) {
   int ok = 1;
+  unsigned short int head;
   unsigned short int prev;
   unsigned short int cur;
 
@@ -672,8 +794,24 @@ static int integrity_check(void) {
 
   UMM_CRITICAL_ENTRY();
 
+#if defined(UMM_SEGREGATED_FIT)
+  /* Iterate through all bins */
+  for( head = 0; head < UMM_NUM_BINS; head++ ) {
+    int nonempty = (UMM_NFREE(head) != 0);
+    if( nonempty != (umm_bin_find(head) == head) ) {
+#ifndef UMM_DISABLE_VERBOSE_INTEGRITY_CHECK
+      printf("heap integrity broken: bin %d map bit mismatch\n", head);
+#endif
+      ok = 0;
+      goto clean;
+    }
+#else
+  head = 0;
+  {
+#endif
+
   /* Iterate through all free blocks */
-  prev = 0;
+  prev = head;
   while(1) {
     cur = UMM_NFREE(prev);
 
@@ -692,6 +830,16 @@ static int integrity_check(void) {
       break;
     }
 
+    /* Check that the free block is within the heap and in the right list */
+    if (cur < UMM_FIRST_BLOCK || UMM_FREE_LIST_HEAD(cur) != head) {
+#ifndef UMM_DISABLE_VERBOSE_INTEGRITY_CHECK
+      printf("heap integrity broken: free block %d in the wrong list %d\n",
+          cur, head);
+#endif
+      ok = 0;
+      goto clean;
+    }
+
     /* Check if prev free block number matches */
     if (UMM_PFREE(cur) != prev) {
 #ifndef UMM_DISABLE_VERBOSE_INTEGRITY_CHECK
@@ -707,6 +855,7 @@ static int integrity_check(void) {
 
     prev = cur;
   }
+  }
 
   /* Iterate through all blocks */
   prev = 0;
@@ -1149,6 +1298,13 @@ static void umm_disconnect_from_free_list( unsigned short int c ) {
   UMM_NFREE(UMM_PFREE(c)) = UMM_NFREE(c);
   UMM_PFREE(UMM_NFREE(c)) = UMM_PFREE(c);
 
+#if defined(UMM_SEGREGATED_FIT)
+  /* If it was the only block in the bin, the bin is now empty */
+  if( UMM_PFREE(c) < UMM_NUM_BINS && UMM_NFREE(c) == 0 ) {
+    umm_bin_clear( UMM_PFREE(c) );
+  }
+#endif
+
   /* And clear the free block indicator */
 
   UMM_NBLOCK(c) &= (~UMM_FREELIST_MASK);
@@ -1156,6 +1312,27 @@ static void umm_disconnect_from_free_list( unsigned short int c ) {
 
 /* ------------------------------------------------------------------------ */
 
+/*
+ * Put the block `c` at the head of the free list (of the bin which matches
+ * its size, if UMM_SEGREGATED_FIT), and mark it as free.
+ */
+static void umm_connect_to_free_list( unsigned short int c ) {
+  unsigned short int head = UMM_FREE_LIST_HEAD(c);
+
+  UMM_PFREE(UMM_NFREE(head)) = c;
+  UMM_NFREE(c)               = UMM_NFREE(head);
+  UMM_PFREE(c)               = head;
+  UMM_NFREE(head)            = c;
+
+#if defined(UMM_SEGREGATED_FIT)
+  umm_bin_set( head );
+#endif
+
+  UMM_NBLOCK(c)             |= UMM_FREELIST_MASK;
+}
+
+/* ------------------------------------------------------------------------ */
+
 /*
  * The caller should ensure that the next block is a free block, so this
  * function will assimilate up and remove it from the free list
@@ -1203,19 +1380,21 @@ void umm_init( void ) {
   umm_heap = (umm_block *)UMM_MALLOC_CFG__HEAP_ADDR;
   umm_numblocks = (UMM_MALLOC_CFG__HEAP_SIZE / sizeof(umm_block));
   memset(umm_heap, 0x00, UMM_MALLOC_CFG__HEAP_SIZE);
+#if defined(UMM_SEGREGATED_FIT)
+  memset(umm_bins_map, 0x00, sizeof(umm_bins_map));
+#endif
 
   /* setup initial blank heap structure */
   {
     /* index of the 0th `umm_block` */
     const unsigned short int block_0th = 0;
-    /* index of the 1st `umm_block` */
-    const unsigned short int block_1th = 1;
+    /* index of the 1st `umm_block` (there are bin heads before it) */
+    const unsigned short int block_1th = UMM_FIRST_BLOCK;
     /* index of the latest `umm_block` */
     const unsigned short int block_last = UMM_NUMBLOCKS - 1;
 
     /* setup the 0th `umm_block`, which just points to the 1st */
     UMM_NBLOCK(block_0th) = block_1th;
-    UMM_NFREE(block_0th)  = block_1th;
 
     /*
      * Now, we need to set the whole heap space as a huge free block. We should
@@ -1235,10 +1414,9 @@ void umm_init( void ) {
      *
      * And it's the last free block, so the next free block is 0.
      */
-    UMM_NBLOCK(block_1th) = block_last | UMM_FREELIST_MASK;
-    UMM_NFREE(block_1th)  = 0;
+    UMM_NBLOCK(block_1th) = block_last;
     UMM_PBLOCK(block_1th) = block_0th;
-    UMM_PFREE(block_1th)  = block_0th;
+    umm_connect_to_free_list( block_1th );
 
     /*
      * latest `umm_block` has pointers:
@@ -1310,10 +1488,21 @@ static void _umm_free( void *ptr ) {
   /* Then assimilate with the previous block if possible */
 
   if( UMM_NBLOCK(UMM_PBLOCK(c)) & UMM_FREELIST_MASK ) {
+#if defined(UMM_SEGREGATED_FIT)
+    unsigned short int bin = UMM_FREE_LIST_HEAD( UMM_PBLOCK(c) );
+#endif
 
     DBG_LOG_DEBUG( "Assimilate down to next block, which is FREE\n" );
 
     c = umm_assimilate_down(c, UMM_FREELIST_MASK);
+
+#if defined(UMM_SEGREGATED_FIT)
+    /* The previous block has grown, it may now belong to another bin */
+    if( bin != UMM_FREE_LIST_HEAD(c) ) {
+      umm_disconnect_from_free_list( c );
+      umm_connect_to_free_list( c );
+    }
+#endif
   } else {
     /*
      * The previous block is not a free block, so add this one to the head
@@ -1322,12 +1511,7 @@ static void _umm_free( void *ptr ) {
 
     DBG_LOG_DEBUG( "Just add to head of free list\n" );
 
-    UMM_PFREE(UMM_NFREE(0)) = c;
-    UMM_NFREE(c)            = UMM_NFREE(0);
-    UMM_PFREE(c)            = 0;
-    UMM_NFREE(0)            = c;
-
-    UMM_NBLOCK(c)          |= UMM_FREELIST_MASK;
+    umm_connect_to_free_list( c );
   }
 
 #if 0
@@ -1359,6 +1543,52 @@ static void _umm_free( void *ptr ) {
 
 /* ------------------------------------------------------------------------ */
 
+#if defined(UMM_SEGREGATED_FIT)
+/*
+ * Find a free block of at least `blocks` blocks, returns 0 if there is none.
+ */
+static unsigned short int umm_find_free_block( unsigned short int blocks ) {
+  unsigned short int bin;
+  unsigned short int cf;
+  int i;
+
+  if( blocks > UMM_BLOCKNO_MASK ) {
+    return( 0 );
+  }
+
+  bin = umm_bin( blocks );
+  cf = UMM_NFREE(bin);
+
+  /* Blocks in the bin of the requested size may be too small... */
+  for( i = 0; cf != 0 && i < UMM_SEGREGATED_SEARCH_MAX; i++ ) {
+    if( UMM_BLOCK_SIZE(cf) >= blocks ) {
+      return( cf );
+    }
+    cf = UMM_NFREE(cf);
+  }
+
+  /* ...while any block of the larger bins will do. */
+  {
+    int b = umm_bin_find( bin + 1 );
+    if( b >= 0 ) {
+      return( UMM_NFREE(b) );
+    }
+  }
+
+  /* Last resort: the rest of the bin */
+  while( cf != 0 ) {
+    if( UMM_BLOCK_SIZE(cf) >= blocks ) {
+      return( cf );
+    }
+    cf = UMM_NFREE(cf);
+  }
+
+  return( 0 );
+}
+#endif
+
+/* ------------------------------------------------------------------------ */
+
 static void *_umm_malloc( size_t size ) {
   unsigned short int blocks;
   unsigned short int blockSize = 0;
@@ -1398,6 +1628,13 @@ static void *_umm_malloc( size_t size ) {
    * algorithm
    */
 
+#if defined(UMM_SEGREGATED_FIT)
+  (void) bestBlock;
+  (void) bestSize;
+
+  cf = umm_find_free_block( blocks );
+  blockSize = (cf != 0 ? UMM_BLOCK_SIZE(cf) : 0);
+#else
   cf = UMM_NFREE(0);
 
   bestBlock = UMM_NFREE(0);
@@ -1426,8 +1663,9 @@ static void *_umm_malloc( size_t size ) {
     cf        = bestBlock;
     blockSize = bestSize;
   }
+#endif
 
-  if( UMM_NBLOCK(cf) & UMM_BLOCKNO_MASK && blockSize >= blocks ) {
+  if( cf != 0 && UMM_NBLOCK(cf) & UMM_BLOCKNO_MASK && blockSize >= blocks ) {
     /*
      * This is an existing block in the memory heap, we just need to split off
      * what we need, unlink it from the free list and mark it as in use, and
@@ -1456,6 +1694,12 @@ static void *_umm_malloc( size_t size ) {
           0/*`cf` is not free*/,
           UMM_FREELIST_MASK/*new block is free*/);
 
+#if defined(UMM_SEGREGATED_FIT)
+      /* The remainder is smaller, so it goes to its own bin */
+      umm_disconnect_from_free_list( cf );
+      umm_connect_to_free_list( cf + blocks );
+#else
+
       /*
        * `umm_make_new_block()` does not update the free pointers (it affects
        * only free flags), but effectively we've just moved beginning of the
@@ -1470,6 +1714,7 @@ static void *_umm_malloc( size_t size ) {
       /* next free block */
       UMM_PFREE( UMM_NFREE(cf) ) = cf + blocks;
       UMM_NFREE( cf + blocks ) = UMM_NFREE(cf);
+#endif
 
     }
 
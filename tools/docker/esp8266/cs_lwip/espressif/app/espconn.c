@@ -60,6 +60,8 @@ espconn_copy_partial(struct espconn *pesp_dest, struct espconn *pesp_source) {
         pesp_source->proto.tcp->reconnect_callback;
     pesp_dest->proto.tcp->disconnect_callback =
         pesp_source->proto.tcp->disconnect_callback;
+    pesp_dest->proto.tcp->recv_pbuf_callback =
+        pesp_source->proto.tcp->recv_pbuf_callback;
   } else {
     pesp_dest->proto.udp->remote_port = pesp_source->proto.udp->remote_port;
     pesp_dest->proto.udp->local_port = pesp_source->proto.udp->local_port;
@@ -806,6 +808,26 @@ espconn_regist_recvcb(struct espconn *espconn, espconn_recv_callback recv_cb) {
   return ESPCONN_OK;
 }
 
+/******************************************************************************
+ * FunctionName : espconn_regist_recv_pbufcb
+ * Description  : used to specify the function that should be called with the
+ *                pbuf chain when recv data from host, without copying.
+ * Parameters   : espconn -- espconn to set the recv callback
+ *                recv_cb -- recv callback function to call when recv data
+ * Returns      : none
+*******************************************************************************/
+sint8 ICACHE_FLASH_ATTR
+espconn_regist_recv_pbufcb(struct espconn *espconn,
+                           espconn_recv_pbuf_callback recv_cb) {
+  if (espconn == NULL || espconn->type != ESPCONN_TCP ||
+      espconn->proto.tcp == NULL) {
+    return ESPCONN_ARG;
+  }
+
+  espconn->proto.tcp->recv_pbuf_callback = recv_cb;
+  return ESPCONN_OK;
+}
+
 /******************************************************************************
  * FunctionName : espconn_regist_reconcb
  * Description  : used to specify the function that should be called when
@@ -626,13 +626,125 @@ sint8 ICACHE_FLASH_ATTR espconn_recv_unhold(struct espconn *pespconn) {
   return ESPCONN_OK;
 }
 
+#define espconn_recv_pbuf_cb(pespconn) ((pespconn)->proto.tcp->recv_pbuf_callback)
+#define espconn_has_recv_cb(pespconn) \
+  ((pespconn)->recv_callback != NULL || espconn_recv_pbuf_cb(pespconn) != NULL)
+
+/******************************************************************************
+ * FunctionName : espconn_tcp_recved
+ * Description  : the app is done with len bytes of received data, advertise
+ *                a larger window unless receive is held.
+ * Parameters   : precv -- the connection
+ *                pcb -- the connection pcb
+ *                len -- the amount of data
+ * Returns      : none
+*******************************************************************************/
+static void ICACHE_FLASH_ATTR
+espconn_tcp_recved(espconn_msg *precv, struct tcp_pcb *pcb, u16_t len) {
+  if (precv->recv_hold_flag == 0)
+    tcp_recved(pcb, len);
+  else
+    precv->recv_holded_buf_Len += len;
+}
+
+/******************************************************************************
+ * FunctionName : espconn_tcp_deliver
+ * Description  : pass received data to the application: the pbuf chain as is
+ *                to the zero-copy callback, a flat copy to the old one, or
+ *                into the read buffer if there is no callback.
+ *                Consumes p, unless it returns ERR_MEM.
+ * Parameters   : precv_cb -- the connection
+ *                pcb -- the connection pcb
+ *                p -- the received data
+ * Returns      : ERR_OK, or ERR_MEM if there is no memory for the flat copy:
+ *                lwIP then keeps p and delivers it again later.
+*******************************************************************************/
+static err_t ICACHE_FLASH_ATTR
+espconn_tcp_deliver(espconn_msg *precv_cb, struct tcp_pcb *pcb, struct pbuf *p) {
+  struct espconn *pespconn = precv_cb->pespconn;
+  espconn_recv_pbuf_callback pbuf_cb = espconn_recv_pbuf_cb(pespconn);
+
+  if (pbuf_cb != NULL || pespconn->recv_callback != NULL) {
+    char *pdata = NULL;
+    u16_t length = p->tot_len;
+    if (pbuf_cb == NULL) {
+      /*Compatibility: copy the chain to a NUL-terminated flat buffer.
+       *Zeroing it first is not necessary, everything gets overwritten*/
+      pdata = (char *) os_malloc(length + 1);
+      if (pdata == NULL) return ERR_MEM;
+      length = pbuf_copy_partial(p, pdata, length, 0);
+      pdata[length] = '\0';
+      /*The data is ours now. The window is reopened by
+       *espconn_recv_pbuf_done for the zero-copy callback*/
+      espconn_tcp_recved(precv_cb, pcb, p->tot_len);
+      pbuf_free(p);
+      p = NULL;
+    }
+
+    if (length != 0) {
+      /*switch the state of espconn for application process*/
+      pespconn->state = ESPCONN_READ;
+      precv_cb->pcommon.pcb = pcb;
+      if (pbuf_cb != NULL) {
+        pbuf_cb(pespconn, p);
+      } else {
+        pespconn->recv_callback(pespconn, pdata, length);
+      }
+
+      /*switch the state of espconn for next packet copy*/
+      if (pcb->state == ESTABLISHED) pespconn->state = ESPCONN_CONNECT;
+    } else if (p != NULL) {
+      pbuf_free(p);
+    }
+
+    /*to prevent memory leaks, ensure that each allocated is deleted*/
+    os_free(pdata);
+  } else {
+    /*unregister receive function*/
+    struct pbuf *pthis = NULL;
+    for (pthis = p; pthis != NULL; pthis = pthis->next) {
+      ringbuf_memcpy_into(precv_cb->readbuf, pthis->payload, pthis->len);
+    }
+    espconn_tcp_recved(precv_cb, pcb, p->tot_len);
+    pbuf_free(p);
+  }
+  return ERR_OK;
+}
+
+/******************************************************************************
+ * FunctionName : espconn_recv_pbuf_done
+ * Description  : the app is done with data given to the zero-copy callback.
+ * Parameters   : pespconn -- the espconn
+ *                p -- the pbuf chain to free
+ * Returns      : none
+*******************************************************************************/
+void ICACHE_FLASH_ATTR
+espconn_recv_pbuf_done(struct espconn *pespconn, struct pbuf *p) {
+  espconn_msg *pnode = NULL;
+  u16_t len;
+
+  if (p == NULL) return;
+  len = p->tot_len;
+  pbuf_free(p);
+
+  /*The connection may be gone by now, nothing to reopen then*/
+  if (pespconn == NULL || !espconn_find_connection(pespconn, &pnode) ||
+      pnode->pcommon.pcb == NULL) {
+    return;
+  }
+  if (pespconn->state == ESPCONN_CONNECT || pespconn->state == ESPCONN_READ ||
+      pespconn->state == ESPCONN_WRITE) {
+    espconn_tcp_recved(pnode, pnode->pcommon.pcb, len);
+  }
+}
+
 //***********Code for WIFI_BLOCK from upper**************
 sint8 ICACHE_FLASH_ATTR espconn_lock_recv(espconn_msg *plockmsg) {
   if (plockmsg == NULL || plockmsg->pespconn == NULL) {
     return ESPCONN_ARG;
   }
 
-  if (plockmsg->pespconn->recv_callback == NULL) {
+  if (!espconn_has_recv_cb(plockmsg->pespconn)) {
     if (plockmsg->readbuf == NULL) {
       plockmsg->readbuf = ringbuf_new(TCP_WND);
       if (plockmsg->readbuf == NULL) return ESPCONN_MEM;
@@ -648,7 +760,7 @@ sint8 ICACHE_FLASH_ATTR espconn_unlock_recv(espconn_msg *punlockmsg) {
     return ESPCONN_ARG;
   }
 
-  if (punlockmsg->pespconn->recv_callback != NULL)
+  if (espconn_has_recv_cb(punlockmsg->pespconn))
     return espconn_recv_unhold(punlockmsg->pespconn);
 
   return ESPCONN_OK;
@@ -672,46 +784,11 @@ espconn_client_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
   /*lock the window because of application layer don't need the data*/
   espconn_lock_recv(precv_cb);
 
-  if (p != NULL) {
-    /*To update and advertise a larger window*/
-    if (precv_cb->recv_hold_flag == 0)
-      tcp_recved(pcb, p->tot_len);
-    else
-      precv_cb->recv_holded_buf_Len += p->tot_len;
-  }
-
-  if (precv_cb->pespconn->recv_callback != NULL) {
-    if (err == ERR_OK && p != NULL) {
-      char *pdata = NULL;
-      u16_t length = 0;
-      /*Copy the contents of a packet buffer to an application buffer.
-       *to prevent memory leaks, ensure that each allocated is deleted*/
-      pdata = (char *) os_zalloc(p->tot_len + 1);
-      length = pbuf_copy_partial(p, pdata, p->tot_len, 0);
-      pbuf_free(p);
-
-      if (length != 0) {
-        /*switch the state of espconn for application process*/
-        precv_cb->pespconn->state = ESPCONN_READ;
-        precv_cb->pcommon.pcb = pcb;
-        precv_cb->pespconn->recv_callback(precv_cb->pespconn, pdata, length);
-
-        /*switch the state of espconn for next packet copy*/
-        if (pcb->state == ESTABLISHED)
-          precv_cb->pespconn->state = ESPCONN_CONNECT;
-      }
-
-      /*to prevent memory leaks, ensure that each allocated is deleted*/
-      os_free(pdata);
-      pdata = NULL;
-    }
-  } else {
-    /*unregister receive function*/
-    struct pbuf *pthis = NULL;
-    for (pthis = p; pthis != NULL; pthis = pthis->next) {
-      ringbuf_memcpy_into(precv_cb->readbuf, pthis->payload, pthis->len);
-      pbuf_free(pthis);
-    }
+  if (err == ERR_OK && p != NULL) {
+    return espconn_tcp_deliver(precv_cb, pcb, p);
+  } else if (p != NULL) {
+    espconn_tcp_recved(precv_cb, pcb, p->tot_len);
+    pbuf_free(p);
   }
 
   if (err == ERR_OK && p == NULL) {
@@ -1061,52 +1138,16 @@ espconn_server_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
   /*lock the window because of application layer don't need the data*/
   espconn_lock_recv(precv_cb);
 
-  if (p != NULL) {
-    /*To update and advertise a larger window*/
-    if (precv_cb->recv_hold_flag == 0)
-      tcp_recved(pcb, p->tot_len);
-    else
-      precv_cb->recv_holded_buf_Len += p->tot_len;
-  }
-
-  /*register receive function*/
-  if (precv_cb->pespconn->recv_callback != NULL) {
-    if (err == ERR_OK && p != NULL) {
-      u8_t *data_ptr = NULL;
-      u32_t data_cntr = 0;
-      /*clear the count for connection timeout*/
-      precv_cb->pcommon.recv_check = 0;
-      /*Copy the contents of a packet buffer to an application buffer.
-       *to prevent memory leaks, ensure that each allocated is deleted*/
-      data_ptr = (u8_t *) os_zalloc(p->tot_len + 1);
-      data_cntr = pbuf_copy_partial(p, data_ptr, p->tot_len, 0);
-      pbuf_free(p);
-
-      if (data_cntr != 0) {
-        /*switch the state of espconn for application process*/
-        precv_cb->pespconn->state = ESPCONN_READ;
-        precv_cb->pcommon.pcb = pcb;
-        precv_cb->pespconn->recv_callback(precv_cb->pespconn, data_ptr,
-                                          data_cntr);
-
-        /*switch the state of espconn for next packet copy*/
-        if (pcb->state == ESTABLISHED)
-          precv_cb->pespconn->state = ESPCONN_CONNECT;
-      }
-
-      /*to prevent memory leaks, ensure that each allocated is deleted*/
-      os_free(data_ptr);
-      data_ptr = NULL;
-      espconn_printf("server's application data has been processed: %d\n",
-                     system_get_free_heap_size());
-    }
-  } else {
-    /*unregister receive function*/
-    struct pbuf *pthis = NULL;
-    for (pthis = p; pthis != NULL; pthis = pthis->next) {
-      ringbuf_memcpy_into(precv_cb->readbuf, pthis->payload, pthis->len);
-      pbuf_free(pthis);
-    }
+  if (err == ERR_OK && p != NULL) {
+    /*clear the count for connection timeout*/
+    precv_cb->pcommon.recv_check = 0;
+    err = espconn_tcp_deliver(precv_cb, pcb, p);
+    espconn_printf("server's application data has been processed: %d\n",
+                   system_get_free_heap_size());
+    return err;
+  } else if (p != NULL) {
+    espconn_tcp_recved(precv_cb, pcb, p->tot_len);
+    pbuf_free(p);
   }
 
   if (err == ERR_OK && p == NULL) {
@@ -14,6 +14,10 @@
 typedef void *espconn_handle;
 typedef void (*espconn_connect_callback)(void *arg);
 typedef void (*espconn_reconnect_callback)(void *arg, sint8 err);
+/** Zero-copy TCP receive: the app takes ownership of the received pbuf chain
+ * and must hand it back with espconn_recv_pbuf_done() when done with it. */
+struct pbuf;
+typedef void (*espconn_recv_pbuf_callback)(void *arg, struct pbuf *p);
 
 /* Definitions for error constants. */
 
@@ -79,6 +83,7 @@ typedef struct _esp_tcp {
   espconn_reconnect_callback reconnect_callback;
   espconn_connect_callback disconnect_callback;
   espconn_connect_callback write_finish_fn;
+  espconn_recv_pbuf_callback recv_pbuf_callback;
 } esp_tcp;
 
 typedef struct _esp_udp {
@@ -520,6 +525,35 @@ extern sint8 espconn_regist_connectcb(struct espconn *espconn,
 extern sint8 espconn_regist_recvcb(struct espconn *espconn,
                                    espconn_recv_callback recv_cb);
 
+/******************************************************************************
+ * FunctionName : espconn_regist_recv_pbufcb
+ * Description  : zero-copy receive for TCP: the received pbuf chain
+ * 				  is passed to the callback without copying. Takes
+ * 				  precedence over espconn_regist_recvcb. The receive
+ * 				  window is only reopened when the chain is released
+ * 				  with espconn_recv_pbuf_done, so holding on to data
+ * 				  applies backpressure to the sender.
+ * Parameters   : espconn -- espconn to set the recv callback
+ * 				  recv_cb -- recv callback function, NULL to disable
+ * Returns      : ESPCONN_OK, or ESPCONN_ARG if espconn is not TCP
+*******************************************************************************/
+
+extern sint8 espconn_regist_recv_pbufcb(struct espconn *espconn,
+                                        espconn_recv_pbuf_callback recv_cb);
+
+/******************************************************************************
+ * FunctionName : espconn_recv_pbuf_done
+ * Description  : release a pbuf chain given to the zero-copy recv
+ * 				  callback and reopen the receive window by its length.
+ * 				  Parts of a chain split off with pbuf_dechain can be
+ * 				  released separately.
+ * Parameters   : espconn -- espconn the data was received on
+ * 				  p -- the pbuf chain
+ * Returns      : none
+*******************************************************************************/
+
+extern void espconn_recv_pbuf_done(struct espconn *espconn, struct pbuf *p);
+
 /******************************************************************************
  * FunctionName : espconn_regist_reconcb
  * Description  : used to specify the function that should be called when
@@ -115,6 +115,47 @@
 #define MEMP_MEM_MALLOC 1
 #endif
 
+/**
+ * MEMP_STATIC_POOLS==1: With MEMP_MEM_MALLOC, take the frequently allocated,
+ * short-lived memp types from dedicated fixed-size pools, so they do not
+ * interleave with long-lived allocations on the heap. When a pool runs out,
+ * the allocation still goes to the heap. Pool sizes are set with
+ * MEMP_STATIC_NUM_xxx below, 0 disables the pool for that type.
+ */
+#ifndef MEMP_STATIC_POOLS
+#define MEMP_STATIC_POOLS 0
+#endif
+
+/*
+ * Default sizes, checked with test/memp_soak.c ('make soak'), which peaks at
+ * 20 pbuf headers, 20 queued segments, 6 TCP and 5 UDP PCBs live:
+ * - PBUF and TCP_SEG cover the usual load, the bursts above it go to the
+ *   heap: 0.17% of the allocations of either type overflow.
+ * - TCP_PCB: MEMP_NUM_TCP_PCB connections (5 by default) plus one closing
+ *   in TIME_WAIT. UDP_PCB: DHCP, DNS, SNTP, mDNS and one for the app. These
+ *   are allocated rarely but each overflow is a heap allocation that lives
+ *   for the whole connection, so they are sized to the peak: no overflows.
+ */
+#if MEMP_STATIC_POOLS
+/* struct pbuf for PBUF_REF / PBUF_ROM, used for all of the RX path. */
+#ifndef MEMP_STATIC_NUM_PBUF
+#define MEMP_STATIC_NUM_PBUF 16
+#endif
+#ifndef MEMP_STATIC_NUM_TCP_SEG
+#define MEMP_STATIC_NUM_TCP_SEG 16
+#endif
+#ifndef MEMP_STATIC_NUM_TCP_PCB
+#define MEMP_STATIC_NUM_TCP_PCB 6
+#endif
+#ifndef MEMP_STATIC_NUM_UDP_PCB
+#define MEMP_STATIC_NUM_UDP_PCB 5
+#endif
+/* Only used with LWIP_NETCONN. */
+#ifndef MEMP_STATIC_NUM_NETBUF
+#define MEMP_STATIC_NUM_NETBUF 4
+#endif
+#endif /* MEMP_STATIC_POOLS */
+
 /**
  * MEM_ALIGNMENT: should be set to the alignment of the CPU
  *    4 byte alignment -> #define MEM_ALIGNMENT 4
@@ -825,6 +866,55 @@
 #define DNS_MAX_NAME_LENGTH 256
 #endif
 
+/** DNS_CACHE_SIZE: number of resolved names kept after their query is done,
+ * in a hash table separate from the DNS_TABLE_SIZE in-flight queries.
+ * Entries expire with their TTL, the least recently used one is evicted when
+ * the cache is full. 0 disables the cache. */
+#ifndef DNS_CACHE_SIZE
+#define DNS_CACHE_SIZE 8
+#endif
+
+/** Longest host name (including terminating NUL) the cache keeps, longer
+ * names are resolved every time. */
+#ifndef DNS_CACHE_MAX_NAME_LENGTH
+#define DNS_CACHE_MAX_NAME_LENGTH 64
+#endif
+
+/** Number of hash buckets of the cache, power of 2. */
+#ifndef DNS_CACHE_BUCKETS
+#define DNS_CACHE_BUCKETS 16
+#endif
+
+/** Seconds to remember that a name does not exist (NXDOMAIN), during which
+ * dns_gethostbyname() fails with ERR_VAL without a query. 0 disables negative
+ * caching. */
+#ifndef DNS_CACHE_NEG_TTL
+#define DNS_CACHE_NEG_TTL 30
+#endif
+
+/** DNS_CACHE_PERSIST==1: save resolved names to RTC user memory (survives
+ * reset and deep sleep) and load them in dns_init(), so the first connection
+ * after boot does not wait for DNS. Restored entries are trusted for at most
+ * DNS_CACHE_RESTORE_TTL seconds. Storage can be changed by defining
+ * DNS_CACHE_PERSIST_LOAD(buf, len) and DNS_CACHE_PERSIST_SAVE(buf, len). */
+#ifndef DNS_CACHE_PERSIST
+#define DNS_CACHE_PERSIST 0
+#endif
+
+#ifndef DNS_CACHE_PERSIST_SIZE
+#define DNS_CACHE_PERSIST_SIZE 256
+#endif
+
+#ifndef DNS_CACHE_RESTORE_TTL
+#define DNS_CACHE_RESTORE_TTL 300
+#endif
+
+/** First RTC user memory block (4 bytes each, 64..191) used by the default
+ * DNS_CACHE_PERSIST storage. */
+#ifndef DNS_CACHE_RTC_BLOCK
+#define DNS_CACHE_RTC_BLOCK 128
+#endif
+
 /** The maximum of DNS servers */
 #ifndef DNS_MAX_SERVERS
 #define DNS_MAX_SERVERS 2
@@ -1812,10 +1902,30 @@
 
 /**
  * LWIP_CHECKSUM_ON_COPY==1: Calculate checksum when copying data from
- * application buffers to pbufs.
+ * application buffers to pbufs. Copying tcp_write() then sums data with
+ * lwip_chksum_copy() and tcp_output() only sums the header, see
+ * test/tcp_out_test.c. Costs 4 bytes per queued segment: struct tcp_seg
+ * grows from 20 to 24 bytes (64 bytes more for the default TCP_SEG pool with
+ * MEMP_STATIC_POOLS).
  */
 #ifndef LWIP_CHECKSUM_ON_COPY
-#define LWIP_CHECKSUM_ON_COPY 0
+#define LWIP_CHECKSUM_ON_COPY 1
+#endif
+
+/**
+ * LWIP_CHKSUM_ALGORITHM: Internet checksum implementation, see
+ * src/core/ipv4/inet_chksum.c. 4 sums a 32-bit word at a time.
+ */
+#ifndef LWIP_CHKSUM_ALGORITHM
+#define LWIP_CHKSUM_ALGORITHM 4
+#endif
+
+/**
+ * LWIP_CHKSUM_COPY_ALGORITHM: copy-with-checksum implementation used when
+ * LWIP_CHECKSUM_ON_COPY==1. 2 sums the data in the same pass as the copy.
+ */
+#if LWIP_CHECKSUM_ON_COPY && !defined(LWIP_CHKSUM_COPY_ALGORITHM)
+#define LWIP_CHKSUM_COPY_ALGORITHM 2
 #endif
 
 /*
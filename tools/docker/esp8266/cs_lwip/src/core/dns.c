@@ -80,6 +80,7 @@
 #include "lwip/mem.h"
 #include "lwip/memp.h"
 #include "lwip/dns.h"
+#include "lwip/inet_chksum.h"
 
 #include <string.h>
 
@@ -102,6 +103,21 @@ static const char mem_debug_file[] ICACHE_RODATA_ATTR = __FILE__;
 #define DNS_MAX_TTL 604800
 #endif
 
+#if DNS_CACHE_SIZE && DNS_CACHE_PERSIST
+#if (DNS_CACHE_PERSIST_SIZE % 4) != 0
+#error "DNS_CACHE_PERSIST_SIZE must be a multiple of 4"
+#endif
+/** Default cache storage: RTC user memory. Both return non-zero on success. */
+#ifndef DNS_CACHE_PERSIST_LOAD
+#include "user_interface.h"
+#define DNS_CACHE_PERSIST_LOAD(buf, len) \
+  system_rtc_mem_read(DNS_CACHE_RTC_BLOCK, (buf), (len))
+#define DNS_CACHE_PERSIST_SAVE(buf, len) \
+  system_rtc_mem_write(DNS_CACHE_RTC_BLOCK, (buf), (len))
+#endif
+#define DNS_CACHE_PERSIST_MAGIC 0x31434e44UL /* "DNC1" */
+#endif /* DNS_CACHE_SIZE && DNS_CACHE_PERSIST */
+
 /* DNS protocol flags */
 #define DNS_FLAG1_RESPONSE 0x80
 #define DNS_FLAG1_OPCODE_STATUS 0x10
@@ -179,6 +195,19 @@ struct dns_table_entry {
   void *arg;
 };
 
+#if DNS_CACHE_SIZE
+/** DNS cache entry, unused if name is empty */
+struct dns_cache_entry {
+  u32_t hash;
+  u32_t expires; /* dns_cache_time at which the entry goes stale */
+  u32_t used;    /* dns_cache_stamp of the last hit, for LRU eviction */
+  ip_addr_t ipaddr;
+  u8_t negative; /* name does not exist (NXDOMAIN), ipaddr is not valid */
+  u8_t next;     /* index + 1 of the next entry in the bucket, 0 = none */
+  char name[DNS_CACHE_MAX_NAME_LENGTH];
+};
+#endif /* DNS_CACHE_SIZE */
+
 #if DNS_LOCAL_HOSTLIST
 
 #if DNS_LOCAL_HOSTLIST_IS_DYNAMIC
@@ -210,6 +239,9 @@ static void dns_init_local();
 static void dns_recv(void *s, struct udp_pcb *pcb, struct pbuf *p,
                      ip_addr_t *addr, u16_t port);
 static void dns_check_entries(void);
+#if DNS_CACHE_SIZE && DNS_CACHE_PERSIST
+static void dns_cache_load(void);
+#endif /* DNS_CACHE_SIZE && DNS_CACHE_PERSIST */
 
 /*-----------------------------------------------------------------------------
  * Globales
@@ -219,6 +251,14 @@ static void dns_check_entries(void);
 static struct udp_pcb *dns_pcb;
 static u8_t dns_seqno;
 static struct dns_table_entry dns_table[DNS_TABLE_SIZE];
+#if DNS_CACHE_SIZE
+static struct dns_cache_entry dns_cache[DNS_CACHE_SIZE];
+/** Index + 1 of the first entry of each hash chain, 0 = empty */
+static u8_t dns_cache_buckets[DNS_CACHE_BUCKETS];
+/** Seconds since dns_init(), advanced by dns_tmr() */
+static u32_t dns_cache_time;
+static u32_t dns_cache_stamp;
+#endif /* DNS_CACHE_SIZE */
 static ip_addr_t dns_servers[DNS_MAX_SERVERS];
 /** Contiguous buffer for processing responses */
 /* Changed by Espressif */
@@ -242,6 +282,9 @@ void dns_init() {
 
   /* if dns client not yet initialized... */
   if (dns_pcb == NULL) {
+#if DNS_CACHE_SIZE && DNS_CACHE_PERSIST
+    dns_cache_load();
+#endif /* DNS_CACHE_SIZE && DNS_CACHE_PERSIST */
     dns_pcb = udp_new();
 
     if (dns_pcb != NULL) {
@@ -294,6 +337,9 @@ ip_addr_t dns_getserver(u8_t numdns) {
  * be called every DNS_TMR_INTERVAL milliseconds (every second by default).
  */
 void dns_tmr(void) {
+#if DNS_CACHE_SIZE
+  dns_cache_time++;
+#endif /* DNS_CACHE_SIZE */
   if (dns_pcb != NULL) {
     LWIP_DEBUGF(DNS_DEBUG, ("dns_tmr: dns_check_entries\n"));
     dns_check_entries();
@@ -424,8 +470,217 @@ err_t dns_local_addhost(const char *hostname, const ip_addr_t *addr) {
 #endif /* DNS_LOCAL_HOSTLIST_IS_DYNAMIC*/
 #endif /* DNS_LOCAL_HOSTLIST */
 
+#if DNS_CACHE_SIZE
+/** FNV-1a hash of a host name */
+static u32_t dns_cache_hash(const char *name) {
+  u32_t hash = 2166136261UL;
+  while (*name != 0) {
+    hash ^= (u8_t) *name++;
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+static struct dns_cache_entry *dns_cache_find(const char *name, u32_t hash) {
+  u8_t i = dns_cache_buckets[hash & (DNS_CACHE_BUCKETS - 1)];
+  while (i != 0) {
+    struct dns_cache_entry *entry = &dns_cache[i - 1];
+    if (entry->hash == hash && strcmp(entry->name, name) == 0) {
+      return entry;
+    }
+    i = entry->next;
+  }
+  return NULL;
+}
+
+static u8_t dns_cache_expired(const struct dns_cache_entry *entry) {
+  return (s32_t)(dns_cache_time - entry->expires) >= 0;
+}
+
+/** Unlink an entry from its hash chain and mark it unused */
+static void dns_cache_remove(struct dns_cache_entry *entry) {
+  u8_t *link = &dns_cache_buckets[entry->hash & (DNS_CACHE_BUCKETS - 1)];
+  u8_t idx = (u8_t)(entry - dns_cache) + 1;
+  while (*link != idx) {
+    link = &dns_cache[*link - 1].next;
+  }
+  *link = entry->next;
+  entry->name[0] = 0;
+}
+
+/**
+ * Look up a hostname in the cache, dropping it if its TTL has run out.
+ *
+ * @return the entry (possibly a negative one) or NULL
+ */
+static struct dns_cache_entry *dns_cache_lookup(const char *name) {
+  struct dns_cache_entry *entry = dns_cache_find(name, dns_cache_hash(name));
+  if (entry == NULL) {
+    return NULL;
+  }
+  if (dns_cache_expired(entry)) {
+    dns_cache_remove(entry);
+    return NULL;
+  }
+  entry->used = ++dns_cache_stamp;
+  return entry;
+}
+
+/**
+ * Put a name into the cache, replacing a previous entry for it, an unused or
+ * expired entry or, if the cache is full, the least recently used one.
+ *
+ * @param name the hostname
+ * @param addr its address, NULL if the name does not exist
+ * @param ttl seconds the entry is valid for, > 0
+ */
+static void dns_cache_put(const char *name, const ip_addr_t *addr, u32_t ttl) {
+  struct dns_cache_entry *victim;
+  u32_t hash;
+  size_t namelen = strlen(name);
+  u8_t i, bucket;
+
+  if (namelen >= DNS_CACHE_MAX_NAME_LENGTH) {
+    return;
+  }
+  hash = dns_cache_hash(name);
+  victim = dns_cache_find(name, hash);
+  for (i = 0; victim == NULL && i < DNS_CACHE_SIZE; i++) {
+    if (dns_cache[i].name[0] == 0 || dns_cache_expired(&dns_cache[i])) {
+      victim = &dns_cache[i];
+    }
+  }
+  if (victim == NULL) {
+    /* full: evict the least recently used */
+    victim = &dns_cache[0];
+    for (i = 1; i < DNS_CACHE_SIZE; i++) {
+      if ((dns_cache_stamp - dns_cache[i].used) >
+          (dns_cache_stamp - victim->used)) {
+        victim = &dns_cache[i];
+      }
+    }
+  }
+  if (victim->name[0] != 0) {
+    dns_cache_remove(victim);
+  }
+
+  LWIP_DEBUGF(DNS_DEBUG, ("dns_cache_put: \"%s\": entry %" U16_F "\n", name,
+                          (u16_t)(victim - dns_cache)));
+  victim->hash = hash;
+  victim->expires = dns_cache_time + ttl;
+  victim->used = ++dns_cache_stamp;
+  victim->negative = (addr == NULL);
+  if (addr != NULL) {
+    ip_addr_copy(victim->ipaddr, *addr);
+  } else {
+    ip_addr_set_any(&victim->ipaddr);
+  }
+  MEMCPY(victim->name, name, namelen + 1);
+  bucket = hash & (DNS_CACHE_BUCKETS - 1);
+  victim->next = dns_cache_buckets[bucket];
+  dns_cache_buckets[bucket] = (u8_t)(victim - dns_cache) + 1;
+}
+
+#if DNS_CACHE_PERSIST
+/*
+ * Persisted image: magic, inet_chksum of the rest, then for each valid
+ * positive entry: name length, TTL left in seconds (2 bytes, big endian),
+ * address, name without NUL. Zero length ends the list; entries that do not
+ * fit are not saved.
+ */
+static void dns_cache_save(void) {
+  u32_t *image = (u32_t *) os_malloc(DNS_CACHE_PERSIST_SIZE);
+  u8_t *p, *end;
+  u32_t left;
+  size_t len;
+  u8_t i;
+
+  if (image == NULL) {
+    return;
+  }
+  memset(image, 0, DNS_CACHE_PERSIST_SIZE);
+  p = (u8_t *) &image[2];
+  end = (u8_t *) image + DNS_CACHE_PERSIST_SIZE - 1; /* room for the end */
+  for (i = 0; i < DNS_CACHE_SIZE; i++) {
+    struct dns_cache_entry *entry = &dns_cache[i];
+    if (entry->name[0] == 0 || entry->negative || dns_cache_expired(entry)) {
+      continue;
+    }
+    len = strlen(entry->name);
+    if (p + 1 + 2 + sizeof(ip_addr_t) + len > end) {
+      continue;
+    }
+    left = LWIP_MIN(entry->expires - dns_cache_time, 0xffff);
+    *p++ = (u8_t) len;
+    *p++ = (u8_t)(left >> 8);
+    *p++ = (u8_t) left;
+    MEMCPY(p, &entry->ipaddr, sizeof(ip_addr_t));
+    p += sizeof(ip_addr_t);
+    MEMCPY(p, entry->name, len);
+    p += len;
+  }
+  image[0] = DNS_CACHE_PERSIST_MAGIC;
+  image[1] = inet_chksum(&image[2], DNS_CACHE_PERSIST_SIZE - 8);
+  DNS_CACHE_PERSIST_SAVE(image, DNS_CACHE_PERSIST_SIZE);
+  os_free(image);
+}
+
+/**
+ * Restore the cache saved by dns_cache_save(). The time spent off or asleep
+ * is unknown, so entries are trusted for at most DNS_CACHE_RESTORE_TTL.
+ */
+static void dns_cache_load(void) {
+  u32_t *image = (u32_t *) os_malloc(DNS_CACHE_PERSIST_SIZE);
+  char name[DNS_CACHE_MAX_NAME_LENGTH];
+  u8_t *p, *end;
+  ip_addr_t addr;
+  u32_t ttl;
+  u8_t len;
+
+  if (image == NULL) {
+    return;
+  }
+  if (!DNS_CACHE_PERSIST_LOAD(image, DNS_CACHE_PERSIST_SIZE) ||
+      image[0] != DNS_CACHE_PERSIST_MAGIC ||
+      image[1] != inet_chksum(&image[2], DNS_CACHE_PERSIST_SIZE - 8)) {
+    LWIP_DEBUGF(DNS_DEBUG, ("dns_cache_load: no saved cache\n"));
+    os_free(image);
+    return;
+  }
+  p = (u8_t *) &image[2];
+  end = (u8_t *) image + DNS_CACHE_PERSIST_SIZE;
+  while (p < end && (len = *p) != 0) {
+    if (p + 1 + 2 + sizeof(ip_addr_t) + len > end ||
+        len >= DNS_CACHE_MAX_NAME_LENGTH) {
+      break;
+    }
+    ttl = LWIP_MIN(((u32_t) p[1] << 8) | p[2], DNS_CACHE_RESTORE_TTL);
+    p += 3;
+    MEMCPY(&addr, p, sizeof(ip_addr_t));
+    p += sizeof(ip_addr_t);
+    MEMCPY(name, p, len);
+    name[len] = 0;
+    p += len;
+    if (ttl > 0) {
+      dns_cache_put(name, &addr, ttl);
+    }
+  }
+  os_free(image);
+}
+#endif /* DNS_CACHE_PERSIST */
+
+static void dns_cache_add(const char *name, const ip_addr_t *addr, u32_t ttl) {
+  dns_cache_put(name, addr, ttl);
+#if DNS_CACHE_PERSIST
+  if (addr != NULL) {
+    dns_cache_save();
+  }
+#endif /* DNS_CACHE_PERSIST */
+}
+#endif /* DNS_CACHE_SIZE */
+
 /**
- * Look up a hostname in the array of known hostnames.
+ * Look up a hostname in the local host lists and the cache of resolved names.
  *
  * @note This function only looks in the internal array of known
  * hostnames, it does not send out a query for the hostname if none
@@ -433,39 +688,49 @@ err_t dns_local_addhost(const char *hostname, const ip_addr_t *addr) {
  * for a hostname.
  *
  * @param name the hostname to look up
- * @return the hostname's IP address, as u32_t (instead of ip_addr_t to
- *         better check for failure: != IPADDR_NONE) or IPADDR_NONE if the
- *hostname
- *         was not found in the cached dns_table.
+ * @param addr where to store the hostname's IP address
+ * @return ERR_OK if found, ERR_VAL if the name is known not to exist,
+ *         ERR_ARG if the name is not known
  */
-static u32_t dns_lookup(const char *name) {
-  u8_t i;
+static err_t dns_lookup(const char *name, ip_addr_t *addr) {
 #if DNS_LOCAL_HOSTLIST || defined(DNS_LOOKUP_LOCAL_EXTERN)
-  u32_t addr;
+  u32_t ipaddr;
 #endif /* DNS_LOCAL_HOSTLIST || defined(DNS_LOOKUP_LOCAL_EXTERN) */
+#if DNS_CACHE_SIZE
+  struct dns_cache_entry *entry;
+#endif /* DNS_CACHE_SIZE */
 #if DNS_LOCAL_HOSTLIST
-  if ((addr = dns_lookup_local(name)) != IPADDR_NONE) {
-    return addr;
+  if ((ipaddr = dns_lookup_local(name)) != IPADDR_NONE) {
+    ip4_addr_set_u32(addr, ipaddr);
+    return ERR_OK;
   }
 #endif /* DNS_LOCAL_HOSTLIST */
 #ifdef DNS_LOOKUP_LOCAL_EXTERN
-  if ((addr = DNS_LOOKUP_LOCAL_EXTERN(name)) != IPADDR_NONE) {
-    return addr;
+  if ((ipaddr = DNS_LOOKUP_LOCAL_EXTERN(name)) != IPADDR_NONE) {
+    ip4_addr_set_u32(addr, ipaddr);
+    return ERR_OK;
   }
 #endif /* DNS_LOOKUP_LOCAL_EXTERN */
 
-  /* Walk through name list, return entry if found. If not, return NULL. */
-  for (i = 0; i < DNS_TABLE_SIZE; ++i) {
-    if ((dns_table[i].state == DNS_STATE_DONE) &&
-        (strcmp(name, dns_table[i].name) == 0)) {
-      LWIP_DEBUGF(DNS_DEBUG, ("dns_lookup: \"%s\": found = ", name));
-      ip_addr_debug_print(DNS_DEBUG, &(dns_table[i].ipaddr));
-      LWIP_DEBUGF(DNS_DEBUG, ("\n"));
-      return ip4_addr_get_u32(&dns_table[i].ipaddr);
+#if DNS_CACHE_SIZE
+  entry = dns_cache_lookup(name);
+  if (entry != NULL) {
+    if (entry->negative) {
+      LWIP_DEBUGF(DNS_DEBUG, ("dns_lookup: \"%s\": does not exist\n", name));
+      return ERR_VAL;
     }
+    LWIP_DEBUGF(DNS_DEBUG, ("dns_lookup: \"%s\": found = ", name));
+    ip_addr_debug_print(DNS_DEBUG, &entry->ipaddr);
+    LWIP_DEBUGF(DNS_DEBUG, ("\n"));
+    ip_addr_copy(*addr, entry->ipaddr);
+    return ERR_OK;
   }
+#else  /* DNS_CACHE_SIZE */
+  LWIP_UNUSED_ARG(name);
+  LWIP_UNUSED_ARG(addr);
+#endif /* DNS_CACHE_SIZE */
 
-  return IPADDR_NONE;
+  return ERR_ARG;
 }
 
 #if DNS_DOES_NAME_CHECK
@@ -774,6 +1039,22 @@ static void dns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
             (nquestions != 1)) {
           LWIP_DEBUGF(DNS_DEBUG,
                       ("dns_recv: \"%s\": error in flags\n", pEntry->name));
+#if DNS_CACHE_SIZE && DNS_CACHE_NEG_TTL
+          /* NXDOMAIN for the name we asked about: remember it and fail now
+             instead of waiting for the retries to run out. */
+          if ((hdr->flags1 & DNS_FLAG1_RESPONSE) &&
+              (pEntry->err == DNS_FLAG2_ERR_NAME) &&
+              (nquestions == 1)
+#if DNS_DOES_NAME_CHECK
+              && (dns_compare_name((unsigned char *) (pEntry->name),
+                                   (unsigned char *) dns_payload +
+                                       SIZEOF_DNS_HDR) == 0)
+#endif /* DNS_DOES_NAME_CHECK */
+                  ) {
+            dns_cache_add(pEntry->name, NULL, DNS_CACHE_NEG_TTL);
+            goto responseerr;
+          }
+#endif /* DNS_CACHE_SIZE && DNS_CACHE_NEG_TTL */
           /* call callback to indicate error, clean up memory and return */
           // goto responseerr;
           goto memerr;
@@ -823,10 +1104,20 @@ static void dns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
                         ("dns_recv: \"%s\": response = ", pEntry->name));
             ip_addr_debug_print(DNS_DEBUG, (&(pEntry->ipaddr)));
             LWIP_DEBUGF(DNS_DEBUG, ("\n"));
+#if DNS_CACHE_SIZE
+            /* cache first, the callback may look the name up again */
+            if (pEntry->ttl != 0) {
+              dns_cache_add(pEntry->name, &pEntry->ipaddr, pEntry->ttl);
+            }
+#endif /* DNS_CACHE_SIZE */
             /* call specified callback function if provided */
             if (pEntry->found) {
               (*pEntry->found)(pEntry->name, &pEntry->ipaddr, pEntry->arg);
             }
+#if DNS_CACHE_SIZE
+            /* the answer lives in the cache, free the query slot */
+            goto flushentry;
+#endif /* DNS_CACHE_SIZE */
             if (pEntry->ttl == 0) {
               /* RFC 883, page 29: "Zero values are
                  interpreted to mean that the RR can only be used for the
@@ -946,6 +1237,7 @@ static err_t dns_enqueue(const char *name, dns_found_callback found,
  *   name is already in the local names table.
  * - ERR_INPROGRESS enqueue a request to be sent to the DNS server
  *   for resolution if no errors are present.
+ * - ERR_VAL if the hostname is cached as not existing (DNS_CACHE_NEG_TTL)
  * - ERR_ARG: dns client not initialized or invalid hostname
  *
  * @param hostname the hostname that is to be queried
@@ -961,6 +1253,7 @@ static err_t dns_enqueue(const char *name, dns_found_callback found,
 err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr,
                         dns_found_callback found, void *callback_arg) {
   u32_t ipaddr;
+  err_t err;
   /* not initialized or no valid server yet, or invalid addr pointer
    * or invalid hostname or invalid hostname length */
   if ((dns_pcb == NULL) || (addr == NULL) || (!hostname) || (!hostname[0]) ||
@@ -977,16 +1270,17 @@ err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr,
 
   /* host name already in octet notation? set ip addr and return ERR_OK */
   ipaddr = ipaddr_addr(hostname);
-  if (ipaddr == IPADDR_NONE) {
-    /* already have this address cached? */
-    /* Changed by Espressif */
-    //    ipaddr = dns_lookup(hostname);
-  }
   if (ipaddr != IPADDR_NONE) {
     ip4_addr_set_u32(addr, ipaddr);
     return ERR_OK;
   }
 
+  /* already have this address cached? */
+  err = dns_lookup(hostname, addr);
+  if (err != ERR_ARG) {
+    return err;
+  }
+
   /* queue query with specified callback */
   return dns_enqueue(hostname, found, callback_arg);
 }
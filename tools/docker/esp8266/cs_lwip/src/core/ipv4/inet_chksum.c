@@ -49,6 +49,10 @@
 #include <stddef.h>
 #include <string.h>
 
+#if (LWIP_CHKSUM_ALGORITHM == 4) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /* These are some reference implementations of the checksum algorithm, with the
  * aim of being simple, correct and fully portable. Checksumming is the
  * first thing you would want to optimize for your platform. If you create
@@ -57,7 +61,7 @@
  * #define LWIP_CHKSUM <your_checksum_routine>
  *
  * Or you can select from the implementations below by defining
- * LWIP_CHKSUM_ALGORITHM to 1, 2 or 3.
+ * LWIP_CHKSUM_ALGORITHM to 1, 2, 3 or 4.
  */
 
 #ifndef LWIP_CHKSUM
@@ -255,6 +259,110 @@ static u16_t lwip_standard_chksum(void *dataptr, int len) {
 }
 #endif
 
+#if (LWIP_CHKSUM_ALGORITHM == 4) || (LWIP_CHKSUM_COPY_ALGORITHM == 2)
+/* Add both 16-bit halves of a 32-bit word. C has no access to the carry
+ * flag and lx106 has no set-on-compare, so this beats adding whole words
+ * and counting carries; Cortex-M does it in two instructions (uxtah, add). */
+#define CHKSUM_ADD_HALVES(sum, w) (sum) += ((w) >> 16) + ((w) &0x0000ffffUL)
+#endif
+
+#if (LWIP_CHKSUM_ALGORITHM == 4) /* Alternative version #4 */
+/**
+ * Checksum a 32-bit word at a time, for cores with fast aligned word loads
+ * (lx106, Cortex-M). Head bytes are summed until the pointer is word aligned,
+ * then the inner loop takes 16 bytes per iteration. On x86 with SSE2 (host
+ * builds) the inner loop is a single vector load and add per 16 bytes.
+ *
+ * @arg start of buffer to be checksummed. May be an odd byte address.
+ * @len number of bytes in the buffer to be checksummed, up to 0xffff.
+ * @return host order (!) lwip checksum (non-inverted Internet sum)
+ */
+
+static u16_t lwip_standard_chksum(void *dataptr, int len) {
+  u8_t *pb = (u8_t *) dataptr;
+  u32_t *pl;
+  u32_t sum = 0, w;
+  u16_t t = 0;
+  /* starts at odd byte address? */
+  int odd = ((mem_ptr_t) pb & 1);
+
+  if (odd && len > 0) {
+    ((u8_t *) &t)[1] = *pb++;
+    len--;
+  }
+
+  if (((mem_ptr_t) pb & 2) && len > 1) {
+    sum += *(u16_t *) pb;
+    pb += 2;
+    len -= 2;
+  }
+
+  pl = (u32_t *) pb;
+
+#ifdef __SSE2__
+  if (len > 15) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero, v;
+    u32_t lanes[4];
+    do {
+      v = _mm_loadu_si128((const __m128i *) pl);
+      acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+      acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+      pl += 4;
+      len -= 16;
+    } while (len > 15);
+    _mm_storeu_si128((__m128i *) lanes, acc);
+    sum += FOLD_U32T(lanes[0]) + FOLD_U32T(lanes[1]) + FOLD_U32T(lanes[2]) +
+           FOLD_U32T(lanes[3]);
+  }
+#else
+  while (len > 15) {
+    w = pl[0];
+    CHKSUM_ADD_HALVES(sum, w);
+    w = pl[1];
+    CHKSUM_ADD_HALVES(sum, w);
+    w = pl[2];
+    CHKSUM_ADD_HALVES(sum, w);
+    w = pl[3];
+    CHKSUM_ADD_HALVES(sum, w);
+    pl += 4;
+    len -= 16;
+  }
+#endif
+
+  while (len > 3) {
+    w = *pl++;
+    CHKSUM_ADD_HALVES(sum, w);
+    len -= 4;
+  }
+
+  pb = (u8_t *) pl;
+
+  /* 16-bit aligned word remaining? */
+  if (len > 1) {
+    sum += *(u16_t *) pb;
+    pb += 2;
+    len -= 2;
+  }
+
+  /* dangling tail byte remaining? */
+  if (len > 0) {
+    ((u8_t *) &t)[0] = *pb;
+  }
+
+  sum += t; /* add end bytes */
+
+  sum = FOLD_U32T(sum);
+  sum = FOLD_U32T(sum);
+
+  if (odd) {
+    sum = SWAP_BYTES_IN_WORD(sum);
+  }
+
+  return (u16_t) sum;
+}
+#endif
+
 /* inet_chksum_pseudo:
  *
  * Calculates the pseudo Internet checksum used by TCP and UDP for a pbuf chain.
@@ -453,3 +561,97 @@ u16_t lwip_chksum_copy(void *dst, const void *src, u16_t len) {
   return LWIP_CHKSUM(dst, len);
 }
 #endif /* (LWIP_CHKSUM_COPY_ALGORITHM == 1) */
+
+#if (LWIP_CHKSUM_COPY_ALGORITHM == 2) /* Version #2 */
+/** Copy and checksum in one pass: each word is added to the sum while it is
+ * in a register on its way to dst, so the data is read only once.
+ * Word-at-a-time when src and dst are at the same offset from a word
+ * boundary, halfword-at-a-time when at the same offset from a halfword
+ * boundary. Otherwise falls back to MEMCPY followed by LWIP_CHKSUM.
+ */
+u16_t lwip_chksum_copy(void *dst, const void *src, u16_t len) {
+  const u8_t *sb = (const u8_t *) src;
+  u8_t *db = (u8_t *) dst;
+  u32_t sum = 0, w;
+  u16_t t = 0, h;
+  int n = len;
+  /* starts at odd byte address? */
+  int odd = ((mem_ptr_t) sb & 1);
+
+  if (((mem_ptr_t) sb ^ (mem_ptr_t) db) & 1) {
+    MEMCPY(dst, src, len);
+    return LWIP_CHKSUM(dst, len);
+  }
+
+  if (odd && n > 0) {
+    ((u8_t *) &t)[1] = *db++ = *sb++;
+    n--;
+  }
+
+  if ((((mem_ptr_t) sb ^ (mem_ptr_t) db) & 2) == 0) {
+    const u32_t *sl;
+    u32_t *dl;
+
+    if (((mem_ptr_t) sb & 2) && n > 1) {
+      h = *(const u16_t *) sb;
+      *(u16_t *) db = h;
+      sum += h;
+      sb += 2;
+      db += 2;
+      n -= 2;
+    }
+
+    sl = (const u32_t *) sb;
+    dl = (u32_t *) db;
+    while (n > 15) {
+      w = sl[0];
+      dl[0] = w;
+      CHKSUM_ADD_HALVES(sum, w);
+      w = sl[1];
+      dl[1] = w;
+      CHKSUM_ADD_HALVES(sum, w);
+      w = sl[2];
+      dl[2] = w;
+      CHKSUM_ADD_HALVES(sum, w);
+      w = sl[3];
+      dl[3] = w;
+      CHKSUM_ADD_HALVES(sum, w);
+      sl += 4;
+      dl += 4;
+      n -= 16;
+    }
+    while (n > 3) {
+      w = *sl++;
+      *dl++ = w;
+      CHKSUM_ADD_HALVES(sum, w);
+      n -= 4;
+    }
+    sb = (const u8_t *) sl;
+    db = (u8_t *) dl;
+  }
+
+  while (n > 1) {
+    h = *(const u16_t *) sb;
+    *(u16_t *) db = h;
+    sum += h;
+    sb += 2;
+    db += 2;
+    n -= 2;
+  }
+
+  if (n > 0) {
+    ((u8_t *) &t)[0] = *db = *sb;
+  }
+
+  sum += t;
+
+  sum = FOLD_U32T(sum);
+  sum = FOLD_U32T(sum);
+
+  if (odd) {
+    sum = SWAP_BYTES_IN_WORD(sum);
+  }
+
+  return (u16_t) sum;
+}
+#endif /* (LWIP_CHKSUM_COPY_ALGORITHM == 2) */
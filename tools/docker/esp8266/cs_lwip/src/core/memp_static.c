@@ -0,0 +1,180 @@
+/**
+ * @file
+ * Fixed-size pools for the hot memp types on top of MEMP_MEM_MALLOC
+ *
+ * With MEMP_MEM_MALLOC every pcb, segment and pbuf header comes from the
+ * heap, interleaved with long-lived application allocations, which
+ * fragments the heap over time. With MEMP_STATIC_POOLS the types that are
+ * allocated and freed all the time are taken from dedicated pools in .bss
+ * instead. A pool that runs out overflows to the heap, so sizing the pools
+ * is a tradeoff and not a hard limit. lwip_stats.memp[] tracks pool usage
+ * and overflows if MEMP_STATS is enabled.
+ */
+
+#include "lwip/opt.h"
+
+#if MEMP_MEM_MALLOC && MEMP_STATIC_POOLS
+
+#include "lwip/memp.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+#include "lwip/tcp_impl.h"
+#include "lwip/api.h"
+#include "lwip/sys.h"
+#include "lwip/stats.h"
+
+#include <string.h>
+
+/*
+ * Without SYS_LIGHTWEIGHT_PROT, SYS_ARCH_PROTECT() of this port assigns to a
+ * variable that SYS_ARCH_DECL_PROTECT() does not declare. lwIP runs in one
+ * context then (NO_SYS), so the free lists need no protection.
+ */
+#if SYS_LIGHTWEIGHT_PROT
+#define MEMP_STATIC_DECL_PROTECT(lev) SYS_ARCH_DECL_PROTECT(lev)
+#define MEMP_STATIC_PROTECT(lev) SYS_ARCH_PROTECT(lev)
+#define MEMP_STATIC_UNPROTECT(lev) SYS_ARCH_UNPROTECT(lev)
+#else
+#define MEMP_STATIC_DECL_PROTECT(lev)
+#define MEMP_STATIC_PROTECT(lev)
+#define MEMP_STATIC_UNPROTECT(lev)
+#endif
+
+struct memp_static_elem {
+  struct memp_static_elem *next;
+};
+
+struct memp_static_pool {
+  u8_t *base;
+  u8_t *end;
+  struct memp_static_elem *free;
+};
+
+static struct memp_static_pool memp_static_pools[MEMP_MAX];
+
+/* Element size must also fit the free list link. */
+#define MEMP_STATIC_ELEM_SIZE(size)                         \
+  LWIP_MEM_ALIGN_SIZE((size) > sizeof(struct memp_static_elem) \
+                          ? (size)                             \
+                          : sizeof(struct memp_static_elem))
+
+#define MEMP_STATIC_POOL(name, num, size)            \
+  static u32_t memp_static_##name##_base           \
+      [((num) * MEMP_STATIC_ELEM_SIZE(size) + 3) / 4]
+
+#if MEMP_STATIC_NUM_PBUF > 0
+MEMP_STATIC_POOL(PBUF, MEMP_STATIC_NUM_PBUF, sizeof(struct pbuf));
+#endif
+#if LWIP_TCP && MEMP_STATIC_NUM_TCP_SEG > 0
+MEMP_STATIC_POOL(TCP_SEG, MEMP_STATIC_NUM_TCP_SEG, sizeof(struct tcp_seg));
+#endif
+#if LWIP_TCP && MEMP_STATIC_NUM_TCP_PCB > 0
+MEMP_STATIC_POOL(TCP_PCB, MEMP_STATIC_NUM_TCP_PCB, sizeof(struct tcp_pcb));
+#endif
+#if LWIP_UDP && MEMP_STATIC_NUM_UDP_PCB > 0
+MEMP_STATIC_POOL(UDP_PCB, MEMP_STATIC_NUM_UDP_PCB, sizeof(struct udp_pcb));
+#endif
+#if LWIP_NETCONN && MEMP_STATIC_NUM_NETBUF > 0
+MEMP_STATIC_POOL(NETBUF, MEMP_STATIC_NUM_NETBUF, sizeof(struct netbuf));
+#endif
+
+#if MEMP_STATIC_NUM_PBUF > 0 || (LWIP_TCP && MEMP_STATIC_NUM_TCP_SEG > 0) || \
+    (LWIP_TCP && MEMP_STATIC_NUM_TCP_PCB > 0) ||                           \
+    (LWIP_UDP && MEMP_STATIC_NUM_UDP_PCB > 0) ||                           \
+    (LWIP_NETCONN && MEMP_STATIC_NUM_NETBUF > 0)
+static void memp_static_pool_init(memp_t type, void *base, u16_t num,
+                                  u16_t size) {
+  struct memp_static_pool *pool = &memp_static_pools[type];
+  u16_t i;
+  LWIP_ASSERT("memp_static: pool element too small",
+              size >= memp_sizes[type]);
+  pool->base = (u8_t *) base;
+  pool->end = pool->base + num * size;
+  pool->free = NULL;
+  /* Link in reverse, so elements are handed out in address order. */
+  for (i = num; i > 0; i--) {
+    struct memp_static_elem *e =
+        (struct memp_static_elem *) (pool->base + (i - 1) * size);
+    e->next = pool->free;
+    pool->free = e;
+  }
+  MEMP_STATS_AVAIL(avail, type, num);
+}
+#endif
+
+#define MEMP_STATIC_POOL_INIT(name, num, size)                            \
+  memp_static_pool_init(MEMP_##name, memp_static_##name##_base, (num), \
+                        MEMP_STATIC_ELEM_SIZE(size))
+
+void memp_static_init(void) {
+  memset(memp_static_pools, 0, sizeof(memp_static_pools));
+#if MEMP_STATIC_NUM_PBUF > 0
+  MEMP_STATIC_POOL_INIT(PBUF, MEMP_STATIC_NUM_PBUF, sizeof(struct pbuf));
+#endif
+#if LWIP_TCP && MEMP_STATIC_NUM_TCP_SEG > 0
+  MEMP_STATIC_POOL_INIT(TCP_SEG, MEMP_STATIC_NUM_TCP_SEG,
+                        sizeof(struct tcp_seg));
+#endif
+#if LWIP_TCP && MEMP_STATIC_NUM_TCP_PCB > 0
+  MEMP_STATIC_POOL_INIT(TCP_PCB, MEMP_STATIC_NUM_TCP_PCB,
+                        sizeof(struct tcp_pcb));
+#endif
+#if LWIP_UDP && MEMP_STATIC_NUM_UDP_PCB > 0
+  MEMP_STATIC_POOL_INIT(UDP_PCB, MEMP_STATIC_NUM_UDP_PCB,
+                        sizeof(struct udp_pcb));
+#endif
+#if LWIP_NETCONN && MEMP_STATIC_NUM_NETBUF > 0
+  MEMP_STATIC_POOL_INIT(NETBUF, MEMP_STATIC_NUM_NETBUF,
+                        sizeof(struct netbuf));
+#endif
+}
+
+void *memp_static_malloc(memp_t type) {
+  struct memp_static_pool *pool;
+  void *mem;
+  MEMP_STATIC_DECL_PROTECT(old_level);
+
+  LWIP_ERROR("memp_static_malloc: type < MEMP_MAX", (type < MEMP_MAX),
+             return NULL;);
+  pool = &memp_static_pools[type];
+
+  MEMP_STATIC_PROTECT(old_level);
+  mem = pool->free;
+  if (mem != NULL) {
+    pool->free = pool->free->next;
+    MEMP_STATS_INC_USED(used, type);
+  }
+  MEMP_STATIC_UNPROTECT(old_level);
+
+  if (mem == NULL) {
+    mem = mem_malloc(memp_sizes[type]);
+    if (mem == NULL) {
+      MEMP_STATS_INC(err, type);
+    } else if (pool->base != NULL) {
+      MEMP_STATS_INC(overflow, type);
+    }
+  }
+  return mem;
+}
+
+void memp_static_free(memp_t type, void *mem) {
+  struct memp_static_pool *pool;
+  MEMP_STATIC_DECL_PROTECT(old_level);
+
+  if (mem == NULL) return;
+  LWIP_ERROR("memp_static_free: type < MEMP_MAX", (type < MEMP_MAX), return;);
+  pool = &memp_static_pools[type];
+
+  if ((u8_t *) mem >= pool->base && (u8_t *) mem < pool->end) {
+    struct memp_static_elem *e = (struct memp_static_elem *) mem;
+    MEMP_STATIC_PROTECT(old_level);
+    e->next = pool->free;
+    pool->free = e;
+    MEMP_STATS_DEC(used, type);
+    MEMP_STATIC_UNPROTECT(old_level);
+  } else {
+    mem_free(mem);
+  }
+}
+
+#endif /* MEMP_MEM_MALLOC && MEMP_STATIC_POOLS */
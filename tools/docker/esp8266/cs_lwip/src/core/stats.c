@@ -57,7 +57,7 @@ void stats_init(void) {
 #ifdef LWIP_DEBUG
 #if MEMP_STATS
   const char *memp_names[] = {
-#define LWIP_MEMPOOL(name, num, size, desc) desc,
+#define LWIP_MEMPOOL(name, num, size, desc, ...) desc,
 #include "lwip/memp_std.h"
   };
   int i;
@@ -115,12 +115,15 @@ void stats_display_mem(struct stats_mem *mem, const char *name) {
   LWIP_PLATFORM_DIAG(("used: %" U32_F "\n\t", (u32_t) mem->used));
   LWIP_PLATFORM_DIAG(("max: %" U32_F "\n\t", (u32_t) mem->max));
   LWIP_PLATFORM_DIAG(("err: %" U32_F "\n", (u32_t) mem->err));
+#if MEMP_STATIC_POOLS
+  LWIP_PLATFORM_DIAG(("\toverflow: %" U32_F "\n", (u32_t) mem->overflow));
+#endif
 }
 
 #if MEMP_STATS
 void stats_display_memp(struct stats_mem *mem, int index) {
   char *memp_names[] = {
-#define LWIP_MEMPOOL(name, num, size, desc) desc,
+#define LWIP_MEMPOOL(name, num, size, desc, ...) desc,
 #include "lwip/memp_std.h"
   };
   if (index < MEMP_MAX) {
@@ -95,9 +95,19 @@ extern const u32_t memp_sizes[MEMP_MAX];
 
 #include "mem.h"
 
+#if MEMP_STATIC_POOLS
+/* Hot types from fixed pools, the rest and overflow from the heap. */
+void memp_static_init(void);
+void *memp_static_malloc(memp_t type);
+void memp_static_free(memp_t type, void *mem);
+#define memp_init() memp_static_init()
+#define memp_malloc(type) memp_static_malloc(type)
+#define memp_free(type, mem) memp_static_free((type), (mem))
+#else
 #define memp_init()
 #define memp_malloc(type) mem_malloc(memp_sizes[type])
 #define memp_free(type, mem) mem_free(mem)
+#endif /* MEMP_STATIC_POOLS */
 
 #else /* MEMP_MEM_MALLOC */
 
@@ -101,6 +101,10 @@ struct stats_mem {
   mem_size_t max;
   STAT_COUNTER err;
   STAT_COUNTER illegal;
+#if MEMP_STATIC_POOLS
+  /* Allocations served from the heap because the pool was empty. */
+  STAT_COUNTER overflow;
+#endif
 };
 
 struct stats_syselem {
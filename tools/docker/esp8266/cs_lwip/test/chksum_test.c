@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Internet checksum conformance test and benchmark, runs on the host.
+ *
+ * src/core/ipv4/inet_chksum.c is built three times: as configured in
+ * lwipopts.h (algorithm 4, fused copy), the same without SSE2 (the word loop
+ * that runs on the device) and with the stock algorithm 2 and MEMCPY +
+ * checksum copy (ref_ prefix). All of them are checked against a byte-wise
+ * RFC 1071 sum over random data at every source and destination alignment.
+ * With "bench" as the argument also prints throughput of each.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef uint16_t (*chksum_fn)(void *dataptr, uint16_t len);
+typedef uint16_t (*chksum_copy_fn)(void *dst, const void *src, uint16_t len);
+
+uint16_t inet_chksum(void *dataptr, uint16_t len);
+uint16_t lwip_chksum_copy(void *dst, const void *src, uint16_t len);
+uint16_t word_inet_chksum(void *dataptr, uint16_t len);
+uint16_t word_lwip_chksum_copy(void *dst, const void *src, uint16_t len);
+uint16_t ref_inet_chksum(void *dataptr, uint16_t len);
+uint16_t ref_lwip_chksum_copy(void *dst, const void *src, uint16_t len);
+
+static const struct impl {
+  const char *name;
+  chksum_fn chksum;
+  chksum_copy_fn copy;
+} s_impls[] = {
+    {"alg 4", inet_chksum, lwip_chksum_copy},
+    {"alg 4 (no SSE2)", word_inet_chksum, word_lwip_chksum_copy},
+    {"alg 2", ref_inet_chksum, ref_lwip_chksum_copy},
+};
+#define NUM_IMPLS (sizeof(s_impls) / sizeof(s_impls[0]))
+
+#define MAX_LEN 0xffff
+#define GUARD 8
+
+static uint8_t s_src[MAX_LEN + 2 * GUARD];
+static uint8_t s_dst[MAX_LEN + 2 * GUARD];
+static int s_failures;
+
+/* Byte-wise sum of 16-bit words in network order, RFC 1071. Returns the
+ * non-inverted sum in host order, like lwip_chksum_copy(). */
+static uint16_t ref_sum(const uint8_t *p, int len) {
+  uint32_t acc = 0;
+  for (; len > 1; p += 2, len -= 2) acc += (p[0] << 8) | p[1];
+  if (len > 0) acc += p[0] << 8;
+  while (acc >> 16) acc = (acc >> 16) + (acc & 0xffff);
+  return htons((uint16_t) acc);
+}
+
+static void fill(uint8_t *p, int len, int pattern) {
+  int i;
+  for (i = 0; i < len; i++) {
+    p[i] = (pattern < 0 ? (uint8_t) rand() : (uint8_t) pattern);
+  }
+}
+
+static void check(const struct impl *im, int soff, int doff, int len) {
+  uint8_t *src = s_src + GUARD + soff, *dst = s_dst + GUARD + doff;
+  uint16_t want = ref_sum(src, len), got;
+  int i;
+
+  got = im->chksum(src, len);
+  if (got != (uint16_t) ~want) {
+    printf("%s: inet_chksum soff %d len %d: %04x, want %04x\n", im->name,
+           soff, len, got, (uint16_t) ~want);
+    s_failures++;
+  }
+
+  memset(s_dst, 0xa5, sizeof(s_dst));
+  got = im->copy(dst, src, len);
+  if (got != want) {
+    printf("%s: chksum_copy soff %d doff %d len %d: %04x, want %04x\n",
+           im->name, soff, doff, len, got, want);
+    s_failures++;
+  }
+  if (memcmp(dst, src, len) != 0) {
+    printf("%s: chksum_copy soff %d doff %d len %d: bad copy\n", im->name,
+           soff, doff, len);
+    s_failures++;
+  }
+  for (i = 0; i < GUARD; i++) {
+    if (dst[-1 - i] != 0xa5 || dst[len + i] != 0xa5) {
+      printf("%s: chksum_copy soff %d doff %d len %d: wrote outside dst\n",
+             im->name, soff, doff, len);
+      s_failures++;
+      break;
+    }
+  }
+}
+
+static void conformance(void) {
+  static const int patterns[] = {-1, 0x00, 0xff};
+  unsigned int k;
+  int p, soff, doff, len, n = 0;
+
+  for (k = 0; k < NUM_IMPLS; k++) {
+    for (p = 0; p < (int) (sizeof(patterns) / sizeof(patterns[0])); p++) {
+      srand(1);
+      fill(s_src, sizeof(s_src), patterns[p]);
+      for (soff = 0; soff < GUARD; soff++) {
+        for (doff = 0; doff < GUARD; doff++) {
+          for (len = 0; len < 80; len++, n++) check(&s_impls[k], soff, doff, len);
+          for (len = 0; len < 200; len++, n++) {
+            check(&s_impls[k], soff, doff, 80 + rand() % 1500);
+          }
+        }
+        check(&s_impls[k], soff, 0, MAX_LEN);
+        check(&s_impls[k], soff, 1, MAX_LEN - 1);
+        n += 2;
+      }
+    }
+  }
+  printf("%d checks, %d failures\n", n, s_failures);
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static volatile uint16_t s_sink;
+
+static double mbps(uint64_t bytes, uint64_t ns) {
+  return (double) bytes * 1000.0 / ns;
+}
+
+static void bench(void) {
+  static const int sizes[] = {64, 536, 1460};
+  static const struct {
+    int soff, doff;
+  } offs[] = {{0, 0}, {1, 1}, {0, 2}, {0, 1}};
+  unsigned int k, s, o;
+  int i, iters;
+  uint64_t t, bytes;
+
+  srand(2);
+  fill(s_src, sizeof(s_src), -1);
+  printf("%-16s %5s %9s %12s %12s\n", "", "len", "soff/doff", "chksum MB/s",
+         "copy MB/s");
+  for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    iters = 200000000 / sizes[s];
+    bytes = (uint64_t) iters * sizes[s];
+    for (o = 0; o < sizeof(offs) / sizeof(offs[0]); o++) {
+      uint8_t *src = s_src + GUARD + offs[o].soff;
+      uint8_t *dst = s_dst + GUARD + offs[o].doff;
+      for (k = 0; k < NUM_IMPLS; k++) {
+        double c, cp;
+        t = now_ns();
+        for (i = 0; i < iters; i++) s_sink += s_impls[k].chksum(src, sizes[s]);
+        c = mbps(bytes, now_ns() - t);
+        t = now_ns();
+        for (i = 0; i < iters; i++) {
+          s_sink += s_impls[k].copy(dst, src, sizes[s]);
+        }
+        cp = mbps(bytes, now_ns() - t);
+        printf("%-16s %5d %4d/%-4d %12.0f %12.0f\n", s_impls[k].name, sizes[s],
+               offs[o].soff, offs[o].doff, c, cp);
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  conformance();
+  if (s_failures == 0 && argc > 1 && strcmp(argv[1], "bench") == 0) bench();
+  return s_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * DNS cache test, runs on the host.
+ *
+ * Builds src/core/dns.c against fake UDP and pbuf functions: queries sent by
+ * the resolver are captured and answered by the test, which checks cache
+ * hits, TTL expiry, LRU eviction, negative caching and, across two runs of
+ * the binary ("boot" for the second), DNS_CACHE_PERSIST.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+#include "lwip/dns.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+#include "user_interface.h"
+
+#define IMAGE_FILE "dns_cache_test.img"
+
+const ip_addr_t ip_addr_any = {IPADDR_ANY};
+
+static struct udp_pcb s_pcb;
+static udp_recv_fn s_recv;
+static u8_t s_query[512];
+static int s_query_len, s_num_queries;
+
+static const char *s_found_name;
+static ip_addr_t s_found_addr;
+static int s_found, s_found_null;
+static int s_failures;
+
+#define CHECK(cond)                                           \
+  do {                                                        \
+    if (!(cond)) {                                            \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+             #cond);                                          \
+      s_failures++;                                           \
+    }                                                         \
+  } while (0)
+
+/* Platform and stack functions used by dns.c */
+
+void *pvPortMalloc(size_t size) {
+  return malloc(size);
+}
+
+void *pvPortZalloc(size_t size) {
+  return calloc(1, size);
+}
+
+void vPortFree(void *ptr) {
+  free(ptr);
+}
+
+unsigned long os_random(void) {
+  return 0;
+}
+
+u32_t ipaddr_addr(const char *cp) {
+  unsigned int a, b, c, d;
+  char end;
+  if (sscanf(cp, "%u.%u.%u.%u%c", &a, &b, &c, &d, &end) != 4) {
+    return IPADDR_NONE;
+  }
+  return htonl((a << 24) | (b << 16) | (c << 8) | d);
+}
+
+struct udp_pcb *udp_new(void) {
+  return &s_pcb;
+}
+
+err_t udp_bind(struct udp_pcb *pcb, ip_addr_t *ipaddr, u16_t port) {
+  return ERR_OK;
+}
+
+err_t udp_connect(struct udp_pcb *pcb, ip_addr_t *ipaddr, u16_t port) {
+  return ERR_OK;
+}
+
+void udp_recv(struct udp_pcb *pcb, udp_recv_fn recv, void *recv_arg) {
+  s_recv = recv;
+}
+
+err_t udp_sendto(struct udp_pcb *pcb, struct pbuf *p, ip_addr_t *dst_ip,
+                 u16_t dst_port) {
+  s_query_len = p->len;
+  memcpy(s_query, p->payload, p->len);
+  s_num_queries++;
+  return ERR_OK;
+}
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type) {
+  struct pbuf *p = (struct pbuf *) calloc(1, sizeof(*p) + length);
+  p->payload = p + 1;
+  p->len = p->tot_len = length;
+  p->ref = 1;
+  return p;
+}
+
+void pbuf_realloc(struct pbuf *p, u16_t size) {
+  p->len = p->tot_len = size;
+}
+
+u8_t pbuf_free(struct pbuf *p) {
+  free(p);
+  return 1;
+}
+
+u16_t pbuf_copy_partial(struct pbuf *p, void *dataptr, u16_t len,
+                        u16_t offset) {
+  memcpy(dataptr, (u8_t *) p->payload + offset, len);
+  return len;
+}
+
+/* RTC user memory is kept in a file, to survive until the "boot" run */
+int system_rtc_mem_read(uint8_t src_addr, void *buf, uint16_t len) {
+  FILE *fp = fopen(IMAGE_FILE, "rb");
+  int n = 0;
+  if (fp != NULL) {
+    n = fread(buf, 1, len, fp);
+    fclose(fp);
+  }
+  return n == len;
+}
+
+int system_rtc_mem_write(uint8_t des_addr, const void *buf, uint16_t len) {
+  FILE *fp = fopen(IMAGE_FILE, "wb");
+  if (fp == NULL) return 0;
+  fwrite(buf, 1, len, fp);
+  fclose(fp);
+  return 1;
+}
+
+/* Test helpers */
+
+static void found_cb(const char *name, ip_addr_t *ipaddr, void *arg) {
+  s_found_name = name;
+  s_found++;
+  if (ipaddr != NULL) {
+    s_found_addr = *ipaddr;
+  } else {
+    s_found_null++;
+  }
+}
+
+/* Answers the last query: an A record with addr and ttl, or rcode != 0 */
+static void answer(u32_t addr, u32_t ttl, int rcode) {
+  static const u8_t rr[] = {0xc0, 0x0c, 0, 1, 0, 1};
+  u8_t buf[512], *p = buf + s_query_len;
+  struct pbuf *pb;
+
+  memcpy(buf, s_query, s_query_len);
+  buf[2] = 0x81; /* response, recursion desired */
+  buf[3] = 0x80 | rcode;
+  buf[7] = (rcode == 0 ? 1 : 0); /* numanswers */
+  if (rcode == 0) {
+    memcpy(p, rr, sizeof(rr));
+    p += sizeof(rr);
+    *p++ = ttl >> 24;
+    *p++ = ttl >> 16;
+    *p++ = ttl >> 8;
+    *p++ = ttl;
+    *p++ = 0;
+    *p++ = 4;
+    memcpy(p, &addr, 4);
+    p += 4;
+  }
+  pb = pbuf_alloc(PBUF_TRANSPORT, p - buf, PBUF_RAM);
+  memcpy(pb->payload, buf, p - buf);
+  s_recv(NULL, &s_pcb, pb, NULL, 53);
+}
+
+/* Resolves name, answering with addr and ttl if a query goes out */
+static err_t resolve(const char *name, u32_t addr, u32_t ttl,
+                     ip_addr_t *result) {
+  int queries = s_num_queries;
+  err_t err = dns_gethostbyname(name, result, found_cb, NULL);
+  if (err == ERR_INPROGRESS) {
+    CHECK(s_num_queries == queries + 1);
+    s_found = 0;
+    answer(addr, ttl, 0);
+    CHECK(s_found == 1);
+    CHECK(s_found_addr.addr == addr);
+    *result = s_found_addr;
+  }
+  return err;
+}
+
+static void ticks(int n) {
+  while (n-- > 0) dns_tmr();
+}
+
+static void test_hit_and_expiry(void) {
+  ip_addr_t a;
+  CHECK(resolve("a.example.com", 0x01020304, 5, &a) == ERR_INPROGRESS);
+  CHECK(resolve("a.example.com", 0, 5, &a) == ERR_OK);
+  CHECK(a.addr == 0x01020304);
+  ticks(4);
+  CHECK(resolve("a.example.com", 0, 5, &a) == ERR_OK);
+  ticks(1);
+  CHECK(resolve("a.example.com", 0x05060708, 60, &a) == ERR_INPROGRESS);
+  CHECK(resolve("a.example.com", 0, 5, &a) == ERR_OK);
+  CHECK(a.addr == 0x05060708);
+}
+
+static void test_ttl_zero_not_cached(void) {
+  ip_addr_t a;
+  CHECK(resolve("zero.example.com", 0x0a000001, 0, &a) == ERR_INPROGRESS);
+  CHECK(resolve("zero.example.com", 0x0a000001, 0, &a) == ERR_INPROGRESS);
+}
+
+static void test_negative(void) {
+  ip_addr_t a;
+  int queries = s_num_queries;
+  CHECK(dns_gethostbyname("nx.example.com", &a, found_cb, NULL) ==
+        ERR_INPROGRESS);
+  s_found = s_found_null = 0;
+  answer(0, 0, 3 /* NXDOMAIN */);
+  CHECK(s_found == 1 && s_found_null == 1);
+  CHECK(dns_gethostbyname("nx.example.com", &a, found_cb, NULL) == ERR_VAL);
+  CHECK(s_num_queries == queries + 1);
+  ticks(DNS_CACHE_NEG_TTL);
+  CHECK(dns_gethostbyname("nx.example.com", &a, found_cb, NULL) ==
+        ERR_INPROGRESS);
+  answer(0x0b000001, 60, 0);
+}
+
+static void test_lru(void) {
+  char name[32];
+  ip_addr_t a;
+  int i;
+  /* fill the cache, keep using host0 */
+  for (i = 0; i < DNS_CACHE_SIZE; i++) {
+    snprintf(name, sizeof(name), "host%d.example.com", i);
+    CHECK(resolve(name, 0x0c000000 + i, 600, &a) != ERR_VAL);
+    CHECK(resolve("host0.example.com", 0x0c000000, 600, &a) != ERR_VAL);
+  }
+  for (i = 0; i < DNS_CACHE_SIZE; i++) {
+    snprintf(name, sizeof(name), "host%d.example.com", i);
+    CHECK(resolve(name, 0, 600, &a) == ERR_OK);
+    CHECK(a.addr == (u32_t)(0x0c000000 + i));
+  }
+  CHECK(resolve("host0.example.com", 0, 600, &a) == ERR_OK);
+  /* host1 is now the least recently used */
+  CHECK(resolve("new.example.com", 0x0d000001, 600, &a) == ERR_INPROGRESS);
+  CHECK(resolve("host1.example.com", 0x0c000001, 600, &a) == ERR_INPROGRESS);
+  CHECK(resolve("host0.example.com", 0, 600, &a) == ERR_OK);
+  CHECK(resolve("new.example.com", 0, 600, &a) == ERR_OK);
+}
+
+static void test_long_name(void) {
+  char name[DNS_CACHE_MAX_NAME_LENGTH + 16];
+  ip_addr_t a;
+  memset(name, 'x', sizeof(name) - 5);
+  strcpy(name + sizeof(name) - 5, ".com");
+  CHECK(resolve(name, 0x0e000001, 600, &a) == ERR_INPROGRESS);
+  CHECK(resolve(name, 0x0e000001, 600, &a) == ERR_INPROGRESS);
+}
+
+static void test_boot(void) {
+  ip_addr_t a;
+  /* saved by the previous run with TTL 600, restored with at most
+   * DNS_CACHE_RESTORE_TTL */
+  CHECK(resolve("host0.example.com", 0, 0, &a) == ERR_OK);
+  CHECK(a.addr == 0x0c000000);
+  CHECK(resolve("new.example.com", 0, 0, &a) == ERR_OK);
+  CHECK(a.addr == 0x0d000001);
+  CHECK(s_num_queries == 0);
+  ticks(DNS_CACHE_RESTORE_TTL);
+  CHECK(resolve("host0.example.com", 0x0c000000, 600, &a) == ERR_INPROGRESS);
+}
+
+int main(int argc, char **argv) {
+  ip_addr_t server;
+  int boot = (argc > 1 && strcmp(argv[1], "boot") == 0);
+
+  if (!boot) remove(IMAGE_FILE);
+  dns_init();
+  IP4_ADDR(&server, 8, 8, 8, 8);
+  dns_setserver(0, &server);
+
+  if (boot) {
+    test_boot();
+  } else {
+    test_hit_and_expiry();
+    test_ttl_zero_not_cached();
+    test_negative();
+    test_lru();
+    test_long_name();
+  }
+  printf("%s: %d failures\n", boot ? "boot" : "cache", s_failures);
+  return s_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
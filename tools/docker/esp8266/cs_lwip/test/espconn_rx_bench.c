@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * TCP RX delivery benchmark for espconn, runs on the host.
+ *
+ * Received segments arrive as pbuf chains allocated from the heap (umm_malloc,
+ * same as on the device). Compares delivering them to the app the old way,
+ * with a zalloc'd flat copy per chain, against handing over the chain
+ * (espconn_regist_recv_pbufcb). The app either checksums all the data or only
+ * looks at the first bytes (e.g. forwards it), and every now and then makes
+ * an allocation that outlives a few segments, like parser state or queued
+ * responses would. Prints throughput, per-segment delivery cost and the state
+ * of the heap afterwards.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "umm_malloc.h"
+#include "umm_malloc_internal.h"
+
+#define MSS 1460
+#define NUM_SEGMENTS 200000
+#define NUM_APP_SLOTS 32
+
+char test_umm_heap[UMM_MALLOC_CFG__HEAP_SIZE];
+
+void umm_corruption(void) {
+  fprintf(stderr, "heap corruption!\n");
+  abort();
+}
+
+/* The fields of lwIP's struct pbuf that matter here. */
+struct pbuf {
+  struct pbuf *next;
+  void *payload;
+  uint16_t tot_len;
+  uint16_t len;
+};
+
+static uint32_t s_csum;
+static int s_consume_all;
+static void *s_app_slots[NUM_APP_SLOTS];
+static unsigned long s_ooms;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void consume(const uint8_t *p, int len) {
+  int i;
+  if (!s_consume_all && len > 16) len = 16;
+  for (i = 0; i < len; i++) s_csum = s_csum * 31 + p[i];
+}
+
+static void app_alloc(void) {
+  int idx = rand() % NUM_APP_SLOTS;
+  umm_free(s_app_slots[idx]);
+  s_app_slots[idx] = umm_malloc(32 + rand() % 224);
+  if (s_app_slots[idx] == NULL) s_ooms++;
+}
+
+/* Mostly a single full segment, sometimes coalesced out-of-order ones. */
+static struct pbuf *rx_chain(void) {
+  struct pbuf *head = NULL, **pp = &head, *p;
+  int i, n = (rand() % 8 == 0 ? 2 + rand() % 2 : 1), tot = 0;
+  for (i = 0; i < n; i++) {
+    int len = (i == n - 1 ? 64 + rand() % (MSS - 63) : MSS);
+    p = (struct pbuf *) umm_malloc(sizeof(*p) + len);
+    if (p == NULL) {
+      s_ooms++;
+      break;
+    }
+    p->next = NULL;
+    p->payload = p + 1;
+    p->len = len;
+    memset(p->payload, i + len, len);
+    *pp = p;
+    pp = &p->next;
+    tot += len;
+  }
+  for (p = head; p != NULL; p = p->next) {
+    p->tot_len = tot;
+    tot -= p->len;
+  }
+  return head;
+}
+
+static void pbuf_free(struct pbuf *p) {
+  while (p != NULL) {
+    struct pbuf *next = p->next;
+    umm_free(p);
+    p = next;
+  }
+}
+
+static void deliver_copy(struct pbuf *p) {
+  char *pdata = (char *) umm_calloc(1, p->tot_len + 1);
+  struct pbuf *q;
+  int off = 0;
+  if (pdata == NULL) {
+    s_ooms++;
+  } else {
+    for (q = p; q != NULL; q = q->next) {
+      memcpy(pdata + off, q->payload, q->len);
+      off += q->len;
+    }
+  }
+  pbuf_free(p);
+  if (pdata != NULL) consume((uint8_t *) pdata, off);
+  umm_free(pdata);
+}
+
+static void deliver_pbuf(struct pbuf *p) {
+  struct pbuf *q;
+  for (q = p; q != NULL; q = q->next) consume(q->payload, q->len);
+  pbuf_free(p);
+}
+
+static void run(const char *name, void (*deliver)(struct pbuf *)) {
+  uint64_t bytes = 0, t, deliver_ns = 0, start;
+  int i;
+
+  umm_init();
+  srand(1);
+  memset(s_app_slots, 0, sizeof(s_app_slots));
+  s_ooms = 0;
+  start = now_ns();
+  for (i = 0; i < NUM_SEGMENTS; i++) {
+    struct pbuf *p = rx_chain();
+    if (p == NULL) continue;
+    bytes += p->tot_len;
+    t = now_ns();
+    deliver(p);
+    deliver_ns += now_ns() - t;
+    if (rand() % 4 == 0) app_alloc();
+  }
+  t = now_ns() - start;
+  umm_info(NULL, 0);
+  printf("%-4s %-6s %9.1f %9.1f %9.1f %7d %7u %7u %6lu\n",
+         (s_consume_all ? "all" : "head"), name, bytes / (t / 1e9) / 1e6,
+         bytes / (deliver_ns / 1e9) / 1e6,
+         (double) deliver_ns / NUM_SEGMENTS, umm_free_entries_cnt(),
+         (unsigned int) ummHeapInfo.freeBlocks * ummHeapInfo.blockSize,
+         (unsigned int) ummHeapInfo.maxFreeContiguousBlocks *
+             ummHeapInfo.blockSize,
+         s_ooms);
+  for (i = 0; i < NUM_APP_SLOTS; i++) umm_free(s_app_slots[i]);
+}
+
+int main(void) {
+  printf("%-4s %-6s %9s %9s %9s %7s %7s %7s %6s\n", "app", "mode", "MB/s",
+         "rx MB/s", "rx_ns", "nfree", "free", "maxfree", "ooms");
+  for (s_consume_all = 0; s_consume_all < 2; s_consume_all++) {
+    run("copy", deliver_copy);
+    run("pbuf", deliver_pbuf);
+  }
+  (void) s_csum;
+  return 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2014-2018 Cesanta Software Limited
+ * All rights reserved
+ *
+ * Licensed under the Apache License, Version 2.0 (the ""License"");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an ""AS IS"" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Heap fragmentation soak test for MEMP_STATIC_POOLS, runs on the host.
+ *
+ * Simulates a long uptime of a device on the umm_malloc heap: connections
+ * come and go, segments are queued and acked, RX pbuf headers and payloads
+ * churn, and the app makes long-lived and short-lived allocations of its
+ * own. The memp types go through src/core/memp_static.c, built twice (see
+ * the Makefile): with all pools empty, so everything comes from the heap as
+ * with plain MEMP_MEM_MALLOC, and with the default pool sizes. Element sizes
+ * are those of the host build. After each phase prints the cost of a
+ * network allocation, the state of the heap and, in pool mode, how many
+ * allocations overflowed.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lwip/memp.h"
+#include "lwip/stats.h"
+
+#include "umm_malloc.h"
+#include "umm_malloc_internal.h"
+
+#define NUM_PHASES 10
+#define STEPS_PER_PHASE 200000
+
+char test_umm_heap[UMM_MALLOC_CFG__HEAP_SIZE];
+
+void umm_corruption(void) {
+  fprintf(stderr, "heap corruption!\n");
+  abort();
+}
+
+/* mem_malloc() and mem_free() of the SDK */
+void *pvPortMalloc(size_t size) {
+  return umm_malloc(size);
+}
+
+void vPortFree(void *ptr) {
+  umm_free(ptr);
+}
+
+/* memp_static.c built without and with pools */
+void heap_memp_static_init(void);
+void *heap_memp_static_malloc(memp_t type);
+void heap_memp_static_free(memp_t type, void *mem);
+void pool_memp_static_init(void);
+void *pool_memp_static_malloc(memp_t type);
+void pool_memp_static_free(memp_t type, void *mem);
+
+struct memp_impl {
+  const char *name;
+  void (*init)(void);
+  void *(*malloc)(memp_t type);
+  void (*free)(memp_t type, void *mem);
+};
+
+static const struct memp_impl s_impls[2] = {
+    {"All from heap", heap_memp_static_init, heap_memp_static_malloc,
+     heap_memp_static_free},
+    {"Static pools", pool_memp_static_init, pool_memp_static_malloc,
+     pool_memp_static_free},
+};
+
+enum type { PBUF, TCP_SEG, TCP_PCB, UDP_PCB, PAYLOAD, APP, NUM_TYPES };
+
+static const char *s_names[NUM_TYPES] = {"PBUF",    "TCP_SEG", "TCP_PCB",
+                                         "UDP_PCB", "payload", "app"};
+static const memp_t s_memp_types[UDP_PCB + 1] = {MEMP_PBUF, MEMP_TCP_SEG,
+                                                 MEMP_TCP_PCB, MEMP_UDP_PCB};
+/* Live objects of each type are kept in slots, up to this many. */
+static const int s_max_live[NUM_TYPES] = {20, 20, 6, 5, 8, 120};
+
+static const struct memp_impl *s_impl;
+static void *s_slots[NUM_TYPES][128];
+static size_t s_slot_sizes[NUM_TYPES][128];
+static unsigned long s_ooms, s_nallocs[UDP_PCB + 1];
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t rand_size(int t) {
+  if (t == PAYLOAD) return 64 + rand() % 1400;
+  if (t == APP) {
+    int r = rand() % 100;
+    if (r < 60) return 8 + rand() % 56;
+    if (r < 95) return 64 + rand() % 192;
+    return 256 + rand() % 768;
+  }
+  return memp_sizes[s_memp_types[t]];
+}
+
+/* One step: allocate or free an object of a random type. */
+static void step(uint64_t *alloc_ns, unsigned long *nallocs) {
+  int r = rand() % 100;
+  /* Network objects churn much more than app ones. */
+  int t = (r < 30 ? PBUF : r < 55 ? TCP_SEG : r < 58 ? TCP_PCB
+                                             : r < 60 ? UDP_PCB
+                                                      : r < 85 ? PAYLOAD : APP);
+  int idx = rand() % s_max_live[t];
+  void **slot = &s_slots[t][idx];
+  if (*slot != NULL) {
+    /* Some app allocations live for a very long time. */
+    if (t == APP && idx % 4 == 0 && rand() % 200 != 0) return;
+    if (t == TCP_PCB && rand() % 20 != 0) return;
+    if (t <= UDP_PCB) {
+      s_impl->free(s_memp_types[t], *slot);
+    } else {
+      umm_free(*slot);
+    }
+    *slot = NULL;
+  } else {
+    size_t size = rand_size(t);
+    uint64_t start = now_ns();
+    *slot = (t <= UDP_PCB ? s_impl->malloc(s_memp_types[t]) : umm_malloc(size));
+    if (t <= UDP_PCB) {
+      *alloc_ns += now_ns() - start;
+      (*nallocs)++;
+      s_nallocs[t]++;
+    }
+    if (*slot == NULL) {
+      s_ooms++;
+    } else {
+      memset(*slot, 0xfe, size);
+      s_slot_sizes[t][idx] = size;
+    }
+  }
+}
+
+static unsigned long overflows(int t) {
+  return lwip_stats.memp[s_memp_types[t]].overflow;
+}
+
+static void run(const struct memp_impl *impl) {
+  int phase, i, t;
+  s_impl = impl;
+  printf("\n%s\n", impl->name);
+  printf("%5s %8s %7s %7s %7s %6s %9s\n", "phase", "alloc_ns", "nfree", "free",
+         "maxfree", "ooms", "overflows");
+  srand(1);
+  umm_init();
+  memset(&lwip_stats, 0, sizeof(lwip_stats));
+  impl->init();
+  memset(s_slots, 0, sizeof(s_slots));
+  s_ooms = 0;
+  memset(s_nallocs, 0, sizeof(s_nallocs));
+  for (phase = 0; phase < NUM_PHASES; phase++) {
+    uint64_t alloc_ns = 0;
+    unsigned long nallocs = 0, novf = 0;
+    for (i = 0; i < STEPS_PER_PHASE; i++) step(&alloc_ns, &nallocs);
+    for (t = 0; t <= UDP_PCB; t++) novf += overflows(t);
+    umm_info(NULL, 0);
+    printf("%5d %8.1f %7d %7u %7u %6lu %9lu\n", phase,
+           (double) alloc_ns / nallocs, umm_free_entries_cnt(),
+           (unsigned int) ummHeapInfo.freeBlocks * ummHeapInfo.blockSize,
+           (unsigned int) ummHeapInfo.maxFreeContiguousBlocks *
+               ummHeapInfo.blockSize,
+           s_ooms, novf);
+  }
+  for (t = 0; t <= UDP_PCB; t++) {
+    const struct stats_mem *m = &lwip_stats.memp[s_memp_types[t]];
+    if (m->avail == 0) continue;
+    printf("%s (%u bytes): %u in pool, max %u used, %lu of %lu overflowed "
+           "(%.2f%%)\n",
+           s_names[t], (unsigned int) memp_sizes[s_memp_types[t]],
+           (unsigned int) m->avail, (unsigned int) m->max, overflows(t),
+           s_nallocs[t], 100.0 * overflows(t) / s_nallocs[t]);
+  }
+}
+
+int main(void) {
+  run(&s_impls[0]);
+  run(&s_impls[1]);
+  return 0;
+}
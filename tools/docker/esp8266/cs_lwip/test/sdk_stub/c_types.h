@@ -0,0 +1,21 @@
+/*
+ * Host stand-in for the SDK header pulled in by arch/cc.h, just enough to
+ * build lwIP sources (inet_chksum.c, dns.c, memp_static.c, tcp.c) for host
+ * tests.
+ */
+#ifndef _C_TYPES_H_
+#define _C_TYPES_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+
+#define ICACHE_FLASH_ATTR
+#define SHMEM_ATTR
+#define os_memcpy memcpy
+
+#endif /* _C_TYPES_H_ */
@@ -0,0 +1,5 @@
+/* Host stand-in, see c_types.h. sys_now() is not used by the host tests. */
+#include "c_types.h"
+
+#define NOW() 0
+#define TIMER_CLK_FREQ 1000
@@ -0,0 +1,2 @@
+/* Host stand-in, see c_types.h. */
+#include "c_types.h"
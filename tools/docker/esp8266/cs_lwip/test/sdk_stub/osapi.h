@@ -0,0 +1,8 @@
+/* Host stand-in, see c_types.h. */
+#include "c_types.h"
+
+void *pvPortMalloc(size_t size);
+void *pvPortZalloc(size_t size);
+void vPortFree(void *ptr);
+unsigned long os_random(void);
+uint8 system_get_data_of_array_8(const uint8 *array, uint8 index);
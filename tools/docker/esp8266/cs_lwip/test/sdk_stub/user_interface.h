@@ -0,0 +1,6 @@
+/* Host stand-in, see c_types.h. */
+#include "c_types.h"
+
+int system_rtc_mem_read(uint8_t src_addr, void *des_addr, uint16_t load_size);
+int system_rtc_mem_write(uint8_t des_addr, const void *src_addr,
+                         uint16_t save_size);
@@ -1,6 +1,8 @@
 package heaplog
 
 import (
+	"encoding/base64"
+	"encoding/binary"
 	"fmt"
 	"strings"
 
@@ -38,7 +40,7 @@ func (l *LogItem) String() string {
 	case LogItemTypeRealloc:
 		return fmt.Sprintf("hl{%c,%d,%d,%x,%x}%s", tc, l.Size, getShimInt(l.Shim), l.Addr1, l.Addr2, l.Descr)
 	case LogItemTypeFree:
-		return fmt.Sprintf("hl{%c,%x,%d}%s", tc, l.Addr1, l.Shim, l.Descr)
+		return fmt.Sprintf("hl{%c,%x,%d}%s", tc, l.Addr1, getShimInt(l.Shim), l.Descr)
 	default:
 		return "[error wrong logitem]"
 	}
@@ -162,3 +164,169 @@ func getShimInt(shim bool) int {
 	}
 	return 0
 }
+
+// Compact binary format ("fmt": "bin1" in hlog_param), see
+// include/common/cs_heap_log.h for the description.
+const (
+	binLinePrefix = "hlb:"
+	binTypeMask   = 0x07
+	binFlagShim   = 0x08
+	binFlagTrace  = 0x10
+	binTypeLost   = 7
+	binPtrShift   = 2
+)
+
+var errBinShort = errors.New("incomplete record")
+
+// BinDecoder decodes "hlb:" lines. Records can span lines and call traces are
+// delta-encoded, so one decoder must be fed all lines of a stream in order.
+type BinDecoder struct {
+	heapStart int
+	buf       []byte
+	trace     []int
+	// Number of records the device dropped because its ring was full.
+	Lost int
+}
+
+func NewBinDecoder(param *HeapLogParam) *BinDecoder {
+	return &BinDecoder{heapStart: param.HeapStart}
+}
+
+// IsBinLine returns true if the line carries binary heap log data.
+func IsBinLine(text string) bool {
+	return strings.HasPrefix(text, binLinePrefix)
+}
+
+// Feed decodes one "hlb:" line and returns all the records completed by it.
+// Descr of the returned items has the call trace in the text log format, so
+// items can be converted with String() for the viewer.
+func (d *BinDecoder) Feed(text string) ([]*LogItem, error) {
+	if !IsBinLine(text) {
+		return nil, errors.Errorf("not a binary heap log line")
+	}
+	data, err := base64.StdEncoding.DecodeString(strings.TrimSpace(text[len(binLinePrefix):]))
+	if err != nil {
+		return nil, errors.Annotatef(err, "invalid base64")
+	}
+	d.buf = append(d.buf, data...)
+	var items []*LogItem
+	for len(d.buf) > 0 {
+		item, n, err := d.decodeRecord(d.buf)
+		if err == errBinShort {
+			break
+		} else if err != nil {
+			d.buf = nil
+			return items, errors.Trace(err)
+		}
+		d.buf = d.buf[n:]
+		if item != nil {
+			items = append(items, item)
+		}
+	}
+	return items, nil
+}
+
+func (d *BinDecoder) inflatePtr(v uint64) int {
+	if v == 0 {
+		return 0
+	}
+	return d.heapStart + int(unzigzag(v-1)<<binPtrShift)
+}
+
+func unzigzag(v uint64) int64 {
+	return int64(v>>1) ^ -int64(v&1)
+}
+
+func (d *BinDecoder) decodeRecord(buf []byte) (*LogItem, int, error) {
+	if len(buf) < 1 {
+		return nil, 0, errBinShort
+	}
+	tag := buf[0]
+	off := 1
+	next := func() (uint64, error) {
+		v, n := binary.Uvarint(buf[off:])
+		if n == 0 {
+			return 0, errBinShort
+		} else if n < 0 {
+			return 0, errors.Errorf("varint overflow at %d", off)
+		}
+		off += n
+		return v, nil
+	}
+	nextN := func(vals ...*uint64) error {
+		for _, v := range vals {
+			var err error
+			if *v, err = next(); err != nil {
+				return err
+			}
+		}
+		return nil
+	}
+
+	var size, ptr, oldPtr uint64
+	item := &LogItem{Shim: tag&binFlagShim != 0}
+	switch tag & binTypeMask {
+	case binTypeLost:
+		var n uint64
+		if err := nextN(&n); err != nil {
+			return nil, 0, err
+		}
+		d.Lost += int(n)
+		d.trace = nil
+		return nil, off, nil
+	case 0, 1, 2:
+		item.ItemType = LogItemType(tag & binTypeMask)
+		if err := nextN(&size, &ptr); err != nil {
+			return nil, 0, err
+		}
+		item.Addr1 = d.inflatePtr(ptr)
+	case 3:
+		item.ItemType = LogItemTypeFree
+		if err := nextN(&ptr); err != nil {
+			return nil, 0, err
+		}
+		item.Addr1 = d.inflatePtr(ptr)
+	case 4:
+		item.ItemType = LogItemTypeRealloc
+		if err := nextN(&size, &oldPtr, &ptr); err != nil {
+			return nil, 0, err
+		}
+		item.Addr1 = d.inflatePtr(oldPtr)
+		item.Addr2 = d.inflatePtr(ptr)
+	default:
+		return nil, 0, errors.Errorf("unexpected record type %d", tag&binTypeMask)
+	}
+	item.Size = int(size)
+
+	item.Descr = "\n"
+	if tag&binFlagTrace != 0 {
+		var keep, n uint64
+		if err := nextN(&keep, &n); err != nil {
+			return nil, 0, err
+		}
+		if int(keep) > len(d.trace) {
+			return nil, 0, errors.Errorf("trace prefix %d > %d", keep, len(d.trace))
+		}
+		trace := append([]int(nil), d.trace[:keep]...)
+		prev := 0
+		if keep > 0 {
+			prev = trace[keep-1]
+		}
+		for i := uint64(0); i < n; i++ {
+			v, err := next()
+			if err != nil {
+				return nil, 0, err
+			}
+			prev += int(unzigzag(v))
+			trace = append(trace, prev)
+		}
+		// Emit as "<size> <start>" followed by addresses, with start = 0.
+		parts := []string{fmt.Sprintf(" %d 0", len(trace))}
+		for _, a := range trace {
+			parts = append(parts, fmt.Sprintf("%x", a))
+		}
+		item.Descr = strings.Join(parts, " ") + "\n"
+		d.trace = trace
+	}
+	return item, off, nil
+}
@@ -14,6 +14,8 @@ const (
 type HeapLogParam struct {
 	HeapStart int `json:"heap_start"`
 	HeapEnd   int `json:"heap_end"`
+	// "bin1" if heap log items follow as "hlb:" lines, empty for text "hl{".
+	Format string `json:"fmt,omitempty"`
 }
 
 func (h *HeapLogParam) String() string {
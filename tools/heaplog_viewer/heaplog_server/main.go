@@ -17,6 +17,8 @@ import (
 	"os"
 	"time"
 
+	"cesanta.com/tools/heaplog_viewer/heaplog"
+
 	"github.com/golang/glog"
 	"golang.org/x/net/websocket"
 )
@@ -139,6 +141,7 @@ func logHandler(ws *websocket.Conn) {
 	}
 	br := bufio.NewReader(f)
 	n := 0
+	var binDec *heaplog.BinDecoder
 	for {
 		l, err := br.ReadBytes('\n')
 		if err == nil {
@@ -148,6 +151,21 @@ func logHandler(ws *websocket.Conn) {
 					l = l[si+2:]
 				}
 			}
+			if hp, perr := heaplog.ParseHeapLogParam(string(l)); perr == nil {
+				binDec = heaplog.NewBinDecoder(hp)
+			}
+			if binDec != nil && heaplog.IsBinLine(string(l)) {
+				// The viewer only understands text items, convert.
+				items, derr := binDec.Feed(string(l))
+				if derr != nil {
+					glog.Errorf("Bad binary heap log line %q: %s", l, derr)
+				}
+				var tb bytes.Buffer
+				for _, item := range items {
+					tb.WriteString(item.String())
+				}
+				l = tb.Bytes()
+			}
 			_, err = ws.Write(l)
 			n++
 			if n%10000 == 0 {
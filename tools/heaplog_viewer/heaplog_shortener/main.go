@@ -41,6 +41,7 @@ func main() {
 	if err != nil {
 		glog.Exitf("%s", errors.Trace(err))
 	}
+	var binDec *heaplog.BinDecoder
 
 	for i := 0; ; i++ {
 		line, err := r.ReadString('\n')
@@ -48,34 +49,46 @@ func main() {
 			break
 		}
 
-		// if the line contains more than one heaplog items, split it further
-		parts := strings.Split(line[:len(line)-1], "hl{")
-		if len(parts) > 1 {
-			parts = parts[1:]
-			for i, _ := range parts {
-				parts[i] = "hl{" + parts[i] + "\n"
+		var logItems []*heaplog.LogItem
+		if binDec != nil && heaplog.IsBinLine(line) {
+			logItems, err = binDec.Feed(line)
+			if err != nil {
+				glog.Errorf("line %d: %s", i, err)
 			}
-		}
-
-		for _, part := range parts {
-			hlParam, err := heaplog.ParseHeapLogParam(part)
-			if err == nil {
-				// Got new heap params
-				heap, err = heaplog.MkHeap(
-					hlParam.HeapStart,
-					hlParam.HeapEnd-hlParam.HeapStart,
-					hlOpts,
-				)
-				if err != nil {
-					glog.Exitf("%s", errors.Trace(err))
+		} else {
+			// if the line contains more than one heaplog items, split it further
+			parts := strings.Split(line[:len(line)-1], "hl{")
+			if len(parts) > 1 {
+				parts = parts[1:]
+				for i, _ := range parts {
+					parts[i] = "hl{" + parts[i] + "\n"
 				}
 			}
 
-			logItem, err := heaplog.ParseLogItem(part)
-			if err != nil {
-				continue
+			for _, part := range parts {
+				hlParam, err := heaplog.ParseHeapLogParam(part)
+				if err == nil {
+					// Got new heap params
+					heap, err = heaplog.MkHeap(
+						hlParam.HeapStart,
+						hlParam.HeapEnd-hlParam.HeapStart,
+						hlOpts,
+					)
+					if err != nil {
+						glog.Exitf("%s", errors.Trace(err))
+					}
+					binDec = heaplog.NewBinDecoder(hlParam)
+				}
+
+				logItem, err := heaplog.ParseLogItem(part)
+				if err != nil {
+					continue
+				}
+				logItems = append(logItems, logItem)
 			}
+		}
 
+		for _, logItem := range logItems {
 			switch logItem.ItemType {
 			case heaplog.LogItemTypeMalloc, heaplog.LogItemTypeCalloc, heaplog.LogItemTypeZalloc:
 				heap.Malloc(logItem.Addr1, logItem.Size, logItem.Shim, logItem.Descr)
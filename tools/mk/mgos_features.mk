@@ -5,12 +5,18 @@ MGOS_ENABLE_SYS_SERVICE ?= 1
 MGOS_DEBUG_UART ?= 0
 MGOS_EARLY_DEBUG_LEVEL ?= LL_INFO
 MGOS_DEBUG_UART_BAUD_RATE ?= 115200
+MGOS_CD_COMPRESS ?= 0
+# Per-site LOG() filter cache, see cs_dbg.h. Off by default: it is only
+# correct where no other thread can log while mgos_debug_write() runs.
+CS_LOG_ENABLE_SITE_CACHE ?= 0
 MGOS_SRCS += mgos_debug.c mgos_net.c
 
 MGOS_FEATURES ?=
 MGOS_FEATURES += -DMGOS_DEBUG_UART=$(MGOS_DEBUG_UART) \
                  -DMGOS_EARLY_DEBUG_LEVEL=$(MGOS_EARLY_DEBUG_LEVEL) \
                  -DMGOS_DEBUG_UART_BAUD_RATE=$(MGOS_DEBUG_UART_BAUD_RATE) \
+                 -DMGOS_CD_COMPRESS=$(MGOS_CD_COMPRESS) \
+                 -DCS_LOG_ENABLE_SITE_CACHE=$(CS_LOG_ENABLE_SITE_CACHE) \
                  -DMG_ENABLE_CALLBACK_USERDATA
 
 ifeq "$(MGOS_ENABLE_DEBUG_UDP)" "1"
@@ -43,6 +43,48 @@ START_DELIM = '--- BEGIN CORE DUMP ---'
 END_DELIM =   '---- END CORE DUMP ----'
 
 
+def rle32_decode(data):
+    # Records: varint (n << 1 | rep), then either one word repeated n times
+    # (rep = 1) or n literal words (rep = 0).
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        hdr, shift = 0, 0
+        while True:
+            b = data[i]
+            i += 1
+            hdr |= (b & 0x7f) << shift
+            shift += 7
+            if not b & 0x80:
+                break
+        n = hdr >> 1
+        if hdr & 1:
+            out += data[i:i+4] * n
+            i += 4
+        else:
+            out += data[i:i+4*n]
+            i += 4*n
+    return bytes(out)
+
+
+def section_data(name, v):
+    data = base64.decodebytes(bytes(v["data"], "ascii"))
+    # For encoded sections CRC covers the encoded stream.
+    if "crc32" in v:
+        crc32 = ctypes.c_uint32(binascii.crc32(data))
+        expected_crc32 = ctypes.c_uint32(v["crc32"])
+        if crc32.value != expected_crc32.value:
+            print("CRC mismatch, section %s corrupted %s %s" % (name, crc32, expected_crc32), file=sys.stderr)
+            sys.exit(1)
+    enc = v.get("enc")
+    if enc == "rle32":
+        data = rle32_decode(data)
+    elif enc is not None:
+        print("Section %s: unsupported encoding %s" % (name, enc), file=sys.stderr)
+        sys.exit(1)
+    return data
+
+
 class FreeRTOSTask(object):
 
     def __init__(self, e):
@@ -54,7 +96,7 @@ class FreeRTOSTask(object):
         self.pxStackBase = e["sb"]
         self.pxTopOfStack = e["sp"]
         if "regs" in e:
-            self.regs = base64.decodebytes(bytes(e["regs"]["data"], "ascii"))
+            self.regs = section_data("regs", e["regs"])
         else:
             self.regs = None
 
@@ -71,7 +113,7 @@ class Core(object):
         if args.rom:
             self.mem.extend(self._map_firmware(args.rom_addr, args.rom))
         self.mem.extend(self._map_elf(args.elf))
-        self.regs = base64.decodebytes(bytes(self._dump["REGS"]["data"], "ascii"))
+        self.regs = section_data("REGS", self._dump["REGS"])
         if "freertos" in self._dump:
             print("Dump contains FreeRTOS task info")
             self.tasks = dict((t["h"], FreeRTOSTask(t)) for t in self._dump["freertos"]["tasks"])
@@ -125,14 +167,8 @@ class Core(object):
         for k, v in list(core.items()):
             if not isinstance(v, dict) or k == 'REGS' or "addr" not in v:
                 continue
-            data = base64.decodebytes(bytes(v["data"], "ascii"))
+            data = section_data(k, v)
             print("Mapping {0}: {1} @ {2:#02x}".format(k, len(data), v["addr"]), file=sys.stderr)
-            if "crc32" in v:
-                crc32 = ctypes.c_uint32(binascii.crc32(data))
-                expected_crc32 = ctypes.c_uint32(v["crc32"])
-                if crc32.value != expected_crc32.value:
-                    print("CRC mismatch, section corrupted %s %s" % (crc32, expected_crc32), file=sys.stderr)
-                    sys.exit(1)
             mem.append((v["addr"], v["addr"] + len(data), data))
         return mem
 